@@ -674,6 +674,12 @@ extern "C" void InitScripts()
 {
 	scriptLogWindow = new ScriptLogWindow();
 
+	config_t *global_config = obs_frontend_get_global_config();
+	obs_scripting_python_set_threaded(
+		config_get_bool(global_config, "Python", "ThreadedTick"));
+	obs_scripting_python_set_call_budget((uint32_t)config_get_uint(
+		global_config, "Python", "CallBudgetMS"));
+
 	obs_scripting_load();
 	obs_scripting_set_log_callback(script_log, nullptr);
 
@@ -428,6 +428,8 @@ bool OBSApp::InitGlobalConfigDefaults()
 				true);
 
 	config_set_default_bool(globalConfig, "General", "ConfirmOnExit", true);
+	config_set_default_bool(globalConfig, "General",
+				"ParallelModuleLoading", false);
 
 #if _WIN32
 	config_set_default_string(globalConfig, "Video", "Renderer",
@@ -494,6 +496,9 @@ bool OBSApp::InitGlobalConfigDefaults()
 	config_set_default_bool(globalConfig, "BasicWindow",
 				"MultiviewDrawAreas", true);
 
+	config_set_default_uint(globalConfig, "Audio",
+				"AudioBufferingShrinkDelay", 60);
+
 #ifdef _WIN32
 	uint32_t winver = GetWindowsVersion();
 
@@ -0,0 +1,410 @@
+#include "scene-collection-saver.hpp"
+
+#include <string.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define FULL_SAVE_INTERVAL_NS 60000000000ULL
+
+static const char *source_dirty_signals[] = {
+	"update",
+	"volume",
+	"mute",
+	"enable",
+	"push_to_mute_changed",
+	"push_to_mute_delay",
+	"push_to_talk_changed",
+	"push_to_talk_delay",
+	"update_flags",
+	"audio_sync",
+	"audio_balance",
+	"audio_mixers",
+	"audio_monitoring",
+	"filter_add",
+	"filter_remove",
+	"reorder_filters",
+};
+
+static const char *scene_dirty_signals[] = {
+	"item_add",     "item_remove", "reorder",
+	"item_visible", "item_transform", "item_locked",
+};
+
+static inline bool is_scene_or_group(obs_source_t *source)
+{
+	return obs_scene_from_source(source) || obs_group_from_source(source);
+}
+
+static bool data_has_string(obs_data_t *data, const char *str);
+
+static bool array_has_string(obs_data_array_t *array, const char *str)
+{
+	size_t count = obs_data_array_count(array);
+
+	for (size_t i = 0; i < count; i++) {
+		OBSDataAutoRelease item = obs_data_array_item(array, i);
+		if (data_has_string(item, str))
+			return true;
+	}
+
+	return false;
+}
+
+static bool data_has_string(obs_data_t *data, const char *str)
+{
+	obs_data_item_t *item;
+
+	for (item = obs_data_first(data); item; obs_data_item_next(&item)) {
+		enum obs_data_type type = obs_data_item_gettype(item);
+		bool found = false;
+
+		if (type == OBS_DATA_STRING) {
+			const char *val = obs_data_item_get_string(item);
+			found = val && strcmp(val, str) == 0;
+		} else if (type == OBS_DATA_OBJECT) {
+			OBSDataAutoRelease obj = obs_data_item_get_obj(item);
+			found = data_has_string(obj, str);
+		} else if (type == OBS_DATA_ARRAY) {
+			OBSDataArrayAutoRelease array =
+				obs_data_item_get_array(item);
+			found = array_has_string(array, str);
+		}
+
+		if (found) {
+			obs_data_item_release(&item);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+SceneCollectionSaver::~SceneCollectionSaver()
+{
+	Stop();
+}
+
+void SceneCollectionSaver::SourceCreated(void *data, calldata_t *cd)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+	obs_source_t *source = (obs_source_t *)calldata_ptr(cd, "source");
+
+	saver->ConnectSource(source);
+}
+
+void SceneCollectionSaver::SourceDestroyed(void *data, calldata_t *cd)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+	obs_source_t *source = (obs_source_t *)calldata_ptr(cd, "source");
+
+	std::lock_guard<std::mutex> lock(saver->cacheMutex);
+	saver->cache.erase(source);
+	saver->connected.erase(source);
+}
+
+void SceneCollectionSaver::SourceRemoved(void *data, calldata_t *cd)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+	obs_source_t *source = (obs_source_t *)calldata_ptr(cd, "source");
+
+	std::lock_guard<std::mutex> lock(saver->cacheMutex);
+	saver->cache.erase(source);
+}
+
+void SceneCollectionSaver::SourceChanged(void *data, calldata_t *cd)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+	obs_source_t *source = (obs_source_t *)calldata_ptr(cd, "source");
+
+	/* filters are saved as part of their parent */
+	if (obs_source_get_type(source) == OBS_SOURCE_TYPE_FILTER)
+		source = obs_filter_get_parent(source);
+
+	saver->MarkDirty(source);
+}
+
+/* scenes and groups save their items by name, as do sources referencing
+ * other sources in their settings, so everything whose saved data contains
+ * the previous name is saved again */
+void SceneCollectionSaver::SourceRenamed(void *data, calldata_t *cd)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+	obs_source_t *source = (obs_source_t *)calldata_ptr(cd, "source");
+	const char *prev_name = calldata_string(cd, "prev_name");
+
+	saver->MarkDirty(source);
+
+	if (!prev_name || !*prev_name)
+		return;
+
+	std::lock_guard<std::mutex> lock(saver->cacheMutex);
+	for (auto &entry : saver->cache) {
+		if (!entry.second.dirty &&
+		    data_has_string(entry.second.data, prev_name))
+			entry.second.dirty = true;
+	}
+}
+
+void SceneCollectionSaver::SceneChanged(void *data, calldata_t *cd)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+	obs_scene_t *scene = (obs_scene_t *)calldata_ptr(cd, "scene");
+
+	saver->MarkDirty(obs_scene_get_source(scene));
+}
+
+void SceneCollectionSaver::HotkeysChanged(void *data, calldata_t *)
+{
+	SceneCollectionSaver *saver = static_cast<SceneCollectionSaver *>(data);
+
+	std::lock_guard<std::mutex> lock(saver->cacheMutex);
+	for (auto &entry : saver->cache)
+		entry.second.dirty = true;
+}
+
+void SceneCollectionSaver::ConnectSource(obs_source_t *source)
+{
+	signal_handler_t *sh = obs_source_get_signal_handler(source);
+
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		if (!connected.insert(source).second)
+			return;
+	}
+
+	for (const char *signal : source_dirty_signals)
+		signal_handler_connect(sh, signal, SourceChanged, this);
+	signal_handler_connect(sh, "rename", SourceRenamed, this);
+
+	if (is_scene_or_group(source)) {
+		for (const char *signal : scene_dirty_signals)
+			signal_handler_connect(sh, signal, SceneChanged, this);
+	}
+}
+
+void SceneCollectionSaver::DisconnectSource(obs_source_t *source)
+{
+	signal_handler_t *sh = obs_source_get_signal_handler(source);
+
+	for (const char *signal : source_dirty_signals)
+		signal_handler_disconnect(sh, signal, SourceChanged, this);
+	signal_handler_disconnect(sh, "rename", SourceRenamed, this);
+
+	if (is_scene_or_group(source)) {
+		for (const char *signal : scene_dirty_signals)
+			signal_handler_disconnect(sh, signal, SceneChanged,
+						  this);
+	}
+}
+
+void SceneCollectionSaver::MarkDirty(obs_source_t *source)
+{
+	if (!source)
+		return;
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	auto it = cache.find(source);
+	if (it != cache.end())
+		it->second.dirty = true;
+}
+
+void SceneCollectionSaver::MarkDirty(obs_sceneitem_t *item)
+{
+	MarkDirty(obs_scene_get_source(obs_sceneitem_get_scene(item)));
+}
+
+void SceneCollectionSaver::ForceFullSave()
+{
+	forceFullSave = true;
+}
+
+void SceneCollectionSaver::Connect()
+{
+	signal_handler_t *sh = obs_get_signal_handler();
+
+	globalSignals.emplace_back(sh, "source_create", SourceCreated, this);
+	globalSignals.emplace_back(sh, "source_destroy", SourceDestroyed, this);
+	globalSignals.emplace_back(sh, "source_remove", SourceRemoved, this);
+	globalSignals.emplace_back(sh, "hotkey_bindings_changed",
+				   HotkeysChanged, this);
+
+	auto cb = [](void *data, obs_source_t *source) {
+		static_cast<SceneCollectionSaver *>(data)->ConnectSource(
+			source);
+		return true;
+	};
+	obs_enum_all_sources(cb, this);
+}
+
+void SceneCollectionSaver::Stop()
+{
+	globalSignals.clear();
+
+	std::unordered_set<obs_source_t *> sources;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		sources.swap(connected);
+		cache.clear();
+	}
+
+	for (obs_source_t *source : sources)
+		DisconnectSource(source);
+
+	{
+		std::lock_guard<std::mutex> lock(writeMutex);
+		exiting = true;
+	}
+	writeCV.notify_one();
+
+	if (writeThread.joinable())
+		writeThread.join();
+}
+
+void SceneCollectionSaver::Clear()
+{
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	cache.clear();
+	fullSave = true;
+}
+
+void SceneCollectionSaver::BeginSave(bool forceFull)
+{
+	uint64_t ts = os_gettime_ns();
+
+	fullSave = forceFull || forceFullSave || !lastFullSave ||
+		   ts - lastFullSave >= FULL_SAVE_INTERVAL_NS;
+	if (fullSave)
+		lastFullSave = ts;
+	forceFullSave = false;
+}
+
+obs_data_t *SceneCollectionSaver::SaveSource(obs_source_t *source)
+{
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		CachedSource &entry = cache[source];
+
+		if (!fullSave && !entry.dirty && entry.data) {
+			obs_data_addref(entry.data);
+			return entry.data;
+		}
+
+		/* cleared before saving, so that changes made while saving
+		 * mark it dirty again */
+		entry.dirty = false;
+	}
+
+	OBSDataAutoRelease data = obs_save_source(source);
+
+	/* the saved data can reference the source's live settings, keep a
+	 * copy that nothing else modifies */
+	obs_data_t *copy = obs_data_create();
+	obs_data_apply(copy, data);
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	auto it = cache.find(source);
+	if (it != cache.end())
+		it->second.data = copy;
+
+	return copy;
+}
+
+obs_data_array_t *
+SceneCollectionSaver::SaveSources(obs_save_source_filter_cb cb, void *param)
+{
+	std::vector<OBSSource> sources;
+
+	/* only used to enumerate the sources obs_save_sources_filtered would
+	 * save, the sources are saved outside of the sources mutex */
+	auto collect = [&](obs_source_t *source) {
+		if (cb(param, source))
+			sources.emplace_back(source);
+		return false;
+	};
+	using collect_t = decltype(collect);
+
+	OBSDataArrayAutoRelease unused = obs_save_sources_filtered(
+		[](void *data, obs_source_t *source) {
+			return (*static_cast<collect_t *>(data))(source);
+		},
+		static_cast<void *>(&collect));
+
+	obs_data_array_t *array = obs_data_array_create();
+
+	for (obs_source_t *source : sources) {
+		OBSDataAutoRelease data = SaveSource(source);
+		obs_data_array_push_back(array, data);
+	}
+
+	return array;
+}
+
+void SceneCollectionSaver::WriteThread()
+{
+	os_set_thread_name("scene collection writer");
+
+	std::unique_lock<std::mutex> lock(writeMutex);
+
+	for (;;) {
+		writeCV.wait(lock, [this] { return exiting || pendingData; });
+		if (!pendingData)
+			break;
+
+		OBSData data = std::move(pendingData);
+		std::string file = std::move(pendingFile);
+		pendingData = nullptr;
+		writing = true;
+		lock.unlock();
+
+		if (!obs_data_save_json_safe(data, file.c_str(), "tmp", "bak"))
+			blog(LOG_ERROR, "Could not save scene data to %s",
+			     file.c_str());
+
+		lock.lock();
+		writing = false;
+		idleCV.notify_all();
+	}
+}
+
+void SceneCollectionSaver::WaitForWrite()
+{
+	std::unique_lock<std::mutex> lock(writeMutex);
+	idleCV.wait(lock, [this] { return !pendingData && !writing; });
+}
+
+void SceneCollectionSaver::Write(obs_data_t *data, const char *file, bool now)
+{
+	if (now) {
+		WaitForWrite();
+
+		if (!obs_data_save_json_safe(data, file, "tmp", "bak"))
+			blog(LOG_ERROR, "Could not save scene data to %s",
+			     file);
+		return;
+	}
+
+	/* everything but the saved sources can still be modified by their
+	 * owners while the file is being written, so write a copy */
+	OBSDataArrayAutoRelease sources = obs_data_get_array(data, "sources");
+	OBSDataArrayAutoRelease groups = obs_data_get_array(data, "groups");
+	obs_data_erase(data, "sources");
+	obs_data_erase(data, "groups");
+
+	OBSDataAutoRelease copy = obs_data_create();
+	obs_data_apply(copy, data);
+	obs_data_set_array(copy, "sources", sources);
+	obs_data_set_array(copy, "groups", groups);
+
+	std::unique_lock<std::mutex> lock(writeMutex);
+	if (exiting)
+		return;
+	if (!writeThread.joinable())
+		writeThread = std::thread(&SceneCollectionSaver::WriteThread,
+					  this);
+
+	pendingData = copy.Get();
+	pendingFile = file;
+	lock.unlock();
+
+	writeCV.notify_one();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <obs.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* Saves scene collections incrementally.  The saved data of every source is
+ * kept and only sources that changed since the last save are saved again.
+ * Changes are tracked through source signals; anything that changes without
+ * a signal has to be marked dirty by whoever changes it, and is otherwise
+ * picked up by a periodic full save.  Writing the file happens on
+ * a background thread, newer data replaces data still waiting to be written. */
+class SceneCollectionSaver {
+	struct CachedSource {
+		OBSData data;
+		bool dirty = true;
+	};
+
+	std::mutex cacheMutex;
+	std::unordered_map<obs_source_t *, CachedSource> cache;
+	std::unordered_set<obs_source_t *> connected;
+	std::vector<OBSSignal> globalSignals;
+	uint64_t lastFullSave = 0;
+	bool fullSave = true;
+	bool forceFullSave = false;
+
+	std::thread writeThread;
+	std::mutex writeMutex;
+	std::condition_variable writeCV;
+	std::condition_variable idleCV;
+	OBSData pendingData;
+	std::string pendingFile;
+	bool writing = false;
+	bool exiting = false;
+
+	static void SourceCreated(void *data, calldata_t *cd);
+	static void SourceDestroyed(void *data, calldata_t *cd);
+	static void SourceRemoved(void *data, calldata_t *cd);
+	static void SourceChanged(void *data, calldata_t *cd);
+	static void SourceRenamed(void *data, calldata_t *cd);
+	static void SceneChanged(void *data, calldata_t *cd);
+	static void HotkeysChanged(void *data, calldata_t *cd);
+
+	void ConnectSource(obs_source_t *source);
+	void DisconnectSource(obs_source_t *source);
+	void WriteThread();
+
+public:
+	~SceneCollectionSaver();
+
+	void Connect();
+	void Stop();
+	void Clear();
+
+	/* for changes made through setters that do not signal: the item's
+	 * scene or group, the source, or everything on the next save pass
+	 * when the owner of a change cannot be told */
+	void MarkDirty(obs_source_t *source);
+	void MarkDirty(obs_sceneitem_t *item);
+	void ForceFullSave();
+
+	/* starts a save pass; sources are all saved again when forced or when
+	 * the last full save is too old */
+	void BeginSave(bool forceFull);
+
+	/* same as obs_save_source/obs_save_sources_filtered, but only saves
+	 * sources that changed.  the returned data must not be modified. */
+	obs_data_t *SaveSource(obs_source_t *source);
+	obs_data_array_t *SaveSources(obs_save_source_filter_cb cb, void *param);
+
+	/* writes on the background thread unless now is set.  the sources
+	 * and groups arrays are taken out of data. */
+	void Write(obs_data_t *data, const char *file, bool now);
+	void WaitForWrite();
+};
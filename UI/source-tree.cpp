@@ -609,6 +609,7 @@ void SourceTreeItem::ExpandClicked(bool checked)
 	OBSDataAutoRelease data = obs_sceneitem_get_private_settings(sceneitem);
 
 	obs_data_set_bool(data, "collapsed", checked);
+	OBSBasic::Get()->GetCollectionSaver().MarkDirty(sceneitem);
 
 	if (!checked)
 		tree->GetStm()->ExpandGroup(sceneitem);
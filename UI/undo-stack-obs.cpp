@@ -2,7 +2,105 @@
 
 #include <util/util.hpp>
 
+#include <algorithm>
+#include <unordered_set>
+
 #define MAX_STACK_SIZE 5000
+#define MAX_STACK_MEMORY (128 * 1024 * 1024)
+
+std::string undo_stack::delta_t::get() const
+{
+	if (!base)
+		return middle;
+
+	std::string data;
+	data.reserve(prefix + middle.size() + suffix);
+	data.append(*base, 0, prefix);
+	data.append(middle);
+	data.append(*base, base->size() - suffix, suffix);
+	return data;
+}
+
+size_t undo_stack::delta_t::size() const
+{
+	return middle.size();
+}
+
+undo_stack::delta_t undo_stack::make_delta(const snapshot_t &base,
+					   const std::string &data)
+{
+	delta_t delta;
+
+	if (!base) {
+		delta.middle = data;
+		return delta;
+	}
+
+	const std::string &b = *base;
+	size_t max_len = std::min(b.size(), data.size());
+	size_t prefix = 0;
+	size_t suffix = 0;
+
+	while (prefix < max_len && b[prefix] == data[prefix])
+		prefix++;
+	while (suffix < max_len - prefix &&
+	       b[b.size() - suffix - 1] == data[data.size() - suffix - 1])
+		suffix++;
+
+	delta.base = base;
+	delta.prefix = prefix;
+	delta.suffix = suffix;
+	delta.middle = data.substr(prefix, data.size() - prefix - suffix);
+	return delta;
+}
+
+void undo_stack::update_memory_used()
+{
+	std::unordered_set<const std::string *> bases;
+	size_t size = 0;
+
+	auto add_delta = [&](const delta_t &delta) {
+		size += delta.size();
+		if (delta.base && bases.insert(delta.base.get()).second)
+			size += delta.base->size();
+	};
+
+	if (snapshot && bases.insert(snapshot.get()).second)
+		size += snapshot->size();
+
+	for (const undo_redo_t &item : undo_items) {
+		add_delta(item.undo_data);
+		add_delta(item.redo_data);
+	}
+	for (const undo_redo_t &item : redo_items) {
+		add_delta(item.undo_data);
+		add_delta(item.redo_data);
+	}
+
+	memory_used = size;
+}
+
+void undo_stack::pop_oldest()
+{
+	const undo_redo_t &item = undo_items.back();
+	const snapshot_t &undo_base = item.undo_data.base;
+	const snapshot_t &redo_base = item.redo_data.base;
+
+	memory_used -= item.undo_data.size() + item.redo_data.size();
+
+	/* snapshots only referenced by this item go away with it */
+	if (undo_base == redo_base) {
+		if (undo_base && undo_base.use_count() == 2)
+			memory_used -= undo_base->size();
+	} else {
+		if (undo_base && undo_base.use_count() == 1)
+			memory_used -= undo_base->size();
+		if (redo_base && redo_base.use_count() == 1)
+			memory_used -= redo_base->size();
+	}
+
+	undo_items.pop_back();
+}
 
 undo_stack::undo_stack(ui_ptr ui) : ui(ui)
 {
@@ -21,6 +119,8 @@ void undo_stack::clear()
 {
 	undo_items.clear();
 	redo_items.clear();
+	snapshot.reset();
+	memory_used = 0;
 	last_is_repeatable = false;
 
 	ui->actionMainUndo->setText(QTStr("Undo.Undo"));
@@ -38,26 +138,44 @@ void undo_stack::add_action(const QString &name, const undo_redo_cb &undo,
 	if (!is_enabled())
 		return;
 
-	while (undo_items.size() >= MAX_STACK_SIZE) {
-		undo_redo_t item = undo_items.back();
-		undo_items.pop_back();
-	}
-
 	if (repeatable) {
 		repeat_reset_timer.start();
 	}
 
 	if (last_is_repeatable && repeatable && name == undo_items[0].name) {
-		undo_items[0].redo = redo;
-		undo_items[0].redo_data = redo_data;
+		undo_redo_t &item = undo_items[0];
+
+		memory_used -= item.redo_data.size();
+		item.redo = redo;
+		item.redo_data = make_delta(item.undo_data.base, redo_data);
+		memory_used += item.redo_data.size();
 		return;
 	}
 
-	undo_redo_t n = {name, undo_data, redo_data, undo, redo};
+	clear_redo();
+
+	delta_t undo_delta = make_delta(snapshot, undo_data);
+	if (undo_delta.size() > undo_data.size() / 2) {
+		/* mostly unrelated to the current snapshot, start a new one */
+		if (snapshot && snapshot.use_count() == 1)
+			memory_used -= snapshot->size();
+		snapshot = std::make_shared<const std::string>(undo_data);
+		memory_used += snapshot->size();
+		undo_delta = make_delta(snapshot, undo_data);
+	}
+
+	delta_t redo_delta = make_delta(snapshot, redo_data);
+	memory_used += undo_delta.size() + redo_delta.size();
+
+	undo_redo_t n = {name, std::move(undo_delta), std::move(redo_delta),
+			 undo, redo};
 
 	last_is_repeatable = repeatable;
-	undo_items.push_front(n);
-	clear_redo();
+	undo_items.push_front(std::move(n));
+
+	while (undo_items.size() > MAX_STACK_SIZE ||
+	       (memory_used > MAX_STACK_MEMORY && undo_items.size() > 1))
+		pop_oldest();
 
 	ui->actionMainUndo->setText(QTStr("Undo.Item.Undo").arg(name));
 	ui->actionMainUndo->setEnabled(true);
@@ -74,7 +192,7 @@ void undo_stack::undo()
 	last_is_repeatable = false;
 
 	undo_redo_t temp = undo_items.front();
-	temp.undo(temp.undo_data);
+	temp.undo(temp.undo_data.get());
 	redo_items.push_front(temp);
 	undo_items.pop_front();
 
@@ -98,7 +216,7 @@ void undo_stack::redo()
 	last_is_repeatable = false;
 
 	undo_redo_t temp = redo_items.front();
-	temp.redo(temp.redo_data);
+	temp.redo(temp.redo_data.get());
 	undo_items.push_front(temp);
 	redo_items.pop_front();
 
@@ -161,5 +279,9 @@ void undo_stack::pop_disabled()
 
 void undo_stack::clear_redo()
 {
+	if (redo_items.empty())
+		return;
+
 	redo_items.clear();
+	update_memory_used();
 }
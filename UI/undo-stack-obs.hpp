@@ -18,10 +18,25 @@ class undo_stack : public QObject {
 	typedef std::function<void(bool is_undo)> func;
 	typedef std::unique_ptr<Ui::OBSBasic> &ui_ptr;
 
+	typedef std::shared_ptr<const std::string> snapshot_t;
+
+	/* Undo/redo data is mostly the json of the same scene or source before
+	 * and after a small change, so it is stored as the part that differs
+	 * from a shared snapshot. */
+	struct delta_t {
+		snapshot_t base;
+		size_t prefix = 0;
+		size_t suffix = 0;
+		std::string middle;
+
+		std::string get() const;
+		size_t size() const;
+	};
+
 	struct undo_redo_t {
 		QString name;
-		std::string undo_data;
-		std::string redo_data;
+		delta_t undo_data;
+		delta_t redo_data;
 		undo_redo_cb undo;
 		undo_redo_cb redo;
 	};
@@ -29,6 +44,8 @@ class undo_stack : public QObject {
 	ui_ptr ui;
 	std::deque<undo_redo_t> undo_items;
 	std::deque<undo_redo_t> redo_items;
+	snapshot_t snapshot;
+	size_t memory_used = 0;
 	int disable_refs = 0;
 	bool enabled = true;
 	bool last_is_repeatable = false;
@@ -41,6 +58,11 @@ class undo_stack : public QObject {
 	void disable_internal();
 	void clear_redo();
 
+	static delta_t make_delta(const snapshot_t &base,
+				  const std::string &data);
+	void update_memory_used();
+	void pop_oldest();
+
 private slots:
 	void reset_repeatable_state();
 
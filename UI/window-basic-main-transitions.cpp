@@ -996,6 +996,8 @@ QMenu *OBSBasic::CreatePerSceneTransitionMenu()
 		OBSDataAutoRelease data =
 			obs_source_get_private_settings(scene);
 
+		collectionSaver.MarkDirty(scene);
+
 		if (idx == -1) {
 			obs_data_set_string(data, "transition", "");
 			return;
@@ -1015,6 +1017,7 @@ QMenu *OBSBasic::CreatePerSceneTransitionMenu()
 			obs_source_get_private_settings(scene);
 
 		obs_data_set_int(data, "transition_duration", duration);
+		collectionSaver.MarkDirty(scene);
 	};
 
 	connect(duration, (void(QSpinBox::*)(int)) & QSpinBox::valueChanged,
@@ -1089,6 +1092,7 @@ void OBSBasic::PasteShowHideTransition(obs_sceneitem_t *item, bool show,
 			OBSDataAutoRelease dat =
 				obs_data_create_from_json(data.c_str());
 			obs_sceneitem_transition_load(i, dat, show);
+			OBSBasic::Get()->GetCollectionSaver().MarkDirty(i);
 		}
 	};
 
@@ -1098,6 +1102,7 @@ void OBSBasic::PasteShowHideTransition(obs_sceneitem_t *item, bool show,
 	OBSSourceAutoRelease dup =
 		obs_source_duplicate(tr, obs_source_get_name(tr), true);
 	obs_sceneitem_set_transition(item, show, dup);
+	collectionSaver.MarkDirty(item);
 
 	OBSDataAutoRelease transitionData =
 		obs_sceneitem_transition_save(item, show);
@@ -1160,6 +1165,8 @@ QMenu *OBSBasic::CreateVisibilityTransitionMenu(bool visible)
 				OBSDataAutoRelease dat =
 					obs_data_create_from_json(data.c_str());
 				obs_sceneitem_transition_load(i, dat, visible);
+				OBSBasic::Get()->GetCollectionSaver().MarkDirty(
+					i);
 			}
 		};
 		OBSDataAutoRelease oldTransitionData =
@@ -1198,6 +1205,8 @@ QMenu *OBSBasic::CreateVisibilityTransitionMenu(bool visible)
 			if (obs_source_configurable(tr))
 				CreatePropertiesWindow(tr);
 		}
+		main->collectionSaver.MarkDirty(sceneItem);
+
 		OBSDataAutoRelease newTransitionData =
 			obs_sceneitem_transition_save(sceneItem, visible);
 		std::string undo_data(obs_data_get_json(oldTransitionData));
@@ -1217,6 +1226,7 @@ QMenu *OBSBasic::CreateVisibilityTransitionMenu(bool visible)
 
 		OBSSceneItem item = main->GetCurrentSceneItem();
 		obs_sceneitem_set_transition_duration(item, visible, duration);
+		main->collectionSaver.MarkDirty(item);
 	};
 	connect(duration, (void(QSpinBox::*)(int)) & QSpinBox::valueChanged,
 		setDuration);
@@ -113,6 +113,8 @@ QCefCookieManager *panel_cookies = nullptr;
 
 void DestroyPanelCookieManager();
 
+#define SAVE_INTERVAL_MS 1000
+
 namespace {
 
 template<typename OBSRef> struct SignalContainer {
@@ -266,6 +268,11 @@ OBSBasic::OBSBasic(QWidget *parent)
 	connect(this, SIGNAL(customContextMenuRequested(const QPoint &)), this,
 		SLOT(on_customContextMenuRequested(const QPoint &)));
 
+	saveTimer.setSingleShot(true);
+	saveTimer.setInterval(SAVE_INTERVAL_MS);
+	connect(&saveTimer, &QTimer::timeout, this,
+		&OBSBasic::SaveProjectDeferred);
+
 	api = InitializeAPIInterface(this);
 
 	ui->setupUi(this);
@@ -482,7 +489,8 @@ OBSBasic::OBSBasic(QWidget *parent)
 }
 
 static void SaveAudioDevice(const char *name, int channel, obs_data_t *parent,
-			    vector<OBSSource> &audioSources)
+			    vector<OBSSource> &audioSources,
+			    SceneCollectionSaver &saver)
 {
 	OBSSourceAutoRelease source = obs_get_output_source(channel);
 	if (!source)
@@ -490,7 +498,7 @@ static void SaveAudioDevice(const char *name, int channel, obs_data_t *parent,
 
 	audioSources.push_back(source.Get());
 
-	OBSDataAutoRelease data = obs_save_source(source);
+	OBSDataAutoRelease data = saver.SaveSource(source);
 
 	obs_data_set_obj(parent, name, data);
 }
@@ -500,19 +508,20 @@ static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder,
 				    int transitionDuration,
 				    obs_data_array_t *transitions,
 				    OBSScene &scene, OBSSource &curProgramScene,
-				    obs_data_array_t *savedProjectorList)
+				    obs_data_array_t *savedProjectorList,
+				    SceneCollectionSaver &saver)
 {
 	obs_data_t *saveData = obs_data_create();
 
 	vector<OBSSource> audioSources;
 	audioSources.reserve(6);
 
-	SaveAudioDevice(DESKTOP_AUDIO_1, 1, saveData, audioSources);
-	SaveAudioDevice(DESKTOP_AUDIO_2, 2, saveData, audioSources);
-	SaveAudioDevice(AUX_AUDIO_1, 3, saveData, audioSources);
-	SaveAudioDevice(AUX_AUDIO_2, 4, saveData, audioSources);
-	SaveAudioDevice(AUX_AUDIO_3, 5, saveData, audioSources);
-	SaveAudioDevice(AUX_AUDIO_4, 6, saveData, audioSources);
+	SaveAudioDevice(DESKTOP_AUDIO_1, 1, saveData, audioSources, saver);
+	SaveAudioDevice(DESKTOP_AUDIO_2, 2, saveData, audioSources, saver);
+	SaveAudioDevice(AUX_AUDIO_1, 3, saveData, audioSources, saver);
+	SaveAudioDevice(AUX_AUDIO_2, 4, saveData, audioSources, saver);
+	SaveAudioDevice(AUX_AUDIO_3, 5, saveData, audioSources, saver);
+	SaveAudioDevice(AUX_AUDIO_4, 6, saveData, audioSources, saver);
 
 	/* -------------------------------- */
 	/* save non-group sources           */
@@ -526,7 +535,7 @@ static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder,
 	};
 	using FilterAudioSources_t = decltype(FilterAudioSources);
 
-	obs_data_array_t *sourcesArray = obs_save_sources_filtered(
+	obs_data_array_t *sourcesArray = saver.SaveSources(
 		[](void *data, obs_source_t *source) {
 			auto &func = *static_cast<FilterAudioSources_t *>(data);
 			return func(source);
@@ -537,7 +546,7 @@ static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder,
 	/* save group sources separately    */
 
 	/* saving separately ensures they won't be loaded in older versions */
-	obs_data_array_t *groupsArray = obs_save_sources_filtered(
+	obs_data_array_t *groupsArray = saver.SaveSources(
 		[](void *, obs_source_t *source) {
 			return obs_source_is_group(source);
 		},
@@ -707,8 +716,10 @@ obs_data_array_t *OBSBasic::SaveProjectors()
 	return savedProjectors;
 }
 
-void OBSBasic::Save(const char *file)
+void OBSBasic::Save(const char *file, bool now)
 {
+	collectionSaver.BeginSave(now);
+
 	OBSScene scene = GetCurrentScene();
 	OBSSource curProgramScene = OBSGetStrongRef(programScene);
 	if (!curProgramScene)
@@ -720,7 +731,8 @@ void OBSBasic::Save(const char *file)
 	OBSDataArrayAutoRelease savedProjectorList = SaveProjectors();
 	OBSDataAutoRelease saveData = GenerateSaveData(
 		sceneOrder, quickTrData, ui->transitionDuration->value(),
-		transitions, scene, curProgramScene, savedProjectorList);
+		transitions, scene, curProgramScene, savedProjectorList,
+		collectionSaver);
 
 	obs_data_set_bool(saveData, "preview_locked", ui->preview->Locked());
 	obs_data_set_bool(saveData, "scaling_enabled",
@@ -741,8 +753,7 @@ void OBSBasic::Save(const char *file)
 		obs_data_set_obj(saveData, "modules", moduleObj);
 	}
 
-	if (!obs_data_save_json_safe(saveData, file, "tmp", "bak"))
-		blog(LOG_ERROR, "Could not save scene data to %s", file);
+	collectionSaver.Write(saveData, file, now);
 }
 
 void OBSBasic::DeferSaveBegin()
@@ -1604,6 +1615,8 @@ void OBSBasic::InitOBSCallbacks()
 				    OBSBasic::SourceAudioDeactivated, this);
 	signalHandlers.emplace_back(obs_get_signal_handler(), "source_rename",
 				    OBSBasic::SourceRenamed, this);
+
+	collectionSaver.Connect();
 }
 
 void OBSBasic::InitPrimitives()
@@ -1788,7 +1801,11 @@ void OBSBasic::OBSInit()
 
 	AddExtraModulePaths();
 	blog(LOG_INFO, "---------------------------------");
-	obs_load_all_modules2(&mfi);
+	if (config_get_bool(App()->GlobalConfig(), "General",
+			    "ParallelModuleLoading"))
+		obs_load_all_modules_parallel(&mfi);
+	else
+		obs_load_all_modules2(&mfi);
 	blog(LOG_INFO, "---------------------------------");
 	obs_log_loaded_modules();
 	blog(LOG_INFO, "---------------------------------");
@@ -2736,8 +2753,9 @@ void OBSBasic::SaveProjectNow()
 	if (disableSaving)
 		return;
 
+	saveTimer.stop();
 	projectChanged = true;
-	SaveProjectDeferred();
+	SaveProjectToFile(true);
 }
 
 void OBSBasic::SaveProject()
@@ -2745,12 +2763,18 @@ void OBSBasic::SaveProject()
 	if (disableSaving)
 		return;
 
+	/* rapid changes are written out together */
 	projectChanged = true;
-	QMetaObject::invokeMethod(this, "SaveProjectDeferred",
-				  Qt::QueuedConnection);
+	if (!saveTimer.isActive())
+		saveTimer.start();
 }
 
 void OBSBasic::SaveProjectDeferred()
+{
+	SaveProjectToFile(false);
+}
+
+void OBSBasic::SaveProjectToFile(bool now)
 {
 	if (disableSaving)
 		return;
@@ -2779,7 +2803,7 @@ void OBSBasic::SaveProjectDeferred()
 	if (ret <= 0)
 		return;
 
-	Save(savePath);
+	Save(savePath, now);
 }
 
 OBSSource OBSBasic::GetProgramSource()
@@ -3269,6 +3293,8 @@ static inline void SetSourceMixerHidden(obs_source_t *source, bool hidden)
 	OBSDataAutoRelease priv_settings =
 		obs_source_get_private_settings(source);
 	obs_data_set_bool(priv_settings, "mixer_hidden", hidden);
+
+	OBSBasic::Get()->GetCollectionSaver().MarkDirty(source);
 }
 
 void OBSBasic::GetAudioSourceFilters()
@@ -3400,6 +3426,7 @@ void OBSBasic::LockVolumeControl(bool lock)
 	OBSDataAutoRelease priv_settings =
 		obs_source_get_private_settings(source);
 	obs_data_set_bool(priv_settings, "volume_locked", lock);
+	collectionSaver.MarkDirty(source);
 
 	vol->EnableSlider(!lock);
 }
@@ -4501,6 +4528,11 @@ bool OBSBasic::ResetAudio()
 	if (lowLatencyAudioBuffering) {
 		ai.max_buffering_ms = 20;
 		ai.fixed_buffering = true;
+	} else {
+		ai.shrink_buffering_ms =
+			(uint32_t)config_get_uint(GetGlobalConfig(), "Audio",
+						  "AudioBufferingShrinkDelay") *
+			1000;
 	}
 
 	return obs_reset_audio2(&ai);
@@ -4664,6 +4696,7 @@ void OBSBasic::ClearSceneData()
 		api->on_event(OBS_FRONTEND_EVENT_SCENE_COLLECTION_CLEANUP);
 
 	undo_s.clear();
+	collectionSaver.Clear();
 
 	/* using QEvent::DeferredDelete explicitly is the only way to ensure
 	 * that deleteLater events are processed at this point */
@@ -4756,6 +4789,7 @@ void OBSBasic::closeEvent(QCloseEvent *event)
 
 	Auth::Save();
 	SaveProjectNow();
+	collectionSaver.Stop();
 	auth.reset();
 
 	delete extraBrowsers;
@@ -5172,15 +5206,16 @@ void OBSBasic::on_scenes_customContextMenuRequested(const QPoint &pos)
 		multiviewAction->setCheckable(true);
 		multiviewAction->setChecked(show);
 
-		auto showInMultiview = [](OBSData data) {
+		auto showInMultiview = [this](OBSSource source, OBSData data) {
 			bool show =
 				obs_data_get_bool(data, "show_in_multiview");
 			obs_data_set_bool(data, "show_in_multiview", !show);
+			collectionSaver.MarkDirty(source);
 			OBSProjector::UpdateMultiviewProjectors();
 		};
 
 		connect(multiviewAction, &QAction::triggered,
-			std::bind(showInMultiview, data.Get()));
+			std::bind(showInMultiview, source, data.Get()));
 
 		copyFilters->setEnabled(obs_source_filter_count(source) > 0);
 	}
@@ -5387,6 +5422,7 @@ void OBSBasic::SetScaleFilter()
 	OBSSceneItem sceneItem = GetCurrentSceneItem();
 
 	obs_sceneitem_set_scale_filter(sceneItem, mode);
+	collectionSaver.MarkDirty(sceneItem);
 }
 
 QMenu *OBSBasic::AddScaleFilteringMenu(QMenu *menu, obs_sceneitem_t *item)
@@ -5420,6 +5456,7 @@ void OBSBasic::SetBlendingMethod()
 	OBSSceneItem sceneItem = GetCurrentSceneItem();
 
 	obs_sceneitem_set_blending_method(sceneItem, method);
+	collectionSaver.MarkDirty(sceneItem);
 }
 
 QMenu *OBSBasic::AddBlendingMethodMenu(QMenu *menu, obs_sceneitem_t *item)
@@ -5450,6 +5487,7 @@ void OBSBasic::SetBlendingMode()
 	OBSSceneItem sceneItem = GetCurrentSceneItem();
 
 	obs_sceneitem_set_blending_mode(sceneItem, mode);
+	collectionSaver.MarkDirty(sceneItem);
 }
 
 QMenu *OBSBasic::AddBlendingModeMenu(QMenu *menu, obs_sceneitem_t *item)
@@ -9569,6 +9607,7 @@ static void ConfirmColor(SourceTree *sources, const QColor &color,
 		obs_data_set_int(privData, "color-preset", 1);
 		obs_data_set_string(privData, "color",
 				    QT_TO_UTF8(color.name(QColor::HexArgb)));
+		OBSBasic::Get()->GetCollectionSaver().MarkDirty(sceneItem);
 	}
 }
 
@@ -9599,6 +9638,7 @@ void OBSBasic::ColorChange()
 				obs_sceneitem_get_private_settings(sceneItem);
 			obs_data_set_int(privData, "color-preset", preset + 1);
 			obs_data_set_string(privData, "color", "");
+			collectionSaver.MarkDirty(sceneItem);
 		}
 
 		for (int i = 1; i < 9; i++) {
@@ -9698,6 +9738,7 @@ void OBSBasic::ColorChange()
 				obs_data_set_int(privData, "color-preset",
 						 preset);
 				obs_data_set_string(privData, "color", "");
+				collectionSaver.MarkDirty(sceneItem);
 			}
 		}
 	}
@@ -38,6 +38,7 @@
 #include "auth-base.hpp"
 #include "log-viewer.hpp"
 #include "undo-stack-obs.hpp"
+#include "scene-collection-saver.hpp"
 
 #include <obs-frontend-internal.hpp>
 
@@ -226,6 +227,8 @@ private:
 	bool loaded = false;
 	long disableSaving = 1;
 	bool projectChanged = false;
+	QTimer saveTimer;
+	SceneCollectionSaver collectionSaver;
 	bool previewEnabled = true;
 	ContextBarSize contextBarSize = ContextBarSize_Normal;
 
@@ -356,7 +359,8 @@ private:
 
 	void UploadLog(const char *subdir, const char *file, const bool crash);
 
-	void Save(const char *file);
+	void Save(const char *file, bool now = true);
+	void SaveProjectToFile(bool now);
 	void LoadData(obs_data_t *data, const char *file);
 	void Load(const char *file);
 
@@ -897,6 +901,10 @@ public:
 	}
 
 	inline bool SavingDisabled() const { return disableSaving; }
+	inline SceneCollectionSaver &GetCollectionSaver()
+	{
+		return collectionSaver;
+	}
 
 	inline double GetCPUUsage() const
 	{
@@ -175,6 +175,11 @@ OBSBasicProperties::~OBSBasicProperties()
 		obs_source_dec_active(sourceClone);
 	}
 	obs_source_dec_showing(source);
+
+	/* private sources (show/hide transitions) are saved as part of
+	 * whatever owns them, which cannot be told from here */
+	if (obs_obj_is_private(source))
+		main->GetCollectionSaver().ForceFullSave();
 	main->SaveProject();
 	main->UpdateContextBarDeferred(true);
 }
@@ -132,6 +132,7 @@ static void AddSource(void *_data, obs_scene_t *scene)
 		obs_sceneitem_set_blending_mode(sceneitem, *data->blend_mode);
 
 	obs_sceneitem_set_visible(sceneitem, data->visible);
+	OBSBasic::Get()->GetCollectionSaver().MarkDirty(sceneitem);
 }
 
 char *get_new_source_name(const char *name, const char *format)
@@ -80,6 +80,8 @@ OBSBasicStats::OBSBasicStats(QWidget *parent, bool closeable)
 	hddSpace = new QLabel(this);
 	recordTimeLeft = new QLabel(this);
 	memUsage = new QLabel(this);
+	audioBuffering = new QLabel(this);
+	audioHeadroom = new QLabel(this);
 
 	QString str = MakeTimeLeftText(99999, 59);
 	int textWidth = recordTimeLeft->fontMetrics().boundingRect(str).width();
@@ -89,6 +91,8 @@ OBSBasicStats::OBSBasicStats(QWidget *parent, bool closeable)
 	newStat("HDDSpaceAvailable", hddSpace, 0);
 	newStat("DiskFullIn", recordTimeLeft, 0);
 	newStat("MemoryUsage", memUsage, 0);
+	newStat("AudioBuffering", audioBuffering, 0);
+	newStat("AudioBufferingHeadroom", audioHeadroom, 0);
 
 	fps = new QLabel(this);
 	renderTime = new QLabel(this);
@@ -354,6 +358,24 @@ void OBSBasicStats::Update()
 
 	/* ------------------ */
 
+	struct obs_audio_buffering_info abi = {};
+	obs_get_audio_buffering_info(&abi);
+
+	str = QString("%1 ms / %2 ms")
+		      .arg(QString::number(abi.buffering_ms),
+			   QString::number(abi.max_buffering_ms));
+	audioBuffering->setText(str);
+
+	if (abi.max_buffering_ms && abi.buffering_ms >= abi.max_buffering_ms)
+		setThemeID(audioBuffering, "warning");
+	else
+		setThemeID(audioBuffering, "");
+
+	str = QString::number(abi.headroom_ms) + QStringLiteral(" ms");
+	audioHeadroom->setText(str);
+
+	/* ------------------ */
+
 	num = (long double)obs_get_average_frame_time_ns() / 1000000.0l;
 
 	str = QString::number(num, 'f', 1) + QStringLiteral(" ms");
@@ -0,0 +1,633 @@
+/*
+ * Copyright (c) 2023 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <util/darray.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <zlib.h>
+
+#include "cache.h"
+
+enum cache_state {
+	CACHE_EMPTY,
+	CACHE_WRITING,
+	CACHE_READY,
+	CACHE_FAILED,
+};
+
+struct cached_frame {
+	/* data pointers are only valid while the frame is stored raw */
+	struct obs_source_frame frame;
+	size_t plane_sizes[MAX_AV_PLANES];
+	size_t raw_size;
+
+	uint8_t *raw;
+	uint8_t *packed;
+	size_t packed_size;
+
+	int64_t ts;
+};
+
+struct cached_audio {
+	struct obs_source_audio audio;
+	int64_t ts;
+};
+
+struct mp_cache {
+	char *key;
+	long refs;
+
+	pthread_mutex_t mutex;
+	enum cache_state state;
+	const void *writer;
+	bool have_base_ts;
+	uint64_t base_ts;
+
+	DARRAY(struct cached_frame *) frames;
+	DARRAY(struct cached_audio) audio;
+	size_t bytes;
+	size_t max_bytes;
+
+	bool compress;
+	bool compress_thread_active;
+	pthread_t compress_thread;
+	os_sem_t *compress_sem;
+	size_t compress_idx;
+	size_t compress_done;
+	bool compress_stop;
+};
+
+static pthread_mutex_t caches_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(mp_cache_t *) caches;
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint32_t plane_height(enum video_format format, size_t plane,
+				    uint32_t height)
+{
+	if (plane == 0)
+		return height;
+
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I010:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_P010:
+		return (height + 1) / 2;
+	case VIDEO_FORMAT_I40A:
+		return plane == 3 ? height : (height + 1) / 2;
+	default:
+		return height;
+	}
+}
+
+/* rows are stored as differences to the previous byte, which makes the
+ * (mostly smooth) image data compress a lot better */
+static void predict_rows(uint8_t *data, size_t size, uint32_t linesize)
+{
+	for (size_t row = 0; row + linesize <= size; row += linesize) {
+		uint8_t *line = data + row;
+		for (uint32_t x = linesize - 1; x > 0; x--)
+			line[x] -= line[x - 1];
+	}
+}
+
+static void unpredict_rows(uint8_t *data, size_t size, uint32_t linesize)
+{
+	for (size_t row = 0; row + linesize <= size; row += linesize) {
+		uint8_t *line = data + row;
+		for (uint32_t x = 1; x < linesize; x++)
+			line[x] += line[x - 1];
+	}
+}
+
+static bool compress_frame(struct cached_frame *cf, uint8_t **buf,
+			   size_t *buf_size)
+{
+	uLongf packed_size = compressBound((uLong)cf->raw_size);
+	size_t offset = 0;
+
+	if (*buf_size < packed_size) {
+		*buf = brealloc(*buf, packed_size);
+		*buf_size = packed_size;
+	}
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (cf->plane_sizes[i] && cf->frame.linesize[i])
+			predict_rows(cf->raw + offset, cf->plane_sizes[i],
+				     cf->frame.linesize[i]);
+		offset += cf->plane_sizes[i];
+	}
+
+	if (compress2(*buf, &packed_size, cf->raw, (uLong)cf->raw_size,
+		      Z_BEST_SPEED) != Z_OK) {
+		offset = 0;
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			if (cf->plane_sizes[i] && cf->frame.linesize[i])
+				unpredict_rows(cf->raw + offset,
+					       cf->plane_sizes[i],
+					       cf->frame.linesize[i]);
+			offset += cf->plane_sizes[i];
+		}
+		return false;
+	}
+
+	cf->packed = bmemdup(*buf, packed_size);
+	cf->packed_size = packed_size;
+	return true;
+}
+
+static void *compress_thread(void *data)
+{
+	mp_cache_t *cache = data;
+	uint8_t *buf = NULL;
+	size_t buf_size = 0;
+
+	os_set_thread_name("mp_cache: compress thread");
+
+	while (os_sem_wait(cache->compress_sem) == 0) {
+		struct cached_frame *cf;
+
+		pthread_mutex_lock(&cache->mutex);
+		if (cache->compress_stop ||
+		    cache->compress_idx >= cache->frames.num) {
+			bool stop = cache->compress_stop;
+			pthread_mutex_unlock(&cache->mutex);
+			if (stop)
+				break;
+			continue;
+		}
+		cf = cache->frames.array[cache->compress_idx++];
+		pthread_mutex_unlock(&cache->mutex);
+
+		/* the writer does not touch frames after pushing them, and
+		 * the cache is not read until it is ready */
+		if (!compress_frame(cf, &buf, &buf_size)) {
+			pthread_mutex_lock(&cache->mutex);
+			cache->compress_done++;
+			pthread_mutex_unlock(&cache->mutex);
+			continue;
+		}
+
+		pthread_mutex_lock(&cache->mutex);
+		bfree(cf->raw);
+		cf->raw = NULL;
+		cache->bytes -= cf->raw_size - cf->packed_size;
+		cache->compress_done++;
+		pthread_mutex_unlock(&cache->mutex);
+	}
+
+	bfree(buf);
+	return NULL;
+}
+
+static void start_compress_thread(mp_cache_t *cache)
+{
+	cache->compress_idx = 0;
+	cache->compress_done = 0;
+	cache->compress_stop = false;
+
+	if (os_sem_init(&cache->compress_sem, 0) != 0)
+		return;
+
+	cache->compress_thread_active =
+		pthread_create(&cache->compress_thread, NULL, compress_thread,
+			       cache) == 0;
+	if (!cache->compress_thread_active) {
+		os_sem_destroy(cache->compress_sem);
+		cache->compress_sem = NULL;
+	}
+}
+
+/* call without the cache mutex held.  without discard, waits until all
+ * queued frames are compressed. */
+static void stop_compress_thread(mp_cache_t *cache, bool discard)
+{
+	if (!cache->compress_thread_active)
+		return;
+
+	pthread_mutex_lock(&cache->mutex);
+	if (discard)
+		cache->compress_idx = cache->frames.num;
+	pthread_mutex_unlock(&cache->mutex);
+
+	/* every pushed frame has been posted already, wait for the thread to
+	 * get through them before asking it to stop */
+	for (;;) {
+		bool done;
+
+		pthread_mutex_lock(&cache->mutex);
+		done = cache->compress_idx >= cache->frames.num;
+		cache->compress_stop = done;
+		pthread_mutex_unlock(&cache->mutex);
+
+		if (done)
+			break;
+		os_sleep_ms(1);
+	}
+
+	os_sem_post(cache->compress_sem);
+	pthread_join(cache->compress_thread, NULL);
+	os_sem_destroy(cache->compress_sem);
+	cache->compress_sem = NULL;
+	cache->compress_thread_active = false;
+}
+
+/* the memory limit applies to the compressed cache, but the writer can get
+ * ahead of the compress thread.  so before giving up, waits until every
+ * pushed frame is compressed and checks the limit again. */
+static bool over_limit_compressed(mp_cache_t *cache)
+{
+	for (;;) {
+		bool done, over_limit;
+
+		pthread_mutex_lock(&cache->mutex);
+		done = cache->compress_done >= cache->frames.num;
+		over_limit = cache->bytes > cache->max_bytes;
+		pthread_mutex_unlock(&cache->mutex);
+
+		if (done || !over_limit)
+			return over_limit;
+		os_sleep_ms(1);
+	}
+}
+
+static void free_data(mp_cache_t *cache)
+{
+	for (size_t i = 0; i < cache->frames.num; i++) {
+		struct cached_frame *cf = cache->frames.array[i];
+		bfree(cf->raw);
+		bfree(cf->packed);
+		bfree(cf);
+	}
+	for (size_t i = 0; i < cache->audio.num; i++) {
+		struct cached_audio *ca = &cache->audio.array[i];
+		for (size_t j = 0; j < MAX_AV_PLANES; j++)
+			bfree((void *)ca->audio.data[j]);
+	}
+
+	da_free(cache->frames);
+	da_free(cache->audio);
+	cache->bytes = 0;
+	cache->have_base_ts = false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* a shared cache replaces the caches every user would have had, so it gets
+ * the largest of their limits, and is compressed if anyone asks for it (from
+ * the next pass on if it is being filled already) */
+static void merge_options(mp_cache_t *cache, size_t max_bytes, bool compress)
+{
+	pthread_mutex_lock(&cache->mutex);
+
+	if (max_bytes != cache->max_bytes || compress != cache->compress) {
+		blog(LOG_INFO,
+		     "MP: Cache for '%s' is shared with different options "
+		     "(%zu MB%s, now %zu MB%s)",
+		     cache->key, cache->max_bytes / (1024 * 1024),
+		     cache->compress ? " compressed" : "",
+		     max_bytes / (1024 * 1024), compress ? " compressed" : "");
+	}
+
+	if (compress && !cache->compress) {
+		cache->compress = true;
+		if (cache->state == CACHE_FAILED)
+			cache->state = CACHE_EMPTY;
+	}
+
+	/* a cache that did not fit may fit now */
+	if (max_bytes > cache->max_bytes) {
+		cache->max_bytes = max_bytes;
+		if (cache->state == CACHE_FAILED)
+			cache->state = CACHE_EMPTY;
+	}
+
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+mp_cache_t *mp_cache_acquire(const char *key, size_t max_bytes, bool compress)
+{
+	mp_cache_t *cache = NULL;
+
+	pthread_mutex_lock(&caches_mutex);
+
+	for (size_t i = 0; i < caches.num; i++) {
+		if (strcmp(caches.array[i]->key, key) == 0) {
+			cache = caches.array[i];
+			cache->refs++;
+			merge_options(cache, max_bytes, compress);
+			break;
+		}
+	}
+
+	if (!cache) {
+		cache = bzalloc(sizeof(*cache));
+		cache->key = bstrdup(key);
+		cache->refs = 1;
+		cache->max_bytes = max_bytes;
+		cache->compress = compress;
+		pthread_mutex_init(&cache->mutex, NULL);
+		da_push_back(caches, &cache);
+	}
+
+	pthread_mutex_unlock(&caches_mutex);
+	return cache;
+}
+
+void mp_cache_release(mp_cache_t *cache, const void *owner)
+{
+	bool destroy;
+
+	if (!cache)
+		return;
+
+	mp_cache_abandon(cache, owner);
+
+	pthread_mutex_lock(&caches_mutex);
+	destroy = --cache->refs == 0;
+	if (destroy)
+		da_erase_item(caches, &cache);
+	pthread_mutex_unlock(&caches_mutex);
+
+	if (destroy) {
+		stop_compress_thread(cache, true);
+		free_data(cache);
+		pthread_mutex_destroy(&cache->mutex);
+		bfree(cache->key);
+		bfree(cache);
+	}
+}
+
+bool mp_cache_begin(mp_cache_t *cache, const void *owner)
+{
+	bool writing;
+	bool compress;
+
+	if (!cache)
+		return false;
+
+	pthread_mutex_lock(&cache->mutex);
+	if (cache->state == CACHE_EMPTY) {
+		cache->state = CACHE_WRITING;
+		cache->writer = owner;
+	}
+	writing = cache->state == CACHE_WRITING && cache->writer == owner;
+	compress = cache->compress;
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (writing && compress && !cache->compress_thread_active)
+		start_compress_thread(cache);
+	return writing;
+}
+
+bool mp_cache_writing(mp_cache_t *cache, const void *owner)
+{
+	bool writing;
+
+	if (!cache)
+		return false;
+
+	pthread_mutex_lock(&cache->mutex);
+	writing = cache->state == CACHE_WRITING && cache->writer == owner;
+	pthread_mutex_unlock(&cache->mutex);
+	return writing;
+}
+
+static void fail(mp_cache_t *cache)
+{
+	blog(LOG_INFO,
+	     "MP: Cache for '%s' would exceed %zu MB, "
+	     "frames will be decoded instead",
+	     cache->key, cache->max_bytes / (1024 * 1024));
+
+	stop_compress_thread(cache, true);
+
+	pthread_mutex_lock(&cache->mutex);
+	free_data(cache);
+	cache->state = CACHE_FAILED;
+	cache->writer = NULL;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+static inline int64_t relative_ts(mp_cache_t *cache, uint64_t ts)
+{
+	if (!cache->have_base_ts) {
+		cache->base_ts = ts;
+		cache->have_base_ts = true;
+	}
+	return (int64_t)(ts - cache->base_ts);
+}
+
+void mp_cache_push_video(mp_cache_t *cache, const void *owner,
+			 const struct obs_source_frame *frame)
+{
+	struct cached_frame *cf;
+	size_t offset = 0;
+	bool over_limit;
+
+	if (!mp_cache_writing(cache, owner))
+		return;
+
+	cf = bzalloc(sizeof(*cf));
+	cf->frame = *frame;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (!frame->data[i])
+			continue;
+		cf->plane_sizes[i] = (size_t)frame->linesize[i] *
+				     plane_height(frame->format, i,
+						  frame->height);
+		cf->raw_size += cf->plane_sizes[i];
+	}
+
+	cf->raw = bmalloc(cf->raw_size);
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (cf->plane_sizes[i])
+			memcpy(cf->raw + offset, frame->data[i],
+			       cf->plane_sizes[i]);
+		cf->frame.data[i] = NULL;
+		offset += cf->plane_sizes[i];
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	cf->ts = relative_ts(cache, frame->timestamp);
+	da_push_back(cache->frames, &cf);
+	cache->bytes += cf->raw_size + sizeof(*cf);
+	over_limit = cache->bytes > cache->max_bytes;
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (cache->compress_thread_active) {
+		os_sem_post(cache->compress_sem);
+		if (over_limit)
+			over_limit = over_limit_compressed(cache);
+	}
+
+	if (over_limit)
+		fail(cache);
+}
+
+void mp_cache_push_audio(mp_cache_t *cache, const void *owner,
+			 const struct obs_source_audio *audio,
+			 size_t plane_size)
+{
+	struct cached_audio ca;
+	bool over_limit;
+
+	if (!mp_cache_writing(cache, owner))
+		return;
+
+	ca.audio = *audio;
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (audio->data[i])
+			ca.audio.data[i] = bmemdup(audio->data[i], plane_size);
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+	ca.ts = relative_ts(cache, audio->timestamp);
+	da_push_back(cache->audio, &ca);
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (audio->data[i])
+			cache->bytes += plane_size;
+	}
+	over_limit = cache->bytes > cache->max_bytes;
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (over_limit && cache->compress_thread_active)
+		over_limit = over_limit_compressed(cache);
+	if (over_limit)
+		fail(cache);
+}
+
+void mp_cache_end(mp_cache_t *cache, const void *owner)
+{
+	if (!mp_cache_writing(cache, owner))
+		return;
+
+	stop_compress_thread(cache, false);
+
+	pthread_mutex_lock(&cache->mutex);
+	cache->state = cache->frames.num || cache->audio.num ? CACHE_READY
+							     : CACHE_EMPTY;
+	cache->writer = NULL;
+	pthread_mutex_unlock(&cache->mutex);
+
+	blog(LOG_INFO, "MP: Cached '%s': %zu frames, %zu audio blocks, %.1f MB",
+	     cache->key, cache->frames.num, cache->audio.num,
+	     (double)cache->bytes / (1024.0 * 1024.0));
+}
+
+void mp_cache_abandon(mp_cache_t *cache, const void *owner)
+{
+	if (!mp_cache_writing(cache, owner))
+		return;
+
+	stop_compress_thread(cache, true);
+
+	pthread_mutex_lock(&cache->mutex);
+	free_data(cache);
+	cache->state = CACHE_EMPTY;
+	cache->writer = NULL;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+bool mp_cache_ready(mp_cache_t *cache)
+{
+	bool ready;
+
+	if (!cache)
+		return false;
+
+	pthread_mutex_lock(&cache->mutex);
+	ready = cache->state == CACHE_READY;
+	pthread_mutex_unlock(&cache->mutex);
+	return ready;
+}
+
+size_t mp_cache_num_video(const mp_cache_t *cache)
+{
+	return cache->frames.num;
+}
+
+size_t mp_cache_num_audio(const mp_cache_t *cache)
+{
+	return cache->audio.num;
+}
+
+int64_t mp_cache_video_ts(const mp_cache_t *cache, size_t idx)
+{
+	return cache->frames.array[idx]->ts;
+}
+
+uint64_t mp_cache_video_duration(const mp_cache_t *cache, size_t idx)
+{
+	return cache->frames.array[idx]->frame.duration;
+}
+
+int64_t mp_cache_audio_ts(const mp_cache_t *cache, size_t idx)
+{
+	return cache->audio.array[idx].ts;
+}
+
+bool mp_cache_get_video(const mp_cache_t *cache, size_t idx,
+			struct obs_source_frame *out, uint8_t **scratch,
+			size_t *scratch_size)
+{
+	const struct cached_frame *cf = cache->frames.array[idx];
+	uint8_t *data = cf->raw;
+	size_t offset = 0;
+
+	if (!data) {
+		uLongf size = (uLongf)cf->raw_size;
+
+		if (*scratch_size < cf->raw_size) {
+			*scratch = brealloc(*scratch, cf->raw_size);
+			*scratch_size = cf->raw_size;
+		}
+
+		if (uncompress(*scratch, &size, cf->packed,
+			       (uLong)cf->packed_size) != Z_OK ||
+		    size != cf->raw_size)
+			return false;
+
+		data = *scratch;
+	}
+
+	*out = cf->frame;
+	out->timestamp = (uint64_t)cf->ts;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (!cf->plane_sizes[i])
+			continue;
+
+		out->data[i] = data + offset;
+		if (!cf->raw)
+			unpredict_rows(out->data[i], cf->plane_sizes[i],
+				       out->linesize[i]);
+		offset += cf->plane_sizes[i];
+	}
+
+	return true;
+}
+
+void mp_cache_get_audio(const mp_cache_t *cache, size_t idx,
+			struct obs_source_audio *out)
+{
+	const struct cached_audio *ca = &cache->audio.array[idx];
+
+	*out = ca->audio;
+	out->timestamp = (uint64_t)ca->ts;
+}
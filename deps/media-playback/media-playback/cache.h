@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2023 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <obs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Decoded frame cache for looping local files.
+ *
+ * Caches are shared by key (file path, modification time and the options
+ * that change the decoded output), so several media playing the same file
+ * only decode and store it once.  One media at a time fills the cache during
+ * a full pass over the file, the others keep decoding until it is ready.
+ * If the cache grows past its memory limit it is dropped and everyone keeps
+ * decoding.  Video frames can optionally be stored losslessly compressed,
+ * which is done on a separate thread; the limit then applies to the
+ * compressed size.  Users of a shared cache with different options get the
+ * largest limit, and compression if any of them asks for it.
+ *
+ * Timestamps are stored relative to the start of the file.
+ */
+
+struct mp_cache;
+typedef struct mp_cache mp_cache_t;
+
+extern mp_cache_t *mp_cache_acquire(const char *key, size_t max_bytes,
+				    bool compress);
+extern void mp_cache_release(mp_cache_t *cache, const void *owner);
+
+/* starts filling the cache if nobody else is, returns true if owner is
+ * filling the cache */
+extern bool mp_cache_begin(mp_cache_t *cache, const void *owner);
+extern bool mp_cache_writing(mp_cache_t *cache, const void *owner);
+extern void mp_cache_push_video(mp_cache_t *cache, const void *owner,
+				const struct obs_source_frame *frame);
+extern void mp_cache_push_audio(mp_cache_t *cache, const void *owner,
+				const struct obs_source_audio *audio,
+				size_t plane_size);
+/* the whole file has been pushed */
+extern void mp_cache_end(mp_cache_t *cache, const void *owner);
+/* the pass was interrupted (seek, stop), drops what has been pushed */
+extern void mp_cache_abandon(mp_cache_t *cache, const void *owner);
+
+/* once ready, the cache does not change anymore and can be read without
+ * locking */
+extern bool mp_cache_ready(mp_cache_t *cache);
+
+extern size_t mp_cache_num_video(const mp_cache_t *cache);
+extern size_t mp_cache_num_audio(const mp_cache_t *cache);
+extern int64_t mp_cache_video_ts(const mp_cache_t *cache, size_t idx);
+extern uint64_t mp_cache_video_duration(const mp_cache_t *cache, size_t idx);
+extern int64_t mp_cache_audio_ts(const mp_cache_t *cache, size_t idx);
+
+/* fills out with the frame, decompressing into the caller's scratch buffer
+ * if needed.  out->timestamp is relative. */
+extern bool mp_cache_get_video(const mp_cache_t *cache, size_t idx,
+			       struct obs_source_frame *out, uint8_t **scratch,
+			       size_t *scratch_size);
+/* out->timestamp is relative */
+extern void mp_cache_get_audio(const mp_cache_t *cache, size_t idx,
+			       struct obs_source_audio *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -108,6 +108,7 @@ static int mp_open_codec(struct mp_decode *d, bool hw)
 	    c->codec_id != AV_CODEC_ID_JPEG2000 &&
 	    c->codec_id != AV_CODEC_ID_MPEG4 && c->codec_id != AV_CODEC_ID_WEBP)
 		c->thread_count = 0;
+	c->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
 
 	ret = avcodec_open2(c, d->codec, NULL);
 	if (ret < 0)
@@ -151,6 +152,8 @@ static uint16_t get_max_luminance(const AVStream *stream)
 	return max_luminance;
 }
 
+static void start_thread(struct mp_decode *d);
+
 bool mp_decode_init(mp_media_t *m, enum AVMediaType type, bool hw)
 {
 	struct mp_decode *d = type == AVMEDIA_TYPE_VIDEO ? &m->v : &m->a;
@@ -230,11 +233,59 @@ bool mp_decode_init(mp_media_t *m, enum AVMediaType type, bool hw)
 	d->orig_pkt = av_packet_alloc();
 	d->pkt = av_packet_alloc();
 
+	start_thread(d);
 	return true;
 }
 
 extern void mp_media_free_packet(mp_media_t *m, AVPacket *pkt);
 
+/* decoded frames the decoding thread may queue ahead of playback */
+#define MAX_QUEUED_VIDEO_FRAMES 4
+#define MAX_QUEUED_AUDIO_FRAMES 32
+/* packets the media thread may queue ahead of a decoder that has not
+ * produced a frame yet before it waits for it */
+#define MAX_QUEUED_PACKETS 64
+
+struct mp_decoded_frame {
+	AVFrame *frame;
+	int64_t pts;
+	int64_t duration;
+};
+
+static inline void lock_queues(struct mp_decode *d)
+{
+	if (d->threaded)
+		pthread_mutex_lock(&d->mutex);
+}
+
+static inline void unlock_queues(struct mp_decode *d)
+{
+	if (d->threaded)
+		pthread_mutex_unlock(&d->mutex);
+}
+
+/* the queue mutex has to be held */
+static inline size_t queued_packets(struct mp_decode *d)
+{
+	return d->packets.size / sizeof(AVPacket *);
+}
+
+static inline bool has_queued_packets(struct mp_decode *d)
+{
+	bool has_packets;
+
+	lock_queues(d);
+	has_packets = queued_packets(d) != 0;
+	unlock_queues(d);
+
+	return has_packets;
+}
+
+static inline size_t queued_frames(struct mp_decode *d)
+{
+	return d->frames.size / sizeof(struct mp_decoded_frame);
+}
+
 void mp_decode_clear_packets(struct mp_decode *d)
 {
 	if (d->packet_pending) {
@@ -242,17 +293,46 @@ void mp_decode_clear_packets(struct mp_decode *d)
 		d->packet_pending = false;
 	}
 
+	lock_queues(d);
 	while (d->packets.size) {
 		AVPacket *pkt;
 		circlebuf_pop_front(&d->packets, &pkt, sizeof(pkt));
 		mp_media_free_packet(d->m, pkt);
 	}
+	while (d->frames.size) {
+		struct mp_decoded_frame df;
+		circlebuf_pop_front(&d->frames, &df, sizeof(df));
+		av_frame_free(&df.frame);
+	}
+	d->demux_eof = false;
+	d->decoder_eof = false;
+	unlock_queues(d);
+}
+
+static void stop_thread(struct mp_decode *d)
+{
+	if (!d->threaded)
+		return;
+
+	os_atomic_set_bool(&d->stop, true);
+	os_sem_post(d->sem);
+	pthread_join(d->thread, NULL);
+
+	d->threaded = false;
+	pthread_mutex_destroy(&d->mutex);
+	pthread_mutex_destroy(&d->decode_mutex);
+	os_sem_destroy(d->sem);
+	os_event_destroy(d->frame_event);
 }
 
 void mp_decode_free(struct mp_decode *d)
 {
+	stop_thread(d);
+
 	mp_decode_clear_packets(d);
 	circlebuf_free(&d->packets);
+	circlebuf_free(&d->frames);
+	av_frame_free(&d->out_frame);
 
 	av_packet_free(&d->pkt);
 	av_packet_free(&d->orig_pkt);
@@ -281,7 +361,12 @@ void mp_decode_free(struct mp_decode *d)
 
 void mp_decode_push_packet(struct mp_decode *decode, AVPacket *packet)
 {
+	lock_queues(decode);
 	circlebuf_push_back(&decode->packets, &packet, sizeof(packet));
+	unlock_queues(decode);
+
+	if (decode->threaded)
+		os_sem_post(decode->sem);
 }
 
 static inline int64_t get_estimated_duration(struct mp_decode *d,
@@ -293,10 +378,10 @@ static inline int64_t get_estimated_duration(struct mp_decode *d,
 				    (AVRational){1, 1000000000});
 	} else {
 		if (last_pts)
-			return d->frame_pts - last_pts;
+			return d->dec_frame_pts - last_pts;
 
-		if (d->last_duration)
-			return d->last_duration;
+		if (d->dec_last_duration)
+			return d->dec_last_duration;
 
 		return av_rescale_q(d->decoder->time_base.num,
 				    d->decoder->time_base,
@@ -341,7 +426,7 @@ static int decode_packet(struct mp_decode *d, int *got_frame)
 #ifdef USE_NEW_HARDWARE_CODEC_METHOD
 	if (*got_frame && d->hw) {
 		if (d->hw_frame->format != d->hw_format) {
-			d->frame = d->hw_frame;
+			d->dec_frame = d->hw_frame;
 			return ret;
 		}
 
@@ -359,45 +444,54 @@ static int decode_packet(struct mp_decode *d, int *got_frame)
 	}
 #endif
 
-	d->frame = d->sw_frame;
+	d->dec_frame = d->sw_frame;
 	return ret;
 }
 
-bool mp_decode_next(struct mp_decode *d)
+static bool pop_packet(struct mp_decode *d)
+{
+	bool popped = false;
+
+	lock_queues(d);
+	if (d->packets.size) {
+		mp_media_free_packet(d->m, d->orig_pkt);
+		circlebuf_pop_front(&d->packets, &d->orig_pkt,
+				    sizeof(d->orig_pkt));
+		popped = true;
+	}
+	unlock_queues(d);
+
+	return popped;
+}
+
+/* returns 1 if a frame was decoded, 0 if not (more packets are needed or the
+ * packet failed to decode) and -1 once the decoder is drained */
+static int decode_next_frame(struct mp_decode *d, bool eof)
 {
-	bool eof = d->m->eof;
+	bool frame_ready = false;
 	int got_frame;
 	int ret;
 
-	d->frame_ready = false;
-
-	if (!eof && !d->packets.size)
-		return true;
+	if (!eof && !has_queued_packets(d))
+		return 0;
 
-	while (!d->frame_ready) {
+	while (!frame_ready) {
 		if (!d->packet_pending) {
-			if (!d->packets.size) {
-				if (eof) {
-					d->pkt->data = NULL;
-					d->pkt->size = 0;
-				} else {
-					return true;
-				}
-			} else {
-				mp_media_free_packet(d->m, d->orig_pkt);
-				circlebuf_pop_front(&d->packets, &d->orig_pkt,
-						    sizeof(d->orig_pkt));
+			if (pop_packet(d)) {
 				av_packet_ref(d->pkt, d->orig_pkt);
 				d->packet_pending = true;
+			} else if (eof) {
+				d->pkt->data = NULL;
+				d->pkt->size = 0;
+			} else {
+				return 0;
 			}
 		}
 
 		ret = decode_packet(d, &got_frame);
 
-		if (!got_frame && ret == 0) {
-			d->eof = true;
-			return true;
-		}
+		if (!got_frame && ret == 0)
+			return -1;
 		if (ret < 0) {
 #ifdef DETAILED_DEBUG_INFO
 			blog(LOG_DEBUG, "MP: decode failed: %s",
@@ -409,10 +503,10 @@ bool mp_decode_next(struct mp_decode *d)
 				av_packet_unref(d->pkt);
 				d->packet_pending = false;
 			}
-			return true;
+			return 0;
 		}
 
-		d->frame_ready = !!got_frame;
+		frame_ready = !!got_frame;
 
 		if (d->packet_pending) {
 			if (d->pkt->size) {
@@ -428,44 +522,218 @@ bool mp_decode_next(struct mp_decode *d)
 		}
 	}
 
-	if (d->frame_ready) {
-		int64_t last_pts = d->frame_pts;
-
-		if (d->in_frame->best_effort_timestamp == AV_NOPTS_VALUE)
-			d->frame_pts = d->next_pts;
-		else
-			d->frame_pts =
-				av_rescale_q(d->in_frame->best_effort_timestamp,
-					     d->stream->time_base,
-					     (AVRational){1, 1000000000});
-
-		int64_t duration = d->in_frame->pkt_duration;
-		if (!duration)
-			duration = get_estimated_duration(d, last_pts);
-		else
-			duration = av_rescale_q(duration, d->stream->time_base,
-						(AVRational){1, 1000000000});
-
-		if (d->m->speed != 100) {
-			d->frame_pts = av_rescale_q(
-				d->frame_pts, (AVRational){1, d->m->speed},
-				(AVRational){1, 100});
-			duration = av_rescale_q(duration,
+	int64_t last_pts = d->dec_frame_pts;
+
+	if (d->in_frame->best_effort_timestamp == AV_NOPTS_VALUE)
+		d->dec_frame_pts = d->dec_next_pts;
+	else
+		d->dec_frame_pts =
+			av_rescale_q(d->in_frame->best_effort_timestamp,
+				     d->stream->time_base,
+				     (AVRational){1, 1000000000});
+
+	int64_t duration = d->in_frame->pkt_duration;
+	if (!duration)
+		duration = get_estimated_duration(d, last_pts);
+	else
+		duration = av_rescale_q(duration, d->stream->time_base,
+					(AVRational){1, 1000000000});
+
+	if (d->m->speed != 100) {
+		d->dec_frame_pts = av_rescale_q(d->dec_frame_pts,
 						(AVRational){1, d->m->speed},
 						(AVRational){1, 100});
-		}
+		duration = av_rescale_q(duration, (AVRational){1, d->m->speed},
+					(AVRational){1, 100});
+	}
+
+	d->dec_last_duration = duration;
+	d->dec_next_pts = d->dec_frame_pts + duration;
+	return 1;
+}
+
+static inline void publish_frame(struct mp_decode *d, AVFrame *frame,
+				 int64_t pts, int64_t duration)
+{
+	d->frame = frame;
+	d->frame_pts = pts;
+	d->last_duration = duration;
+	d->next_pts = pts + duration;
+	d->frame_ready = true;
+}
 
-		d->last_duration = duration;
-		d->next_pts = d->frame_pts + duration;
+/* runs on the decoding thread, returns false when there is nothing to do
+ * until more packets arrive or frames are consumed */
+static bool decode_queued(struct mp_decode *d)
+{
+	size_t max_frames = d->audio ? MAX_QUEUED_AUDIO_FRAMES
+				     : MAX_QUEUED_VIDEO_FRAMES;
+	struct mp_decoded_frame df;
+	bool can_decode;
+	bool eof;
+	int ret;
+
+	pthread_mutex_lock(&d->decode_mutex);
+
+	pthread_mutex_lock(&d->mutex);
+	eof = d->demux_eof;
+	can_decode = !d->decoder_eof && queued_frames(d) < max_frames &&
+		     (eof || d->packets.size);
+	pthread_mutex_unlock(&d->mutex);
+
+	if (!can_decode) {
+		pthread_mutex_unlock(&d->decode_mutex);
+		return false;
+	}
+
+	ret = decode_next_frame(d, eof);
+
+	if (ret > 0) {
+		/* take the frame's buffers so the decoder allocates new ones,
+		 * this also applies to hardware transfers */
+		df.frame = av_frame_alloc();
+		av_frame_move_ref(df.frame, d->dec_frame);
+		df.pts = d->dec_frame_pts;
+		df.duration = d->dec_last_duration;
+
+		pthread_mutex_lock(&d->mutex);
+		circlebuf_push_back(&d->frames, &df, sizeof(df));
+		pthread_mutex_unlock(&d->mutex);
+		os_event_signal(d->frame_event);
+
+	} else if (ret < 0) {
+		pthread_mutex_lock(&d->mutex);
+		d->decoder_eof = true;
+		pthread_mutex_unlock(&d->mutex);
+		os_event_signal(d->frame_event);
 	}
 
+	pthread_mutex_unlock(&d->decode_mutex);
 	return true;
 }
 
+static void *decode_thread(void *opaque)
+{
+	struct mp_decode *d = opaque;
+
+	os_set_thread_name(d->audio ? "mp_audio_decode" : "mp_video_decode");
+
+	while (os_sem_wait(d->sem) == 0) {
+		if (os_atomic_load_bool(&d->stop))
+			break;
+
+		while (!os_atomic_load_bool(&d->stop) && decode_queued(d))
+			;
+	}
+
+	return NULL;
+}
+
+static void start_thread(struct mp_decode *d)
+{
+	if (pthread_mutex_init(&d->mutex, NULL) != 0)
+		return;
+	if (pthread_mutex_init(&d->decode_mutex, NULL) != 0)
+		goto fail_decode_mutex;
+	if (os_sem_init(&d->sem, 0) != 0)
+		goto fail_sem;
+	if (os_event_init(&d->frame_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail_event;
+
+	d->threaded = true;
+	if (pthread_create(&d->thread, NULL, decode_thread, d) == 0)
+		return;
+
+	blog(LOG_WARNING, "MP: Could not create %s decoding thread, "
+			  "decoding on the media thread",
+	     d->audio ? "audio" : "video");
+	d->threaded = false;
+
+	os_event_destroy(d->frame_event);
+fail_event:
+	os_sem_destroy(d->sem);
+fail_sem:
+	pthread_mutex_destroy(&d->decode_mutex);
+fail_decode_mutex:
+	pthread_mutex_destroy(&d->mutex);
+}
+
+static bool next_queued_frame(struct mp_decode *d)
+{
+	struct mp_decoded_frame df;
+	bool got_frame = false;
+
+	pthread_mutex_lock(&d->mutex);
+	d->demux_eof = d->m->eof;
+	if (d->frames.size) {
+		circlebuf_pop_front(&d->frames, &df, sizeof(df));
+		got_frame = true;
+	} else if (d->decoder_eof) {
+		d->eof = true;
+	}
+	pthread_mutex_unlock(&d->mutex);
+
+	/* room for another frame, or end of file to drain */
+	os_sem_post(d->sem);
+
+	if (got_frame) {
+		av_frame_free(&d->out_frame);
+		d->out_frame = df.frame;
+		publish_frame(d, df.frame, df.pts, df.duration);
+	}
+
+	return true;
+}
+
+bool mp_decode_next(struct mp_decode *d)
+{
+	int ret;
+
+	d->frame_ready = false;
+
+	if (d->threaded)
+		return next_queued_frame(d);
+
+	ret = decode_next_frame(d, d->m->eof);
+	if (ret > 0)
+		publish_frame(d, d->dec_frame, d->dec_frame_pts,
+			      d->dec_last_duration);
+	else if (ret < 0)
+		d->eof = true;
+
+	return true;
+}
+
+void mp_decode_wait(struct mp_decode *d)
+{
+	bool wait;
+
+	if (!d->threaded || d->frame_ready || d->eof)
+		return;
+
+	/* keep demuxing unless the decoder already has plenty to work on */
+	pthread_mutex_lock(&d->mutex);
+	wait = !d->frames.size &&
+	       (d->m->eof || queued_packets(d) >= MAX_QUEUED_PACKETS);
+	pthread_mutex_unlock(&d->mutex);
+
+	if (wait)
+		os_event_timedwait(d->frame_event, 10);
+}
+
 void mp_decode_flush(struct mp_decode *d)
 {
+	if (d->threaded)
+		pthread_mutex_lock(&d->decode_mutex);
+
 	avcodec_flush_buffers(d->decoder);
 	mp_decode_clear_packets(d);
+	d->dec_frame_pts = 0;
+	d->dec_next_pts = 0;
+
+	if (d->threaded)
+		pthread_mutex_unlock(&d->decode_mutex);
+
 	d->eof = false;
 	d->frame_pts = 0;
 	d->frame_ready = false;
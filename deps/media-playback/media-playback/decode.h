@@ -73,6 +73,27 @@ struct mp_decode {
 	AVPacket *pkt;
 	bool packet_pending;
 	struct circlebuf packets;
+
+	/* state of the decoder itself, published to the fields above once
+	 * the frame is used */
+	AVFrame *dec_frame;
+	int64_t dec_frame_pts;
+	int64_t dec_next_pts;
+	int64_t dec_last_duration;
+
+	/* decoding thread; packets are pushed by the media thread and decoded
+	 * frames are queued back to it */
+	bool threaded;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_mutex_t decode_mutex;
+	os_sem_t *sem;
+	os_event_t *frame_event;
+	struct circlebuf frames;
+	AVFrame *out_frame;
+	bool demux_eof;
+	bool decoder_eof;
+	volatile bool stop;
 };
 
 extern bool mp_decode_init(struct mp_media *media, enum AVMediaType type,
@@ -84,6 +105,7 @@ extern void mp_decode_clear_packets(struct mp_decode *decode);
 extern void mp_decode_push_packet(struct mp_decode *decode, AVPacket *pkt);
 extern bool mp_decode_next(struct mp_decode *decode);
 extern void mp_decode_flush(struct mp_decode *decode);
+extern void mp_decode_wait(struct mp_decode *decode);
 
 #ifdef __cplusplus
 }
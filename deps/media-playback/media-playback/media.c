@@ -16,6 +16,8 @@
 
 #include <obs.h>
 #include <util/platform.h>
+#include <util/dstr.h>
+#include <util/util_uint64.h>
 #include <sys/stat.h>
 
 #include <assert.h>
@@ -170,19 +172,27 @@ static inline struct mp_decode *get_packet_decoder(mp_media_t *media,
 void mp_media_free_packet(struct mp_media *media, AVPacket *pkt)
 {
 	av_packet_unref(pkt);
+
+	/* also called from the decoding threads */
+	pthread_mutex_lock(&media->packet_pool_mutex);
 	da_push_back(media->packet_pool, &pkt);
+	pthread_mutex_unlock(&media->packet_pool_mutex);
 }
 
 static int mp_media_next_packet(mp_media_t *media)
 {
-	AVPacket *pkt;
+	AVPacket *pkt = NULL;
+
+	pthread_mutex_lock(&media->packet_pool_mutex);
 	AVPacket **const cached = da_end(media->packet_pool);
 	if (cached) {
 		pkt = *cached;
 		da_pop_back(media->packet_pool);
-	} else {
-		pkt = av_packet_alloc();
 	}
+	pthread_mutex_unlock(&media->packet_pool_mutex);
+
+	if (!pkt)
+		pkt = av_packet_alloc();
 
 	int ret = av_read_frame(media->fmt, pkt);
 	if (ret < 0) {
@@ -245,17 +255,17 @@ static inline int get_sws_range(enum AVColorRange r)
 
 #define FIXED_1_0 (1 << 16)
 
+/* uses the decoded frame rather than the decoder context, which may be in
+ * use by the decoding thread */
 static bool mp_media_init_scaling(mp_media_t *m)
 {
-	int space = get_sws_colorspace(m->v.decoder->colorspace);
-	int range = get_sws_range(m->v.decoder->color_range);
+	const AVFrame *f = m->v.frame;
+	int space = get_sws_colorspace(f->colorspace);
+	int range = get_sws_range(f->color_range);
 	const int *coeff = sws_getCoefficients(space);
 
-	m->swscale = sws_getCachedContext(NULL, m->v.decoder->width,
-					  m->v.decoder->height,
-					  m->v.decoder->pix_fmt,
-					  m->v.decoder->width,
-					  m->v.decoder->height, m->scale_format,
+	m->swscale = sws_getCachedContext(NULL, f->width, f->height, f->format,
+					  f->width, f->height, m->scale_format,
 					  SWS_POINT, NULL, NULL, NULL);
 	if (!m->swscale) {
 		blog(LOG_WARNING, "MP: Failed to initialize scaler");
@@ -265,9 +275,8 @@ static bool mp_media_init_scaling(mp_media_t *m)
 	sws_setColorspaceDetails(m->swscale, coeff, range, coeff, range, 0,
 				 FIXED_1_0, FIXED_1_0);
 
-	int ret = av_image_alloc(m->scale_pic, m->scale_linesizes,
-				 m->v.decoder->width, m->v.decoder->height,
-				 m->scale_format, 32);
+	int ret = av_image_alloc(m->scale_pic, m->scale_linesizes, f->width,
+				 f->height, m->scale_format, 32);
 	if (ret < 0) {
 		blog(LOG_WARNING, "MP: Failed to create scale pic data");
 		return false;
@@ -298,6 +307,11 @@ static bool mp_media_prepare_frames(mp_media_t *m)
 			return false;
 		if (m->has_audio && !mp_decode_frame(&m->a))
 			return false;
+
+		if (m->has_video && !m->v.frame_ready && !m->v.eof)
+			mp_decode_wait(&m->v);
+		else if (m->has_audio && !m->a.frame_ready && !m->a.eof)
+			mp_decode_wait(&m->a);
 	}
 
 	if (m->has_video && m->v.frame_ready && !m->swscale) {
@@ -314,26 +328,144 @@ static bool mp_media_prepare_frames(mp_media_t *m)
 
 static bool mp_media_has_audio_frame_cached(mp_media_t *m)
 {
-	if (m->audio.data.num <= 0)
-		return false;
+	return m->audio.index_eof > 0 && m->audio.index < m->audio.index_eof;
+}
 
-	if (m->audio.index_eof > 0 &&
-		m->audio.index >= m->audio.index_eof)
-		return false;
+static bool mp_media_has_video_frame_cached(mp_media_t *m)
+{
+	return m->video.index_eof > 0 && m->video.index < m->video.index_eof;
+}
 
-	return true;
+static inline int64_t cached_video_ts(mp_media_t *m, int idx)
+{
+	return m->cache_ts_offset + mp_cache_video_ts(m->cache, idx);
 }
 
-static bool mp_media_has_video_frame_cached(mp_media_t *m)
+static inline int64_t cached_audio_ts(mp_media_t *m, int idx)
 {
-	if (m->video.data.num <= 0)
-		return false;
+	return m->cache_ts_offset + mp_cache_audio_ts(m->cache, idx);
+}
 
-	if (m->video.index_eof > 0 &&
-		m->video.index >= m->video.index_eof)
-		return false;
+static inline void update_next_out_ts(mp_media_t *m, uint64_t end_ts)
+{
+	if (end_ts > m->next_out_ts)
+		m->next_out_ts = end_ts;
+}
 
-	return true;
+/* restarts cached playback from the first frame, continuing the timestamps
+ * where the previous pass ended */
+static void mp_media_cache_rewind(mp_media_t *m)
+{
+	int64_t first_ts = INT64_MAX;
+	uint64_t start_ts = m->next_out_ts;
+
+	m->video.index = 0;
+	m->audio.index = 0;
+
+	if (m->video.index_eof < 0 || m->audio.index_eof < 0)
+		return;
+
+	if (m->video.index_eof > 0)
+		first_ts = mp_cache_video_ts(m->cache, 0);
+	if (m->audio.index_eof > 0 && mp_cache_audio_ts(m->cache, 0) < first_ts)
+		first_ts = mp_cache_audio_ts(m->cache, 0);
+	if (first_ts == INT64_MAX)
+		first_ts = 0;
+
+	if (!start_ts)
+		start_ts = os_gettime_ns() - base_sys_ts;
+
+	m->cache_ts_offset = (int64_t)start_ts - first_ts;
+}
+
+/* switches to playing from the cache once it has been filled, either by
+ * this media or by another one playing the same file */
+static void mp_media_check_cache(mp_media_t *m)
+{
+	int num_video;
+	int num_audio;
+
+	if (!m->cache || m->video.index_eof >= 0 || !mp_cache_ready(m->cache))
+		return;
+
+	num_video = (int)mp_cache_num_video(m->cache);
+	num_audio = (int)mp_cache_num_audio(m->cache);
+
+	if (num_video > 1)
+		m->video.refresh_rate_ns = mp_cache_video_ts(m->cache, 1) -
+					   mp_cache_video_ts(m->cache, 0);
+	if (num_audio > 1)
+		m->audio.refresh_rate_ns = mp_cache_audio_ts(m->cache, 1) -
+					   mp_cache_audio_ts(m->cache, 0);
+
+	m->video.index_eof = num_video;
+	m->audio.index_eof = num_audio;
+}
+
+static inline struct mp_preroll_frame *
+mp_preroll_peek(struct mp_preroll *preroll)
+{
+	return preroll->pos < preroll->frames.num
+		       ? preroll->frames.array + preroll->pos
+		       : NULL;
+}
+
+/* the popped frame stays valid until the next pop, it is still being
+ * output */
+static void mp_preroll_pop(struct mp_preroll *preroll)
+{
+	if (preroll->pos > 0)
+		av_frame_free(&preroll->frames.array[preroll->pos - 1].frame);
+	preroll->pos++;
+}
+
+static void mp_preroll_clear(struct mp_preroll *preroll)
+{
+	for (size_t i = 0; i < preroll->frames.num; i++)
+		av_frame_free(&preroll->frames.array[i].frame);
+	da_resize(preroll->frames, 0);
+	preroll->pos = 0;
+}
+
+static void mp_preroll_push(struct mp_preroll *preroll, struct mp_decode *d)
+{
+	struct mp_preroll_frame *pre = da_push_back_new(preroll->frames);
+
+	/* take the decoder's reference so that the next decoded (or hardware
+	 * transferred) frame gets new buffers */
+	pre->frame = av_frame_alloc();
+	av_frame_move_ref(pre->frame, d->frame);
+	pre->pts = d->frame_pts;
+	pre->duration = d->last_duration;
+	d->frame_ready = false;
+}
+
+/* decodes the first frames while the media is inactive, so that playback
+ * can start from memory while decoding catches up */
+static void mp_media_fill_preroll(mp_media_t *m)
+{
+	mp_preroll_clear(&m->v_preroll);
+	mp_preroll_clear(&m->a_preroll);
+
+	while (m->v_preroll.frames.num < (size_t)m->preroll_frames) {
+		int64_t end_pts;
+
+		if (!m->v.frame_ready)
+			break;
+
+		end_pts = m->v.frame_pts + m->v.last_duration;
+		mp_preroll_push(&m->v_preroll, &m->v);
+
+		while (m->has_audio && m->a.frame_ready &&
+		       m->a.frame_pts < end_pts) {
+			mp_preroll_push(&m->a_preroll, &m->a);
+			if (!mp_media_prepare_frames(m))
+				return;
+		}
+
+		if (!mp_media_prepare_frames(m))
+			return;
+	}
 }
 
 static inline int64_t mp_media_get_next_min_pts(mp_media_t *m)
@@ -343,9 +475,10 @@ static inline int64_t mp_media_get_next_min_pts(mp_media_t *m)
 	if( m->enable_caching ) {
 		if (m->has_video && m->video.index_eof >= 0) {
 			if (mp_media_has_video_frame_cached(m)) {
-				struct obs_source_frame *frame = m->video.data.array[m->video.index];
 				int64_t frame_pts =
-					frame->timestamp + frame->duration;
+					cached_video_ts(m, m->video.index) +
+					(int64_t)mp_cache_video_duration(
+						m->cache, m->video.index);
 				if (frame_pts < min_next_ns) {
 				 	use_cached = true;
 					min_next_ns = frame_pts;
@@ -354,15 +487,24 @@ static inline int64_t mp_media_get_next_min_pts(mp_media_t *m)
 		}
 		if (m->has_audio && m->audio.index_eof >= 0) {
 			if (mp_media_has_audio_frame_cached(m)) {
-				struct obs_source_audio *audio = m->audio.data.array[m->audio.index];
-				if ((int64_t)audio->timestamp < min_next_ns) {
+				int64_t audio_ts =
+					cached_audio_ts(m, m->audio.index);
+				if (audio_ts < min_next_ns) {
 					use_cached = true;
-					min_next_ns = (int64_t)audio->timestamp;
+					min_next_ns = audio_ts;
 				}
 			}
 		}
 	}
 	if (!use_cached) {
+		struct mp_preroll_frame *pre;
+
+		if ((pre = mp_preroll_peek(&m->v_preroll)) != NULL)
+			min_next_ns = pre->pts;
+		if ((pre = mp_preroll_peek(&m->a_preroll)) != NULL &&
+		    pre->pts < min_next_ns)
+			min_next_ns = pre->pts;
+
 		if (m->has_video && m->v.frame_ready) {
 			if (m->v.frame_pts < min_next_ns ) 
 				min_next_ns = m->v.frame_pts;
@@ -390,10 +532,14 @@ static inline int64_t mp_media_get_base_pts(mp_media_t *m)
 /* maximum timestamp variance in nanoseconds */
 #define MAX_TS_VAR 2000000000LL
 
+static inline bool mp_media_can_play_pts(mp_media_t *m, int64_t pts)
+{
+	return pts <= m->next_pts_ns || (pts - m->next_pts_ns > MAX_TS_VAR);
+}
+
 static inline bool mp_media_can_play_frame(mp_media_t *m, struct mp_decode *d)
 {
-	return d->frame_ready && (d->frame_pts <= m->next_pts_ns ||
-				  (d->frame_pts - m->next_pts_ns > MAX_TS_VAR));
+	return d->frame_ready && mp_media_can_play_pts(m, d->frame_pts);
 }
 
 static void mp_media_next_audio(mp_media_t *m)
@@ -404,14 +550,23 @@ static void mp_media_next_audio(mp_media_t *m)
 	}
 
 	struct mp_decode *d = &m->a;
-	AVFrame *f = d->frame;
+	struct mp_preroll_frame *pre = mp_preroll_peek(&m->a_preroll);
+	AVFrame *f = pre ? pre->frame : d->frame;
+	int64_t pts = pre ? pre->pts : d->frame_pts;
 	struct obs_source_audio *audio;
 
 	if (m->audio.index_eof < 0 || !m->enable_caching) {
-		if (!mp_media_can_play_frame(m, d))
-			return;
+		if (pre) {
+			if (!mp_media_can_play_pts(m, pts))
+				return;
+
+			mp_preroll_pop(&m->a_preroll);
+		} else {
+			if (!mp_media_can_play_frame(m, d))
+				return;
 
-		d->frame_ready = false;
+			d->frame_ready = false;
+		}
 		if (!m->a_cb)
 			return;
 
@@ -439,9 +594,9 @@ static void mp_media_next_audio(mp_media_t *m)
 		audio->speakers = convert_speaker_layout(f->channels);
 		audio->format = convert_sample_format(f->format);
 		audio->frames = f->nb_samples;
-		audio->timestamp = m->base_ts + d->frame_pts - m->start_ts +
+		audio->timestamp = m->base_ts + pts - m->start_ts +
 			m->play_sys_ts - base_sys_ts;
-		audio->dec_frame_pts = d->frame_pts;
+		audio->dec_frame_pts = pts;
 
 		if (audio->format == AUDIO_FORMAT_UNKNOWN) {
 			for (size_t j = 0; j < MAX_AV_PLANES; j++) {
@@ -453,62 +608,82 @@ static void mp_media_next_audio(mp_media_t *m)
 		}
 
 		if (m->enable_caching) {
-			if (m->audio.index > 0) {
-				struct obs_source_audio *previous_frame = m->audio.data.array[m->audio.index - 1];
+			if (m->audio.index > 0)
 				m->audio.refresh_rate_ns =
-					audio->timestamp - previous_frame->timestamp;
-			}
-			da_push_back(m->audio.data, &audio);
-		}
-	}
-	if (m->enable_caching) {
-		if (!mp_media_has_audio_frame_cached(m))
-			return;
-
-		audio = m->audio.data.array[m->audio.index];
-	}
+					audio->timestamp - m->audio.prev_ts;
+			m->audio.prev_ts = audio->timestamp;
 
-	m->audio.index++;
+			if (mp_cache_writing(m->cache, m))
+				mp_cache_push_audio(m->cache, m, audio,
+						    f->linesize[0]);
+		}
 
-	if (audio) {
+		m->audio.index++;
+		update_next_out_ts(m, audio->timestamp +
+					      util_mul_div64(audio->frames,
+							     1000000000ULL,
+							     audio->samples_per_sec));
 		m->a_cb(m->opaque, audio);
-	}
 
-	if (!m->enable_caching) {
 		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
 			free((void*)audio->data[i]);
 		}
 		free(audio);
+
+	} else {
+		struct obs_source_audio cached;
+
+		if (!mp_media_has_audio_frame_cached(m) || !m->a_cb)
+			return;
+
+		mp_cache_get_audio(m->cache, m->audio.index, &cached);
+		cached.timestamp = cached_audio_ts(m, m->audio.index);
+
+		m->audio.index++;
+		update_next_out_ts(m, cached.timestamp +
+					      util_mul_div64(cached.frames,
+							     1000000000ULL,
+							     cached.samples_per_sec));
+		m->a_cb(m->opaque, &cached);
 	}
 }
 
 static void mp_media_next_video(mp_media_t *m, bool preload)
 {
-	if (!m->process_video) {
+	if (!preload && !m->process_video) {
 		m->process_video = true;
 		return;
 	}
 
 	struct mp_decode *d = &m->v;
+	struct mp_preroll_frame *pre = mp_preroll_peek(&m->v_preroll);
 	enum video_format new_format;
 	enum video_colorspace new_space;
 	enum video_range_type new_range;
-	AVFrame *f = d->frame;
+	AVFrame *f = pre ? pre->frame : d->frame;
+	int64_t pts = pre ? pre->pts : d->frame_pts;
+	int64_t duration = pre ? pre->duration : d->last_duration;
 	struct obs_source_frame *frame;
 
 	if (m->video.index_eof < 0 || !m->enable_caching) {
 		if (!preload) {
-			if (!mp_media_can_play_frame(m, d)) {
-				return;
-			}
+			if (pre) {
+				if (!mp_media_can_play_pts(m, pts))
+					return;
 
-			d->frame_ready = false;
+				mp_preroll_pop(&m->v_preroll);
+			} else {
+				if (!mp_media_can_play_frame(m, d))
+					return;
+
+				d->frame_ready = false;
+			}
 
 			if (!m->v_cb) {
 				return;
 			}
 		}
-		else if (!d->frame_ready) {
+		else if (!pre && !d->frame_ready) {
 			return;
 		}
 
@@ -572,9 +747,9 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 				return;
 			}
 		}
-		current_frame->timestamp = m->base_ts + d->frame_pts - m->start_ts +
+		current_frame->timestamp = m->base_ts + pts - m->start_ts +
 			m->play_sys_ts - base_sys_ts;
-		current_frame->duration = d->last_duration;
+		current_frame->duration = duration;
 
 		current_frame->width = f->width;
 		current_frame->height = f->height;
@@ -611,28 +786,30 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 			m->pix_format = current_frame->format;
 
 		if (m->enable_caching) {
-			struct obs_source_frame *new_frame = obs_source_frame_create(
-				current_frame->format, current_frame->width, current_frame->height);
-
-			obs_source_frame_copy(new_frame, current_frame);
-
-			if (m->video.index > 0 && m->video.refresh_rate_ns == 0) {
-				struct obs_source_frame *previous_frame = m->video.data.array[m->video.index - 1];
-				m->video.refresh_rate_ns = new_frame->timestamp - previous_frame->timestamp;
-			}
-
-			da_push_back(m->video.data, &new_frame);
-			frame = new_frame;
-		}
-		else {
-			frame = current_frame;
+			if (m->video.index > 0 && m->video.refresh_rate_ns == 0)
+				m->video.refresh_rate_ns =
+					current_frame->timestamp -
+					m->video.prev_ts;
+			m->video.prev_ts = current_frame->timestamp;
+
+			if (mp_cache_writing(m->cache, m))
+				mp_cache_push_video(m->cache, m, current_frame);
 		}
-	} else if (m->enable_caching) {
+
+		frame = current_frame;
+	} else {
 		if (!mp_media_has_video_frame_cached(m))
 			return;
-		frame = m->video.data.array[m->video.index];
+		if (!mp_cache_get_video(m->cache, m->video.index,
+					&m->cache_frame, &m->cache_scratch,
+					&m->cache_scratch_size))
+			return;
+
+		m->cache_frame.timestamp = cached_video_ts(m, m->video.index);
+		frame = &m->cache_frame;
 	}
 	m->video.index++;
+	update_next_out_ts(m, frame->timestamp + frame->duration);
 
 
 	if (preload) {
@@ -671,20 +848,11 @@ static void mp_media_calc_next_ns(mp_media_t *m)
 
 static inline void clear_cache(mp_media_t *m)
 {
-	if (m->video.data.num > 0) {
-		for (size_t i = 0; i < m->video.data.num; i++) {
-			obs_source_frame_free(m->video.data.array[i]);
-		}
-	}
-	if (m->audio.data.num > 0) {
-		for (size_t i = 0; i < m->audio.data.num; i++) {
-			for (size_t j = 0; j < MAX_AV_PLANES; j++) {
-				free((void*)((struct obs_source_audio*)m->audio.data.array[i])->data[j]);
-			}
-		}
-	}
-	da_free(m->video.data);
-	da_free(m->audio.data);
+	if (mp_cache_writing(m->cache, m))
+		mp_cache_abandon(m->cache, m);
+
+	m->video.index_eof = -1;
+	m->audio.index_eof = -1;
 }
 
 static void seek_to(mp_media_t *m, int64_t pos)
@@ -735,9 +903,18 @@ static bool mp_media_reset(mp_media_t *m)
 	m->eof = false;
 	m->base_ts += next_ts;
 	m->seek_next_ts = false;
-	m->audio.index = 0;
-	m->video.index = 0;
 
+	/* a pass that did not start at the beginning of the file cannot fill
+	 * the cache, start a new one */
+	if (mp_cache_writing(m->cache, m))
+		mp_cache_abandon(m->cache, m);
+	mp_media_check_cache(m);
+	if (m->cache && m->video.index_eof < 0)
+		mp_cache_begin(m->cache, m);
+	mp_media_cache_rewind(m);
+
+	mp_preroll_clear(&m->v_preroll);
+	mp_preroll_clear(&m->a_preroll);
 	seek_to(m, start_time);
 
 	pthread_mutex_lock(&m->mutex);
@@ -749,6 +926,10 @@ static bool mp_media_reset(mp_media_t *m)
 	if (!mp_media_prepare_frames(m))
 		return false;
 
+	if (!active && m->preroll_frames > 0 && m->has_video &&
+	    m->is_local_file && m->video.index_eof < 0)
+		mp_media_fill_preroll(m);
+
 	if (active) {
 		if (!m->play_sys_ts)
 			m->play_sys_ts = (int64_t)os_gettime_ns();
@@ -794,8 +975,10 @@ static inline bool mp_media_sleep(mp_media_t *m)
 
 static inline bool mp_media_eof(mp_media_t *m)
 {
-	bool v_ended = !m->has_video || !m->v.frame_ready;
-	bool a_ended = !m->has_audio || !m->a.frame_ready;
+	bool v_ended = !m->has_video || (!m->v.frame_ready &&
+					 !mp_preroll_peek(&m->v_preroll));
+	bool a_ended = !m->has_audio || (!m->a.frame_ready &&
+					 !mp_preroll_peek(&m->a_preroll));
 	bool eof = v_ended && a_ended;
 
 	if (eof) {
@@ -807,12 +990,11 @@ static inline bool mp_media_eof(mp_media_t *m)
 			m->active = false;
 			m->stopping = true;
 		}
-		m->video.index_eof = m->video.index;
-		m->video.index = 0;
-		m->audio.index_eof = m->audio.index;
-		m->audio.index = 0;
 		pthread_mutex_unlock(&m->mutex);
 
+		if (mp_cache_writing(m->cache, m))
+			mp_cache_end(m->cache, m);
+
 		mp_media_reset(m);
 	}
 
@@ -992,6 +1174,10 @@ static inline bool mp_media_thread(mp_media_t *m)
 		}
 
 		if (seek) {
+			if (mp_cache_writing(m->cache, m))
+				mp_cache_abandon(m->cache, m);
+			mp_preroll_clear(&m->v_preroll);
+			mp_preroll_clear(&m->a_preroll);
 			m->seek_next_ts = true;
 			seek_to(m, seek_pos);
 			continue;
@@ -1062,8 +1248,7 @@ static inline bool mp_media_thread(mp_media_t *m)
 					         m->video.index == m->video.index_eof;
 				if ((audio_eof || !m->has_audio) &&
 				    (video_eof || !m->has_video)) {
-					m->audio.index = 0;
-					m->video.index = 0;
+					mp_media_cache_rewind(m);
 					m->video.last_processed_ns = 0;
 					m->audio.last_processed_ns = 0;
 					reset_ts(m);
@@ -1098,6 +1283,31 @@ static void *mp_media_thread_start(void *opaque)
 	return NULL;
 }
 
+static mp_cache_t *mp_media_acquire_cache(mp_media_t *m,
+					  const struct mp_media_info *info)
+{
+	size_t max_bytes = info->cache_max_bytes;
+	struct stat stats;
+	struct dstr key = {0};
+	mp_cache_t *cache;
+
+	if (os_stat(m->path, &stats) != 0)
+		return NULL;
+
+	if (!max_bytes)
+		max_bytes = (size_t)MP_CACHE_DEFAULT_MAX_MB * 1024 * 1024;
+
+	/* everything that changes the frames or their timestamps */
+	dstr_printf(&key, "%s|%lld|%lld|%d|%d|%d|%lld", m->path,
+		    (long long)stats.st_mtime, (long long)stats.st_size,
+		    m->speed, (int)m->force_range, (int)m->is_linear_alpha,
+		    (long long)m->volume);
+
+	cache = mp_cache_acquire(key.array, max_bytes, info->cache_compress);
+	dstr_free(&key);
+	return cache;
+}
+
 static inline bool mp_media_init_internal(mp_media_t *m,
 					  const struct mp_media_info *info)
 {
@@ -1105,6 +1315,10 @@ static inline bool mp_media_init_internal(mp_media_t *m,
 		blog(LOG_WARNING, "MP: Failed to init mutex");
 		return false;
 	}
+	if (pthread_mutex_init(&m->packet_pool_mutex, NULL) != 0) {
+		blog(LOG_WARNING, "MP: Failed to init packet pool mutex");
+		return false;
+	}
 	if (os_sem_init(&m->sem, 0) != 0) {
 		blog(LOG_WARNING, "MP: Failed to init semaphore");
 		return false;
@@ -1114,13 +1328,14 @@ static inline bool mp_media_init_internal(mp_media_t *m,
 	m->format_name = info->format ? bstrdup(info->format) : NULL;
 	m->hw = info->hardware_decoding;
 
-	m->video = (struct cached_data) { 0, -1, NULL, -1, 0 };
-	m->audio = (struct cached_data) { 0, -1, NULL, -1, 0 };
+	m->video = (struct cached_data) { 0, -1, 0, 0, 0 };
+	m->audio = (struct cached_data) { 0, -1, 0, 0, 0 };
 	m->process_audio = true;
 	m->process_video = false;
 	m->pix_format = 0;
-	da_init(m->video.data);
-	da_init(m->audio.data);
+
+	if (m->enable_caching && m->is_local_file && m->path)
+		m->cache = mp_media_acquire_cache(m, info);
 
 	if (pthread_create(&m->thread, NULL, mp_media_thread_start, m) != 0) {
 		blog(LOG_WARNING, "MP: Could not create media thread");
@@ -1135,6 +1350,7 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 {
 	memset(media, 0, sizeof(*media));
 	pthread_mutex_init_value(&media->mutex);
+	pthread_mutex_init_value(&media->packet_pool_mutex);
 	media->opaque = info->opaque;
 	media->v_cb = info->v_cb;
 	media->a_cb = info->a_cb;
@@ -1149,6 +1365,7 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 	media->is_local_file = info->is_local_file;
 	media->enable_caching = info->enable_caching;
 	media->volume = info->volume;
+	media->preroll_frames = info->preroll_frames;
 	da_init(media->packet_pool);
 
 	if (!info->is_local_file || media->speed < 1 || media->speed > 200)
@@ -1203,12 +1420,20 @@ void mp_media_free(mp_media_t *media)
 	avformat_close_input(&media->fmt);
 	pthread_mutex_destroy(&media->mutex);
 	os_sem_destroy(media->sem);
+	pthread_mutex_destroy(&media->packet_pool_mutex);
 	sws_freeContext(media->swscale);
 	av_freep(&media->scale_pic[0]);
+	mp_cache_release(media->cache, media);
+	bfree(media->cache_scratch);
+	mp_preroll_clear(&media->v_preroll);
+	mp_preroll_clear(&media->a_preroll);
+	da_free(media->v_preroll.frames);
+	da_free(media->a_preroll.frames);
 	bfree(media->path);
 	bfree(media->format_name);
 	memset(media, 0, sizeof(*media));
 	pthread_mutex_init_value(&media->mutex);
+	pthread_mutex_init_value(&media->packet_pool_mutex);
 }
 
 void mp_media_play(mp_media_t *m, bool loop, bool reconnecting)
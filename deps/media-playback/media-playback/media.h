@@ -18,6 +18,7 @@
 
 #include <obs.h>
 #include "decode.h"
+#include "cache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,12 +45,26 @@ typedef void (*mp_audio_cb)(void *opaque, struct obs_source_audio *audio);
 typedef void (*mp_stop_cb)(void *opaque);
 typedef void (*mp_ready_cb)(void *opaque);
 
+#define MP_CACHE_DEFAULT_MAX_MB 1024
+
 struct cached_data {
 	int index;
 	int index_eof;
-	DARRAY(void*) data;
 	int64_t refresh_rate_ns;
 	uint64_t last_processed_ns;
+	uint64_t prev_ts;
+};
+
+/* frames decoded ahead of playback so that it can start without decoding */
+struct mp_preroll_frame {
+	AVFrame *frame;
+	int64_t pts;
+	int64_t duration;
+};
+
+struct mp_preroll {
+	DARRAY(struct mp_preroll_frame) frames;
+	size_t pos;
 };
 
 struct mp_media {
@@ -74,6 +89,7 @@ struct mp_media {
 	int scale_linesizes[4];
 	uint8_t *scale_pic[4];
 
+	pthread_mutex_t packet_pool_mutex;
 	DARRAY(AVPacket *) packet_pool;
 	struct mp_decode v;
 	struct mp_decode a;
@@ -111,9 +127,19 @@ struct mp_media {
 	bool thread_valid;
 	pthread_t thread;
 
+	int preroll_frames;
+	struct mp_preroll v_preroll;
+	struct mp_preroll a_preroll;
+
 	bool enable_caching;
+	mp_cache_t *cache;
 	struct cached_data video;
 	struct cached_data audio;
+	struct obs_source_frame cache_frame;
+	uint8_t *cache_scratch;
+	size_t cache_scratch_size;
+	int64_t cache_ts_offset;
+	uint64_t next_out_ts;
 	bool process_audio;
 	bool process_video;
 	int32_t pix_format;
@@ -147,8 +173,11 @@ struct mp_media_info {
 	bool hardware_decoding;
 	bool is_local_file;
 	bool enable_caching;
+	size_t cache_max_bytes;
+	bool cache_compress;
 	bool reconnecting;
 	int64_t volume;
+	int preroll_frames;
 };
 
 extern bool mp_media_init(mp_media_t *media, const struct mp_media_info *info);
@@ -63,6 +63,70 @@ static PyObject *py_obspython = NULL;
 struct obs_python_script *cur_python_script = NULL;
 struct python_obs_callback *cur_python_cb = NULL;
 
+/* -------------------------------------------- */
+/* script thread / watchdog                     */
+
+#define DEFAULT_CALL_BUDGET_NS 4000000ULL
+#define BUDGET_WARN_INTERVAL_NS 10000000000ULL
+#define WATCHDOG_STALL_NS 1000000000ULL
+
+static bool python_threaded = false;
+static uint64_t call_budget_ns = DEFAULT_CALL_BUDGET_NS;
+
+static pthread_t python_thread;
+static bool python_thread_active = false;
+static os_sem_t *python_thread_sem = NULL;
+
+/* protects everything shared between the graphics thread and the script
+ * thread: the pending tick, the watchdog state and the tick callbacks */
+static pthread_mutex_t thread_mutex;
+static bool python_thread_exit = false;
+static bool tick_queued = false;
+static float queued_seconds = 0.0f;
+static uint64_t queued_ts = 0;
+static uint64_t busy_since = 0;
+static bool stall_logged = false;
+static struct obs_python_script *watched_script = NULL;
+static DARRAY(struct python_obs_callback *) thread_tick_cbs;
+static DARRAY(struct python_obs_callback *) thread_tick_cbs_copy;
+
+/* must be called with python locked */
+static void script_call_end(struct obs_python_script *script, uint64_t start)
+{
+	uint64_t now = os_gettime_ns();
+	uint64_t elapsed = now - start;
+
+	if (!script)
+		return;
+
+	script->call_time_ns += elapsed;
+	script->num_calls++;
+
+	if (elapsed <= call_budget_ns)
+		return;
+	if (script->last_budget_warn_ts &&
+	    now - script->last_budget_warn_ts < BUDGET_WARN_INTERVAL_NS)
+		return;
+
+	script->last_budget_warn_ts = now;
+	blog(LOG_WARNING,
+	     "[obs-scripting]: Python script '%s' took %.2f ms in a single "
+	     "call, its budget is %.2f ms%s",
+	     script->base.file.array, (double)elapsed / 1000000.0,
+	     (double)call_budget_ns / 1000000.0,
+	     python_thread_active ? "" : " (graphics thread was blocked)");
+}
+
+static inline void watch_script(struct obs_python_script *script)
+{
+	if (!python_thread_active)
+		return;
+
+	pthread_mutex_lock(&thread_mutex);
+	watched_script = script;
+	pthread_mutex_unlock(&thread_mutex);
+}
+
 /* -------------------------------------------- */
 
 bool py_to_libobs_(const char *type, PyObject *py_in, void *libobs_out,
@@ -119,10 +183,12 @@ bool libobs_to_py_(const char *type, void *libobs_in, bool ownership,
 	struct obs_python_script *__last_script = cur_python_script;     \
 	struct python_obs_callback *__last_cb = cur_python_cb;           \
 	cur_python_script = (struct obs_python_script *)cb->base.script; \
-	cur_python_cb = cb
-#define unlock_callback()                  \
-	cur_python_cb = __last_cb;         \
-	cur_python_script = __last_script; \
+	cur_python_cb = cb;                                              \
+	uint64_t __call_start = os_gettime_ns()
+#define unlock_callback()                                 \
+	script_call_end(cur_python_script, __call_start); \
+	cur_python_cb = __last_cb;                        \
+	cur_python_script = __last_script;                \
 	unlock_python()
 
 /* ========================================================================= */
@@ -537,7 +603,14 @@ static PyObject *obs_python_add_tick_callback(PyObject *self, PyObject *args)
 		return python_none();
 
 	struct python_obs_callback *cb = add_python_obs_callback(script, py_cb);
-	obs_add_tick_callback(obs_python_tick_callback, cb);
+
+	if (python_thread_active) {
+		pthread_mutex_lock(&thread_mutex);
+		da_push_back(thread_tick_cbs, &cb);
+		pthread_mutex_unlock(&thread_mutex);
+	} else {
+		obs_add_tick_callback(obs_python_tick_callback, cb);
+	}
 	return python_none();
 }
 
@@ -1406,6 +1479,13 @@ void obs_python_script_unload(obs_script_t *s)
 
 	blog(LOG_INFO, "[obs-scripting]: Unloaded python script: %s",
 	     data->base.file.array);
+	if (data->num_calls)
+		blog(LOG_INFO,
+		     "[obs-scripting]: Python script %s spent %.2f ms in %llu "
+		     "calls",
+		     data->base.file.array,
+		     (double)data->call_time_ns / 1000000.0,
+		     (unsigned long long)data->num_calls);
 }
 
 void obs_python_script_destroy(obs_script_t *s)
@@ -1511,11 +1591,36 @@ void obs_python_script_save(obs_script_t *s)
 
 /* -------------------------------------------- */
 
-static void python_tick(void *param, float seconds)
+static void process_thread_tick_callbacks(float seconds)
+{
+	pthread_mutex_lock(&thread_mutex);
+	for (size_t i = thread_tick_cbs.num; i > 0; i--) {
+		struct python_obs_callback *cb = thread_tick_cbs.array[i - 1];
+		if (script_callback_removed(&cb->base))
+			da_erase(thread_tick_cbs, i - 1);
+	}
+
+	/* callbacks can add tick callbacks, so call them from a copy */
+	da_resize(thread_tick_cbs_copy, thread_tick_cbs.num);
+	if (thread_tick_cbs.num)
+		memcpy(thread_tick_cbs_copy.array, thread_tick_cbs.array,
+		       thread_tick_cbs.num * sizeof(*thread_tick_cbs.array));
+	pthread_mutex_unlock(&thread_mutex);
+
+	for (size_t i = 0; i < thread_tick_cbs_copy.num; i++) {
+		struct python_obs_callback *cb = thread_tick_cbs_copy.array[i];
+
+		watch_script((struct obs_python_script *)cb->base.script);
+		obs_python_tick_callback(cb, seconds);
+	}
+
+	watch_script(NULL);
+}
+
+static void process_python_tick(float seconds, uint64_t ts)
 {
 	struct obs_python_script *data;
 	bool valid;
-	uint64_t ts = obs_get_video_frame_time();
 
 	pthread_mutex_lock(&tick_mutex);
 	valid = !!first_tick_script;
@@ -1532,6 +1637,9 @@ static void python_tick(void *param, float seconds)
 		pthread_mutex_lock(&tick_mutex);
 		data = first_tick_script;
 		while (data) {
+			uint64_t start = os_gettime_ns();
+
+			watch_script(data);
 			cur_python_script = data;
 
 			PyObject *py_ret =
@@ -1539,10 +1647,13 @@ static void python_tick(void *param, float seconds)
 			Py_XDECREF(py_ret);
 			py_error();
 
+			script_call_end(data, start);
+
 			data = data->next_tick;
 		}
 
 		cur_python_script = NULL;
+		watch_script(NULL);
 
 		pthread_mutex_unlock(&tick_mutex);
 
@@ -1551,6 +1662,12 @@ static void python_tick(void *param, float seconds)
 		unlock_python();
 	}
 
+	/* --------------------------------- */
+	/* process tick callbacks            */
+
+	if (python_thread_active)
+		process_thread_tick_callbacks(seconds);
+
 	/* --------------------------------- */
 	/* process timers                    */
 
@@ -1566,10 +1683,15 @@ static void python_tick(void *param, float seconds)
 			uint64_t elapsed = ts - timer->last_ts;
 
 			if (elapsed >= timer->interval) {
+				watch_script((struct obs_python_script *)
+						     cb->base.script);
+
 				lock_python();
 				timer_call(&cb->base);
 				unlock_python();
 
+				watch_script(NULL);
+
 				timer->last_ts += timer->interval;
 			}
 		}
@@ -1577,8 +1699,130 @@ static void python_tick(void *param, float seconds)
 		timer = next;
 	}
 	pthread_mutex_unlock(&timer_mutex);
+}
+
+static void *python_thread_proc(void *param)
+{
+	os_set_thread_name("scripting: python");
+
+	while (os_sem_wait(python_thread_sem) == 0) {
+		float seconds;
+		uint64_t ts;
+
+		pthread_mutex_lock(&thread_mutex);
+		if (python_thread_exit) {
+			pthread_mutex_unlock(&thread_mutex);
+			break;
+		}
+
+		seconds = queued_seconds;
+		ts = queued_ts;
+		queued_seconds = 0.0f;
+		tick_queued = false;
+		busy_since = os_gettime_ns();
+		pthread_mutex_unlock(&thread_mutex);
+
+		process_python_tick(seconds, ts);
+
+		pthread_mutex_lock(&thread_mutex);
+		busy_since = 0;
+		stall_logged = false;
+		pthread_mutex_unlock(&thread_mutex);
+	}
 
 	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+/* called from the graphics thread.  ticks that arrive while the script
+ * thread is still busy are merged into a single tick, so a slow script only
+ * ever delays itself. */
+static void queue_python_tick(float seconds, uint64_t ts)
+{
+	bool post = false;
+
+	pthread_mutex_lock(&thread_mutex);
+	queued_seconds += seconds;
+	queued_ts = ts;
+	if (!tick_queued) {
+		tick_queued = true;
+		post = true;
+	}
+
+	if (busy_since && !stall_logged &&
+	    os_gettime_ns() - busy_since >= WATCHDOG_STALL_NS) {
+		stall_logged = true;
+		blog(LOG_WARNING,
+		     "[obs-scripting]: Python script thread has been busy for "
+		     "over %d ms%s%s",
+		     (int)(WATCHDOG_STALL_NS / 1000000),
+		     watched_script ? ", in script: " : "",
+		     watched_script ? watched_script->base.file.array : "");
+	}
+	pthread_mutex_unlock(&thread_mutex);
+
+	if (post)
+		os_sem_post(python_thread_sem);
+}
+
+static void python_tick(void *param, float seconds)
+{
+	uint64_t ts = obs_get_video_frame_time();
+
+	if (python_thread_active)
+		queue_python_tick(seconds, ts);
+	else
+		process_python_tick(seconds, ts);
+
+	UNUSED_PARAMETER(param);
+}
+
+static void start_python_thread(void)
+{
+	python_thread_exit = false;
+
+	if (os_sem_init(&python_thread_sem, 0) != 0) {
+		warn("Failed to create python script thread semaphore, "
+		     "running scripts on the graphics thread");
+		return;
+	}
+
+	/* set before the thread starts, tick callbacks check it to decide
+	 * where they go */
+	python_thread_active = true;
+
+	if (pthread_create(&python_thread, NULL, python_thread_proc, NULL) !=
+	    0) {
+		warn("Failed to create python script thread, running scripts "
+		     "on the graphics thread");
+		python_thread_active = false;
+		os_sem_destroy(python_thread_sem);
+		python_thread_sem = NULL;
+		return;
+	}
+
+	blog(LOG_INFO, "[obs-scripting]: Running python script ticks on a "
+		       "separate thread");
+}
+
+static void stop_python_thread(void)
+{
+	if (!python_thread_active)
+		return;
+
+	pthread_mutex_lock(&thread_mutex);
+	python_thread_exit = true;
+	pthread_mutex_unlock(&thread_mutex);
+
+	os_sem_post(python_thread_sem);
+	pthread_join(python_thread, NULL);
+
+	os_sem_destroy(python_thread_sem);
+	python_thread_sem = NULL;
+	python_thread_active = false;
+
+	da_free(thread_tick_cbs);
+	da_free(thread_tick_cbs_copy);
 }
 
 /* -------------------------------------------- */
@@ -1606,12 +1850,24 @@ bool obs_scripting_python_loaded(void)
 	return python_loaded;
 }
 
+void obs_scripting_python_set_threaded(bool threaded)
+{
+	python_threaded = threaded;
+}
+
+void obs_scripting_python_set_call_budget(uint32_t budget_ms)
+{
+	call_budget_ns = budget_ms ? (uint64_t)budget_ms * 1000000ULL
+				   : DEFAULT_CALL_BUDGET_NS;
+}
+
 void obs_python_load(void)
 {
 	da_init(python_paths);
 
 	pthread_mutex_init(&tick_mutex, NULL);
 	pthread_mutex_init_recursive(&timer_mutex);
+	pthread_mutex_init(&thread_mutex, NULL);
 
 	mutexes_loaded = true;
 }
@@ -1744,17 +2000,28 @@ out:
 
 	python_loaded_at_all = success;
 
-	if (python_loaded)
+	if (python_loaded) {
+		if (python_threaded)
+			start_python_thread();
 		obs_add_tick_callback(python_tick, NULL);
+	}
 
 	return python_loaded;
 }
 
 void obs_python_unload(void)
 {
+	/* the script thread has to be stopped before its mutex is destroyed
+	 * and python is finalized */
+	if (python_thread_active) {
+		obs_remove_tick_callback(python_tick, NULL);
+		stop_python_thread();
+	}
+
 	if (mutexes_loaded) {
 		pthread_mutex_destroy(&tick_mutex);
 		pthread_mutex_destroy(&timer_mutex);
+		pthread_mutex_destroy(&thread_mutex);
 	}
 
 	if (!python_loaded_at_all)
@@ -80,6 +80,11 @@ struct obs_python_script {
 	PyObject *tick;
 	struct obs_python_script *next_tick;
 	struct obs_python_script **p_prev_next_tick;
+
+	/* time spent in the script's calls, only touched with python locked */
+	uint64_t call_time_ns;
+	uint64_t num_calls;
+	uint64_t last_budget_warn_ts;
 };
 
 /* ------------------------------------------------------------ */
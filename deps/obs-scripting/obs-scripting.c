@@ -463,4 +463,14 @@ void obs_scripting_python_version(char *version, size_t version_length)
 {
 	version[0] = 0;
 }
+
+void obs_scripting_python_set_threaded(bool threaded)
+{
+	UNUSED_PARAMETER(threaded);
+}
+
+void obs_scripting_python_set_call_budget(uint32_t budget_ms)
+{
+	UNUSED_PARAMETER(budget_ms);
+}
 #endif
@@ -50,6 +50,13 @@ EXPORT void obs_scripting_python_version(char *version, size_t version_length);
 EXPORT bool obs_scripting_python_loaded(void);
 EXPORT bool obs_scripting_load_python(const char *python_path);
 
+/* Runs python script ticks, tick callbacks and timers on a separate thread
+ * instead of the graphics thread.  Must be set before python is loaded. */
+EXPORT void obs_scripting_python_set_threaded(bool threaded);
+/* Longest a single python script call may take before a warning is logged,
+ * 0 for the default */
+EXPORT void obs_scripting_python_set_call_budget(uint32_t budget_ms);
+
 EXPORT obs_script_t *obs_script_create(const char *path, obs_data_t *settings);
 EXPORT void obs_script_destroy(obs_script_t *script);
 
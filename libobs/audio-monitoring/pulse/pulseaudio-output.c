@@ -1,31 +1,83 @@
 #include "obs-internal.h"
 #include "pulseaudio-wrapper.h"
 
-#define PULSE_DATA(voidptr) struct audio_monitor *data = voidptr;
+#define PULSE_DATA(voidptr) struct pulse_mixer *data = voidptr;
 #define blog(level, msg, ...) blog(level, "pulse-am: " msg, ##__VA_ARGS__)
 
-struct audio_monitor {
-	obs_source_t *source;
-	pa_stream *stream;
+/* requested stream latency, grown on underflows and slowly shrunk back */
+#define MIN_TLENGTH_USEC 10000
+#define MAX_TLENGTH_USEC 1000000
+#define TLENGTH_SHRINK_INTERVAL_NS 10000000000ULL
+
+/* audio each monitor keeps queued at its lowest point, right before new audio
+ * is pushed, and how far above that it may drift before audio is dropped */
+#define TARGET_LEVEL_MS 10
+#define MAX_EXCESS_MS 250
+
+/* rate controller, in ppm of the monitor's output rate */
+#define MAX_CORRECTION_PPM 2000.0
+#define RATE_KP 50000.0
+#define RATE_KI 5000.0
+#define LEVEL_SMOOTHING 0.05
+
+/* Every monitoring device has one playback stream that all monitors of that
+ * device are mixed into.  The mixer is refcounted by its monitors. */
+struct pulse_mixer {
+	struct pulse_mixer *next;
+	long refs;
+
 	char *device;
+	pa_stream *stream;
 	pa_buffer_attr attr;
+	pa_sample_spec spec;
 	enum speaker_layout speakers;
-	pa_sample_format_t format;
 	uint_fast32_t samples_per_sec;
 	uint_fast32_t bytes_per_frame;
 	uint_fast8_t channels;
+	bool spec_valid;
+
+	/* frames a monitor needs queued before it starts playing again, one
+	 * audio tick on top of the target level since audio arrives a tick at
+	 * a time */
+	size_t prebuffer_frames;
+
+	uint64_t last_underflow_ts;
+	uint64_t latency_sum;
+	uint64_t latency_count;
+
+	/* protects everything below, as well as the queued audio of every
+	 * monitor in monitors */
+	pthread_mutex_t mutex;
+	DARRAY(struct audio_monitor *) monitors;
+	float *scratch;
+	size_t scratch_size;
+};
 
-	uint_fast32_t packets;
-	uint_fast64_t frames;
+struct audio_monitor {
+	obs_source_t *source;
+	struct pulse_mixer *mixer;
+	audio_resampler_t *resampler;
 
 	struct circlebuf new_data;
-	audio_resampler_t *resampler;
-	size_t bytesRemaining;
+	bool buffering;
+
+	double level_err;
+	double level_integral;
+	double correction_ppm;
+	double correction_remainder;
+
+	uint_fast32_t packets;
+	uint_fast64_t frames;
+	uint_fast32_t underruns;
+	uint_fast64_t dropped_frames;
 
 	bool ignore;
 	pthread_mutex_t playback_mutex;
 };
 
+static struct pulse_mixer *first_mixer = NULL;
+static pthread_mutex_t mixers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static enum speaker_layout
 pulseaudio_channels_to_obs_speakers(uint_fast32_t channels)
 {
@@ -51,23 +103,6 @@ pulseaudio_channels_to_obs_speakers(uint_fast32_t channels)
 	}
 }
 
-static enum audio_format
-pulseaudio_to_obs_audio_format(pa_sample_format_t format)
-{
-	switch (format) {
-	case PA_SAMPLE_U8:
-		return AUDIO_FORMAT_U8BIT;
-	case PA_SAMPLE_S16LE:
-		return AUDIO_FORMAT_16BIT;
-	case PA_SAMPLE_S32LE:
-		return AUDIO_FORMAT_32BIT;
-	case PA_SAMPLE_FLOAT32LE:
-		return AUDIO_FORMAT_FLOAT;
-	default:
-		return AUDIO_FORMAT_UNKNOWN;
-	}
-}
-
 static pa_channel_map pulseaudio_channel_map(enum speaker_layout layout)
 {
 	pa_channel_map ret;
@@ -123,101 +158,68 @@ static pa_channel_map pulseaudio_channel_map(enum speaker_layout layout)
 	return ret;
 }
 
-static void process_byte(void *p, size_t frames, size_t channels, float vol)
-{
-	register uint8_t *cur = (uint8_t *)p;
-	register uint8_t *end = cur + frames * channels;
-
-	for (; cur < end; cur++)
-		*cur = ((int)*cur - 128) * vol + 128;
-}
-
-static void process_s16(void *p, size_t frames, size_t channels, float vol)
-{
-	register int16_t *cur = (int16_t *)p;
-	register int16_t *end = cur + frames * channels;
-
-	while (cur < end)
-		*(cur++) *= vol;
-}
-
-static void process_s32(void *p, size_t frames, size_t channels, float vol)
-{
-	register int32_t *cur = (int32_t *)p;
-	register int32_t *end = cur + frames * channels;
-
-	while (cur < end)
-		*(cur++) *= vol;
-}
-
-static void process_float(void *p, size_t frames, size_t channels, float vol)
+static void process_volume(float *p, size_t frames, size_t channels, float vol)
 {
-	register float *cur = (float *)p;
+	register float *cur = p;
 	register float *end = cur + frames * channels;
 
 	while (cur < end)
 		*(cur++) *= vol;
 }
 
-void process_volume(const struct audio_monitor *monitor, float vol,
-		    uint8_t *const *resample_data, uint32_t resample_frames)
+static inline size_t ms_to_frames(const struct pulse_mixer *mixer, size_t ms)
 {
-	switch (monitor->format) {
-	case PA_SAMPLE_U8:
-		process_byte(resample_data[0], resample_frames,
-			     monitor->channels, vol);
-		break;
-	case PA_SAMPLE_S16LE:
-		process_s16(resample_data[0], resample_frames,
-			    monitor->channels, vol);
-		break;
-	case PA_SAMPLE_S32LE:
-		process_s32(resample_data[0], resample_frames,
-			    monitor->channels, vol);
-		break;
-	case PA_SAMPLE_FLOAT32LE:
-		process_float(resample_data[0], resample_frames,
-			      monitor->channels, vol);
-		break;
-	default:
-		// just ignore
-		break;
-	}
+	return (size_t)mixer->samples_per_sec * ms / 1000;
 }
 
-static void do_stream_write(void *param)
+/* Drift correction: instead of dropping audio when a monitor's queue grows
+ * (or stuttering when it runs dry), the monitor's resampler output rate is
+ * nudged so that the lowest queue level stays at TARGET_LEVEL_MS. */
+static void update_rate_control(struct audio_monitor *monitor, size_t level,
+				uint32_t frames)
 {
-	PULSE_DATA(param);
-	uint8_t *buffer = NULL;
-
-	while (data->new_data.size > 0 && data->bytesRemaining > 0) {
-		size_t bytesToFill = data->new_data.size;
-		if (data->bytesRemaining < bytesToFill)
-			bytesToFill = data->bytesRemaining;
-
-		pulseaudio_lock();
-		if (pa_stream_begin_write(data->stream, (void **)&buffer,
-					  &bytesToFill)) {
-			pulseaudio_unlock();
-			return;
-		}
-
-		circlebuf_pop_front(&data->new_data, buffer, bytesToFill);
-
-		pa_stream_write(data->stream, buffer, bytesToFill, NULL, 0LL,
-				PA_SEEK_RELATIVE);
-		pulseaudio_unlock();
-
-		data->bytesRemaining -= bytesToFill;
-	}
+	struct pulse_mixer *mixer = monitor->mixer;
+	double rate = (double)mixer->samples_per_sec;
+	double target = (double)ms_to_frames(mixer, TARGET_LEVEL_MS);
+	double err = ((double)level - target) / rate;
+	double max_integral = MAX_CORRECTION_PPM / RATE_KI;
+	double ppm;
+
+	monitor->level_err += (err - monitor->level_err) * LEVEL_SMOOTHING;
+	monitor->level_integral += monitor->level_err * (double)frames / rate;
+
+	if (monitor->level_integral > max_integral)
+		monitor->level_integral = max_integral;
+	else if (monitor->level_integral < -max_integral)
+		monitor->level_integral = -max_integral;
+
+	ppm = RATE_KP * monitor->level_err +
+	      RATE_KI * monitor->level_integral;
+
+	if (ppm > MAX_CORRECTION_PPM)
+		ppm = MAX_CORRECTION_PPM;
+	else if (ppm < -MAX_CORRECTION_PPM)
+		ppm = -MAX_CORRECTION_PPM;
+
+	monitor->correction_ppm = ppm;
+
+	/* too much queued means fewer samples have to be produced */
+	int distance = (int)mixer->samples_per_sec * AUDIO_DRIFT_DISTANCE_SEC;
+	int delta = audio_drift_get_delta(-ppm, distance,
+					  &monitor->correction_remainder);
+	audio_resampler_set_compensation(monitor->resampler, delta, distance);
 }
 
 static void on_audio_playback(void *param, obs_source_t *source,
 			      const struct audio_data *audio_data, bool muted)
 {
 	struct audio_monitor *monitor = param;
+	struct pulse_mixer *mixer;
 	float vol = source->user_volume;
 	size_t bytes;
+	size_t level;
+	size_t max_level;
+	bool buffering;
 
 	uint8_t *resample_data[MAX_AV_PLANES];
 	uint32_t resample_frames;
@@ -230,6 +232,8 @@ static void on_audio_playback(void *param, obs_source_t *source,
 	if (os_atomic_load_long(&source->activate_refs) == 0)
 		goto unlock;
 
+	mixer = monitor->mixer;
+
 	success = audio_resampler_resample(
 		monitor->resampler, resample_data, &resample_frames, &ts_offset,
 		(const uint8_t *const *)audio_data->data,
@@ -238,35 +242,138 @@ static void on_audio_playback(void *param, obs_source_t *source,
 	if (!success)
 		goto unlock;
 
-	bytes = monitor->bytes_per_frame * resample_frames;
+	bytes = mixer->bytes_per_frame * resample_frames;
 
 	if (muted) {
 		memset(resample_data[0], 0, bytes);
 	} else {
 		if (!close_float(vol, 1.0f, EPSILON)) {
-			process_volume(monitor, vol, resample_data,
-				       resample_frames);
+			process_volume((float *)resample_data[0],
+				       resample_frames, mixer->channels, vol);
 		}
 	}
 
+	max_level = mixer->prebuffer_frames +
+		    ms_to_frames(mixer, MAX_EXCESS_MS);
+
+	pthread_mutex_lock(&mixer->mutex);
+	level = monitor->new_data.size / mixer->bytes_per_frame;
+	buffering = monitor->buffering;
+
 	circlebuf_push_back(&monitor->new_data, resample_data[0], bytes);
+
+	/* only happens if playback stalled for a long time, the rate
+	 * controller can't catch up with that in any reasonable time */
+	if (level + resample_frames > max_level) {
+		size_t drop = level + resample_frames - mixer->prebuffer_frames;
+
+		circlebuf_pop_front(&monitor->new_data, NULL,
+				    drop * mixer->bytes_per_frame);
+		monitor->dropped_frames += drop;
+		monitor->level_err = 0.0;
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+
+	if (buffering)
+		monitor->level_err = 0.0;
+	else
+		update_rate_control(monitor, level, resample_frames);
+
 	monitor->packets++;
 	monitor->frames += resample_frames;
 
 unlock:
 	pthread_mutex_unlock(&monitor->playback_mutex);
-	do_stream_write(param);
+}
+
+static void mix_monitor(struct pulse_mixer *mixer,
+			struct audio_monitor *monitor, float *out,
+			size_t frames)
+{
+	size_t level = monitor->new_data.size / mixer->bytes_per_frame;
+
+	if (monitor->buffering) {
+		if (level < mixer->prebuffer_frames)
+			return;
+
+		monitor->buffering = false;
+	}
+
+	if (level < frames) {
+		if (level)
+			monitor->underruns++;
+		monitor->buffering = true;
+		frames = level;
+	}
+
+	size_t count = frames * mixer->channels;
+	size_t size = count * sizeof(float);
+
+	if (mixer->scratch_size < size) {
+		mixer->scratch = brealloc(mixer->scratch, size);
+		mixer->scratch_size = size;
+	}
+
+	circlebuf_pop_front(&monitor->new_data, mixer->scratch, size);
+
+	for (size_t i = 0; i < count; i++)
+		out[i] += mixer->scratch[i];
+}
+
+static void update_latency(struct pulse_mixer *mixer)
+{
+	pa_usec_t latency;
+	int negative;
+
+	if (pa_stream_get_latency(mixer->stream, &latency, &negative) < 0)
+		return;
+
+	mixer->latency_sum += negative ? 0 : latency;
+	mixer->latency_count++;
+}
+
+/* gives back latency once the stream ran without underflows for a while */
+static void shrink_tlength(struct pulse_mixer *mixer)
+{
+	uint32_t min_tlength = (uint32_t)pa_usec_to_bytes(MIN_TLENGTH_USEC,
+							  &mixer->spec);
+	uint64_t ts = os_gettime_ns();
+
+	if (mixer->attr.tlength <= min_tlength ||
+	    ts - mixer->last_underflow_ts < TLENGTH_SHRINK_INTERVAL_NS)
+		return;
+
+	mixer->attr.tlength = (mixer->attr.tlength * 3) / 4;
+	if (mixer->attr.tlength < min_tlength)
+		mixer->attr.tlength = min_tlength;
+
+	pa_stream_set_buffer_attr(mixer->stream, &mixer->attr, NULL, NULL);
+	mixer->last_underflow_ts = ts;
 }
 
 static void pulseaudio_stream_write(pa_stream *p, size_t nbytes, void *userdata)
 {
-	UNUSED_PARAMETER(p);
 	PULSE_DATA(userdata);
+	float *buffer = NULL;
+
+	if (pa_stream_begin_write(p, (void **)&buffer, &nbytes) || !buffer)
+		goto signal;
+
+	size_t frames = nbytes / data->bytes_per_frame;
+	nbytes = frames * data->bytes_per_frame;
+	memset(buffer, 0, nbytes);
 
-	pthread_mutex_lock(&data->playback_mutex);
-	data->bytesRemaining += nbytes;
-	pthread_mutex_unlock(&data->playback_mutex);
+	pthread_mutex_lock(&data->mutex);
+	for (size_t i = 0; i < data->monitors.num; i++)
+		mix_monitor(data, data->monitors.array[i], buffer, frames);
+	pthread_mutex_unlock(&data->mutex);
 
+	pa_stream_write(p, buffer, nbytes, NULL, 0LL, PA_SEEK_RELATIVE);
+
+	update_latency(data);
+	shrink_tlength(data);
+
+signal:
 	pulseaudio_signal(0);
 }
 
@@ -275,14 +382,11 @@ static void pulseaudio_underflow(pa_stream *p, void *userdata)
 	UNUSED_PARAMETER(p);
 	PULSE_DATA(userdata);
 
-	pa_sample_spec spec = {0};
-	spec.format = data->format;
-	spec.rate = (uint32_t)data->samples_per_sec;
-	spec.channels = data->channels;
-	uint64_t latency = pa_bytes_to_usec(data->attr.tlength, &spec);
+	uint64_t latency = pa_bytes_to_usec(data->attr.tlength, &data->spec);
 
-	pthread_mutex_lock(&data->playback_mutex);
-	if (obs_source_active(data->source) && latency < 1000000) {
+	data->last_underflow_ts = os_gettime_ns();
+
+	if (latency < MAX_TLENGTH_USEC) {
 		data->attr.fragsize = (uint32_t)-1;
 		data->attr.maxlength = (uint32_t)-1;
 		data->attr.prebuf = (uint32_t)-1;
@@ -290,12 +394,8 @@ static void pulseaudio_underflow(pa_stream *p, void *userdata)
 		data->attr.tlength = (data->attr.tlength * 3) / 2;
 		pa_stream_set_buffer_attr(data->stream, &data->attr, NULL,
 					  NULL);
-		data->bytesRemaining = data->attr.maxlength;
-	}
-	pthread_mutex_unlock(&data->playback_mutex);
-
-	if (latency >= 1000000) {
-		blog(LOG_WARNING, "source monitor reached max latency %ldms",
+	} else {
+		blog(LOG_WARNING, "monitor reached max latency %" PRIu64 "ms",
 		     latency / 1000);
 	}
 
@@ -321,7 +421,7 @@ static void pulseaudio_source_info(pa_context *c, const pa_source_info *i,
 	PULSE_DATA(userdata);
 	// An error occurred
 	if (eol < 0) {
-		data->format = PA_SAMPLE_INVALID;
+		data->spec_valid = false;
 		goto skip;
 	}
 	// Terminating call for multi instance callbacks
@@ -332,17 +432,6 @@ static void pulseaudio_source_info(pa_context *c, const pa_source_info *i,
 	     pa_sample_format_to_string(i->sample_spec.format),
 	     i->sample_spec.rate, i->sample_spec.channels);
 
-	pa_sample_format_t format = i->sample_spec.format;
-	if (pulseaudio_to_obs_audio_format(format) == AUDIO_FORMAT_UNKNOWN) {
-		format = PA_SAMPLE_FLOAT32LE;
-
-		blog(LOG_INFO,
-		     "Sample format %s not supported by OBS,"
-		     "using %s instead for recording",
-		     pa_sample_format_to_string(i->sample_spec.format),
-		     pa_sample_format_to_string(format));
-	}
-
 	uint8_t channels = i->sample_spec.channels;
 	if (pulseaudio_channels_to_obs_speakers(channels) == SPEAKERS_UNKNOWN) {
 		channels = 2;
@@ -353,48 +442,206 @@ static void pulseaudio_source_info(pa_context *c, const pa_source_info *i,
 		     i->sample_spec.channels, channels);
 	}
 
-	data->format = format;
 	data->samples_per_sec = i->sample_spec.rate;
 	data->channels = channels;
+	data->spec_valid = true;
 skip:
 	pulseaudio_signal(0);
 }
 
-static void pulseaudio_stop_playback(struct audio_monitor *monitor)
+static void pulseaudio_stop_playback(struct pulse_mixer *mixer)
 {
-	if (monitor->stream) {
+	if (mixer->stream) {
 		/* Stop the stream */
 		pulseaudio_lock();
-		pa_stream_disconnect(monitor->stream);
+		pa_stream_disconnect(mixer->stream);
 		pulseaudio_unlock();
 
 		/* Remove the callbacks, to ensure we no longer try to do anything
 		 * with this stream object */
-		pulseaudio_write_callback(monitor->stream, NULL, NULL);
-		pulseaudio_set_underflow_callback(monitor->stream, NULL, NULL);
+		pulseaudio_write_callback(mixer->stream, NULL, NULL);
+		pulseaudio_set_underflow_callback(mixer->stream, NULL, NULL);
 
 		/* Unreference the stream and drop it. PA will free it when it can. */
 		pulseaudio_lock();
-		pa_stream_unref(monitor->stream);
+		pa_stream_unref(mixer->stream);
 		pulseaudio_unlock();
-		monitor->stream = NULL;
+		mixer->stream = NULL;
 	}
 
-	blog(LOG_INFO, "Stopped Monitoring in '%s'", monitor->device);
-	blog(LOG_INFO,
-	     "Got %" PRIuFAST32 " packets with %" PRIuFAST64 " frames",
-	     monitor->packets, monitor->frames);
+	blog(LOG_INFO, "Stopped Monitoring in '%s'", mixer->device);
+	if (mixer->latency_count)
+		blog(LOG_INFO, "Average sink latency: %" PRIu64 "ms",
+		     mixer->latency_sum / mixer->latency_count / 1000);
+}
+
+static void mixer_destroy(struct pulse_mixer *mixer)
+{
+	pulseaudio_stop_playback(mixer);
 
-	monitor->packets = 0;
-	monitor->frames = 0;
+	pthread_mutex_destroy(&mixer->mutex);
+	da_free(mixer->monitors);
+	bfree(mixer->scratch);
+	bfree(mixer->device);
+	bfree(mixer);
+}
+
+static bool mixer_init(struct pulse_mixer *mixer)
+{
+	if (pulseaudio_get_server_info(pulseaudio_server_info, NULL) < 0) {
+		blog(LOG_ERROR, "Unable to get server info !");
+		return false;
+	}
+
+	if (pulseaudio_get_source_info(pulseaudio_source_info, mixer->device,
+				       (void *)mixer) < 0) {
+		blog(LOG_ERROR, "Unable to get source info !");
+		return false;
+	}
+	if (!mixer->spec_valid) {
+		blog(LOG_ERROR,
+		     "An error occurred while getting the source info!");
+		return false;
+	}
+
+	/* monitors are mixed as float, pulse converts to the sink format */
+	mixer->spec.format = PA_SAMPLE_FLOAT32LE;
+	mixer->spec.rate = (uint32_t)mixer->samples_per_sec;
+	mixer->spec.channels = mixer->channels;
+
+	if (!pa_sample_spec_valid(&mixer->spec)) {
+		blog(LOG_ERROR, "Sample spec is not valid");
+		return false;
+	}
+
+	mixer->speakers = pulseaudio_channels_to_obs_speakers(mixer->channels);
+	mixer->bytes_per_frame = pa_frame_size(&mixer->spec);
+
+	const struct audio_output_info *info =
+		audio_output_get_info(obs->audio.audio);
+
+	mixer->prebuffer_frames =
+		ms_to_frames(mixer, TARGET_LEVEL_MS) +
+		(size_t)util_mul_div64(AUDIO_OUTPUT_FRAMES,
+				       mixer->samples_per_sec,
+				       info->samples_per_sec);
+
+	pa_channel_map channel_map = pulseaudio_channel_map(mixer->speakers);
+
+	mixer->stream = pulseaudio_stream_new("Monitoring", &mixer->spec,
+					      &channel_map);
+	if (!mixer->stream) {
+		blog(LOG_ERROR, "Unable to create stream");
+		return false;
+	}
+
+	mixer->attr.fragsize = (uint32_t)-1;
+	mixer->attr.maxlength = (uint32_t)-1;
+	mixer->attr.minreq = (uint32_t)-1;
+	mixer->attr.prebuf = (uint32_t)-1;
+	mixer->attr.tlength =
+		(uint32_t)pa_usec_to_bytes(MIN_TLENGTH_USEC, &mixer->spec);
+
+	pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING |
+				  PA_STREAM_AUTO_TIMING_UPDATE |
+				  PA_STREAM_ADJUST_LATENCY;
+
+	pulseaudio_write_callback(mixer->stream, pulseaudio_stream_write,
+				  (void *)mixer);
+	pulseaudio_set_underflow_callback(mixer->stream, pulseaudio_underflow,
+					  (void *)mixer);
+
+	int_fast32_t ret = pulseaudio_connect_playback(
+		mixer->stream, mixer->device, &mixer->attr, flags);
+	if (ret < 0) {
+		blog(LOG_ERROR, "Unable to connect to stream");
+		return false;
+	}
+
+	blog(LOG_INFO, "Started Monitoring in '%s'", mixer->device);
+	return true;
+}
+
+static struct pulse_mixer *mixer_acquire(const char *device)
+{
+	struct pulse_mixer *mixer;
+
+	pthread_mutex_lock(&mixers_mutex);
+
+	mixer = first_mixer;
+	while (mixer) {
+		if (strcmp(mixer->device, device) == 0) {
+			mixer->refs++;
+			goto unlock;
+		}
+		mixer = mixer->next;
+	}
+
+	mixer = bzalloc(sizeof(*mixer));
+	mixer->device = bstrdup(device);
+	mixer->refs = 1;
+	mixer->last_underflow_ts = os_gettime_ns();
+	pthread_mutex_init(&mixer->mutex, NULL);
+
+	if (!mixer_init(mixer)) {
+		mixer_destroy(mixer);
+		mixer = NULL;
+		goto unlock;
+	}
+
+	mixer->next = first_mixer;
+	first_mixer = mixer;
+
+unlock:
+	pthread_mutex_unlock(&mixers_mutex);
+	return mixer;
+}
+
+static void mixer_release(struct pulse_mixer *mixer)
+{
+	struct pulse_mixer **p_mixer;
+
+	pthread_mutex_lock(&mixers_mutex);
+
+	if (--mixer->refs > 0) {
+		pthread_mutex_unlock(&mixers_mutex);
+		return;
+	}
+
+	p_mixer = &first_mixer;
+	while (*p_mixer != mixer)
+		p_mixer = &(*p_mixer)->next;
+	*p_mixer = mixer->next;
+
+	mixer_destroy(mixer);
+	pthread_mutex_unlock(&mixers_mutex);
+}
+
+static void mixer_add_monitor(struct pulse_mixer *mixer,
+			      struct audio_monitor *monitor)
+{
+	pthread_mutex_lock(&mixer->mutex);
+	da_push_back(mixer->monitors, &monitor);
+	pthread_mutex_unlock(&mixer->mutex);
+}
+
+static void mixer_remove_monitor(struct pulse_mixer *mixer,
+				 struct audio_monitor *monitor)
+{
+	pthread_mutex_lock(&mixer->mutex);
+	da_erase_item(mixer->monitors, &monitor);
+	pthread_mutex_unlock(&mixer->mutex);
 }
 
 static bool audio_monitor_init(struct audio_monitor *monitor,
 			       obs_source_t *source)
 {
+	char *device = NULL;
+
 	pthread_mutex_init_value(&monitor->playback_mutex);
 
 	monitor->source = source;
+	monitor->buffering = true;
 
 	const char *id = obs->audio.monitoring_device_id;
 	if (!id)
@@ -417,39 +664,18 @@ static bool audio_monitor_init(struct audio_monitor *monitor,
 	pulseaudio_init();
 
 	if (strcmp(id, "default") == 0)
-		get_default_id(&monitor->device);
+		get_default_id(&device);
 	else
-		monitor->device = bstrdup(id);
+		device = bstrdup(id);
 
-	if (!monitor->device)
+	if (!device)
 		return false;
 
-	if (pulseaudio_get_server_info(pulseaudio_server_info,
-				       (void *)monitor) < 0) {
-		blog(LOG_ERROR, "Unable to get server info !");
-		return false;
-	}
+	monitor->mixer = mixer_acquire(device);
+	bfree(device);
 
-	if (pulseaudio_get_source_info(pulseaudio_source_info, monitor->device,
-				       (void *)monitor) < 0) {
-		blog(LOG_ERROR, "Unable to get source info !");
-		return false;
-	}
-	if (monitor->format == PA_SAMPLE_INVALID) {
-		blog(LOG_ERROR,
-		     "An error occurred while getting the source info!");
+	if (!monitor->mixer)
 		return false;
-	}
-
-	pa_sample_spec spec;
-	spec.format = monitor->format;
-	spec.rate = (uint32_t)monitor->samples_per_sec;
-	spec.channels = monitor->channels;
-
-	if (!pa_sample_spec_valid(&spec)) {
-		blog(LOG_ERROR, "Sample spec is not valid");
-		return false;
-	}
 
 	const struct audio_output_info *info =
 		audio_output_get_info(obs->audio.audio);
@@ -458,10 +684,9 @@ static bool audio_monitor_init(struct audio_monitor *monitor,
 				     .speakers = info->speakers,
 				     .format = AUDIO_FORMAT_FLOAT_PLANAR};
 	struct resample_info to = {
-		.samples_per_sec = (uint32_t)monitor->samples_per_sec,
-		.speakers =
-			pulseaudio_channels_to_obs_speakers(monitor->channels),
-		.format = pulseaudio_to_obs_audio_format(monitor->format)};
+		.samples_per_sec = (uint32_t)monitor->mixer->samples_per_sec,
+		.speakers = monitor->mixer->speakers,
+		.format = AUDIO_FORMAT_FLOAT};
 
 	monitor->resampler = audio_resampler_create(&to, &from);
 	if (!monitor->resampler) {
@@ -470,44 +695,12 @@ static bool audio_monitor_init(struct audio_monitor *monitor,
 		return false;
 	}
 
-	monitor->speakers = pulseaudio_channels_to_obs_speakers(spec.channels);
-	monitor->bytes_per_frame = pa_frame_size(&spec);
-
-	pa_channel_map channel_map = pulseaudio_channel_map(monitor->speakers);
-
-	monitor->stream = pulseaudio_stream_new(
-		obs_source_get_name(monitor->source), &spec, &channel_map);
-	if (!monitor->stream) {
-		blog(LOG_ERROR, "Unable to create stream");
-		return false;
-	}
-
-	monitor->attr.fragsize = (uint32_t)-1;
-	monitor->attr.maxlength = (uint32_t)-1;
-	monitor->attr.minreq = (uint32_t)-1;
-	monitor->attr.prebuf = (uint32_t)-1;
-	monitor->attr.tlength = pa_usec_to_bytes(25000, &spec);
-
-	pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING |
-				  PA_STREAM_AUTO_TIMING_UPDATE;
-
 	if (pthread_mutex_init(&monitor->playback_mutex, NULL) != 0) {
 		blog(LOG_WARNING, "%s: %s", __FUNCTION__,
 		     "Failed to init mutex");
 		return false;
 	}
 
-	int_fast32_t ret = pulseaudio_connect_playback(
-		monitor->stream, monitor->device, &monitor->attr, flags);
-	if (ret < 0) {
-		pulseaudio_stop_playback(monitor);
-		blog(LOG_ERROR, "Unable to connect to stream");
-		return false;
-	}
-
-	monitor->bytesRemaining = monitor->attr.maxlength;
-
-	blog(LOG_INFO, "Started Monitoring in '%s'", monitor->device);
 	return true;
 }
 
@@ -516,14 +709,10 @@ static void audio_monitor_init_final(struct audio_monitor *monitor)
 	if (monitor->ignore)
 		return;
 
+	mixer_add_monitor(monitor->mixer, monitor);
+
 	obs_source_add_audio_capture_callback(monitor->source,
 					      on_audio_playback, monitor);
-
-	pulseaudio_write_callback(monitor->stream, pulseaudio_stream_write,
-				  (void *)monitor);
-
-	pulseaudio_set_underflow_callback(monitor->stream, pulseaudio_underflow,
-					  (void *)monitor);
 }
 
 static inline void audio_monitor_free(struct audio_monitor *monitor)
@@ -535,14 +724,22 @@ static inline void audio_monitor_free(struct audio_monitor *monitor)
 		obs_source_remove_audio_capture_callback(
 			monitor->source, on_audio_playback, monitor);
 
+	if (monitor->mixer) {
+		mixer_remove_monitor(monitor->mixer, monitor);
+		mixer_release(monitor->mixer);
+
+		blog(LOG_INFO,
+		     "Got %" PRIuFAST32 " packets with %" PRIuFAST64
+		     " frames, %" PRIuFAST32 " underruns, %" PRIuFAST64
+		     " frames dropped, rate correction %.0f ppm",
+		     monitor->packets, monitor->frames, monitor->underruns,
+		     monitor->dropped_frames, monitor->correction_ppm);
+	}
+
 	audio_resampler_destroy(monitor->resampler);
 	circlebuf_free(&monitor->new_data);
 
-	if (monitor->stream)
-		pulseaudio_stop_playback(monitor);
 	pulseaudio_unref();
-
-	bfree(monitor->device);
 }
 
 struct audio_monitor *audio_monitor_create(obs_source_t *source)
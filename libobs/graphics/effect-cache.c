@@ -0,0 +1,484 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <assert.h>
+#include <limits.h>
+#include "../util/array-serializer.h"
+#include "../util/crc32.h"
+#include "../util/dstr.h"
+#include "../util/file-serializer.h"
+#include "../util/platform.h"
+#include "effect-parser.h"
+#include "effect-cache.h"
+
+#define EFFECT_CACHE_MAGIC 0x4358464F /* "OFXC" */
+#define EFFECT_CACHE_VERSION 1
+
+/* sanity limit for strings/blobs read back from a cache file */
+#define EFFECT_CACHE_MAX_BLOB (16 * 1024 * 1024)
+
+/* ------------------------------------------------------------------------- */
+
+static inline uint32_t string_crc(const char *str)
+{
+	return str ? calc_crc32(0, str, strlen(str)) : 0;
+}
+
+static void write_str(struct serializer *s, const char *str)
+{
+	uint32_t len = str ? (uint32_t)strlen(str) : 0;
+	s_wl32(s, len);
+	s_write(s, str, len);
+}
+
+static void write_blob(struct serializer *s, const struct darray *blob)
+{
+	s_wl32(s, (uint32_t)blob->num);
+	s_write(s, blob->array, blob->num);
+}
+
+static bool read_u32(struct serializer *s, uint32_t *val)
+{
+	uint8_t b[4];
+	if (s_read(s, b, sizeof(b)) != sizeof(b))
+		return false;
+
+	*val = (uint32_t)b[0] | ((uint32_t)b[1] << 8) |
+	       ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+	return true;
+}
+
+static bool read_str(struct serializer *s, char **str)
+{
+	uint32_t len;
+
+	*str = NULL;
+	if (!read_u32(s, &len) || len > EFFECT_CACHE_MAX_BLOB)
+		return false;
+
+	*str = bmalloc(len + 1);
+	if (len && s_read(s, *str, len) != len) {
+		bfree(*str);
+		*str = NULL;
+		return false;
+	}
+
+	(*str)[len] = 0;
+	return true;
+}
+
+static bool read_blob(struct serializer *s, struct darray *blob)
+{
+	uint32_t len;
+
+	if (!read_u32(s, &len) || len > EFFECT_CACHE_MAX_BLOB)
+		return false;
+
+	darray_resize(1, blob, len);
+	return !len || s_read(s, blob->array, len) == len;
+}
+
+/* ------------------------------------------------------------------------- */
+
+char *gs_effect_cache_file(const char *cache_dir, const char *effect_path)
+{
+	struct dstr path = {0};
+	const char *device_name = gs_get_device_name();
+	uint32_t crc;
+
+	if (!cache_dir || !*cache_dir || !effect_path || !device_name)
+		return NULL;
+
+	crc = string_crc(effect_path);
+	crc = calc_crc32(crc, device_name, strlen(device_name));
+
+	dstr_copy(&path, cache_dir);
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_catf(&path, "%08X.effect_cache", crc);
+	return path.array;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void write_header(struct serializer *s, const struct effect_parser *ep,
+			 const char *effect_path, const char *effect_string)
+{
+	const struct cf_preprocessor *pp = &ep->cfp.pp;
+
+	s_wl32(s, EFFECT_CACHE_MAGIC);
+	s_wl32(s, EFFECT_CACHE_VERSION);
+	s_wl32(s, (uint32_t)gs_get_device_type());
+	write_str(s, effect_path);
+	s_wl32(s, (uint32_t)strlen(effect_string));
+	s_wl32(s, string_crc(effect_string));
+
+	s_wl32(s, (uint32_t)pp->dependencies.num);
+	for (size_t i = 0; i < pp->dependencies.num; i++) {
+		const char *file = pp->dependencies.array[i].file;
+		char *contents = os_quick_read_utf8_file(file);
+
+		write_str(s, file);
+		s_wl32(s, contents ? (uint32_t)strlen(contents) : 0);
+		s_wl32(s, string_crc(contents));
+		bfree(contents);
+	}
+}
+
+static bool check_header(struct serializer *s, const char *effect_path,
+			 const char *effect_string)
+{
+	uint32_t magic, version, device_type, size, crc, deps;
+	char *path;
+	bool match;
+
+	if (!read_u32(s, &magic) || magic != EFFECT_CACHE_MAGIC)
+		return false;
+	if (!read_u32(s, &version) || version != EFFECT_CACHE_VERSION)
+		return false;
+	if (!read_u32(s, &device_type) ||
+	    device_type != (uint32_t)gs_get_device_type())
+		return false;
+
+	if (!read_str(s, &path))
+		return false;
+	match = strcmp(path, effect_path) == 0;
+	bfree(path);
+	if (!match)
+		return false;
+
+	if (!read_u32(s, &size) || size != (uint32_t)strlen(effect_string))
+		return false;
+	if (!read_u32(s, &crc) || crc != string_crc(effect_string))
+		return false;
+
+	if (!read_u32(s, &deps))
+		return false;
+
+	for (uint32_t i = 0; i < deps; i++) {
+		char *contents;
+
+		if (!read_str(s, &path))
+			return false;
+		if (!read_u32(s, &size) || !read_u32(s, &crc)) {
+			bfree(path);
+			return false;
+		}
+
+		contents = os_quick_read_utf8_file(path);
+		match = contents && size == (uint32_t)strlen(contents) &&
+			crc == string_crc(contents);
+
+		bfree(contents);
+		bfree(path);
+
+		if (!match)
+			return false;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void write_param(struct serializer *s,
+			const struct gs_effect_param *param)
+{
+	write_str(s, param->name);
+	s_wl32(s, (uint32_t)param->type);
+	write_blob(s, &param->default_val.da);
+}
+
+static bool write_pass_shader(struct serializer *s, const struct dstr *str,
+			      const struct darray *pass_params)
+{
+	const struct pass_shaderparam *params = pass_params->array;
+
+	write_str(s, str->array);
+	s_wl32(s, (uint32_t)pass_params->num);
+
+	for (size_t i = 0; i < pass_params->num; i++) {
+		if (!params[i].eparam)
+			return false;
+		write_str(s, params[i].eparam->name);
+	}
+
+	return true;
+}
+
+static bool write_effect(struct serializer *s, const gs_effect_t *effect,
+			 const struct effect_parser *ep)
+{
+	size_t shader_idx = 0;
+
+	s_wl32(s, (uint32_t)effect->params.num);
+	for (size_t i = 0; i < effect->params.num; i++) {
+		const struct gs_effect_param *param = effect->params.array + i;
+
+		write_param(s, param);
+		s_wl32(s, (uint32_t)param->annotations.num);
+		for (size_t j = 0; j < param->annotations.num; j++)
+			write_param(s, param->annotations.array + j);
+	}
+
+	s_wl32(s, (uint32_t)effect->techniques.num);
+	for (size_t i = 0; i < effect->techniques.num; i++) {
+		const struct gs_effect_technique *tech =
+			effect->techniques.array + i;
+
+		write_str(s, tech->name);
+		s_wl32(s, (uint32_t)tech->passes.num);
+
+		for (size_t j = 0; j < tech->passes.num; j++) {
+			const struct gs_effect_pass *pass =
+				tech->passes.array + j;
+
+			if (shader_idx + 2 > ep->shader_strings.num)
+				return false;
+
+			write_str(s, pass->name);
+			if (!write_pass_shader(
+				    s, ep->shader_strings.array + shader_idx++,
+				    &pass->vertshader_params.da))
+				return false;
+			if (!write_pass_shader(
+				    s, ep->shader_strings.array + shader_idx++,
+				    &pass->pixelshader_params.da))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void gs_effect_cache_save(const gs_effect_t *effect,
+			  const struct effect_parser *ep,
+			  const char *cache_file, const char *effect_string)
+{
+	struct array_output_data data;
+	struct serializer s;
+
+	if (!cache_file || !effect->effect_path)
+		return;
+
+	array_output_serializer_init(&s, &data);
+	write_header(&s, ep, effect->effect_path, effect_string);
+
+	/* only replace the cache file once the whole entry is built */
+	if (write_effect(&s, effect, ep)) {
+		if (file_output_serializer_init_safe(&s, cache_file, "tmp")) {
+			s_write(&s, data.bytes.array, data.bytes.num);
+			file_output_serializer_free(&s);
+		} else {
+			blog(LOG_DEBUG, "Could not open effect cache file '%s'",
+			     cache_file);
+		}
+	}
+
+	array_output_serializer_free(&data);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool read_param(struct serializer *s, gs_effect_t *effect,
+		       struct gs_effect_param *param,
+		       enum effect_section section)
+{
+	uint32_t type;
+
+	param->section = section;
+	param->effect = effect;
+
+	if (!read_str(s, &param->name) || !read_u32(s, &type))
+		return false;
+
+	param->type = (enum gs_shader_param_type)type;
+	return read_blob(s, &param->default_val.da);
+}
+
+static bool read_params(struct serializer *s, gs_effect_t *effect)
+{
+	uint32_t count;
+
+	if (!read_u32(s, &count) || count > EFFECT_CACHE_MAX_BLOB)
+		return false;
+
+	da_resize(effect->params, count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct gs_effect_param *param = effect->params.array + i;
+		uint32_t annotations;
+
+		if (!read_param(s, effect, param, EFFECT_PARAM))
+			return false;
+		if (!read_u32(s, &annotations) ||
+		    annotations > EFFECT_CACHE_MAX_BLOB)
+			return false;
+
+		da_resize(param->annotations, annotations);
+		for (uint32_t j = 0; j < annotations; j++) {
+			if (!read_param(s, effect, param->annotations.array + j,
+					EFFECT_ANNOTATION))
+				return false;
+		}
+
+		if (strcmp(param->name, "ViewProj") == 0)
+			effect->view_proj = param;
+		else if (strcmp(param->name, "World") == 0)
+			effect->world = param;
+	}
+
+	return true;
+}
+
+static bool read_pass_shader(struct serializer *s, gs_effect_t *effect,
+			     struct gs_effect_technique *tech,
+			     struct gs_effect_pass *pass, uint32_t pass_idx,
+			     enum gs_shader_type type)
+{
+	struct darray *pass_params;
+	struct dstr location = {0};
+	gs_shader_t *shader;
+	char *shader_str;
+	uint32_t count;
+
+	if (!read_str(s, &shader_str))
+		return false;
+
+	dstr_copy(&location, effect->effect_path);
+	dstr_cat(&location,
+		 type == GS_SHADER_VERTEX ? " (Vertex " : " (Pixel ");
+	dstr_catf(&location, "shader, technique %s, pass %u)", tech->name,
+		  (unsigned)pass_idx);
+
+	if (type == GS_SHADER_VERTEX) {
+		shader = gs_vertexshader_create(shader_str, location.array,
+						NULL);
+		pass->vertshader = shader;
+		pass_params = &pass->vertshader_params.da;
+	} else {
+		shader = gs_pixelshader_create(shader_str, location.array,
+					       NULL);
+		pass->pixelshader = shader;
+		pass_params = &pass->pixelshader_params.da;
+	}
+
+	dstr_free(&location);
+	bfree(shader_str);
+
+	if (!shader || !read_u32(s, &count) || count > EFFECT_CACHE_MAX_BLOB)
+		return false;
+
+	darray_resize(sizeof(struct pass_shaderparam), pass_params, count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct pass_shaderparam *param = darray_item(
+			sizeof(struct pass_shaderparam), pass_params, i);
+		char *name;
+
+		if (!read_str(s, &name))
+			return false;
+
+		param->eparam = gs_effect_get_param_by_name(effect, name);
+		param->sparam = gs_shader_get_param_by_name(shader, name);
+		bfree(name);
+
+		if (!param->sparam)
+			return false;
+	}
+
+	return true;
+}
+
+static bool read_techniques(struct serializer *s, gs_effect_t *effect)
+{
+	uint32_t count;
+
+	if (!read_u32(s, &count) || count > EFFECT_CACHE_MAX_BLOB)
+		return false;
+
+	da_resize(effect->techniques, count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct gs_effect_technique *tech = effect->techniques.array + i;
+		uint32_t passes;
+
+		tech->section = EFFECT_TECHNIQUE;
+		tech->effect = effect;
+
+		if (!read_str(s, &tech->name) || !read_u32(s, &passes) ||
+		    passes > EFFECT_CACHE_MAX_BLOB)
+			return false;
+
+		da_resize(tech->passes, passes);
+
+		for (uint32_t j = 0; j < passes; j++) {
+			struct gs_effect_pass *pass = tech->passes.array + j;
+
+			pass->section = EFFECT_PASS;
+
+			if (!read_str(s, &pass->name))
+				return false;
+			if (!read_pass_shader(s, effect, tech, pass, j,
+					      GS_SHADER_VERTEX))
+				return false;
+			if (!read_pass_shader(s, effect, tech, pass, j,
+					      GS_SHADER_PIXEL))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void clear_compiled_effect(gs_effect_t *effect)
+{
+	for (size_t i = 0; i < effect->params.num; i++)
+		effect_param_free(effect->params.array + i);
+	for (size_t i = 0; i < effect->techniques.num; i++)
+		effect_technique_free(effect->techniques.array + i);
+
+	da_free(effect->params);
+	da_free(effect->techniques);
+	effect->view_proj = NULL;
+	effect->world = NULL;
+}
+
+bool gs_effect_cache_load(gs_effect_t *effect, const char *cache_file,
+			  const char *effect_string)
+{
+	struct serializer s;
+	bool success;
+
+	if (!cache_file || !effect->effect_path)
+		return false;
+	if (!file_input_serializer_init(&s, cache_file))
+		return false;
+
+	success = check_header(&s, effect->effect_path, effect_string) &&
+		  read_params(&s, effect) && read_techniques(&s, effect);
+
+	file_input_serializer_free(&s);
+
+	if (!success) {
+		clear_compiled_effect(effect);
+		blog(LOG_DEBUG, "Effect cache miss for '%s'",
+		     effect->effect_path);
+	}
+
+	return success;
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "effect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The effect cache stores the compiled form of an effect file (parameters,
+ * annotations, techniques, and the generated shader text of every pass) on
+ * disk so that subsequent loads can skip the preprocessor and effect parser
+ * entirely.  Entries are validated against the contents of the effect file
+ * and of every file it includes, as well as the graphics device type, so a
+ * stale entry is simply ignored and rewritten.
+ */
+
+/* returns the cache file used for an effect, or NULL if caching is disabled */
+extern char *gs_effect_cache_file(const char *cache_dir,
+				  const char *effect_path);
+
+extern bool gs_effect_cache_load(gs_effect_t *effect, const char *cache_file,
+				 const char *effect_string);
+extern void gs_effect_cache_save(const gs_effect_t *effect,
+				 const struct effect_parser *ep,
+				 const char *cache_file,
+				 const char *effect_string);
+
+#ifdef __cplusplus
+}
+#endif
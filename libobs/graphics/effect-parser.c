@@ -68,6 +68,8 @@ void ep_free(struct effect_parser *ep)
 	for (i = 0; i < ep->techniques.num; i++)
 		ep_technique_free(ep->techniques.array + i);
 
+	dstr_array_free(ep->shader_strings.array, ep->shader_strings.num);
+
 	ep->cur_pass = NULL;
 	cf_parser_free(&ep->cfp);
 	da_free(ep->params);
@@ -75,6 +77,7 @@ void ep_free(struct effect_parser *ep)
 	da_free(ep->funcs);
 	da_free(ep->samplers);
 	da_free(ep->techniques);
+	da_free(ep->shader_strings);
 }
 
 static inline struct ep_func *ep_getfunc(struct effect_parser *ep,
@@ -1995,7 +1998,7 @@ static inline bool ep_compile_pass_shader(struct effect_parser *ep,
 	dstr_free(&location);
 	dstr_array_free(used_params.array, used_params.num);
 	darray_free(&used_params);
-	dstr_free(&shader_str);
+	da_push_back(ep->shader_strings, &shader_str);
 
 	return success;
 }
@@ -270,6 +270,10 @@ struct effect_parser {
 	DARRAY(struct cf_token) tokens;
 	struct gs_effect_pass *cur_pass;
 
+	/* generated shader text, vertex then pixel for each compiled pass.
+	 * kept so the effect cache can store it without regenerating */
+	DARRAY(struct dstr) shader_strings;
+
 	struct cf_parser cfp;
 };
 
@@ -282,6 +286,7 @@ static inline void ep_init(struct effect_parser *ep)
 	da_init(ep->techniques);
 	da_init(ep->files);
 	da_init(ep->tokens);
+	da_init(ep->shader_strings);
 
 	ep->cur_pass = NULL;
 	cf_parser_init(&ep->cfp);
@@ -405,6 +405,7 @@ struct graphics_subsystem {
 
 	pthread_mutex_t effect_mutex;
 	struct gs_effect *first_effect;
+	char *effect_cache_dir;
 
 	pthread_mutex_t mutex;
 	volatile long ref;
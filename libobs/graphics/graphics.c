@@ -26,6 +26,7 @@
 #include "quat.h"
 #include "axisang.h"
 #include "effect-parser.h"
+#include "effect-cache.h"
 #include "effect.h"
 
 #ifdef near
@@ -253,6 +254,7 @@ void gs_destroy(graphics_t *graphics)
 	da_free(graphics->matrix_stack);
 	da_free(graphics->viewport_stack);
 	da_free(graphics->blend_state_stack);
+	bfree(graphics->effect_cache_dir);
 	if (graphics->module)
 		os_dlclose(graphics->module);
 	bfree(graphics);
@@ -806,9 +808,59 @@ static inline struct gs_effect *find_cached_effect(const char *filename)
 	return effect;
 }
 
+static void effect_add_to_cache(struct gs_effect *effect)
+{
+	pthread_mutex_lock(&thread_graphics->effect_mutex);
+
+	if (effect->effect_path) {
+		effect->cached = true;
+		effect->next = thread_graphics->first_effect;
+		thread_graphics->first_effect = effect;
+	}
+
+	pthread_mutex_unlock(&thread_graphics->effect_mutex);
+}
+
+static gs_effect_t *effect_create(const char *effect_string,
+				  const char *filename, const char *cache_file,
+				  char **error_string)
+{
+	struct gs_effect *effect = bzalloc(sizeof(struct gs_effect));
+	struct effect_parser parser;
+	bool success;
+
+	effect->graphics = thread_graphics;
+	effect->effect_path = bstrdup(filename);
+
+	if (gs_effect_cache_load(effect, cache_file, effect_string)) {
+		effect_add_to_cache(effect);
+		return effect;
+	}
+
+	ep_init(&parser);
+	success = ep_parse(&parser, effect, effect_string, filename);
+	if (!success) {
+		if (error_string)
+			*error_string =
+				error_data_buildstring(&parser.cfp.error_list);
+		gs_effect_destroy(effect);
+		effect = NULL;
+	}
+
+	if (effect) {
+		gs_effect_cache_save(effect, &parser, cache_file,
+				     effect_string);
+		effect_add_to_cache(effect);
+	}
+
+	ep_free(&parser);
+	return effect;
+}
+
 gs_effect_t *gs_effect_create_from_file(const char *file, char **error_string)
 {
 	char *file_string;
+	char *cache_file;
 	gs_effect_t *effect = NULL;
 
 	if (!gs_valid_p("gs_effect_create_from_file", file))
@@ -824,7 +876,10 @@ gs_effect_t *gs_effect_create_from_file(const char *file, char **error_string)
 		return NULL;
 	}
 
-	effect = gs_effect_create(file_string, file, error_string);
+	cache_file =
+		gs_effect_cache_file(thread_graphics->effect_cache_dir, file);
+	effect = effect_create(file_string, file, cache_file, error_string);
+	bfree(cache_file);
 	bfree(file_string);
 
 	return effect;
@@ -836,37 +891,19 @@ gs_effect_t *gs_effect_create(const char *effect_string, const char *filename,
 	if (!gs_valid_p("gs_effect_create", effect_string))
 		return NULL;
 
-	struct gs_effect *effect = bzalloc(sizeof(struct gs_effect));
-	struct effect_parser parser;
-	bool success;
-
-	effect->graphics = thread_graphics;
-	effect->effect_path = bstrdup(filename);
-
-	ep_init(&parser);
-	success = ep_parse(&parser, effect, effect_string, filename);
-	if (!success) {
-		if (error_string)
-			*error_string =
-				error_data_buildstring(&parser.cfp.error_list);
-		gs_effect_destroy(effect);
-		effect = NULL;
-	}
-
-	if (effect) {
-		pthread_mutex_lock(&thread_graphics->effect_mutex);
+	return effect_create(effect_string, filename, NULL, error_string);
+}
 
-		if (effect->effect_path) {
-			effect->cached = true;
-			effect->next = thread_graphics->first_effect;
-			thread_graphics->first_effect = effect;
-		}
+void gs_set_effect_cache_dir(const char *dir)
+{
+	if (!gs_valid("gs_set_effect_cache_dir"))
+		return;
 
-		pthread_mutex_unlock(&thread_graphics->effect_mutex);
-	}
+	bfree(thread_graphics->effect_cache_dir);
+	thread_graphics->effect_cache_dir = NULL;
 
-	ep_free(&parser);
-	return effect;
+	if (dir && *dir && os_mkdirs(dir) != MKDIR_ERROR)
+		thread_graphics->effect_cache_dir = bstrdup(dir);
 }
 
 gs_shader_t *gs_vertexshader_create_from_file(const char *file,
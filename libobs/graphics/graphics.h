@@ -575,6 +575,10 @@ EXPORT gs_effect_t *gs_effect_create_from_file(const char *file,
 EXPORT gs_effect_t *gs_effect_create(const char *effect_string,
 				     const char *filename, char **error_string);
 
+/** Sets the directory used to cache compiled effect files between runs.
+ * Pass NULL to disable the cache. */
+EXPORT void gs_set_effect_cache_dir(const char *dir);
+
 EXPORT gs_shader_t *gs_vertexshader_create_from_file(const char *file,
 						     char **error_string);
 EXPORT gs_shader_t *gs_pixelshader_create_from_file(const char *file,
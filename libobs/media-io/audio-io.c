@@ -72,6 +72,7 @@ struct audio_output {
 	os_event_t *stop_event;
 
 	bool initialized;
+	bool catch_up;
 
 	audio_input_callback_t input_cb;
 	void *input_param;
@@ -236,6 +237,11 @@ static void *audio_thread(void *param)
 		input_and_output(audio, audio_time, prev_time);
 		prev_time = audio_time;
 
+		while (audio->catch_up) {
+			audio->catch_up = false;
+			input_and_output(audio, audio_time, prev_time);
+		}
+
 		profile_end(audio_thread_name);
 
 		profile_reenable_thread();
@@ -433,6 +439,12 @@ const struct audio_output_info *audio_output_get_info(const audio_t *audio)
 	return audio ? &audio->info : NULL;
 }
 
+void audio_output_request_catch_up(audio_t *audio)
+{
+	if (audio)
+		audio->catch_up = true;
+}
+
 bool audio_output_active(const audio_t *audio)
 {
 	if (!audio)
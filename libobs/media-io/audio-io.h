@@ -222,6 +222,11 @@ EXPORT void audio_output_disconnect(audio_t *video, size_t mix_idx,
 
 EXPORT bool audio_output_active(const audio_t *audio);
 
+/* Makes the audio thread call the input callback once more right after the
+ * current call, without waiting for the next tick.  Only valid from within
+ * the input callback, used to catch up when the input lowers its latency. */
+EXPORT void audio_output_request_catch_up(audio_t *audio);
+
 EXPORT size_t audio_output_get_block_size(const audio_t *audio);
 EXPORT size_t audio_output_get_planes(const audio_t *audio);
 EXPORT size_t audio_output_get_channels(const audio_t *audio);
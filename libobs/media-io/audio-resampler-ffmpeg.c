@@ -18,10 +18,14 @@
 #include "../util/bmem.h"
 #include "audio-resampler.h"
 #include "audio-io.h"
+#include <math.h>
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
 
+/* limits how fast the compensation catches up with its error */
+#define MAX_COMPENSATION 0.005
+
 struct audio_resampler {
 	struct SwrContext *context;
 	bool opened;
@@ -37,6 +41,12 @@ struct audio_resampler {
 	uint32_t output_ch;
 	uint32_t output_freq;
 	uint32_t output_planes;
+
+	/* requested rate change, and requested minus produced samples */
+	bool compensating;
+	int comp_distance;
+	double comp_ratio;
+	double comp_error;
 };
 
 static inline enum AVSampleFormat convert_audio_format(enum audio_format format)
@@ -160,6 +170,41 @@ void audio_resampler_destroy(audio_resampler_t *rs)
 	}
 }
 
+/* libswresample applies compensation as an integer step of its phase
+ * increment, which is about 1000 ppm at the default phase count, so small
+ * corrections would be rounded to nothing.  instead, the compensation of
+ * each call also makes up for the samples the previous calls were off by,
+ * which switches between the nearest steps the resampler can do and
+ * averages out to the requested rate. */
+static void apply_compensation(audio_resampler_t *rs, uint32_t in_frames)
+{
+	double expected = (double)in_frames * (double)rs->output_freq /
+			  (double)rs->input_freq;
+	double ratio = rs->comp_ratio + rs->comp_error / expected;
+	int delta;
+
+	if (ratio > MAX_COMPENSATION)
+		ratio = MAX_COMPENSATION;
+	else if (ratio < -MAX_COMPENSATION)
+		ratio = -MAX_COMPENSATION;
+
+	delta = (int)lround(ratio * (double)rs->comp_distance);
+	if (swr_set_compensation(rs->context, delta, rs->comp_distance) < 0)
+		rs->compensating = false;
+}
+
+/* samples produced beyond what the consumed input amounts to at the
+ * nominal rate, delays are in nanoseconds of input */
+static inline double produced_extra(audio_resampler_t *rs, uint32_t in_frames,
+				    int64_t delay_before, int64_t delay_after,
+				    int out_frames)
+{
+	double consumed = (double)in_frames / (double)rs->input_freq +
+			  (double)(delay_before - delay_after) / 1000000000.0;
+
+	return (double)out_frames - consumed * (double)rs->output_freq;
+}
+
 bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
 			      uint32_t *out_frames, uint64_t *ts_offset,
 			      const uint8_t *const input[], uint32_t in_frames)
@@ -168,15 +213,20 @@ bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
 		return false;
 
 	struct SwrContext *context = rs->context;
+	int64_t delay_ns;
 	int ret;
 
+	if (rs->compensating && in_frames)
+		apply_compensation(rs, in_frames);
+
 	int64_t delay = swr_get_delay(context, rs->input_freq);
 	int estimated = (int)av_rescale_rnd(delay + (int64_t)in_frames,
 					    (int64_t)rs->output_freq,
 					    (int64_t)rs->input_freq,
 					    AV_ROUND_UP);
 
-	*ts_offset = (uint64_t)swr_get_delay(context, 1000000000);
+	delay_ns = swr_get_delay(context, 1000000000);
+	*ts_offset = (uint64_t)delay_ns;
 
 	/* resize the buffer if bigger */
 	if (estimated > rs->output_size) {
@@ -200,6 +250,38 @@ bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
 	for (uint32_t i = 0; i < rs->output_planes; i++)
 		output[i] = rs->output_buffer[i];
 
+	if (rs->compensating) {
+		int64_t delay_after = swr_get_delay(context, 1000000000);
+
+		rs->comp_error += (double)ret * rs->comp_ratio -
+				  produced_extra(rs, in_frames, delay_ns,
+						 delay_after, ret);
+	}
+
 	*out_frames = (uint32_t)ret;
 	return true;
 }
+
+bool audio_resampler_set_compensation(audio_resampler_t *rs, int sample_delta,
+				      int distance)
+{
+	if (!rs)
+		return false;
+
+	int ret = swr_set_compensation(rs->context, sample_delta, distance);
+	if (ret < 0) {
+		blog(LOG_ERROR, "swr_set_compensation failed: %d", ret);
+		rs->compensating = false;
+		return false;
+	}
+
+	/* the rate itself is applied by audio_resampler_resample */
+	rs->compensating = distance > 0;
+	rs->comp_distance = distance;
+	rs->comp_ratio = distance > 0 ? (double)sample_delta / (double)distance
+				      : 0.0;
+	if (!rs->compensating)
+		rs->comp_error = 0.0;
+
+	return true;
+}
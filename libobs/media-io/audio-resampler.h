@@ -44,6 +44,13 @@ EXPORT bool audio_resampler_resample(audio_resampler_t *resampler,
 				     const uint8_t *const input[],
 				     uint32_t in_frames);
 
+/* Changes the output rate by sample_delta samples per distance output
+ * samples, used to slowly correct clock drift.  The rate holds until changed
+ * again, a distance of 0 stops the correction.  Corrections finer than the
+ * resampler can do are averaged over the following calls to resample. */
+EXPORT bool audio_resampler_set_compensation(audio_resampler_t *resampler,
+					     int sample_delta, int distance);
+
 #ifdef __cplusplus
 }
 #endif
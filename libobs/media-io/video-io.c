@@ -41,23 +41,27 @@ struct cached_frame_info {
 	int count;
 };
 
-struct video_input {
+/* scaled/converted frames, shared by all inputs that request the same
+ * conversion so that each frame is only converted once per conversion */
+struct video_scale_cache {
 	struct video_scale_info conversion;
 	video_scaler_t *scaler;
 	struct video_frame frame[MAX_CONVERT_BUFFERS];
 	int cur_frame;
+	long refs;
+
+	uint64_t scaled_seq;
+	bool success;
+};
+
+struct video_input {
+	struct video_scale_info conversion;
+	struct video_scale_cache *cache;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
-
 struct video_output {
 	struct video_output_info info;
 
@@ -74,6 +78,8 @@ struct video_output {
 
 	pthread_mutex_t input_mutex;
 	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_scale_cache *) scale_caches;
+	uint64_t frame_seq;
 
 	size_t available_frames;
 	size_t first_added;
@@ -86,35 +92,42 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
+static inline bool scale_video_output(struct video_output *video,
+				      struct video_input *input,
 				      struct video_data *data)
 {
-	bool success = true;
+	struct video_scale_cache *cache = input->cache;
+	struct video_frame *frame;
 
-	if (input->scaler) {
-		struct video_frame *frame;
+	if (!cache)
+		return true;
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	/* the first input to ask for this conversion does the work */
+	if (cache->scaled_seq != video->frame_seq) {
+		if (++cache->cur_frame == MAX_CONVERT_BUFFERS)
+			cache->cur_frame = 0;
 
-		frame = &input->frame[input->cur_frame];
+		frame = &cache->frame[cache->cur_frame];
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+		cache->scaled_seq = video->frame_seq;
+		cache->success = video_scaler_scale(
+			cache->scaler, frame->data, frame->linesize,
+			(const uint8_t *const *)data->data, data->linesize);
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i] = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
+		if (!cache->success)
 			blog(LOG_WARNING, "video-io: Could not scale frame!");
+	}
+
+	if (cache->success) {
+		frame = &cache->frame[cache->cur_frame];
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			data->data[i] = frame->data[i];
+			data->linesize[i] = frame->linesize[i];
 		}
 	}
 
-	return success;
+	return cache->success;
 }
 
 static inline bool video_output_cur_frame(struct video_output *video)
@@ -135,11 +148,13 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->input_mutex);
 
+	video->frame_seq++;
+
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array + i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
+		if (scale_video_output(video, input, &frame))
 			input->callback(input->param, &frame);
 	}
 
@@ -201,6 +216,110 @@ static void *video_thread(void *param)
 
 /* ------------------------------------------------------------------------- */
 
+static bool match_range(enum video_range_type a, enum video_range_type b)
+{
+	return (a == VIDEO_RANGE_FULL) == (b == VIDEO_RANGE_FULL);
+}
+
+static enum video_colorspace collapse_space(enum video_colorspace cs)
+{
+	switch (cs) {
+	case VIDEO_CS_DEFAULT:
+	case VIDEO_CS_SRGB:
+		cs = VIDEO_CS_709;
+		break;
+	case VIDEO_CS_2100_HLG:
+		cs = VIDEO_CS_2100_PQ;
+	}
+
+	return cs;
+}
+
+static bool match_space(enum video_colorspace a, enum video_colorspace b)
+{
+	return collapse_space(a) == collapse_space(b);
+}
+
+static inline bool match_conversion(const struct video_scale_info *a,
+				    const struct video_scale_info *b)
+{
+	return a->width == b->width && a->height == b->height &&
+	       a->format == b->format && match_range(a->range, b->range) &&
+	       match_space(a->colorspace, b->colorspace);
+}
+
+static void video_scale_cache_free(struct video_scale_cache *cache)
+{
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&cache->frame[i]);
+	video_scaler_destroy(cache->scaler);
+	bfree(cache);
+}
+
+static struct video_scale_cache *
+video_scale_cache_acquire(struct video_output *video,
+			  const struct video_scale_info *conversion)
+{
+	struct video_scale_cache *cache;
+	struct video_scale_info from = {.format = video->info.format,
+					.width = video->info.width,
+					.height = video->info.height,
+					.range = video->info.range,
+					.colorspace = video->info.colorspace};
+	int ret;
+
+	for (size_t i = 0; i < video->scale_caches.num; i++) {
+		cache = video->scale_caches.array[i];
+
+		if (match_conversion(&cache->conversion, conversion)) {
+			cache->refs++;
+			return cache;
+		}
+	}
+
+	cache = bzalloc(sizeof(struct video_scale_cache));
+	cache->conversion = *conversion;
+	cache->refs = 1;
+
+	ret = video_scaler_create(&cache->scaler, conversion, &from,
+				  VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		bfree(cache);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_init(&cache->frame[i], conversion->format,
+				 conversion->width, conversion->height);
+
+	da_push_back(video->scale_caches, &cache);
+	return cache;
+}
+
+static void video_scale_cache_release(struct video_output *video,
+				      struct video_scale_cache *cache)
+{
+	if (!cache || --cache->refs > 0)
+		return;
+
+	da_erase_item(video->scale_caches, &cache);
+	video_scale_cache_free(cache);
+}
+
+static inline void video_input_free(struct video_output *video,
+				    struct video_input *input)
+{
+	video_scale_cache_release(video, input->cache);
+	input->cache = NULL;
+}
+
 static inline bool valid_video_params(const struct video_output_info *info)
 {
 	return info->height != 0 && info->width != 0 && info->fps_den != 0 &&
@@ -273,8 +392,9 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video, &video->inputs.array[i]);
 	da_free(video->inputs);
+	da_free(video->scale_caches);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame *)&video->cache[i]);
@@ -296,30 +416,6 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
-static bool match_range(enum video_range_type a, enum video_range_type b)
-{
-	return (a == VIDEO_RANGE_FULL) == (b == VIDEO_RANGE_FULL);
-}
-
-static enum video_colorspace collapse_space(enum video_colorspace cs)
-{
-	switch (cs) {
-	case VIDEO_CS_DEFAULT:
-	case VIDEO_CS_SRGB:
-		cs = VIDEO_CS_709;
-		break;
-	case VIDEO_CS_2100_HLG:
-		cs = VIDEO_CS_2100_PQ;
-	}
-
-	return cs;
-}
-
-static bool match_space(enum video_colorspace a, enum video_colorspace b)
-{
-	return collapse_space(a) == collapse_space(b);
-}
-
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
@@ -329,32 +425,10 @@ static inline bool video_input_init(struct video_input *input,
 	    !match_range(input->conversion.range, video->info.range) ||
 	    !match_space(input->conversion.colorspace,
 			 video->info.colorspace)) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
+		input->cache =
+			video_scale_cache_acquire(video, &input->conversion);
+		if (!input->cache)
 			return false;
-		}
-
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					 input->conversion.format,
-					 input->conversion.width,
-					 input->conversion.height);
 	}
 
 	return true;
@@ -443,7 +517,7 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		video_input_free(video, video->inputs.array + idx);
 		da_erase(video->inputs, idx);
 
 		if (video->inputs.num == 0) {
@@ -16,18 +16,60 @@
 ******************************************************************************/
 
 #include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
 #include "video-scaler.h"
 
+#include <libavutil/frame.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 
+/* output slices (sws_receive_slice) are needed to split the image into
+ * bands that are scaled by separate contexts */
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+#define SCALER_BANDS 1
+#else
+#define SCALER_BANDS 0
+#endif
+
+#define MAX_BANDS 4
+#define MIN_BAND_PIXELS (2560 * 1440)
+
+struct video_scaler;
+
+struct scaler_band {
+	struct video_scaler *scaler;
+	struct SwsContext *swscale;
+	pthread_t thread;
+	bool thread_active;
+	os_sem_t *start;
+	unsigned int start_y;
+	unsigned int height;
+	int ret;
+};
+
 struct video_scaler {
 	struct SwsContext *swscale;
 	int src_height;
 	int dst_heights[4];
 	uint8_t *dst_pointers[4];
 	int dst_linesizes[4];
+	int dst_size;
+
+	/* the calling thread scales the first band, every other band has a
+	 * thread and context of its own */
+	struct video_scale_info src;
+	struct video_scale_info dst;
+	int scale_type;
+
+	size_t num_bands;
+	struct scaler_band bands[MAX_BANDS];
+	os_sem_t *bands_done;
+	AVFrame *src_frame;
+	AVFrame *dst_frame;
+	bool bands_failed;
+	volatile bool stop;
 };
 
 static inline enum AVPixelFormat
@@ -143,6 +185,275 @@ static inline int get_ffmpeg_range_type(enum video_range_type type)
 
 #define FIXED_1_0 (1 << 16)
 
+static struct SwsContext *create_swscale(const struct video_scale_info *dst,
+					 const struct video_scale_info *src,
+					 int scale_type)
+{
+	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
+	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
+	const int *coeff_src = get_ffmpeg_coeffs(src->colorspace);
+	const int *coeff_dst = get_ffmpeg_coeffs(dst->colorspace);
+	int range_src = get_ffmpeg_range_type(src->range);
+	int range_dst = get_ffmpeg_range_type(dst->range);
+	struct SwsContext *swscale;
+	int ret;
+
+	swscale = sws_alloc_context();
+	if (!swscale) {
+		blog(LOG_ERROR, "video_scaler_create: Could not create "
+				"swscale");
+		return NULL;
+	}
+
+	av_opt_set_int(swscale, "sws_flags", scale_type, 0);
+	av_opt_set_int(swscale, "srcw", src->width, 0);
+	av_opt_set_int(swscale, "srch", src->height, 0);
+	av_opt_set_int(swscale, "dstw", dst->width, 0);
+	av_opt_set_int(swscale, "dsth", dst->height, 0);
+	av_opt_set_int(swscale, "src_format", format_src, 0);
+	av_opt_set_int(swscale, "dst_format", format_dst, 0);
+	av_opt_set_int(swscale, "src_range", range_src, 0);
+	av_opt_set_int(swscale, "dst_range", range_dst, 0);
+	if (sws_init_context(swscale, NULL, NULL) < 0) {
+		blog(LOG_ERROR, "video_scaler_create: sws_init_context failed");
+		sws_freeContext(swscale);
+		return NULL;
+	}
+
+	ret = sws_setColorspaceDetails(swscale, coeff_src, range_src, coeff_dst,
+				       range_dst, 0, FIXED_1_0, FIXED_1_0);
+	if (ret < 0) {
+		blog(LOG_DEBUG, "video_scaler_create: "
+				"sws_setColorspaceDetails failed, ignoring");
+	}
+
+	return swscale;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#if SCALER_BANDS
+static void free_unowned(void *opaque, uint8_t *data)
+{
+	UNUSED_PARAMETER(opaque);
+	UNUSED_PARAMETER(data);
+}
+
+/* wraps memory we own in an AVFrame so that sws_frame_start references it
+ * instead of copying it */
+static bool wrap_frame(AVFrame *frame, const struct video_scale_info *info,
+		       uint8_t *const data[], const int linesize[], int size)
+{
+	frame->format = get_ffmpeg_video_format(info->format);
+	frame->width = (int)info->width;
+	frame->height = (int)info->height;
+
+	for (size_t i = 0; i < 4; i++) {
+		frame->data[i] = data[i];
+		frame->linesize[i] = linesize[i];
+	}
+
+	frame->buf[0] =
+		av_buffer_create(data[0], size, free_unowned, NULL, 0);
+	return frame->buf[0] != NULL;
+}
+
+static int scale_band(struct video_scaler *scaler, struct scaler_band *band)
+{
+	int ret = sws_frame_start(band->swscale, scaler->dst_frame,
+				  scaler->src_frame);
+	if (ret >= 0)
+		ret = sws_send_slice(band->swscale, 0,
+				     (unsigned int)scaler->src_height);
+	if (ret >= 0)
+		ret = sws_receive_slice(band->swscale, band->start_y,
+					band->height);
+
+	sws_frame_end(band->swscale);
+	return ret;
+}
+
+static void *band_thread(void *data)
+{
+	struct scaler_band *band = data;
+	struct video_scaler *scaler = band->scaler;
+
+	os_set_thread_name("video-scaler: band thread");
+
+	while (os_sem_wait(band->start) == 0) {
+		if (scaler->stop)
+			break;
+
+		band->ret = scale_band(scaler, band);
+		os_sem_post(scaler->bands_done);
+	}
+
+	return NULL;
+}
+
+static void free_bands(struct video_scaler *scaler)
+{
+	scaler->stop = true;
+
+	for (size_t i = 1; i < scaler->num_bands; i++) {
+		struct scaler_band *band = &scaler->bands[i];
+
+		if (band->thread_active) {
+			os_sem_post(band->start);
+			pthread_join(band->thread, NULL);
+		}
+
+		os_sem_destroy(band->start);
+		sws_freeContext(band->swscale);
+	}
+
+	os_sem_destroy(scaler->bands_done);
+	av_frame_free(&scaler->src_frame);
+	av_frame_free(&scaler->dst_frame);
+
+	memset(scaler->bands, 0, sizeof(scaler->bands));
+	scaler->bands_done = NULL;
+	scaler->num_bands = 0;
+	scaler->stop = false;
+}
+
+static bool init_bands(struct video_scaler *scaler, size_t num_bands)
+{
+	unsigned int dst_height = (unsigned int)scaler->dst.height;
+	unsigned int align = sws_receive_slice_alignment(scaler->swscale);
+	unsigned int band_height = dst_height / (unsigned int)num_bands;
+	unsigned int y = 0;
+
+	band_height -= band_height % align;
+	if (!band_height)
+		return false;
+
+	scaler->num_bands = num_bands;
+	scaler->src_frame = av_frame_alloc();
+	scaler->dst_frame = av_frame_alloc();
+	if (!scaler->src_frame || !scaler->dst_frame)
+		return false;
+	if (os_sem_init(&scaler->bands_done, 0) != 0)
+		return false;
+	if (!wrap_frame(scaler->dst_frame, &scaler->dst, scaler->dst_pointers,
+			scaler->dst_linesizes, scaler->dst_size))
+		return false;
+
+	for (size_t i = 0; i < num_bands; i++) {
+		struct scaler_band *band = &scaler->bands[i];
+
+		band->scaler = scaler;
+		band->start_y = y;
+		band->height = i == num_bands - 1 ? dst_height - y
+						  : band_height;
+		y += band->height;
+
+		/* the first band is scaled by the calling thread */
+		if (i == 0) {
+			band->swscale = scaler->swscale;
+			continue;
+		}
+
+		band->swscale = create_swscale(&scaler->dst, &scaler->src,
+					       scaler->scale_type);
+		if (!band->swscale)
+			return false;
+		if (os_sem_init(&band->start, 0) != 0)
+			return false;
+		if (pthread_create(&band->thread, NULL, band_thread, band) != 0)
+			return false;
+		band->thread_active = true;
+	}
+
+	return true;
+}
+
+static bool scale_bands(struct video_scaler *scaler,
+			const uint8_t *const input[],
+			const uint32_t in_linesize[])
+{
+	int linesize[4];
+	bool success = true;
+
+	for (size_t i = 0; i < 4; i++)
+		linesize[i] = (int)in_linesize[i];
+
+	/* the buffer size is only informational, the frame is never written
+	 * to through the reference */
+	if (!wrap_frame(scaler->src_frame, &scaler->src, (uint8_t *const *)input,
+			linesize, 1))
+		return false;
+
+	for (size_t i = 1; i < scaler->num_bands; i++)
+		os_sem_post(scaler->bands[i].start);
+
+	scaler->bands[0].ret = scale_band(scaler, &scaler->bands[0]);
+
+	for (size_t i = 1; i < scaler->num_bands; i++)
+		os_sem_wait(scaler->bands_done);
+
+	av_frame_unref(scaler->src_frame);
+
+	for (size_t i = 0; i < scaler->num_bands; i++) {
+		if (scaler->bands[i].ret < 0) {
+			blog(LOG_WARNING,
+			     "video_scaler_scale: band %d failed: %d, "
+			     "falling back to single threaded scaling",
+			     (int)i, scaler->bands[i].ret);
+			success = false;
+		}
+	}
+
+	return success;
+}
+#endif
+
+static size_t default_num_bands(const struct video_scale_info *src)
+{
+	int cores = os_get_logical_cores() / 2;
+
+	if (src->width * src->height < MIN_BAND_PIXELS || cores < 2)
+		return 1;
+	return cores < MAX_BANDS ? (size_t)cores : MAX_BANDS;
+}
+
+void video_scaler_set_threads(video_scaler_t *scaler, int threads)
+{
+	if (!scaler)
+		return;
+
+#if SCALER_BANDS
+	if (scaler->num_bands)
+		free_bands(scaler);
+
+	scaler->bands_failed = false;
+
+	if (threads > MAX_BANDS)
+		threads = MAX_BANDS;
+	if (threads > 1 && !init_bands(scaler, (size_t)threads)) {
+		blog(LOG_WARNING, "video_scaler_set_threads: Failed to "
+				  "initialize scaler bands");
+		free_bands(scaler);
+	}
+#else
+	UNUSED_PARAMETER(threads);
+#endif
+}
+
+int video_scaler_get_threads(const video_scaler_t *scaler)
+{
+	if (!scaler)
+		return 0;
+
+#if SCALER_BANDS
+	if (scaler->num_bands > 1 && !scaler->bands_failed)
+		return (int)scaler->num_bands;
+#endif
+	return 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
 int video_scaler_create(video_scaler_t **scaler_out,
 			const struct video_scale_info *dst,
 			const struct video_scale_info *src,
@@ -151,10 +462,6 @@ int video_scaler_create(video_scaler_t **scaler_out,
 	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
 	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
 	int scale_type = get_ffmpeg_scale_type(type);
-	const int *coeff_src = get_ffmpeg_coeffs(src->colorspace);
-	const int *coeff_dst = get_ffmpeg_coeffs(dst->colorspace);
-	int range_src = get_ffmpeg_range_type(src->range);
-	int range_dst = get_ffmpeg_range_type(dst->range);
 	struct video_scaler *scaler;
 	int ret;
 
@@ -166,6 +473,9 @@ int video_scaler_create(video_scaler_t **scaler_out,
 
 	scaler = bzalloc(sizeof(struct video_scaler));
 	scaler->src_height = src->height;
+	scaler->src = *src;
+	scaler->dst = *dst;
+	scaler->scale_type = scale_type;
 
 	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format_dst);
 	bool has_plane[4] = {0};
@@ -188,35 +498,13 @@ int video_scaler_create(video_scaler_t **scaler_out,
 		     "video_scaler_create: av_image_alloc failed: %d", ret);
 		goto fail;
 	}
+	scaler->dst_size = ret;
 
-	scaler->swscale = sws_alloc_context();
-	if (!scaler->swscale) {
-		blog(LOG_ERROR, "video_scaler_create: Could not create "
-				"swscale");
+	scaler->swscale = create_swscale(dst, src, scale_type);
+	if (!scaler->swscale)
 		goto fail;
-	}
 
-	av_opt_set_int(scaler->swscale, "sws_flags", scale_type, 0);
-	av_opt_set_int(scaler->swscale, "srcw", src->width, 0);
-	av_opt_set_int(scaler->swscale, "srch", src->height, 0);
-	av_opt_set_int(scaler->swscale, "dstw", dst->width, 0);
-	av_opt_set_int(scaler->swscale, "dsth", dst->height, 0);
-	av_opt_set_int(scaler->swscale, "src_format", format_src, 0);
-	av_opt_set_int(scaler->swscale, "dst_format", format_dst, 0);
-	av_opt_set_int(scaler->swscale, "src_range", range_src, 0);
-	av_opt_set_int(scaler->swscale, "dst_range", range_dst, 0);
-	if (sws_init_context(scaler->swscale, NULL, NULL) < 0) {
-		blog(LOG_ERROR, "video_scaler_create: sws_init_context failed");
-		goto fail;
-	}
-
-	ret = sws_setColorspaceDetails(scaler->swscale, coeff_src, range_src,
-				       coeff_dst, range_dst, 0, FIXED_1_0,
-				       FIXED_1_0);
-	if (ret < 0) {
-		blog(LOG_DEBUG, "video_scaler_create: "
-				"sws_setColorspaceDetails failed, ignoring");
-	}
+	video_scaler_set_threads(scaler, (int)default_num_bands(src));
 
 	*scaler_out = scaler;
 	return VIDEO_SCALER_SUCCESS;
@@ -229,6 +517,10 @@ fail:
 void video_scaler_destroy(video_scaler_t *scaler)
 {
 	if (scaler) {
+#if SCALER_BANDS
+		if (scaler->num_bands)
+			free_bands(scaler);
+#endif
 		sws_freeContext(scaler->swscale);
 
 		if (scaler->dst_pointers[0])
@@ -243,16 +535,29 @@ bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
 			const uint8_t *const input[],
 			const uint32_t in_linesize[])
 {
+	bool scaled = false;
+
 	if (!scaler)
 		return false;
 
-	int ret = sws_scale(scaler->swscale, input, (const int *)in_linesize, 0,
-			    scaler->src_height, scaler->dst_pointers,
-			    scaler->dst_linesizes);
-	if (ret <= 0) {
-		blog(LOG_ERROR, "video_scaler_scale: sws_scale failed: %d",
-		     ret);
-		return false;
+#if SCALER_BANDS
+	if (scaler->num_bands > 1 && !scaler->bands_failed) {
+		scaled = scale_bands(scaler, input, in_linesize);
+		if (!scaled)
+			scaler->bands_failed = true;
+	}
+#endif
+
+	if (!scaled) {
+		int ret = sws_scale(scaler->swscale, input,
+				    (const int *)in_linesize, 0,
+				    scaler->src_height, scaler->dst_pointers,
+				    scaler->dst_linesizes);
+		if (ret <= 0) {
+			blog(LOG_ERROR,
+			     "video_scaler_scale: sws_scale failed: %d", ret);
+			return false;
+		}
 	}
 
 	for (size_t plane = 0; plane < 4; ++plane) {
@@ -37,6 +37,13 @@ EXPORT int video_scaler_create(video_scaler_t **scaler,
 			       enum video_scale_type type);
 EXPORT void video_scaler_destroy(video_scaler_t *scaler);
 
+/* number of threads (image bands) used to scale each frame, 1 to scale on
+ * the calling thread only.  Large images use multiple threads by default. */
+EXPORT void video_scaler_set_threads(video_scaler_t *scaler, int threads);
+/* number of threads actually scaling each frame, 1 if the image could not be
+ * split into bands or a band failed to scale */
+EXPORT int video_scaler_get_threads(const video_scaler_t *scaler);
+
 EXPORT bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
 			       const uint32_t out_linesize[],
 			       const uint8_t *const input[],
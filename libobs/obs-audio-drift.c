@@ -0,0 +1,63 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include "obs-audio-drift.h"
+
+/* the gains are kept low because capture timestamps jitter by milliseconds,
+ * while device clocks only drift by microseconds per second */
+#define MAX_DRIFT_PPM 1000.0
+#define DRIFT_ENGAGE_PPM 20.0
+#define DRIFT_KP 10000.0
+#define DRIFT_KI 25.0
+#define DRIFT_SMOOTHING 0.01
+
+bool audio_drift_update(struct audio_drift *drift, int64_t err_ns,
+			uint32_t frames, size_t sample_rate)
+{
+	double err = (double)err_ns / 1000000000.0;
+	double dt = (double)frames / (double)sample_rate;
+	double max_integral = MAX_DRIFT_PPM / DRIFT_KI;
+	bool engaged = false;
+	double ppm;
+
+	drift->err += (err - drift->err) * DRIFT_SMOOTHING;
+	drift->integral += drift->err * dt;
+
+	if (drift->integral > max_integral)
+		drift->integral = max_integral;
+	else if (drift->integral < -max_integral)
+		drift->integral = -max_integral;
+
+	if (!drift->compensating) {
+		if (fabs(DRIFT_KI * drift->integral) < DRIFT_ENGAGE_PPM)
+			return false;
+
+		drift->compensating = true;
+		engaged = true;
+	}
+
+	ppm = DRIFT_KP * drift->err + DRIFT_KI * drift->integral;
+
+	if (ppm > MAX_DRIFT_PPM)
+		ppm = MAX_DRIFT_PPM;
+	else if (ppm < -MAX_DRIFT_PPM)
+		ppm = -MAX_DRIFT_PPM;
+
+	drift->ppm = ppm;
+	return engaged;
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Clock drift controller for async audio.
+ *
+ * Estimates how fast the clock of an audio device runs compared to
+ * os_gettime_ns from the difference between the timestamps of its packets and
+ * the timestamps their sample count predicts.  The result is a correction in
+ * ppm of the output sample rate, applied through the source's resampler so
+ * that the prediction keeps up with the timestamps.
+ */
+
+/* number of seconds a correction is spread over, see audio_drift_get_delta */
+#define AUDIO_DRIFT_DISTANCE_SEC 10
+
+struct audio_drift {
+	double err;
+	double integral;
+	double ppm;
+	double remainder;
+	bool compensating;
+};
+
+/* feeds the prediction error of a packet, returns true when compensation
+ * was engaged by this packet */
+extern bool audio_drift_update(struct audio_drift *drift, int64_t err_ns,
+			       uint32_t frames, size_t sample_rate);
+
+/* forgets the current error once the timing was reset, the estimate of the
+ * device clock itself is kept */
+static inline void audio_drift_reset_error(struct audio_drift *drift)
+{
+	drift->err = 0.0;
+}
+
+/* converts a correction to the sample delta over distance samples passed to
+ * audio_resampler_set_compensation.  only whole samples can be passed, the
+ * rest is carried in remainder and added to the next delta. */
+static inline int audio_drift_get_delta(double ppm, int distance,
+					double *remainder)
+{
+	double samples = ppm * (double)distance / 1000000.0 + *remainder;
+	int delta = (int)(samples < 0.0 ? samples - 0.5 : samples + 0.5);
+
+	*remainder = samples - (double)delta;
+	return delta;
+}
+
+#ifdef __cplusplus
+}
+#endif
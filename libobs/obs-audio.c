@@ -158,7 +158,7 @@ static bool ignore_audio(obs_source_t *source, size_t channels,
 	source->audio_ts = 0;
 	/* tell the timestamp adjustment code in source_output_audio_data to
 	 * reset everything, and hopefully fix the timestamps */
-	source->timing_set = false;
+	obs_source_request_audio_timing_reset(source, true, 0, 0);
 	return false;
 }
 
@@ -308,6 +308,20 @@ static inline bool audio_buffering_maxed(struct obs_core_audio *audio)
 	return audio->total_buffering_ticks == audio->max_buffering_ticks;
 }
 
+static void buffering_changed(struct obs_core_audio *audio, size_t sample_rate,
+			      bool increased)
+{
+	size_t total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES *
+			  1000 / sample_rate;
+
+	os_atomic_set_long(&audio->buffering_ms, (long)total_ms);
+	os_atomic_inc_long(increased ? &audio->buffering_increases
+				     : &audio->buffering_decreases);
+
+	audio->stable_ticks = 0;
+	audio->min_headroom = INT64_MAX;
+}
+
 static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 				      size_t sample_rate, struct ts_info *ts)
 {
@@ -323,6 +337,7 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 
 	ticks = audio->max_buffering_ticks - audio->total_buffering_ticks;
 	audio->total_buffering_ticks += ticks;
+	buffering_changed(audio, sample_rate, true);
 
 	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
 		   sample_rate;
@@ -388,6 +403,8 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 		blog(LOG_WARNING, "Max audio buffering reached!");
 	}
 
+	buffering_changed(audio, sample_rate, true);
+
 	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
 	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
 		   sample_rate;
@@ -432,6 +449,80 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	*ts = new_ts;
 }
 
+/* Lowers buffering by a tick once every source had at least two ticks of audio
+ * queued beyond the tick being mixed for the whole configured period.  The
+ * removed tick is caught up on by mixing the next buffered tick right away,
+ * so the output stays continuous. */
+static void shrink_audio_buffering(struct obs_core_audio *audio,
+				   size_t sample_rate, int64_t headroom)
+{
+	const int64_t tick_ns =
+		(int64_t)audio_frames_to_ns(sample_rate, AUDIO_OUTPUT_FRAMES);
+
+	if (headroom < audio->min_headroom)
+		audio->min_headroom = headroom;
+
+	os_atomic_set_long(&audio->headroom_ms,
+			   audio->min_headroom == INT64_MAX
+				   ? 0
+				   : (long)(audio->min_headroom / 1000000));
+
+	if (!audio->shrink_buffering_ticks || audio->fixed_buffer)
+		return;
+
+	/* any tick with too little headroom starts the period over */
+	if (headroom == INT64_MAX || headroom < 2 * tick_ns) {
+		audio->stable_ticks = 0;
+		return;
+	}
+
+	if (!audio->total_buffering_ticks ||
+	    ++audio->stable_ticks < audio->shrink_buffering_ticks)
+		return;
+
+	audio->total_buffering_ticks--;
+	audio->catching_up = true;
+	audio_output_request_catch_up(audio->audio);
+	buffering_changed(audio, sample_rate, false);
+
+	blog(LOG_INFO,
+	     "removing %d milliseconds of audio buffering, total "
+	     "audio buffering is now %d milliseconds",
+	     (int)(tick_ns / 1000000),
+	     (int)os_atomic_load_long(&audio->buffering_ms));
+}
+
+/* how far the source with the least audio queued is ahead of the end of the
+ * current tick, INT64_MAX if no source is active.  an active source that is
+ * waiting for audio or has less than a tick queued has no headroom. */
+static int64_t find_min_headroom(struct obs_core_data *data,
+				 size_t sample_rate, const struct ts_info *ts)
+{
+	int64_t min_headroom = INT64_MAX;
+
+	struct obs_source *source = data->first_audio_source;
+	while (source) {
+		size_t frames = source->audio_input_buf[0].size / sizeof(float);
+
+		if (!source->info.audio_render && source->audio_ts) {
+			uint64_t end = source->audio_ts +
+				       audio_frames_to_ns(sample_rate, frames);
+			int64_t headroom = (int64_t)(end - ts->end);
+
+			if ((source->audio_pending ||
+			     frames < AUDIO_OUTPUT_FRAMES) &&
+			    headroom > 0)
+				headroom = 0;
+			if (headroom < min_headroom)
+				min_headroom = headroom;
+		}
+
+		source = (struct obs_source *)source->next_audio_source;
+	}
+
+	return min_headroom;
+}
+
 static bool audio_buffer_insuffient(struct obs_source *source,
 				    size_t sample_rate, uint64_t min_ts)
 {
@@ -542,7 +633,12 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	da_resize(audio->render_order, 0);
 	da_resize(audio->root_nodes, 0);
 
-	circlebuf_push_back(&audio->buffered_timestamps, &ts, sizeof(ts));
+	/* when catching up, the next buffered tick is mixed instead */
+	if (audio->catching_up)
+		audio->catching_up = false;
+	else
+		circlebuf_push_back(&audio->buffered_timestamps, &ts,
+				    sizeof(ts));
 	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
 	min_ts = ts.start;
 
@@ -576,6 +672,16 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	pthread_mutex_unlock(&data->audio_sources_mutex);
 
+	/* ------------------------------------------------ */
+	/* move queued audio into source buffers */
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+
+		pthread_mutex_lock(&source->audio_buf_mutex);
+		obs_source_flush_audio_queue(source);
+		pthread_mutex_unlock(&source->audio_buf_mutex);
+	}
+
 	/* ------------------------------------------------ */
 	/* render audio data */
 	for (size_t i = 0; i < audio->render_order.num; i++) {
@@ -620,6 +726,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	/* get minimum audio timestamp */
 	pthread_mutex_lock(&data->audio_sources_mutex);
 	const char *buffering_name = calc_min_ts(data, sample_rate, &min_ts);
+	int64_t headroom = find_min_headroom(data, sample_rate, &ts);
 	pthread_mutex_unlock(&data->audio_sources_mutex);
 
 	/* ------------------------------------------------ */
@@ -659,6 +766,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	source = data->first_audio_source;
 	while (source) {
 		pthread_mutex_lock(&source->audio_buf_mutex);
+		obs_source_flush_audio_queue(source);
 		discard_audio(audio, source, channels, sample_rate, &ts);
 		pthread_mutex_unlock(&source->audio_buf_mutex);
 
@@ -675,11 +783,14 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	*out_ts = ts.start;
 
+	OBS_LATENCY_TRACE(OBS_LATENCY_AUDIO, ts.start, OBS_LATENCY_OUTPUT);
+
 	if (audio->buffering_wait_ticks) {
 		audio->buffering_wait_ticks--;
 		return false;
 	}
 
+	shrink_audio_buffering(audio, sample_rate, headroom);
 	execute_audio_tasks();
 
 	UNUSED_PARAMETER(param);
@@ -94,18 +94,25 @@ void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 {
 	struct array_output_data output;
 	struct serializer s;
-	long ref = 1;
+	long *p_refs;
 
 	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
-	serialize(&s, &ref, sizeof(ref));
 	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
 			   &avc_packet->priority);
 
-	avc_packet->data = output.bytes.array + sizeof(ref);
-	avc_packet->size = output.bytes.num - sizeof(ref);
+	/* parsed packets are released with obs_encoder_packet_release, so
+	 * they have to come from the packet pool */
+	p_refs = bpool_alloc(sizeof(long) + output.bytes.num);
+	*p_refs = 1;
+	memcpy(p_refs + 1, output.bytes.array, output.bytes.num);
+
+	avc_packet->data = (uint8_t *)(p_refs + 1);
+	avc_packet->size = output.bytes.num;
 	avc_packet->drop_priority = avc_packet->priority;
+
+	array_output_serializer_free(&output);
 }
 
 int obs_parse_avc_packet_priority(const struct encoder_packet *packet)
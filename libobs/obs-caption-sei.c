@@ -0,0 +1,150 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <caption/caption.h>
+#include <caption/mpeg.h>
+
+#include "util/bmem.h"
+#include "util/threading.h"
+#include "obs.h"
+#include "obs-caption-sei.h"
+
+struct caption_sei {
+	caption_frame_t frame;
+	sei_t sei;
+
+	/* the message used for every CEA-608 SEI, never freed with the SEI */
+	sei_message_t *cc_msg;
+};
+
+static const uint8_t nal_start[4] = {0, 0, 0, 1};
+
+caption_sei_t *caption_sei_create(void)
+{
+	caption_sei_t *cs = bzalloc(sizeof(*cs));
+
+	sei_init(&cs->sei, 0.0);
+	cs->cc_msg = sei_message_new(sei_type_user_data_registered_itu_t_t35,
+				     0, CEA608_MAX_SIZE);
+	return cs;
+}
+
+static void clear_sei(caption_sei_t *cs)
+{
+	if (cs->sei.head == cs->cc_msg) {
+		cs->cc_msg->next = NULL;
+		sei_init(&cs->sei, 0.0);
+	} else {
+		sei_free(&cs->sei);
+	}
+}
+
+void caption_sei_destroy(caption_sei_t *cs)
+{
+	if (!cs)
+		return;
+
+	clear_sei(cs);
+	sei_message_free(cs->cc_msg);
+	bfree(cs);
+}
+
+bool caption_sei_build_cc_data(caption_sei_t *cs, struct circlebuf *cc_data)
+{
+	cea708_t cea708;
+	uint8_t triplet[3];
+
+	clear_sei(cs);
+	cea708_init(&cea708, 0); // set up a new popon frame
+
+	while (cc_data->size >= sizeof(triplet)) {
+		circlebuf_pop_front(cc_data, triplet, sizeof(triplet));
+
+		// only send cea 608
+		if ((triplet[0] & 0x3) != 0)
+			continue;
+
+		uint16_t data = (uint16_t)((triplet[1] << 8) | triplet[2]);
+
+		// padding
+		if (data == 0x8080 || data == 0)
+			continue;
+
+		if (!eia608_parity_varify(data))
+			continue;
+
+		cea708_add_cc_data(&cea708, 1, triplet[0] & 0x3, data);
+	}
+
+	if (cc_data->size)
+		circlebuf_pop_front(cc_data, NULL, cc_data->size);
+
+	cs->cc_msg->size = cea708_render(&cea708, sei_message_data(cs->cc_msg),
+					 CEA608_MAX_SIZE);
+	sei_message_append(&cs->sei, cs->cc_msg);
+	return true;
+}
+
+bool caption_sei_build_text(caption_sei_t *cs, const char *text)
+{
+	clear_sei(cs);
+
+	caption_frame_init(&cs->frame);
+	caption_frame_from_text(&cs->frame, text);
+
+	return sei_from_caption_frame(&cs->sei, &cs->frame) == LIBCAPTION_OK;
+}
+
+bool caption_sei_append(caption_sei_t *cs, struct encoder_packet *packet)
+{
+	size_t needed = sei_render_size(&cs->sei);
+	long *p_refs = ((long *)packet->data) - 1;
+	size_t capacity = bpool_block_size(p_refs);
+	uint8_t *pos;
+
+	if (!needed)
+		return false;
+
+	needed += sizeof(nal_start);
+
+	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
+	if (os_atomic_load_long(p_refs) == 1 &&
+	    capacity >= sizeof(long) + packet->size + needed) {
+		pos = packet->data + packet->size;
+		memcpy(pos, nal_start, sizeof(nal_start));
+		packet->size += sizeof(nal_start) +
+				sei_render(&cs->sei, pos + sizeof(nal_start));
+		return true;
+	}
+
+	struct encoder_packet backup = *packet;
+	long *new_refs = bpool_alloc(sizeof(long) + packet->size + needed);
+	uint8_t *data = (uint8_t *)(new_refs + 1);
+
+	*new_refs = 1;
+	memcpy(data, packet->data, packet->size);
+
+	pos = data + packet->size;
+	memcpy(pos, nal_start, sizeof(nal_start));
+	backup.size += sizeof(nal_start) +
+		       sei_render(&cs->sei, pos + sizeof(nal_start));
+	backup.data = data;
+
+	obs_encoder_packet_release(packet);
+	*packet = backup;
+	return false;
+}
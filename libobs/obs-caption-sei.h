@@ -0,0 +1,60 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/c99defs.h"
+#include "util/circlebuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CEA-708 caption SEI encoding for video packets.
+ *
+ * Every output keeps one context, so that encoding the SEI of a packet reuses
+ * the same caption frame and SEI message instead of allocating them for every
+ * video packet.  The SEI is written into spare room after the packet data when
+ * the packet's buffer has enough of it, which outputs with captions make sure
+ * of by creating their video packets with CAPTION_SEI_HEADROOM extra bytes.
+ */
+
+/* fits any SEI made from CEA-608 data and most caption texts */
+#define CAPTION_SEI_HEADROOM 1024
+
+struct encoder_packet;
+struct caption_sei;
+typedef struct caption_sei caption_sei_t;
+
+caption_sei_t *caption_sei_create(void);
+void caption_sei_destroy(caption_sei_t *cs);
+
+/* builds the SEI from the CEA-608 triplets queued in cc_data, emptying it */
+bool caption_sei_build_cc_data(caption_sei_t *cs, struct circlebuf *cc_data);
+
+/* builds the SEI for a caption text */
+bool caption_sei_build_text(caption_sei_t *cs, const char *text);
+
+/* appends the SEI built last to the packet.  the packet's data is only
+ * reallocated if it is shared or doesn't have enough room after it.  returns
+ * true if the SEI was written in place. */
+bool caption_sei_append(caption_sei_t *cs, struct encoder_packet *packet);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,9 +15,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <inttypes.h>
 #include "obs.h"
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "util/circlebuf-spsc.h"
 
 #define encoder_active(encoder) os_atomic_load_bool(&encoder->active)
 #define set_encoder_active(encoder, val) \
@@ -25,16 +27,32 @@
 
 #define get_weak(encoder) ((obs_weak_encoder_t *)encoder->context.control)
 
-struct obs_encoder_info *find_encoder(const char *id)
+static void free_callbacks(struct obs_encoder *encoder);
+
+static struct obs_encoder_info *find_encoder_info(const char *id)
 {
+	struct obs_encoder_info *found = NULL;
+
+	pthread_mutex_lock(&obs->modules_mutex);
 	for (size_t i = 0; i < obs->encoder_types.num; i++) {
 		struct obs_encoder_info *info = obs->encoder_types.array + i;
 
-		if (strcmp(info->id, id) == 0)
-			return info;
+		if (strcmp(info->id, id) == 0) {
+			found = info;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 
-	return NULL;
+	return found;
+}
+
+struct obs_encoder_info *find_encoder(const char *id)
+{
+	struct obs_encoder_info *info = find_encoder_info(id);
+	if (!info && obs_activate_deferred_module(id))
+		info = find_encoder_info(id);
+	return info;
 }
 
 const char *obs_encoder_get_display_name(const char *id)
@@ -265,7 +283,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
-		da_free(encoder->callbacks);
+		free_callbacks(encoder);
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
@@ -531,6 +549,259 @@ void obs_encoder_shutdown(obs_encoder_t *encoder)
 	pthread_mutex_unlock(&encoder->init_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Packet dispatch
+ *
+ * Each callback gets its own thread that calls it, fed through a lock-free
+ * queue, so that the time outputs spend muxing, interleaving or writing
+ * packets is not charged to the encoder thread. */
+
+#define DISPATCH_QUEUE_PACKETS 1024
+
+struct dispatch_packet {
+	struct encoder_packet packet;
+	uint64_t queued_ts;
+};
+
+struct encoder_dispatcher {
+	struct obs_encoder *encoder;
+	void (*new_packet)(void *param, struct encoder_packet *packet);
+	void *param;
+
+	struct spsc_circlebuf queue;
+	pthread_t thread;
+	os_sem_t *packet_sem;
+	os_event_t *space_event;
+	volatile bool discard;
+	bool warned_full;
+
+	/* metrics.  max_depth is updated by the encoder thread when it queues
+	 * a packet, the rest by the dispatch thread, all of them with
+	 * metrics_mutex held so they can be read by
+	 * obs_encoder_get_dispatch_stats */
+	pthread_mutex_t metrics_mutex;
+	volatile long depth;
+	long max_depth;
+	uint64_t num_packets;
+	uint64_t total_latency_ns;
+	uint64_t max_latency_ns;
+};
+
+static void *dispatch_thread(void *data)
+{
+	struct encoder_dispatcher *dispatcher = data;
+
+	os_set_thread_name("obs-encoder: packet dispatch thread");
+
+	while (os_sem_wait(dispatcher->packet_sem) == 0) {
+		struct dispatch_packet dp;
+		uint64_t latency;
+
+		/* posted without a packet: all queued packets are done */
+		if (!spsc_circlebuf_pop_front(&dispatcher->queue, &dp,
+					      sizeof(dp)))
+			break;
+
+		os_atomic_dec_long(&dispatcher->depth);
+		os_event_signal(dispatcher->space_event);
+
+		latency = os_gettime_ns() - dp.queued_ts;
+		pthread_mutex_lock(&dispatcher->metrics_mutex);
+		dispatcher->num_packets++;
+		dispatcher->total_latency_ns += latency;
+		if (latency > dispatcher->max_latency_ns)
+			dispatcher->max_latency_ns = latency;
+		pthread_mutex_unlock(&dispatcher->metrics_mutex);
+
+		if (!os_atomic_load_bool(&dispatcher->discard))
+			dispatcher->new_packet(dispatcher->param, &dp.packet);
+
+		obs_encoder_packet_release(&dp.packet);
+	}
+
+	return NULL;
+}
+
+static struct encoder_dispatcher *
+dispatcher_create(struct obs_encoder *encoder,
+		  void (*new_packet)(void *param, struct encoder_packet *packet),
+		  void *param)
+{
+	struct encoder_dispatcher *dispatcher =
+		bzalloc(sizeof(struct encoder_dispatcher));
+
+	dispatcher->encoder = encoder;
+	dispatcher->new_packet = new_packet;
+	dispatcher->param = param;
+	pthread_mutex_init_value(&dispatcher->metrics_mutex);
+
+	spsc_circlebuf_init(&dispatcher->queue, DISPATCH_QUEUE_PACKETS *
+							sizeof(struct dispatch_packet));
+
+	if (pthread_mutex_init(&dispatcher->metrics_mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&dispatcher->packet_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&dispatcher->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (pthread_create(&dispatcher->thread, NULL, dispatch_thread,
+			   dispatcher) != 0)
+		goto fail;
+
+	return dispatcher;
+
+fail:
+	blog(LOG_WARNING,
+	     "encoder '%s': Failed to create packet dispatch "
+	     "thread, sending packets directly",
+	     encoder->context.name);
+	os_event_destroy(dispatcher->space_event);
+	os_sem_destroy(dispatcher->packet_sem);
+	pthread_mutex_destroy(&dispatcher->metrics_mutex);
+	spsc_circlebuf_free(&dispatcher->queue);
+	bfree(dispatcher);
+	return NULL;
+}
+
+/* delivers (or discards) all queued packets and destroys the dispatcher */
+static void dispatcher_destroy(struct encoder_dispatcher *dispatcher,
+			       bool discard)
+{
+	struct dispatch_packet dp;
+
+	if (!dispatcher)
+		return;
+
+	os_atomic_set_bool(&dispatcher->discard, discard);
+	os_sem_post(dispatcher->packet_sem);
+	pthread_join(dispatcher->thread, NULL);
+
+	/* only left over if the thread stopped early */
+	while (spsc_circlebuf_pop_front(&dispatcher->queue, &dp, sizeof(dp)))
+		obs_encoder_packet_release(&dp.packet);
+
+	if (dispatcher->num_packets) {
+		blog(LOG_INFO,
+		     "encoder '%s': dispatched %" PRIu64 " packets, "
+		     "max queue depth %ld, latency avg %.2f ms, "
+		     "max %.2f ms",
+		     dispatcher->encoder->context.name,
+		     dispatcher->num_packets, dispatcher->max_depth,
+		     (double)dispatcher->total_latency_ns /
+			     (double)dispatcher->num_packets / 1000000.0,
+		     (double)dispatcher->max_latency_ns / 1000000.0);
+	}
+
+	os_event_destroy(dispatcher->space_event);
+	os_sem_destroy(dispatcher->packet_sem);
+	pthread_mutex_destroy(&dispatcher->metrics_mutex);
+	spsc_circlebuf_free(&dispatcher->queue);
+	bfree(dispatcher);
+}
+
+static void dispatch_packet(struct encoder_dispatcher *dispatcher,
+			    struct encoder_packet *packet)
+{
+	struct dispatch_packet dp;
+	long depth;
+
+	/* a stalled output only holds up the encoder once its queue is full */
+	while (spsc_circlebuf_space(&dispatcher->queue) < sizeof(dp)) {
+		if (!dispatcher->warned_full) {
+			blog(LOG_WARNING,
+			     "encoder '%s': Packet dispatch queue is full, "
+			     "output is not keeping up",
+			     dispatcher->encoder->context.name);
+			dispatcher->warned_full = true;
+		}
+
+		os_event_wait(dispatcher->space_event);
+	}
+
+	obs_encoder_packet_create_instance(&dp.packet, packet);
+	dp.queued_ts = os_gettime_ns();
+
+	spsc_circlebuf_push_back(&dispatcher->queue, &dp, sizeof(dp));
+
+	depth = os_atomic_inc_long(&dispatcher->depth);
+	pthread_mutex_lock(&dispatcher->metrics_mutex);
+	if (depth > dispatcher->max_depth)
+		dispatcher->max_depth = depth;
+	pthread_mutex_unlock(&dispatcher->metrics_mutex);
+
+	os_sem_post(dispatcher->packet_sem);
+}
+
+static inline void deliver_packet(struct encoder_callback *cb,
+				  struct encoder_packet *packet)
+{
+	if (cb->dispatcher)
+		dispatch_packet(cb->dispatcher, packet);
+	else
+		cb->new_packet(cb->param, packet);
+}
+
+static void add_dispatch_stats(struct encoder_dispatcher *dispatcher,
+			       struct obs_encoder_dispatch_stats *stats,
+			       uint64_t *total_latency_ns)
+{
+	pthread_mutex_lock(&dispatcher->metrics_mutex);
+	stats->packets += dispatcher->num_packets;
+	stats->queue_depth += os_atomic_load_long(&dispatcher->depth);
+	if (dispatcher->max_depth > stats->max_queue_depth)
+		stats->max_queue_depth = dispatcher->max_depth;
+	if (dispatcher->max_latency_ns > stats->max_latency_ns)
+		stats->max_latency_ns = dispatcher->max_latency_ns;
+	*total_latency_ns += dispatcher->total_latency_ns;
+	pthread_mutex_unlock(&dispatcher->metrics_mutex);
+}
+
+bool obs_encoder_get_dispatch_stats(obs_encoder_t *encoder,
+				    struct obs_encoder_dispatch_stats *stats)
+{
+	uint64_t total_latency_ns = 0;
+	bool found = false;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_dispatch_stats"))
+		return false;
+	if (!obs_ptr_valid(stats, "obs_encoder_get_dispatch_stats"))
+		return false;
+
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&encoder->callbacks_mutex);
+	for (size_t i = 0; i < encoder->callbacks.num; i++) {
+		struct encoder_dispatcher *dispatcher =
+			encoder->callbacks.array[i].dispatcher;
+
+		if (dispatcher) {
+			add_dispatch_stats(dispatcher, stats,
+					   &total_latency_ns);
+			found = true;
+		}
+	}
+	pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+	if (stats->packets)
+		stats->avg_latency_ns = total_latency_ns / stats->packets;
+	return found;
+}
+
+static void free_callbacks(struct obs_encoder *encoder)
+{
+	DARRAY(struct encoder_callback) callbacks;
+
+	pthread_mutex_lock(&encoder->callbacks_mutex);
+	da_move(callbacks, encoder->callbacks);
+	pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+	for (size_t i = 0; i < callbacks.num; i++)
+		dispatcher_destroy(callbacks.array[i].dispatcher, true);
+	da_free(callbacks);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline size_t
 get_callback_idx(const struct obs_encoder *encoder,
 		 void (*new_packet)(void *param, struct encoder_packet *packet),
@@ -561,7 +832,7 @@ static inline void obs_encoder_start_internal(
 	void (*new_packet)(void *param, struct encoder_packet *packet),
 	void *param)
 {
-	struct encoder_callback cb = {false, new_packet, param};
+	struct encoder_callback cb = {false, new_packet, param, NULL};
 	bool first = false;
 
 	if (!encoder->context.data)
@@ -572,8 +843,10 @@ static inline void obs_encoder_start_internal(
 	first = (encoder->callbacks.num == 0);
 
 	size_t idx = get_callback_idx(encoder, new_packet, param);
-	if (idx == DARRAY_INVALID)
+	if (idx == DARRAY_INVALID) {
+		cb.dispatcher = dispatcher_create(encoder, new_packet, param);
 		da_push_back(encoder->callbacks, &cb);
+	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
@@ -606,6 +879,7 @@ static inline bool obs_encoder_stop_internal(
 	void (*new_packet)(void *param, struct encoder_packet *packet),
 	void *param)
 {
+	struct encoder_dispatcher *dispatcher = NULL;
 	bool last = false;
 	size_t idx;
 
@@ -613,12 +887,16 @@ static inline bool obs_encoder_stop_internal(
 
 	idx = get_callback_idx(encoder, new_packet, param);
 	if (idx != DARRAY_INVALID) {
+		dispatcher = encoder->callbacks.array[idx].dispatcher;
 		da_erase(encoder->callbacks, idx);
 		last = (encoder->callbacks.num == 0);
 	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
+	/* packets encoded before the stop are still delivered */
+	dispatcher_destroy(dispatcher, false);
+
 	if (last) {
 		remove_connection(encoder, true);
 		encoder->initialized = false;
@@ -885,7 +1163,7 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	da_init(data);
 
 	if (!get_sei(encoder, &sei, &size) || !sei || !size) {
-		cb->new_packet(cb->param, packet);
+		deliver_packet(cb, packet);
 		cb->sent_first_packet = true;
 		return;
 	}
@@ -897,7 +1175,7 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	first_packet.data = data.array;
 	first_packet.size = data.num;
 
-	cb->new_packet(cb->param, &first_packet);
+	deliver_packet(cb, &first_packet);
 	cb->sent_first_packet = true;
 
 	da_free(data);
@@ -913,13 +1191,16 @@ static inline void send_packet(struct obs_encoder *encoder,
 	if (encoder->info.type == OBS_ENCODER_VIDEO && !cb->sent_first_packet)
 		send_first_video_packet(encoder, cb, packet);
 	else
-		cb->new_packet(cb->param, packet);
+		deliver_packet(cb, packet);
 	profile_end(send_packet_name);
 }
 
 void full_stop(struct obs_encoder *encoder)
 {
 	if (encoder) {
+		/* the outputs are stopped, pending packets are of no use */
+		free_callbacks(encoder);
+
 		pthread_mutex_lock(&encoder->outputs_mutex);
 		for (size_t i = 0; i < encoder->outputs.num; i++) {
 			struct obs_output *output = encoder->outputs.array[i];
@@ -931,10 +1212,6 @@ void full_stop(struct obs_encoder *encoder)
 		}
 		pthread_mutex_unlock(&encoder->outputs_mutex);
 
-		pthread_mutex_lock(&encoder->callbacks_mutex);
-		da_free(encoder->callbacks);
-		pthread_mutex_unlock(&encoder->callbacks_mutex);
-
 		remove_connection(encoder, false);
 		encoder->initialized = false;
 	}
@@ -966,6 +1243,8 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 		pkt->sys_dts_usec += encoder->pause.ts_offset / 1000;
 		pthread_mutex_unlock(&encoder->pause.mutex);
 
+		OBS_LATENCY_TRACE_ENCODED(pkt);
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
@@ -1074,6 +1353,9 @@ static void receive_video(void *param, struct video_data *frame)
 	enc_frame.frames = 1;
 	enc_frame.pts = encoder->cur_pts;
 
+	OBS_LATENCY_TRACE_ENCODE(encoder, OBS_LATENCY_VIDEO, frame->timestamp,
+				 enc_frame.pts);
+
 	if (do_encode(encoder, &enc_frame))
 		encoder->cur_pts += encoder->timebase_num;
 
@@ -1304,6 +1586,10 @@ static void receive_audio(void *param, size_t mix_idx, struct audio_data *in)
 
 	while (encoder->audio_input_buffer[0].size >=
 	       encoder->framesize_bytes) {
+		/* the frame is traced as the newest block it contains */
+		OBS_LATENCY_TRACE_ENCODE(encoder, OBS_LATENCY_AUDIO,
+					 audio.timestamp, encoder->cur_pts);
+
 		if (!send_audio_data(encoder)) {
 			break;
 		}
@@ -1337,18 +1623,25 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
-void obs_encoder_packet_create_instance(struct encoder_packet *dst,
-					const struct encoder_packet *src)
+void obs_encoder_packet_create_instance_ex(struct encoder_packet *dst,
+					   const struct encoder_packet *src,
+					   size_t extra_size)
 {
 	long *p_refs;
 
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
+	p_refs = bpool_alloc(src->size + sizeof(long) + extra_size);
 	dst->data = (void *)(p_refs + 1);
 	*p_refs = 1;
 	memcpy(dst->data, src->data, src->size);
 }
 
+void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+					const struct encoder_packet *src)
+{
+	obs_encoder_packet_create_instance_ex(dst, src, 0);
+}
+
 /* OBS_DEPRECATED */
 void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 				  const struct encoder_packet *src)
@@ -1383,8 +1676,10 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 
 	if (pkt->data) {
 		long *p_refs = ((long *)pkt->data) - 1;
+
+		/* also frees packets encoders allocated with bmalloc */
 		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+			bpool_free(p_refs);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
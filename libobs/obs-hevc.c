@@ -142,18 +142,25 @@ void obs_parse_hevc_packet(struct encoder_packet *hevc_packet,
 {
 	struct array_output_data output;
 	struct serializer s;
-	long ref = 1;
+	long *p_refs;
 
 	array_output_serializer_init(&s, &output);
 	*hevc_packet = *src;
 
-	serialize(&s, &ref, sizeof(ref));
 	serialize_hevc_data(&s, src->data, src->size, &hevc_packet->keyframe,
 			    &hevc_packet->priority);
 
-	hevc_packet->data = output.bytes.array + sizeof(ref);
-	hevc_packet->size = output.bytes.num - sizeof(ref);
+	/* parsed packets are released with obs_encoder_packet_release, so
+	 * they have to come from the packet pool */
+	p_refs = bpool_alloc(sizeof(long) + output.bytes.num);
+	*p_refs = 1;
+	memcpy(p_refs + 1, output.bytes.array, output.bytes.num);
+
+	hevc_packet->data = (uint8_t *)(p_refs + 1);
+	hevc_packet->size = output.bytes.num;
 	hevc_packet->drop_priority = hevc_packet->priority;
+
+	array_output_serializer_free(&output);
 }
 
 int obs_parse_hevc_packet_priority(const struct encoder_packet *packet)
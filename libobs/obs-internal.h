@@ -20,6 +20,7 @@
 #include "util/c99defs.h"
 #include "util/darray.h"
 #include "util/circlebuf.h"
+#include "util/circlebuf-spsc.h"
 #include "util/dstr.h"
 #include "util/threading.h"
 #include "util/platform.h"
@@ -36,6 +37,8 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-latency.h"
+#include "obs-audio-drift.h"
 
 #define NUM_TEXTURES 2
 #define NUM_CHANNELS 3
@@ -103,11 +106,33 @@ struct obs_module {
 	const char *(*description)(void);
 	const char *(*author)(void);
 
+	/* ranges of the core type arrays filled in by obs_module_load, used
+	 * to build the module index */
+	size_t source_types_start, source_types_end;
+	size_t output_types_start, output_types_end;
+	size_t encoder_types_start, encoder_types_end;
+	size_t service_types_start, service_types_end;
+
 	struct obs_module *next;
 };
 
 extern void free_module(struct obs_module *mod);
 
+/* a module found in the module index that has not been loaded yet */
+struct obs_deferred_module {
+	char *bin_path;
+	char *data_path;
+	char *name;
+	DARRAY(char *) type_ids;
+};
+
+/* loads the deferred module that registers the type id, returns true if
+ * the type should be looked up again */
+extern bool obs_activate_deferred_module(const char *id);
+/* loads every deferred module, so that type enumeration is complete */
+extern void obs_activate_deferred_modules(void);
+extern void free_deferred_modules(void);
+
 struct obs_module_path {
 	char *bin;
 	char *data;
@@ -366,6 +391,18 @@ struct obs_core_audio {
 	int max_buffering_ticks;
 	bool fixed_buffer;
 
+	/* lowering buffering again, see shrink_audio_buffering */
+	uint64_t shrink_buffering_ticks;
+	uint64_t stable_ticks;
+	int64_t min_headroom;
+	bool catching_up;
+
+	/* statistics, read from other threads */
+	volatile long buffering_ms;
+	volatile long headroom_ms;
+	volatile long buffering_increases;
+	volatile long buffering_decreases;
+
 	float user_volume;
 
 	pthread_mutex_t monitoring_mutex;
@@ -446,6 +483,17 @@ struct obs_core {
 	struct obs_module *first_module;
 	DARRAY(struct obs_module_path) module_paths;
 
+	/* guards the module list, the registered type arrays and the deferred
+	 * modules, since deferred modules register their types while other
+	 * threads look types up */
+	pthread_mutex_t modules_mutex;
+	DARRAY(struct obs_deferred_module) deferred_modules;
+	bool activating_deferred_module;
+	pthread_t deferred_activation_thread;
+	os_event_t *deferred_modules_idle;
+	DARRAY(void *) retired_type_arrays;
+	volatile bool modules_post_loaded;
+
 	DARRAY(struct obs_source_info) source_types;
 	DARRAY(struct obs_source_info) input_types;
 	DARRAY(struct obs_source_info) filter_types;
@@ -703,6 +751,11 @@ struct obs_source {
 	uint64_t last_audio_ts;
 	uint64_t next_audio_ts_min;
 	uint64_t next_audio_sys_ts_min;
+
+	/* clock drift correction for async audio with system timestamps, the
+	 * controller state is only touched by the thread outputting audio */
+	struct audio_drift drift;
+
 	uint64_t last_frame_ts;
 	uint64_t last_sys_timestamp;
 	bool async_rendered;
@@ -719,6 +772,21 @@ struct obs_source {
 	uint64_t audio_ts;
 	struct circlebuf audio_input_buf[MAX_AUDIO_CHANNELS];
 	size_t last_audio_input_buf_size;
+
+	/* audio handed from the source's audio thread to the obs audio
+	 * thread without locking audio_buf_mutex; written only under
+	 * audio_mutex and read only under audio_buf_mutex */
+	struct spsc_circlebuf audio_input_queue;
+	DARRAY(uint8_t) audio_queue_block;
+	uint64_t audio_queue_reset_ts;
+	bool audio_queue_reset;
+
+	/* timing resets requested by other threads, written under
+	 * audio_buf_mutex and applied by the thread outputting audio */
+	volatile bool audio_timing_reset_pending;
+	bool audio_timing_resync;
+	uint64_t audio_timing_reset_ts;
+	uint64_t audio_timing_reset_os_time;
 	DARRAY(struct audio_action) audio_actions;
 	float *audio_output_buf[MAX_AUDIO_MIXES][MAX_AUDIO_CHANNELS];
 	float *audio_mix_buf[MAX_AUDIO_CHANNELS];
@@ -844,6 +912,11 @@ struct obs_source {
 };
 
 extern struct obs_source_info *get_source_info(const char *id);
+extern void obs_source_flush_audio_queue(obs_source_t *source);
+extern void obs_source_request_audio_timing_reset(obs_source_t *source,
+						  bool resync,
+						  uint64_t timestamp,
+						  uint64_t os_time);
 extern struct obs_source_info *get_source_info2(const char *unversioned_id,
 						uint32_t ver);
 extern bool obs_source_init_context(struct obs_source *source,
@@ -1097,6 +1170,11 @@ struct obs_output {
 
 	struct circlebuf caption_data;
 
+	/* created once the output is sent captions, video packets get
+	 * CAPTION_SEI_HEADROOM spare bytes from then on */
+	struct caption_sei *caption_sei;
+	volatile bool caption_headroom;
+
 	bool valid;
 
 	uint64_t active_delay_ns;
@@ -1140,6 +1218,11 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 extern void
 obs_encoder_packet_create_instance(struct encoder_packet *dst,
 				   const struct encoder_packet *src);
+/* same, with at least extra_size spare bytes after the packet data */
+extern void
+obs_encoder_packet_create_instance_ex(struct encoder_packet *dst,
+				      const struct encoder_packet *src,
+				      size_t extra_size);
 void obs_output_destroy(obs_output_t *output);
 
 /* ------------------------------------------------------------------------- */
@@ -1150,10 +1233,15 @@ struct obs_weak_encoder {
 	struct obs_encoder *encoder;
 };
 
+struct encoder_dispatcher;
+
 struct encoder_callback {
 	bool sent_first_packet;
 	void (*new_packet)(void *param, struct encoder_packet *packet);
 	void *param;
+
+	/* delivers packets on a thread of its own */
+	struct encoder_dispatcher *dispatcher;
 };
 
 struct obs_encoder {
@@ -1252,6 +1340,26 @@ extern void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 
 void obs_encoder_destroy(obs_encoder_t *encoder);
 
+/* ------------------------------------------------------------------------- */
+/* latency tracing */
+
+#ifdef ENABLE_LATENCY_TRACING
+/* records the encode stage and remembers the frame id for the pts */
+extern void obs_latency_trace_encode(const obs_encoder_t *encoder,
+				     enum obs_latency_type type, uint64_t id,
+				     int64_t pts);
+/* maps a new packet to its frame id and records the encoded stage */
+extern void obs_latency_trace_encoded(const struct encoder_packet *packet);
+extern void obs_latency_add_procs(proc_handler_t *procs);
+
+#define OBS_LATENCY_TRACE_ENCODE(encoder, type, id, pts) \
+	obs_latency_trace_encode(encoder, type, id, pts)
+#define OBS_LATENCY_TRACE_ENCODED(packet) obs_latency_trace_encoded(packet)
+#else
+#define OBS_LATENCY_TRACE_ENCODE(encoder, type, id, pts) ((void)0)
+#define OBS_LATENCY_TRACE_ENCODED(packet) ((void)0)
+#endif
+
 /* ------------------------------------------------------------------------- */
 /* services */
 
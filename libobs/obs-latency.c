@@ -0,0 +1,407 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "util/profiler.h"
+#include "util/threading.h"
+#include "obs-internal.h"
+#include "obs-latency.h"
+
+static const char *stage_names[OBS_LATENCY_STAGE_COUNT] = {
+	"capture", "render",      "output", "encode",
+	"encoded", "interleave", "send",
+};
+
+const char *obs_latency_stage_name(enum obs_latency_stage stage)
+{
+	return stage < OBS_LATENCY_STAGE_COUNT ? stage_names[stage] : NULL;
+}
+
+#ifdef ENABLE_LATENCY_TRACING
+
+/* frames that are in flight at the same time; a frame whose slot is taken
+ * over by a newer frame simply stops being traced */
+#define MAX_RECORDS 512
+#define MAX_PTS_ENTRIES 1024
+
+/* 100us steps up to 10ms, 1ms steps up to 100ms, 10ms steps up to 2s */
+#define NUM_BUCKETS 381
+
+struct latency_record {
+	uint64_t id;
+	uint64_t ts[OBS_LATENCY_STAGE_COUNT];
+};
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t total_usec;
+	uint64_t max_usec;
+	uint32_t buckets[NUM_BUCKETS];
+};
+
+struct latency_stage {
+	/* since the frame was captured (or rendered) */
+	struct latency_hist total;
+	/* since the previous stage */
+	struct latency_hist step;
+};
+
+/* frame ids by encoder and input pts, until the packet is encoded */
+struct pts_entry {
+	const obs_encoder_t *encoder;
+	int64_t pts;
+	uint64_t id;
+};
+
+/* frame ids of encoded packets.  outputs rewrite the pts and dts of the
+ * packets they receive, the system dts stays the same. */
+struct packet_entry {
+	const obs_encoder_t *encoder;
+	int64_t sys_dts_usec;
+	uint64_t id;
+};
+
+static pthread_mutex_t latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct latency_record records[2][MAX_RECORDS];
+static struct latency_stage stages[2][OBS_LATENCY_STAGE_COUNT];
+static struct pts_entry pts_entries[MAX_PTS_ENTRIES];
+static struct packet_entry packet_entries[MAX_PTS_ENTRIES];
+
+/* profiler root names, compared by pointer */
+static const char *profile_names[2][OBS_LATENCY_STAGE_COUNT] = {
+	{
+		NULL,
+		"video_latency(render)",
+		"video_latency(output)",
+		"video_latency(encode)",
+		"video_latency(encoded)",
+		"video_latency(interleave)",
+		"video_latency(send)",
+	},
+	{
+		NULL,
+		"audio_latency(render)",
+		"audio_latency(output)",
+		"audio_latency(encode)",
+		"audio_latency(encoded)",
+		"audio_latency(interleave)",
+		"audio_latency(send)",
+	},
+};
+
+static inline size_t hash_id(uint64_t id)
+{
+	return (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 40);
+}
+
+static inline size_t bucket_index(uint64_t usec)
+{
+	if (usec < 10000)
+		return (size_t)(usec / 100);
+	if (usec < 100000)
+		return 100 + (size_t)((usec - 10000) / 1000);
+	if (usec < 2000000)
+		return 190 + (size_t)((usec - 100000) / 10000);
+	return NUM_BUCKETS - 1;
+}
+
+static inline uint64_t bucket_upper_usec(size_t idx)
+{
+	if (idx < 100)
+		return (idx + 1) * 100;
+	if (idx < 190)
+		return 10000 + (idx - 99) * 1000;
+	if (idx < NUM_BUCKETS - 1)
+		return 100000 + (idx - 189) * 10000;
+	return UINT64_MAX;
+}
+
+static inline void hist_add(struct latency_hist *hist, uint64_t usec)
+{
+	hist->buckets[bucket_index(usec)]++;
+	hist->total_usec += usec;
+	hist->count++;
+	if (usec > hist->max_usec)
+		hist->max_usec = usec;
+}
+
+static uint64_t hist_percentile(const struct latency_hist *hist,
+				double percentile)
+{
+	uint64_t target = (uint64_t)((double)hist->count * percentile);
+	uint64_t count = 0;
+
+	for (size_t i = 0; i < NUM_BUCKETS; i++) {
+		count += hist->buckets[i];
+		if (count > target) {
+			uint64_t upper = bucket_upper_usec(i);
+			return upper < hist->max_usec ? upper : hist->max_usec;
+		}
+	}
+
+	return hist->max_usec;
+}
+
+void obs_latency_trace(enum obs_latency_type type, uint64_t id,
+		       enum obs_latency_stage stage, uint64_t ts)
+{
+	struct latency_record *rec;
+	const char *profile_name = NULL;
+	uint64_t origin = 0;
+	uint64_t prev = 0;
+
+	if (!id || stage >= OBS_LATENCY_STAGE_COUNT)
+		return;
+
+	pthread_mutex_lock(&latency_mutex);
+
+	rec = &records[type][hash_id(id) & (MAX_RECORDS - 1)];
+	if (rec->id != id) {
+		memset(rec, 0, sizeof(*rec));
+		rec->id = id;
+
+		/* audio timestamps are the time the audio was captured */
+		if (type == OBS_LATENCY_AUDIO)
+			rec->ts[OBS_LATENCY_CAPTURE] = id;
+	}
+
+	/* a composited frame is as old as the oldest async frame in it */
+	if (stage == OBS_LATENCY_CAPTURE) {
+		if (!rec->ts[stage] || ts < rec->ts[stage])
+			rec->ts[stage] = ts;
+		goto unlock;
+	}
+
+	/* several encoders/outputs can handle the same frame, only the first
+	 * one is counted */
+	if (rec->ts[stage])
+		goto unlock;
+
+	rec->ts[stage] = ts;
+
+	for (size_t i = 0; i < (size_t)stage; i++) {
+		if (!rec->ts[i])
+			continue;
+		if (!origin)
+			origin = rec->ts[i];
+		prev = rec->ts[i];
+	}
+
+	if (origin && ts >= prev && prev >= origin) {
+		struct latency_stage *s = &stages[type][stage];
+		hist_add(&s->total, (ts - origin) / 1000);
+		hist_add(&s->step, (ts - prev) / 1000);
+		profile_name = profile_names[type][stage];
+	}
+
+unlock:
+	pthread_mutex_unlock(&latency_mutex);
+
+	if (profile_name)
+		profile_record(profile_name, origin, ts);
+}
+
+static inline struct pts_entry *get_pts_entry(const obs_encoder_t *encoder,
+					      int64_t pts)
+{
+	size_t idx = hash_id((uint64_t)(uintptr_t)encoder ^ (uint64_t)pts);
+	return &pts_entries[idx & (MAX_PTS_ENTRIES - 1)];
+}
+
+static inline struct packet_entry *
+get_packet_entry(const struct encoder_packet *packet)
+{
+	size_t idx = hash_id((uint64_t)(uintptr_t)packet->encoder ^
+			     (uint64_t)packet->sys_dts_usec);
+	return &packet_entries[idx & (MAX_PTS_ENTRIES - 1)];
+}
+
+void obs_latency_trace_packet(const struct encoder_packet *packet,
+			      enum obs_latency_stage stage)
+{
+	struct packet_entry *entry;
+	uint64_t id = 0;
+
+	pthread_mutex_lock(&latency_mutex);
+	entry = get_packet_entry(packet);
+	if (entry->encoder == packet->encoder &&
+	    entry->sys_dts_usec == packet->sys_dts_usec)
+		id = entry->id;
+	pthread_mutex_unlock(&latency_mutex);
+
+	if (!id)
+		return;
+
+	obs_latency_trace(packet->type == OBS_ENCODER_VIDEO
+				  ? OBS_LATENCY_VIDEO
+				  : OBS_LATENCY_AUDIO,
+			  id, stage, os_gettime_ns());
+}
+
+void obs_latency_trace_encode(const obs_encoder_t *encoder,
+			      enum obs_latency_type type, uint64_t id,
+			      int64_t pts)
+{
+	struct pts_entry *entry;
+
+	pthread_mutex_lock(&latency_mutex);
+	entry = get_pts_entry(encoder, pts);
+	entry->encoder = encoder;
+	entry->pts = pts;
+	entry->id = id;
+	pthread_mutex_unlock(&latency_mutex);
+
+	obs_latency_trace(type, id, OBS_LATENCY_ENCODE, os_gettime_ns());
+}
+
+void obs_latency_trace_encoded(const struct encoder_packet *packet)
+{
+	struct pts_entry *entry;
+
+	pthread_mutex_lock(&latency_mutex);
+	entry = get_pts_entry(packet->encoder, packet->pts);
+	if (entry->encoder == packet->encoder && entry->pts == packet->pts) {
+		struct packet_entry *pkt_entry = get_packet_entry(packet);
+		pkt_entry->encoder = packet->encoder;
+		pkt_entry->sys_dts_usec = packet->sys_dts_usec;
+		pkt_entry->id = entry->id;
+		entry->encoder = NULL;
+	}
+	pthread_mutex_unlock(&latency_mutex);
+
+	OBS_LATENCY_TRACE_PACKET(packet, OBS_LATENCY_ENCODED);
+}
+
+static void hist_to_data(obs_data_t *data, const char *name,
+			 const struct latency_hist *hist)
+{
+	obs_data_t *obj = obs_data_create();
+
+	obs_data_set_double(obj, "avg_ms",
+			    (double)hist->total_usec / (double)hist->count /
+				    1000.0);
+	obs_data_set_double(obj, "p50_ms",
+			    (double)hist_percentile(hist, 0.5) / 1000.0);
+	obs_data_set_double(obj, "p90_ms",
+			    (double)hist_percentile(hist, 0.9) / 1000.0);
+	obs_data_set_double(obj, "p99_ms",
+			    (double)hist_percentile(hist, 0.99) / 1000.0);
+	obs_data_set_double(obj, "max_ms", (double)hist->max_usec / 1000.0);
+
+	obs_data_set_obj(data, name, obj);
+	obs_data_release(obj);
+}
+
+static void type_to_data(obs_data_t *data, const char *name,
+			 enum obs_latency_type type)
+{
+	obs_data_t *obj = obs_data_create();
+
+	for (size_t i = 0; i < OBS_LATENCY_STAGE_COUNT; i++) {
+		const struct latency_stage *s = &stages[type][i];
+		obs_data_t *stage;
+
+		if (!s->total.count)
+			continue;
+
+		stage = obs_data_create();
+		obs_data_set_int(stage, "count", (long long)s->total.count);
+		hist_to_data(stage, "total", &s->total);
+		hist_to_data(stage, "step", &s->step);
+		obs_data_set_obj(obj, stage_names[i], stage);
+		obs_data_release(stage);
+	}
+
+	obs_data_set_obj(data, name, obj);
+	obs_data_release(obj);
+}
+
+char *obs_latency_get_stats_json(void)
+{
+	obs_data_t *data = obs_data_create();
+	char *json;
+
+	pthread_mutex_lock(&latency_mutex);
+	type_to_data(data, "video", OBS_LATENCY_VIDEO);
+	type_to_data(data, "audio", OBS_LATENCY_AUDIO);
+	pthread_mutex_unlock(&latency_mutex);
+
+	json = bstrdup(obs_data_get_json(data));
+	obs_data_release(data);
+	return json;
+}
+
+void obs_latency_reset(void)
+{
+	pthread_mutex_lock(&latency_mutex);
+	memset(records, 0, sizeof(records));
+	memset(stages, 0, sizeof(stages));
+	memset(pts_entries, 0, sizeof(pts_entries));
+	memset(packet_entries, 0, sizeof(packet_entries));
+	pthread_mutex_unlock(&latency_mutex);
+}
+
+static void get_latency_stats_proc(void *param, calldata_t *cd)
+{
+	char *json = obs_latency_get_stats_json();
+	calldata_set_string(cd, "json", json);
+	bfree(json);
+
+	UNUSED_PARAMETER(param);
+}
+
+static void reset_latency_stats_proc(void *param, calldata_t *cd)
+{
+	obs_latency_reset();
+
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(cd);
+}
+
+void obs_latency_add_procs(proc_handler_t *procs)
+{
+	proc_handler_add(procs, "void get_latency_stats(out string json)",
+			 get_latency_stats_proc, NULL);
+	proc_handler_add(procs, "void reset_latency_stats()",
+			 reset_latency_stats_proc, NULL);
+}
+
+#else
+
+void obs_latency_trace(enum obs_latency_type type, uint64_t id,
+		       enum obs_latency_stage stage, uint64_t ts)
+{
+	UNUSED_PARAMETER(type);
+	UNUSED_PARAMETER(id);
+	UNUSED_PARAMETER(stage);
+	UNUSED_PARAMETER(ts);
+}
+
+void obs_latency_trace_packet(const struct encoder_packet *packet,
+			      enum obs_latency_stage stage)
+{
+	UNUSED_PARAMETER(packet);
+	UNUSED_PARAMETER(stage);
+}
+
+char *obs_latency_get_stats_json(void)
+{
+	return NULL;
+}
+
+void obs_latency_reset(void) {}
+
+#endif
@@ -0,0 +1,93 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/c99defs.h"
+#include "util/platform.h"
+#include "obs-config.h"
+
+/*
+ * Pipeline latency tracing
+ *
+ * Only active when libobs is built with ENABLE_LATENCY_TRACING.  Every video
+ * frame is identified by the system timestamp of the tick it was rendered
+ * in, and every audio block by its system timestamp.  Each stage of the
+ * pipeline records when it handled a frame, and the time since the frame
+ * was captured as well as the time spent since the previous stage are
+ * collected into histograms.  Encoded packets are mapped back to the id by
+ * their encoder and system dts.
+ *
+ * The results are available through the "get_latency_stats" procedure of
+ * obs_get_proc_handler() and in the profiler.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct encoder_packet;
+
+enum obs_latency_type {
+	OBS_LATENCY_VIDEO,
+	OBS_LATENCY_AUDIO,
+};
+
+enum obs_latency_stage {
+	/** Frame output by an async source, or audio captured */
+	OBS_LATENCY_CAPTURE,
+	/** Composited frame rendered */
+	OBS_LATENCY_RENDER,
+	/** Raw frame handed to video-io or queued for texture encoders,
+	 * audio mixed */
+	OBS_LATENCY_OUTPUT,
+	/** Frame received by an encoder */
+	OBS_LATENCY_ENCODE,
+	/** Packet produced by an encoder */
+	OBS_LATENCY_ENCODED,
+	/** Packet interleaved and passed to an output */
+	OBS_LATENCY_INTERLEAVE,
+	/** Packet written to the network */
+	OBS_LATENCY_SEND,
+
+	OBS_LATENCY_STAGE_COUNT
+};
+
+EXPORT void obs_latency_trace(enum obs_latency_type type, uint64_t id,
+			      enum obs_latency_stage stage, uint64_t ts);
+EXPORT void obs_latency_trace_packet(const struct encoder_packet *packet,
+				     enum obs_latency_stage stage);
+
+EXPORT const char *obs_latency_stage_name(enum obs_latency_stage stage);
+
+/** Returns the collected histograms as JSON, free with bfree */
+EXPORT char *obs_latency_get_stats_json(void);
+EXPORT void obs_latency_reset(void);
+
+#ifdef ENABLE_LATENCY_TRACING
+#define OBS_LATENCY_TRACE(type, id, stage) \
+	obs_latency_trace(type, id, stage, os_gettime_ns())
+#define OBS_LATENCY_TRACE_PACKET(packet, stage) \
+	obs_latency_trace_packet(packet, stage)
+#else
+#define OBS_LATENCY_TRACE(type, id, stage) ((void)0)
+#define OBS_LATENCY_TRACE_PACKET(packet, stage) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
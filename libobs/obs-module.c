@@ -15,8 +15,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <sys/stat.h>
+
 #include "util/platform.h"
 #include "util/dstr.h"
+#include "util/task.h"
 
 #include "obs-defs.h"
 #include "obs-internal.h"
@@ -97,8 +100,10 @@ static inline char *get_module_name(const char *file)
 extern void reset_win32_symbol_paths(void);
 #endif
 
-int obs_open_module(obs_module_t **module, const char *path,
-		    const char *data_path)
+/* opens the module and loads its locale without linking it into the module
+ * list, so it can safely be called from a module loader thread */
+static int open_module(obs_module_t **module, const char *path,
+		       const char *data_path)
 {
 	static char* excluded_patterns[] = {
 	"libEGL",
@@ -131,8 +136,6 @@ int obs_open_module(obs_module_t **module, const char *path,
 	}
 #endif
 
-	blog(LOG_DEBUG, "---------------------------------");
-
 	mod.module = os_dlopen(path);
 	if (!mod.module) {
 		blog(LOG_WARNING, "Module '%s' not loaded", path);
@@ -148,14 +151,12 @@ int obs_open_module(obs_module_t **module, const char *path,
 	mod.file = (!mod.file) ? mod.bin_path : (mod.file + 1);
 	mod.mod_name = get_module_name(mod.file);
 	mod.data_path = bstrdup(data_path);
-	mod.next = obs->first_module;
 
 	if (mod.file) {
 		blog(LOG_DEBUG, "Loading module: %s", mod.file);
 	}
 
 	*module = bmemdup(&mod, sizeof(mod));
-	obs->first_module = (*module);
 	mod.set_pointer(*module);
 
 	if (mod.set_locale)
@@ -164,6 +165,32 @@ int obs_open_module(obs_module_t **module, const char *path,
 	return MODULE_SUCCESS;
 }
 
+static inline void link_module(obs_module_t *module)
+{
+	pthread_mutex_lock(&obs->modules_mutex);
+	module->next = obs->first_module;
+	obs->first_module = module;
+	pthread_mutex_unlock(&obs->modules_mutex);
+}
+
+int obs_open_module(obs_module_t **module, const char *path,
+		    const char *data_path)
+{
+	int errorcode;
+
+	if (!module || !path || !obs)
+		return MODULE_ERROR;
+
+	blog(LOG_DEBUG, "---------------------------------");
+
+	*module = NULL;
+	errorcode = open_module(module, path, data_path);
+	if (errorcode == MODULE_SUCCESS && *module)
+		link_module(*module);
+
+	return errorcode;
+}
+
 bool obs_init_module(obs_module_t *module)
 {
 	if (!module || !obs)
@@ -176,11 +203,21 @@ bool obs_init_module(obs_module_t *module)
 				   "obs_init_module(%s)", module->file);
 	profile_start(profile_name);
 
+	module->source_types_start = obs->source_types.num;
+	module->output_types_start = obs->output_types.num;
+	module->encoder_types_start = obs->encoder_types.num;
+	module->service_types_start = obs->service_types.num;
+
 	module->loaded = module->load();
 	if (!module->loaded)
 		blog(LOG_WARNING, "Failed to initialize module '%s'",
 		     module->file);
 
+	module->source_types_end = obs->source_types.num;
+	module->output_types_end = obs->output_types.num;
+	module->encoder_types_end = obs->encoder_types.num;
+	module->service_types_end = obs->service_types.num;
+
 	profile_end(profile_name);
 	return module->loaded;
 }
@@ -225,16 +262,19 @@ const char *obs_get_module_data_path(obs_module_t *module)
 
 obs_module_t *obs_get_module(const char *name)
 {
-	obs_module_t *module = obs->first_module;
+	obs_module_t *module;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	module = obs->first_module;
 	while (module) {
-		if (strcmp(module->mod_name, name) == 0) {
-			return module;
-		}
+		if (strcmp(module->mod_name, name) == 0)
+			break;
 
 		module = module->next;
 	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 
-	return NULL;
+	return module;
 }
 
 void *obs_get_module_lib(obs_module_t *module)
@@ -299,20 +339,25 @@ struct fail_info {
 	size_t fail_count;
 };
 
-static void load_all_callback(void *param, const struct obs_module_info2 *info)
+static void add_load_failure(struct fail_info *fail_info, const char *name)
 {
-	struct fail_info *fail_info = param;
-	obs_module_t *module = NULL;
-
-	bool is_obs_plugin;
-	bool can_load_obs_plugin;
-
-	get_plugin_info(info->bin_path, &is_obs_plugin, &can_load_obs_plugin);
+	if (fail_info) {
+		dstr_cat(&fail_info->fail_modules, name);
+		dstr_cat(&fail_info->fail_modules, ";");
+		fail_info->fail_count++;
+	}
+}
 
+/* returns true if the module was opened and should be initialized */
+static bool check_open_result(struct fail_info *fail_info,
+			      const struct obs_module_info2 *info,
+			      bool is_obs_plugin, bool can_load_obs_plugin,
+			      int code)
+{
 	if (!is_obs_plugin) {
 		blog(LOG_WARNING, "Skipping module '%s', not an OBS plugin",
 		     info->bin_path);
-		return;
+		return false;
 	}
 
 	if (!can_load_obs_plugin) {
@@ -320,46 +365,60 @@ static void load_all_callback(void *param, const struct obs_module_info2 *info)
 		     "Skipping module '%s' due to possible "
 		     "import conflicts",
 		     info->bin_path);
-		goto load_failure;
+		add_load_failure(fail_info, info->name);
+		return false;
 	}
 
-	int code = obs_open_module(&module, info->bin_path, info->data_path);
 	switch (code) {
 	case MODULE_MISSING_EXPORTS:
 		blog(LOG_DEBUG,
 		     "Failed to load module file '%s', not an OBS plugin",
 		     info->bin_path);
-		return;
+		return false;
 	case MODULE_FILE_NOT_FOUND:
 		blog(LOG_DEBUG,
 		     "Failed to load module file '%s', file not found",
 		     info->bin_path);
-		return;
+		return false;
 	case MODULE_ERROR:
 		blog(LOG_DEBUG, "Failed to load module file '%s'",
 		     info->bin_path);
-		goto load_failure;
+		add_load_failure(fail_info, info->name);
+		return false;
 	case MODULE_INCOMPATIBLE_VER:
 		blog(LOG_DEBUG,
 		     "Failed to load module file '%s', incompatible version",
 		     info->bin_path);
-		goto load_failure;
+		add_load_failure(fail_info, info->name);
+		return false;
 	case MODULE_HARDCODED_SKIP:
-		return;
+		return false;
 	}
 
-	if (!obs_init_module(module))
-		free_module(module);
+	return true;
+}
 
-	UNUSED_PARAMETER(param);
-	return;
+static void load_all_callback(void *param, const struct obs_module_info2 *info)
+{
+	struct fail_info *fail_info = param;
+	obs_module_t *module = NULL;
 
-load_failure:
-	if (fail_info) {
-		dstr_cat(&fail_info->fail_modules, info->name);
-		dstr_cat(&fail_info->fail_modules, ";");
-		fail_info->fail_count++;
-	}
+	bool is_obs_plugin;
+	bool can_load_obs_plugin;
+	int code = MODULE_ERROR;
+
+	get_plugin_info(info->bin_path, &is_obs_plugin, &can_load_obs_plugin);
+
+	if (is_obs_plugin && can_load_obs_plugin)
+		code = obs_open_module(&module, info->bin_path,
+				       info->data_path);
+
+	if (!check_open_result(fail_info, info, is_obs_plugin,
+			       can_load_obs_plugin, code))
+		return;
+
+	if (!obs_init_module(module))
+		free_module(module);
 }
 
 static const char *obs_load_all_modules_name = "obs_load_all_modules";
@@ -401,6 +460,523 @@ void obs_load_all_modules2(struct obs_module_failure_info *mfi)
 	dstr_free(&fail_info.fail_modules);
 }
 
+/* ------------------------------------------------------------------------- */
+/* parallel module loading */
+
+#define MAX_MODULE_LOADER_THREADS 8
+
+struct module_load_job {
+	struct obs_module_info2 info;
+	obs_module_t *module;
+	bool is_obs_plugin;
+	bool can_load_obs_plugin;
+	int code;
+};
+
+static void collect_module_callback(void *param,
+				    const struct obs_module_info2 *info)
+{
+	struct darray *jobs = param;
+	struct module_load_job *job =
+		darray_push_back_new(sizeof(struct module_load_job), jobs);
+
+	job->info.bin_path = bstrdup(info->bin_path);
+	job->info.data_path = bstrdup(info->data_path);
+	job->info.name = bstrdup(info->name);
+	job->code = MODULE_ERROR;
+}
+
+static void open_module_task(void *param)
+{
+	struct module_load_job *job = param;
+	const char *profile_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				   "obs_open_module(%s)", job->info.name);
+
+	profile_start(profile_name);
+
+	get_plugin_info(job->info.bin_path, &job->is_obs_plugin,
+			&job->can_load_obs_plugin);
+
+	if (job->is_obs_plugin && job->can_load_obs_plugin)
+		job->code = open_module(&job->module, job->info.bin_path,
+					job->info.data_path);
+
+	profile_end(profile_name);
+}
+
+static void open_modules_parallel(struct module_load_job *jobs, size_t count)
+{
+	os_task_queue_t *queues[MAX_MODULE_LOADER_THREADS] = {0};
+	int num_queues = os_get_logical_cores();
+
+	if (num_queues > MAX_MODULE_LOADER_THREADS)
+		num_queues = MAX_MODULE_LOADER_THREADS;
+	if ((size_t)num_queues > count)
+		num_queues = (int)count;
+	if (num_queues < 1)
+		num_queues = 1;
+
+	for (int i = 0; i < num_queues; i++)
+		queues[i] = os_task_queue_create();
+
+	for (size_t i = 0; i < count; i++) {
+		os_task_queue_t *tq = queues[i % num_queues];
+
+		/* fall back to opening on this thread if the loader thread
+		 * could not be created */
+		if (!os_task_queue_queue_task(tq, open_module_task, jobs + i))
+			open_module_task(jobs + i);
+	}
+
+	for (int i = 0; i < num_queues; i++) {
+		os_task_queue_wait(queues[i]);
+		os_task_queue_destroy(queues[i]);
+	}
+}
+
+static const char *obs_load_all_modules_parallel_name =
+	"obs_load_all_modules_parallel";
+
+void obs_load_all_modules_parallel(struct obs_module_failure_info *mfi)
+{
+	DARRAY(struct module_load_job) jobs;
+	struct fail_info fail_info = {0};
+
+	da_init(jobs);
+	if (mfi)
+		memset(mfi, 0, sizeof(*mfi));
+
+	profile_start(obs_load_all_modules_parallel_name);
+
+	obs_find_modules2(collect_module_callback, &jobs.da);
+	open_modules_parallel(jobs.array, jobs.num);
+
+	/* modules are linked and initialized in discovery order on this
+	 * thread, so type registration happens exactly as it would with
+	 * obs_load_all_modules2 */
+	for (size_t i = 0; i < jobs.num; i++) {
+		struct module_load_job *job = jobs.array + i;
+
+		if (check_open_result(&fail_info, &job->info,
+				      job->is_obs_plugin,
+				      job->can_load_obs_plugin, job->code) &&
+		    job->module) {
+			link_module(job->module);
+
+			if (!obs_init_module(job->module))
+				free_module(job->module);
+		}
+
+		bfree((char *)job->info.bin_path);
+		bfree((char *)job->info.data_path);
+		bfree((char *)job->info.name);
+	}
+
+	da_free(jobs);
+
+#ifdef _WIN32
+	profile_start(reset_win32_symbol_paths_name);
+	reset_win32_symbol_paths();
+	profile_end(reset_win32_symbol_paths_name);
+#endif
+	profile_end(obs_load_all_modules_parallel_name);
+
+	if (mfi) {
+		mfi->count = fail_info.fail_count;
+		mfi->failed_modules = strlist_split(
+			fail_info.fail_modules.array, ';', false);
+	}
+	dstr_free(&fail_info.fail_modules);
+}
+
+/* ------------------------------------------------------------------------- */
+/* module index and deferred (lazy) module activation */
+
+static bool get_module_file_stats(const char *path, int64_t *size,
+				  int64_t *mtime)
+{
+	struct stat st;
+
+	if (os_stat(path, &st) != 0)
+		return false;
+
+	*size = (int64_t)st.st_size;
+	*mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+#define add_type_ids(ids, types, start, end)                              \
+	do {                                                              \
+		for (size_t i = start; i < end && i < types.num; i++) {   \
+			obs_data_t *item = obs_data_create();             \
+			obs_data_set_string(item, "id", types.array[i].id); \
+			obs_data_array_push_back(ids, item);              \
+			obs_data_release(item);                           \
+		}                                                         \
+	} while (false)
+
+bool obs_write_module_index(const char *path)
+{
+	obs_data_array_t *modules;
+	obs_data_t *index;
+	bool success;
+
+	if (!obs || !path)
+		return false;
+
+	index = obs_data_create();
+	modules = obs_data_array_create();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next) {
+		obs_data_array_t *ids = obs_data_array_create();
+		obs_data_t *entry;
+		int64_t size, mtime;
+
+		if (!mod->loaded ||
+		    !get_module_file_stats(mod->bin_path, &size, &mtime)) {
+			obs_data_array_release(ids);
+			continue;
+		}
+
+		add_type_ids(ids, obs->source_types, mod->source_types_start,
+			     mod->source_types_end);
+		add_type_ids(ids, obs->output_types, mod->output_types_start,
+			     mod->output_types_end);
+		add_type_ids(ids, obs->encoder_types, mod->encoder_types_start,
+			     mod->encoder_types_end);
+		add_type_ids(ids, obs->service_types, mod->service_types_start,
+			     mod->service_types_end);
+
+		entry = obs_data_create();
+		obs_data_set_string(entry, "bin_path", mod->bin_path);
+		obs_data_set_int(entry, "size", size);
+		obs_data_set_int(entry, "mtime", mtime);
+		obs_data_set_array(entry, "types", ids);
+
+		/* modules that register no types most likely do their work
+		 * in obs_module_load itself, so never defer them */
+		obs_data_set_bool(entry, "deferrable",
+				  obs_data_array_count(ids) > 0);
+
+		obs_data_array_push_back(modules, entry);
+		obs_data_release(entry);
+		obs_data_array_release(ids);
+	}
+	pthread_mutex_unlock(&obs->modules_mutex);
+
+	obs_data_set_array(index, "modules", modules);
+	success = obs_data_save_json_safe(index, path, "tmp", "bak");
+
+	obs_data_array_release(modules);
+	obs_data_release(index);
+	return success;
+}
+
+#undef add_type_ids
+
+static void deferred_module_free(struct obs_deferred_module *dm)
+{
+	for (size_t i = 0; i < dm->type_ids.num; i++)
+		bfree(dm->type_ids.array[i]);
+	da_free(dm->type_ids);
+	bfree(dm->bin_path);
+	bfree(dm->data_path);
+	bfree(dm->name);
+}
+
+void free_deferred_modules(void)
+{
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		deferred_module_free(obs->deferred_modules.array + i);
+	da_free(obs->deferred_modules);
+}
+
+static obs_data_t *find_index_entry(obs_data_array_t *modules,
+				    const char *bin_path)
+{
+	size_t count = obs_data_array_count(modules);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *entry = obs_data_array_item(modules, i);
+		if (strcmp(obs_data_get_string(entry, "bin_path"), bin_path) ==
+		    0)
+			return entry;
+		obs_data_release(entry);
+	}
+
+	return NULL;
+}
+
+static bool defer_module(obs_data_t *entry,
+			 const struct obs_module_info2 *info)
+{
+	struct obs_deferred_module dm = {0};
+	obs_data_array_t *ids;
+	int64_t size, mtime;
+	size_t count;
+
+	if (!obs_data_get_bool(entry, "deferrable"))
+		return false;
+	if (!get_module_file_stats(info->bin_path, &size, &mtime))
+		return false;
+	if (obs_data_get_int(entry, "size") != size ||
+	    obs_data_get_int(entry, "mtime") != mtime)
+		return false;
+
+	ids = obs_data_get_array(entry, "types");
+	count = obs_data_array_count(ids);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(ids, i);
+		const char *id = obs_data_get_string(item, "id");
+		if (*id) {
+			char *id_copy = bstrdup(id);
+			da_push_back(dm.type_ids, &id_copy);
+		}
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(ids);
+
+	if (!dm.type_ids.num)
+		return false;
+
+	dm.bin_path = bstrdup(info->bin_path);
+	dm.data_path = bstrdup(info->data_path);
+	dm.name = bstrdup(info->name);
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	da_push_back(obs->deferred_modules, &dm);
+	pthread_mutex_unlock(&obs->modules_mutex);
+
+	blog(LOG_DEBUG, "Deferring module '%s' until first use",
+	     info->bin_path);
+	return true;
+}
+
+struct lazy_load_data {
+	obs_data_array_t *modules;
+	struct fail_info fail_info;
+};
+
+static void lazy_load_callback(void *param,
+			       const struct obs_module_info2 *info)
+{
+	struct lazy_load_data *data = param;
+	obs_data_t *entry = find_index_entry(data->modules, info->bin_path);
+	bool deferred = entry && defer_module(entry, info);
+
+	obs_data_release(entry);
+
+	if (!deferred)
+		load_all_callback(&data->fail_info, info);
+}
+
+static const char *obs_load_all_modules_lazy_name = "obs_load_all_modules_lazy";
+
+void obs_load_all_modules_lazy(const char *index_path,
+			       struct obs_module_failure_info *mfi)
+{
+	struct lazy_load_data data = {0};
+	obs_data_t *index = NULL;
+
+	if (mfi)
+		memset(mfi, 0, sizeof(*mfi));
+
+	if (index_path && os_file_exists(index_path))
+		index = obs_data_create_from_json_file(index_path);
+	if (index)
+		data.modules = obs_data_get_array(index, "modules");
+
+	profile_start(obs_load_all_modules_lazy_name);
+	obs_find_modules2(lazy_load_callback, &data);
+#ifdef _WIN32
+	profile_start(reset_win32_symbol_paths_name);
+	reset_win32_symbol_paths();
+	profile_end(reset_win32_symbol_paths_name);
+#endif
+	profile_end(obs_load_all_modules_lazy_name);
+
+	obs_data_array_release(data.modules);
+	obs_data_release(index);
+
+	if (mfi) {
+		mfi->count = data.fail_info.fail_count;
+		mfi->failed_modules = strlist_split(
+			data.fail_info.fail_modules.array, ';', false);
+	}
+	dstr_free(&data.fail_info.fail_modules);
+}
+
+/* also matches versioned ids (<id>_v<version>) of the requested id, so
+ * lookups by unversioned id activate the module too */
+static inline bool type_id_matches(const char *type_id, const char *id)
+{
+	size_t len = strlen(id);
+
+	if (strncmp(type_id, id, len) != 0)
+		return false;
+	if (!type_id[len])
+		return true;
+	if (type_id[len] != '_' || type_id[len + 1] != 'v')
+		return false;
+
+	type_id += len + 2;
+	if (!*type_id)
+		return false;
+	while (*type_id >= '0' && *type_id <= '9')
+		type_id++;
+	return !*type_id;
+}
+
+static inline bool deferred_module_has_id(struct obs_deferred_module *dm,
+					  const char *id)
+{
+	for (size_t i = 0; i < dm->type_ids.num; i++) {
+		if (type_id_matches(dm->type_ids.array[i], id))
+			return true;
+	}
+
+	return false;
+}
+
+static size_t find_deferred_module(const char *id)
+{
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		if (deferred_module_has_id(obs->deferred_modules.array + i, id))
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+/* modules_mutex must be locked.  modules are only activated with the
+ * graphics context entered, so a thread that holds the graphics context
+ * never gets here while another thread activates a module, unless there is
+ * no graphics context at all. */
+static void wait_for_deferred_activation(void)
+{
+	pthread_mutex_unlock(&obs->modules_mutex);
+	os_event_wait(obs->deferred_modules_idle);
+	pthread_mutex_lock(&obs->modules_mutex);
+}
+
+static bool deferred_activation_pending(const char *id)
+{
+	bool pending;
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	pending = obs->activating_deferred_module ||
+		  find_deferred_module(id) != DARRAY_INVALID;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return pending;
+}
+
+static void load_deferred_module(struct obs_deferred_module *dm,
+				 const char *id)
+{
+	struct obs_module_info2 info = {dm->bin_path, dm->data_path, dm->name};
+	obs_module_t *mod;
+
+	blog(LOG_INFO, "Activating module '%s' for type '%s'", dm->name, id);
+
+	load_all_callback(NULL, &info);
+
+	/* a module that loaded successfully was linked in first */
+	mod = obs->first_module;
+	if (!mod || !mod->loaded || strcmp(mod->bin_path, dm->bin_path) != 0)
+		return;
+
+	if (os_atomic_load_bool(&obs->modules_post_loaded) && mod->post_load)
+		mod->post_load();
+}
+
+bool obs_activate_deferred_module(const char *id)
+{
+	struct obs_deferred_module dm;
+	bool activated = false;
+	size_t idx;
+
+	if (!obs || !id || !deferred_activation_pending(id))
+		return false;
+
+	/* modules are activated one at a time, since loading them registers
+	 * types.  the mutex is not held while loading: obs_module_load can
+	 * wait on other threads.  the graphics context is entered before the
+	 * mutex, because obs_module_load can enter it too, and a thread that
+	 * already holds it must never wait for another thread's activation. */
+	obs_enter_graphics();
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	for (;;) {
+		idx = find_deferred_module(id);
+		if (!obs->activating_deferred_module)
+			break;
+
+		/* type lookups made by the obs_module_load being run (for
+		 * example duplicate checks on registration) */
+		if (pthread_equal(obs->deferred_activation_thread,
+				  pthread_self()))
+			goto unlock;
+
+		wait_for_deferred_activation();
+
+		/* the module being activated may have registered the type */
+		activated = true;
+	}
+
+	if (idx == DARRAY_INVALID)
+		goto unlock;
+
+	dm = obs->deferred_modules.array[idx];
+	da_erase(obs->deferred_modules, idx);
+
+	obs->activating_deferred_module = true;
+	obs->deferred_activation_thread = pthread_self();
+	os_event_reset(obs->deferred_modules_idle);
+	pthread_mutex_unlock(&obs->modules_mutex);
+
+	load_deferred_module(&dm, id);
+	deferred_module_free(&dm);
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	obs->activating_deferred_module = false;
+	os_event_signal(obs->deferred_modules_idle);
+	activated = true;
+
+unlock:
+	pthread_mutex_unlock(&obs->modules_mutex);
+	obs_leave_graphics();
+	return activated;
+}
+
+void obs_activate_deferred_modules(void)
+{
+	if (!obs)
+		return;
+
+	for (;;) {
+		char *id = NULL;
+
+		pthread_mutex_lock(&obs->modules_mutex);
+		if (obs->deferred_modules.num)
+			id = bstrdup(obs->deferred_modules.array[0]
+					     .type_ids.array[0]);
+		pthread_mutex_unlock(&obs->modules_mutex);
+
+		if (!id)
+			break;
+
+		bool activated = obs_activate_deferred_module(id);
+		bfree(id);
+
+		if (!activated)
+			break;
+	}
+}
+
 void obs_module_failure_info_free(struct obs_module_failure_info *mfi)
 {
 	if (mfi->failed_modules) {
@@ -411,6 +987,10 @@ void obs_module_failure_info_free(struct obs_module_failure_info *mfi)
 
 void obs_post_load_modules(void)
 {
+	/* set first, modules activated by a post load get theirs when they
+	 * are activated */
+	os_atomic_set_bool(&obs->modules_post_loaded, true);
+
 	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next)
 		if (mod->post_load)
 			mod->post_load();
@@ -586,11 +1166,13 @@ void obs_enum_modules(obs_enum_module_callback_t callback, void *param)
 	if (!obs)
 		return;
 
+	pthread_mutex_lock(&obs->modules_mutex);
 	module = obs->first_module;
 	while (module) {
 		callback(param, module);
 		module = module->next;
 	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 }
 
 void free_module(struct obs_module *mod)
@@ -610,6 +1192,7 @@ void free_module(struct obs_module *mod)
 		/* os_dlclose(mod->module); */
 	}
 
+	pthread_mutex_lock(&obs->modules_mutex);
 	for (obs_module_t *m = obs->first_module; !!m; m = m->next) {
 		if (m->next == mod) {
 			m->next = mod->next;
@@ -619,6 +1202,7 @@ void free_module(struct obs_module *mod)
 
 	if (obs->first_module == mod)
 		obs->first_module = mod->next;
+	pthread_mutex_unlock(&obs->modules_mutex);
 
 	bfree(mod->mod_name);
 	bfree(mod->bin_path);
@@ -672,6 +1256,30 @@ cleanup:
 	return lookup;
 }
 
+/* lookups hand out pointers into the type arrays.  a module activated on
+ * first use registers its types while other threads may hold such pointers,
+ * so an array that grows during an activation keeps its old storage around
+ * until shutdown instead of freeing it. */
+static void push_registered_type(const size_t element_size,
+				 struct darray *types, const void *item)
+{
+	pthread_mutex_lock(&obs->modules_mutex);
+
+	if (obs->activating_deferred_module && types->num == types->capacity &&
+	    types->array) {
+		void *retired = types->array;
+		size_t capacity = types->capacity * 2;
+
+		types->array = bmalloc(element_size * capacity);
+		memcpy(types->array, retired, element_size * types->num);
+		types->capacity = capacity;
+		da_push_back(obs->retired_type_arrays, &retired);
+	}
+
+	darray_push_back(element_size, types, item);
+	pthread_mutex_unlock(&obs->modules_mutex);
+}
+
 #define REGISTER_OBS_DEF(size_var, structure, dest, info)               \
 	do {                                                            \
 		struct structure data = {0};                            \
@@ -693,7 +1301,7 @@ cleanup:
 		}                                                       \
                                                                         \
 		memcpy(&data, info, size_var);                          \
-		da_push_back(dest, &data);                              \
+		push_registered_type(sizeof(data), &dest.da, &data);    \
 	} while (false)
 
 #define CHECK_REQUIRED_VAL(type, info, val, func)                       \
@@ -828,8 +1436,8 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 
 	if (array)
-		darray_push_back(sizeof(struct obs_source_info), array, &data);
-	da_push_back(obs->source_types, &data);
+		push_registered_type(sizeof(data), array, &data);
+	push_registered_type(sizeof(data), &obs->source_types.da, &data);
 	return;
 
 error:
@@ -21,9 +21,7 @@
 #include "graphics/math-extra.h"
 #include "obs.h"
 #include "obs-internal.h"
-
-#include <caption/caption.h>
-#include <caption/mpeg.h>
+#include "obs-caption-sei.h"
 
 #define get_weak(output) ((obs_weak_output_t *)output->context.control)
 
@@ -60,14 +58,28 @@ static inline bool data_capture_ending(const struct obs_output *output)
 	return os_atomic_load_bool(&output->end_data_capture_thread_active);
 }
 
-const struct obs_output_info *find_output(const char *id)
+static const struct obs_output_info *find_output_info(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->output_types.num; i++)
-		if (strcmp(obs->output_types.array[i].id, id) == 0)
-			return obs->output_types.array + i;
+	const struct obs_output_info *found = NULL;
 
-	return NULL;
+	pthread_mutex_lock(&obs->modules_mutex);
+	for (size_t i = 0; i < obs->output_types.num; i++) {
+		if (strcmp(obs->output_types.array[i].id, id) == 0) {
+			found = obs->output_types.array + i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&obs->modules_mutex);
+
+	return found;
+}
+
+const struct obs_output_info *find_output(const char *id)
+{
+	const struct obs_output_info *info = find_output_info(id);
+	if (!info && obs_activate_deferred_module(id))
+		info = find_output_info(id);
+	return info;
 }
 
 const char *obs_output_get_display_name(const char *id)
@@ -249,6 +261,7 @@ void obs_output_destroy(obs_output_t *output)
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
 		circlebuf_free(&output->caption_data);
+		caption_sei_destroy(output->caption_sei);
 		if (output->owns_info_id)
 			bfree((void *)output->info.id);
 		if (output->last_error_message)
@@ -1237,99 +1250,24 @@ static inline bool has_higher_opposing_ts(struct obs_output *output,
 		return output->highest_video_ts > packet->dts_usec;
 }
 
-static const uint8_t nal_start[4] = {0, 0, 0, 1};
-
 static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 {
-	struct encoder_packet backup = *out;
-	sei_t sei;
-	uint8_t *data;
-	size_t size;
-	long ref = 1;
-
-	DARRAY(uint8_t) out_data;
-
 	if (out->priority > 1)
 		return false;
 
-	sei_init(&sei, 0.0);
-
-	da_init(out_data);
-	da_push_back_array(out_data, (uint8_t *)&ref, sizeof(ref));
-	da_push_back_array(out_data, out->data, out->size);
-
 	if (output->caption_data.size > 0) {
-
-		cea708_t cea708;
-		cea708_init(&cea708, 0); // set up a new popon frame
-		void *caption_buf = bzalloc(3 * sizeof(uint8_t));
-
-		while (output->caption_data.size > 0) {
-			circlebuf_pop_front(&output->caption_data, caption_buf,
-					    3 * sizeof(uint8_t));
-
-			if ((((uint8_t *)caption_buf)[0] & 0x3) != 0) {
-				// only send cea 608
-				continue;
-			}
-
-			uint16_t captionData = ((uint8_t *)caption_buf)[1];
-			captionData = captionData << 8;
-			captionData += ((uint8_t *)caption_buf)[2];
-
-			// padding
-			if (captionData == 0x8080) {
-				continue;
-			}
-
-			if (captionData == 0) {
-				continue;
-			}
-
-			if (!eia608_parity_varify(captionData)) {
-				continue;
-			}
-
-			cea708_add_cc_data(&cea708, 1,
-					   ((uint8_t *)caption_buf)[0] & 0x3,
-					   captionData);
-		}
-
-		bfree(caption_buf);
-
-		sei_message_t *msg =
-			sei_message_new(sei_type_user_data_registered_itu_t_t35,
-					0, CEA608_MAX_SIZE);
-		msg->size = cea708_render(&cea708, sei_message_data(msg),
-					  sei_message_size(msg));
-		sei_message_append(&sei, msg);
+		caption_sei_build_cc_data(output->caption_sei,
+					  &output->caption_data);
 	} else if (output->caption_head) {
-		caption_frame_t cf;
-		caption_frame_init(&cf);
-		caption_frame_from_text(&cf, &output->caption_head->text[0]);
-
-		sei_from_caption_frame(&sei, &cf);
+		caption_sei_build_text(output->caption_sei,
+				       &output->caption_head->text[0]);
 
 		struct caption_text *next = output->caption_head->next;
 		bfree(output->caption_head);
 		output->caption_head = next;
 	}
 
-	data = malloc(sei_render_size(&sei));
-	size = sei_render(&sei, data);
-	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
-	da_push_back_array(out_data, nal_start, 4);
-	da_push_back_array(out_data, data, size);
-	free(data);
-
-	obs_encoder_packet_release(out);
-
-	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
-
-	sei_free(&sei);
-
+	caption_sei_append(output->caption_sei, out);
 	return true;
 }
 
@@ -1379,6 +1317,8 @@ static inline void send_interleaved(struct obs_output *output)
 		pthread_mutex_unlock(&output->caption_mutex);
 	}
 
+	OBS_LATENCY_TRACE_PACKET(&out, OBS_LATENCY_INTERLEAVE);
+
 	output->info.encoded_packet(output->context.data, &out);
 	obs_encoder_packet_release(&out);
 }
@@ -1744,6 +1684,10 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 
 	if (output->active_delay_ns)
 		out = *packet;
+	else if (packet->type == OBS_ENCODER_VIDEO &&
+		 os_atomic_load_bool(&output->caption_headroom))
+		obs_encoder_packet_create_instance_ex(&out, packet,
+						      CAPTION_SEI_HEADROOM);
 	else
 		obs_encoder_packet_create_instance(&out, packet);
 
@@ -2584,10 +2528,21 @@ const char *obs_output_get_id(const obs_output_t *output)
 							     : NULL;
 }
 
+/* caption_mutex must be locked */
+static inline void enable_caption_sei(obs_output_t *output)
+{
+	if (output->caption_sei)
+		return;
+
+	output->caption_sei = caption_sei_create();
+	os_atomic_set_bool(&output->caption_headroom, true);
+}
+
 void obs_output_caption(obs_output_t *output,
 			const struct obs_source_cea_708 *captions)
 {
 	pthread_mutex_lock(&output->caption_mutex);
+	enable_caption_sei(output);
 	for (size_t i = 0; i < captions->packets; i++) {
 		circlebuf_push_back(&output->caption_data,
 				    captions->data + (i * 3),
@@ -2635,6 +2590,7 @@ void obs_output_output_caption_text2(obs_output_t *output, const char *text,
 	blog(LOG_DEBUG, "Caption text: %s", text);
 
 	pthread_mutex_lock(&output->caption_mutex);
+	enable_caption_sei(output);
 
 	output->caption_tail =
 		caption_text_new(text, size, output->caption_tail,
@@ -19,14 +19,28 @@
 
 #define get_weak(service) ((obs_weak_service_t *)service->context.control)
 
-const struct obs_service_info *find_service(const char *id)
+static const struct obs_service_info *find_service_info(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->service_types.num; i++)
-		if (strcmp(obs->service_types.array[i].id, id) == 0)
-			return obs->service_types.array + i;
+	const struct obs_service_info *found = NULL;
 
-	return NULL;
+	pthread_mutex_lock(&obs->modules_mutex);
+	for (size_t i = 0; i < obs->service_types.num; i++) {
+		if (strcmp(obs->service_types.array[i].id, id) == 0) {
+			found = obs->service_types.array + i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&obs->modules_mutex);
+
+	return found;
+}
+
+const struct obs_service_info *find_service(const char *id)
+{
+	const struct obs_service_info *info = find_service_info(id);
+	if (!info && obs_activate_deferred_module(id))
+		info = find_service_info(id);
+	return info;
 }
 
 const char *obs_service_get_display_name(const char *id)
@@ -50,28 +50,57 @@ static inline bool destroying(const struct obs_source *source)
 	return os_atomic_load_long(&source->destroying);
 }
 
-struct obs_source_info *get_source_info(const char *id)
+static struct obs_source_info *find_source_info(const char *id)
 {
+	struct obs_source_info *found = NULL;
+
+	pthread_mutex_lock(&obs->modules_mutex);
 	for (size_t i = 0; i < obs->source_types.num; i++) {
 		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->id, id) == 0)
-			return info;
+		if (strcmp(info->id, id) == 0) {
+			found = info;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 
-	return NULL;
+	return found;
 }
 
-struct obs_source_info *get_source_info2(const char *unversioned_id,
-					 uint32_t ver)
+struct obs_source_info *get_source_info(const char *id)
+{
+	struct obs_source_info *info = find_source_info(id);
+	if (!info && obs_activate_deferred_module(id))
+		info = find_source_info(id);
+	return info;
+}
+
+static struct obs_source_info *find_source_info2(const char *unversioned_id,
+						 uint32_t ver)
 {
+	struct obs_source_info *found = NULL;
+
+	pthread_mutex_lock(&obs->modules_mutex);
 	for (size_t i = 0; i < obs->source_types.num; i++) {
 		struct obs_source_info *info = &obs->source_types.array[i];
 		if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
-		    info->version == ver)
-			return info;
+		    info->version == ver) {
+			found = info;
+			break;
+		}
 	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 
-	return NULL;
+	return found;
+}
+
+struct obs_source_info *get_source_info2(const char *unversioned_id,
+					 uint32_t ver)
+{
+	struct obs_source_info *info = find_source_info2(unversioned_id, ver);
+	if (!info && obs_activate_deferred_module(unversioned_id))
+		info = find_source_info2(unversioned_id, ver);
+	return info;
 }
 
 static const char *source_signals[] = {
@@ -91,6 +120,7 @@ static const char *source_signals[] = {
 	"void enable(ptr source, bool enabled)",
 	"void rename(ptr source, string new_name, string prev_name)",
 	"void volume(ptr source, in out float volume)",
+	"void update(ptr source)",
 	"void update_properties(ptr source)",
 	"void update_flags(ptr source, int flags)",
 	"void audio_sync(ptr source, int out int offset)",
@@ -161,6 +191,18 @@ static void allocate_audio_mix_buffer(struct obs_source *source)
 	}
 }
 
+/* enough for roughly 250ms of audio, larger blocks take the locked path */
+static void allocate_audio_input_queue(struct obs_source *source)
+{
+	audio_t *audio = obs->audio.audio;
+	size_t channels = audio ? audio_output_get_channels(audio) : 2;
+	size_t sample_rate = audio ? audio_output_get_sample_rate(audio)
+				   : 48000;
+
+	spsc_circlebuf_init(&source->audio_input_queue,
+			    channels * sample_rate * sizeof(float) / 4);
+}
+
 static inline bool is_async_video_source(const struct obs_source *source)
 {
 	return (source->info.output_flags & OBS_SOURCE_ASYNC_VIDEO) ==
@@ -211,6 +253,8 @@ static bool obs_source_init(struct obs_source *source)
 
 	if (is_audio_source(source) || is_composite_source(source))
 		allocate_audio_output_buffer(source);
+	if (is_audio_source(source) && !source->info.audio_render)
+		allocate_audio_input_queue(source);
 	if (source->info.audio_mix)
 		allocate_audio_mix_buffer(source);
 
@@ -722,6 +766,8 @@ static void obs_source_destroy_defer(struct obs_source *source)
 		bfree(source->audio_data.data[i]);
 	for (i = 0; i < MAX_AUDIO_CHANNELS; i++)
 		circlebuf_free(&source->audio_input_buf[i]);
+	spsc_circlebuf_free(&source->audio_input_queue);
+	da_free(source->audio_queue_block);
 	audio_resampler_destroy(source->resampler);
 	bfree(source->audio_output_buf[0][0]);
 	bfree(source->audio_mix_buf[0]);
@@ -995,6 +1041,8 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 		source->info.update(source->context.data,
 				    source->context.settings);
 	}
+
+	obs_source_dosignal(source, NULL, "update");
 }
 
 void obs_source_reset_settings(obs_source_t *source, obs_data_t *settings)
@@ -1211,6 +1259,13 @@ static void async_tick(obs_source_t *source)
 		}
 
 		source->cur_async_frame = get_closest_frame(source, sys_time);
+
+#ifdef ENABLE_LATENCY_TRACING
+		if (source->cur_async_frame)
+			obs_latency_trace(OBS_LATENCY_VIDEO, sys_time,
+					  OBS_LATENCY_CAPTURE,
+					  source->cur_async_frame->trace_ts);
+#endif
 	}
 
 	source->last_sys_timestamp = sys_time;
@@ -1324,6 +1379,21 @@ static inline void reset_audio_timing(obs_source_t *source, uint64_t timestamp,
 {
 	source->timing_set = true;
 	source->timing_adjust = os_time - timestamp;
+	audio_drift_reset_error(&source->drift);
+}
+
+/* Once a steady drift of the device clock is found, the source's resampler is
+ * made to produce slightly more or fewer samples so that the timestamps the
+ * sample count predicts keep up with the source's timestamps, instead of the
+ * timestamps eventually exceeding TS_SMOOTHING_THRESHOLD and jumping. */
+static void update_drift_control(obs_source_t *source, int64_t err_ns,
+				 uint32_t frames, size_t sample_rate)
+{
+	if (audio_drift_update(&source->drift, err_ns, frames, sample_rate))
+		blog(LOG_INFO,
+		     "Audio clock of source '%s' drifts by about %.0f ppm, "
+		     "compensating",
+		     source->context.name, source->drift.ppm);
 }
 
 static void reset_audio_data(obs_source_t *source, uint64_t os_time)
@@ -1336,6 +1406,54 @@ static void reset_audio_data(obs_source_t *source, uint64_t os_time)
 
 	source->last_audio_input_buf_size = 0;
 	source->audio_ts = os_time;
+}
+
+/* drops queued audio without buffering it, call with audio_buf_mutex
+ * locked */
+static void discard_audio_queue(obs_source_t *source)
+{
+	struct spsc_circlebuf *queue = &source->audio_input_queue;
+	size_t size = spsc_circlebuf_size(queue);
+
+	if (size)
+		spsc_circlebuf_pop_front(queue, NULL, size);
+}
+
+/* call with audio_buf_mutex locked.  the timing state belongs to the thread
+ * outputting the source's audio, which applies the reset with its next
+ * packet.  with resync set, the timing is derived from that packet again. */
+void obs_source_request_audio_timing_reset(obs_source_t *source, bool resync,
+					   uint64_t timestamp, uint64_t os_time)
+{
+	source->audio_timing_resync = resync;
+	source->audio_timing_reset_ts = timestamp;
+	source->audio_timing_reset_os_time = os_time;
+	os_atomic_set_bool(&source->audio_timing_reset_pending, true);
+}
+
+static void apply_audio_timing_reset(obs_source_t *source)
+{
+	bool resync;
+	uint64_t timestamp;
+	uint64_t os_time;
+
+	pthread_mutex_lock(&source->audio_buf_mutex);
+	resync = source->audio_timing_resync;
+	timestamp = source->audio_timing_reset_ts;
+	os_time = source->audio_timing_reset_os_time;
+	os_atomic_set_bool(&source->audio_timing_reset_pending, false);
+	pthread_mutex_unlock(&source->audio_buf_mutex);
+
+	if (resync)
+		source->timing_set = false;
+	else
+		reset_audio_timing(source, timestamp, os_time);
+
+	/* the timeline restarts with the next packet.  sources with system
+	 * timestamps set timing_set again right away, so don't let the drift
+	 * controller take the step from the old timeline for drift. */
+	audio_drift_reset_error(&source->drift);
+	source->next_audio_ts_min = 0;
 	source->next_audio_sys_ts_min = os_time;
 }
 
@@ -1347,10 +1465,13 @@ static void handle_ts_jump(obs_source_t *source, uint64_t expected, uint64_t ts,
 	     "expected value %" PRIu64 ", input value %" PRIu64,
 	     source->context.name, diff, expected, ts);
 
-	pthread_mutex_lock(&source->audio_buf_mutex);
 	reset_audio_timing(source, ts, os_time);
-	reset_audio_data(source, os_time);
-	pthread_mutex_unlock(&source->audio_buf_mutex);
+	source->next_audio_sys_ts_min = os_time;
+
+	/* the buffered data itself is reset by the audio thread when it
+	 * picks up the next queued block */
+	source->audio_queue_reset = true;
+	source->audio_queue_reset_ts = os_time;
 }
 
 static void source_signal_audio_data(obs_source_t *source,
@@ -1435,6 +1556,117 @@ static inline void source_output_audio_push_back(obs_source_t *source,
 	source->last_audio_input_buf_size = 0;
 }
 
+struct audio_queue_header {
+	uint64_t timestamp;
+	uint64_t reset_ts;
+	uint32_t frames;
+	uint32_t channels;
+	bool push_back;
+	bool reset;
+};
+
+static void source_output_audio_buffer(obs_source_t *source,
+				       const struct audio_data *in,
+				       bool push_back)
+{
+	if (push_back && source->audio_ts)
+		source_output_audio_push_back(source, in);
+	else
+		source_output_audio_place(source, in);
+}
+
+static void process_queued_audio_block(obs_source_t *source,
+				       const struct audio_queue_header *header,
+				       uint8_t *block)
+{
+	struct audio_data in = {0};
+	size_t size = header->frames * sizeof(float);
+
+	if (header->reset)
+		reset_audio_data(source, header->reset_ts);
+	if (!header->frames)
+		return;
+
+	for (size_t i = 0; i < header->channels; i++)
+		in.data[i] = block + i * size;
+
+	in.frames = header->frames;
+	in.timestamp = header->timestamp;
+
+	source_output_audio_buffer(source, &in, header->push_back);
+}
+
+/* moves queued audio into the source's audio buffers, call with
+ * audio_buf_mutex locked */
+void obs_source_flush_audio_queue(obs_source_t *source)
+{
+	struct spsc_circlebuf *queue = &source->audio_input_queue;
+	struct audio_queue_header header;
+
+	if (!queue->data)
+		return;
+
+	while (spsc_circlebuf_pop_front(queue, &header, sizeof(header))) {
+		size_t size = header.channels * header.frames * sizeof(float);
+
+		da_resize(source->audio_queue_block, size);
+		spsc_circlebuf_pop_front(queue, source->audio_queue_block.array,
+					 size);
+
+		process_queued_audio_block(source, &header,
+					   source->audio_queue_block.array);
+	}
+}
+
+static void source_queue_audio_data(obs_source_t *source,
+				    const struct audio_data *in,
+				    bool push_back)
+{
+	struct spsc_circlebuf *queue = &source->audio_input_queue;
+	size_t channels = audio_output_get_channels(obs->audio.audio);
+	size_t size = in->frames * sizeof(float);
+	struct audio_queue_header header = {
+		.timestamp = in->timestamp,
+		.reset_ts = source->audio_queue_reset_ts,
+		.frames = in->frames,
+		.channels = (uint32_t)channels,
+		.push_back = push_back,
+		.reset = source->audio_queue_reset,
+	};
+
+	source->audio_queue_reset = false;
+
+	if (queue->data &&
+	    spsc_circlebuf_space(queue) >= sizeof(header) + channels * size) {
+		spsc_circlebuf_write(queue, &header, sizeof(header));
+		for (size_t i = 0; i < channels; i++)
+			spsc_circlebuf_write(queue, in->data[i], size);
+		spsc_circlebuf_commit(queue);
+		return;
+	}
+
+	/* queue is full (or the block is larger than the queue), so fall
+	 * back to writing the buffers directly.  queued data goes first to
+	 * keep everything in order. */
+	pthread_mutex_lock(&source->audio_buf_mutex);
+	obs_source_flush_audio_queue(source);
+	if (header.reset)
+		reset_audio_data(source, header.reset_ts);
+	if (in->frames)
+		source_output_audio_buffer(source, in, push_back);
+	pthread_mutex_unlock(&source->audio_buf_mutex);
+}
+
+/* monitor only sources don't buffer audio, but a pending reset still has to
+ * reach the buffers in case they are mixed again later */
+static inline void source_queue_audio_reset(obs_source_t *source)
+{
+	struct audio_data in = {0};
+
+	if (source->audio_queue_reset)
+		source_queue_audio_data(source, &in, false);
+}
+
 static inline bool source_muted(obs_source_t *source, uint64_t os_time)
 {
 	if (source->push_to_mute_enabled && source->user_push_to_mute_pressed)
@@ -1466,6 +1698,9 @@ static void source_output_audio_data(obs_source_t *source,
 	bool using_direct_ts = false;
 	bool push_back = false;
 
+	if (os_atomic_load_bool(&source->audio_timing_reset_pending))
+		apply_audio_timing_reset(source);
+
 	/* detects 'directly' set timestamps as long as they're within
 	 * a certain threshold */
 	if (uint64_diff(in.timestamp, os_time) < MAX_TS_VAR) {
@@ -1487,6 +1722,12 @@ static void source_output_audio_data(obs_source_t *source,
 		else if (diff < TS_SMOOTHING_THRESHOLD) {
 			if (source->async_unbuffered && source->async_decoupled)
 				source->timing_adjust = os_time - in.timestamp;
+			else if (using_direct_ts)
+				update_drift_control(
+					source,
+					(int64_t)(in.timestamp -
+						  source->next_audio_ts_min),
+					in.frames, sample_rate);
 			in.timestamp = source->next_audio_ts_min;
 		} else {
 			blog(LOG_DEBUG,
@@ -1503,8 +1744,6 @@ static void source_output_audio_data(obs_source_t *source,
 
 	in.timestamp += source->timing_adjust;
 
-	pthread_mutex_lock(&source->audio_buf_mutex);
-
 	if (source->next_audio_sys_ts_min == in.timestamp) {
 		push_back = true;
 
@@ -1539,14 +1778,10 @@ static void source_output_audio_data(obs_source_t *source,
 		source->last_sync_offset = sync_offset;
 	}
 
-	if (source->monitoring_type != OBS_MONITORING_TYPE_MONITOR_ONLY) {
-		if (push_back && source->audio_ts)
-			source_output_audio_push_back(source, &in);
-		else
-			source_output_audio_place(source, &in);
-	}
-
-	pthread_mutex_unlock(&source->audio_buf_mutex);
+	if (source->monitoring_type != OBS_MONITORING_TYPE_MONITOR_ONLY)
+		source_queue_audio_data(source, &in, push_back);
+	else
+		source_queue_audio_reset(source);
 
 	source_signal_audio_data(source, data, source_muted(source, os_time));
 }
@@ -3454,6 +3689,9 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 
 	copy_frame_data(new_frame, frame);
 
+#ifdef ENABLE_LATENCY_TRACING
+	new_frame->trace_ts = os_gettime_ns();
+#endif
 	new_frame->in_use = false;
 
 	return new_frame;
@@ -3729,8 +3967,10 @@ void obs_source_show_preloaded_video(obs_source_t *source)
 	sys_ts = (source->monitoring_type != OBS_MONITORING_TYPE_MONITOR_ONLY)
 			 ? os_gettime_ns()
 			 : 0;
-	reset_audio_timing(source, source->last_frame_ts, sys_ts);
+	discard_audio_queue(source);
 	reset_audio_data(source, sys_ts);
+	obs_source_request_audio_timing_reset(source, false,
+					      source->last_frame_ts, sys_ts);
 	pthread_mutex_unlock(&source->audio_buf_mutex);
 }
 
@@ -3858,9 +4098,11 @@ static inline void reset_resampler(obs_source_t *source,
 	source->resampler = NULL;
 	source->resample_offset = 0;
 
+	/* drift compensation needs a resampler even if nothing is converted */
 	if (source->sample_info.samples_per_sec == obs_info->samples_per_sec &&
 	    source->sample_info.format == obs_info->format &&
-	    source->sample_info.speakers == obs_info->speakers) {
+	    source->sample_info.speakers == obs_info->speakers &&
+	    !source->drift.compensating) {
 		source->audio_failed = false;
 		return;
 	}
@@ -3960,7 +4202,8 @@ static void process_audio(obs_source_t *source,
 
 	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
 	    source->sample_info.format != audio->format ||
-	    source->sample_info.speakers != audio->speakers)
+	    source->sample_info.speakers != audio->speakers ||
+	    (source->drift.compensating && !source->resampler))
 		reset_resampler(source, audio);
 
 	if (source->audio_failed)
@@ -3971,6 +4214,18 @@ static void process_audio(obs_source_t *source,
 
 		memset(output, 0, sizeof(output));
 
+		if (source->drift.compensating) {
+			int distance = (int)audio_output_get_sample_rate(
+					       obs->audio.audio) *
+				       AUDIO_DRIFT_DISTANCE_SEC;
+			int delta = audio_drift_get_delta(
+				source->drift.ppm, distance,
+				&source->drift.remainder);
+
+			audio_resampler_set_compensation(source->resampler,
+							 delta, distance);
+		}
+
 		audio_resampler_resample(source->resampler, output, &frames,
 					 &source->resample_offset, audio->data,
 					 audio->frames);
@@ -5700,8 +5955,9 @@ void obs_source_set_async_decoupled(obs_source_t *source, bool decouple)
 	source->async_decoupled = decouple;
 	if (decouple) {
 		pthread_mutex_lock(&source->audio_buf_mutex);
-		source->timing_set = false;
+		discard_audio_queue(source);
 		reset_audio_data(source, 0);
+		obs_source_request_audio_timing_reset(source, true, 0, 0);
 		pthread_mutex_unlock(&source->audio_buf_mutex);
 	}
 }
@@ -97,6 +97,9 @@ static void *gpu_encode_thread(struct obs_core_video_mix *video)
 			if (!encoder->start_ts)
 				encoder->start_ts = timestamp;
 
+			OBS_LATENCY_TRACE_ENCODE(encoder, OBS_LATENCY_VIDEO,
+						 timestamp, encoder->cur_pts);
+
 			if (++lock_count == encoders.num)
 				next_key = 0;
 			else
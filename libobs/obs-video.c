@@ -479,6 +479,8 @@ static inline bool queue_frame(struct obs_core_video_mix *video,
 	gs_texture_release_sync(tf.tex, ++tf.lock_key);
 	circlebuf_push_back(&video->gpu_encoder_queue, &tf, sizeof(tf));
 
+	OBS_LATENCY_TRACE(OBS_LATENCY_VIDEO, tf.timestamp, OBS_LATENCY_OUTPUT);
+
 	os_sem_post(video->gpu_encode_semaphore);
 
 finish:
@@ -883,6 +885,10 @@ static inline void output_frame(struct obs_core_video_mix *video)
 	GS_DEBUG_MARKER_END();
 	profile_end(output_frame_render_video_name);
 
+	if (raw_active || gpu_active)
+		OBS_LATENCY_TRACE(OBS_LATENCY_VIDEO, obs->video.video_time,
+				  OBS_LATENCY_RENDER);
+
 	if (raw_active) {
 		profile_start(output_frame_download_frame_name);
 		frame_ready = download_frame(video, prev_texture, &frame);
@@ -905,6 +911,9 @@ static inline void output_frame(struct obs_core_video_mix *video)
 		profile_start(output_frame_output_video_data_name);
 		output_video_data(video, &frame, vframe_info.count);
 		profile_end(output_frame_output_video_data_name);
+
+		OBS_LATENCY_TRACE(OBS_LATENCY_VIDEO, vframe_info.timestamp,
+				  OBS_LATENCY_OUTPUT);
 	}
 
 	if (++video->cur_texture == NUM_TEXTURES)
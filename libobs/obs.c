@@ -479,6 +479,14 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 
 	gs_enter_context(video->graphics);
 
+	if (obs->module_config_path) {
+		struct dstr cache_dir = {0};
+		dstr_copy(&cache_dir, obs->module_config_path);
+		dstr_cat(&cache_dir, "/libobs/effect_cache");
+		gs_set_effect_cache_dir(cache_dir.array);
+		dstr_free(&cache_dir);
+	}
+
 	char *filename = obs_find_data_file("default.effect");
 	video->default_effect = gs_effect_create_from_file(filename, NULL);
 	bfree(filename);
@@ -1024,6 +1032,10 @@ static inline bool obs_init_handlers(void)
 	if (!obs->procs)
 		return false;
 
+#ifdef ENABLE_LATENCY_TRACING
+	obs_latency_add_procs(obs->procs);
+#endif
+
 	return signal_handler_add_array(obs->signals, obs_signals);
 }
 
@@ -1131,6 +1143,7 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	pthread_mutex_init_value(&obs->audio.task_mutex);
 	pthread_mutex_init_value(&obs->video.task_mutex);
 	pthread_mutex_init_value(&obs->video.mixes_mutex);
+	pthread_mutex_init_value(&obs->modules_mutex);
 
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
@@ -1152,6 +1165,13 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	if (!obs->destruction_task_thread)
 		return false;
 
+	if (pthread_mutex_init_recursive(&obs->modules_mutex) != 0)
+		return false;
+	if (os_event_init(&obs->deferred_modules_idle, OS_EVENT_TYPE_MANUAL) !=
+	    0)
+		return false;
+	os_event_signal(obs->deferred_modules_idle);
+
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
@@ -1329,6 +1349,13 @@ void obs_shutdown(void)
 	}
 	obs->first_module = NULL;
 
+	free_deferred_modules();
+	for (size_t i = 0; i < obs->retired_type_arrays.num; i++)
+		bfree(obs->retired_type_arrays.array[i]);
+	da_free(obs->retired_type_arrays);
+	pthread_mutex_destroy(&obs->modules_mutex);
+	os_event_destroy(obs->deferred_modules_idle);
+
 	obs_free_data();
 	obs_free_audio();
 	obs_free_video();
@@ -1353,6 +1380,10 @@ void obs_shutdown(void)
 	obs = NULL;
 	bfree(cmdline_args.argv);
 
+	blog(LOG_INFO, "Memory pool: %ld blocks reused, %ld cached",
+	     bpool_num_reused(), bpool_num_cached());
+	bpool_trim();
+
 #ifdef _WIN32
 	if (com_initialized)
 		uninitialize_com();
@@ -1505,11 +1536,21 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 		audio->max_buffering_ticks = 45;
 	}
 	audio->fixed_buffer = oai->fixed_buffering;
+	audio->shrink_buffering_ticks =
+		(uint64_t)oai->shrink_buffering_ms * oai->samples_per_sec /
+		SEC_TO_MSEC / AUDIO_OUTPUT_FRAMES;
+	audio->min_headroom = INT64_MAX;
 
 	int max_buffering_ms = audio->max_buffering_ticks *
 				   AUDIO_OUTPUT_FRAMES * SEC_TO_MSEC /
 				   (int)oai->samples_per_sec;
 
+	const char *buffering_type = "dynamically increasing";
+	if (oai->fixed_buffering)
+		buffering_type = "fixed";
+	else if (audio->shrink_buffering_ticks)
+		buffering_type = "dynamically increasing and decreasing";
+
 	ai.name = "Audio";
 	ai.samples_per_sec = oai->samples_per_sec;
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
@@ -1524,7 +1565,7 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 		 "\tmax buffering:   %d milliseconds\n"
 		 "\tbuffering type:  %s",
 		 (int)ai.samples_per_sec, (int)ai.speakers, max_buffering_ms,
-		 oai->fixed_buffering ? "fixed" : "dynamically increasing");
+		 buffering_type);
 
 	return obs_init_audio(&ai);
 }
@@ -1586,30 +1627,50 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 
 bool obs_enum_source_types(size_t idx, const char **id)
 {
-	if (idx >= obs->source_types.num)
-		return false;
-	*id = obs->source_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->source_types.num;
+	if (found)
+		*id = obs->source_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 bool obs_enum_input_types(size_t idx, const char **id)
 {
-	if (idx >= obs->input_types.num)
-		return false;
-	*id = obs->input_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->input_types.num;
+	if (found)
+		*id = obs->input_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 bool obs_enum_input_types2(size_t idx, const char **id,
 			   const char **unversioned_id)
 {
-	if (idx >= obs->input_types.num)
-		return false;
-	if (id)
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->input_types.num;
+	if (found && id)
 		*id = obs->input_types.array[idx].id;
-	if (unversioned_id)
+	if (found && unversioned_id)
 		*unversioned_id = obs->input_types.array[idx].unversioned_id;
-	return true;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 const char *obs_get_latest_input_type_id(const char *unversioned_id)
@@ -1620,6 +1681,9 @@ const char *obs_get_latest_input_type_id(const char *unversioned_id)
 	if (!unversioned_id)
 		return NULL;
 
+	obs_activate_deferred_module(unversioned_id);
+
+	pthread_mutex_lock(&obs->modules_mutex);
 	for (size_t i = 0; i < obs->source_types.num; i++) {
 		struct obs_source_info *info = &obs->source_types.array[i];
 		if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
@@ -1628,6 +1692,7 @@ const char *obs_get_latest_input_type_id(const char *unversioned_id)
 			version = info->version;
 		}
 	}
+	pthread_mutex_unlock(&obs->modules_mutex);
 
 	assert(!!latest);
 	if (!latest)
@@ -1638,42 +1703,77 @@ const char *obs_get_latest_input_type_id(const char *unversioned_id)
 
 bool obs_enum_filter_types(size_t idx, const char **id)
 {
-	if (idx >= obs->filter_types.num)
-		return false;
-	*id = obs->filter_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->filter_types.num;
+	if (found)
+		*id = obs->filter_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 bool obs_enum_transition_types(size_t idx, const char **id)
 {
-	if (idx >= obs->transition_types.num)
-		return false;
-	*id = obs->transition_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->transition_types.num;
+	if (found)
+		*id = obs->transition_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 bool obs_enum_output_types(size_t idx, const char **id)
 {
-	if (idx >= obs->output_types.num)
-		return false;
-	*id = obs->output_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->output_types.num;
+	if (found)
+		*id = obs->output_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 bool obs_enum_encoder_types(size_t idx, const char **id)
 {
-	if (idx >= obs->encoder_types.num)
-		return false;
-	*id = obs->encoder_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->encoder_types.num;
+	if (found)
+		*id = obs->encoder_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 bool obs_enum_service_types(size_t idx, const char **id)
 {
-	if (idx >= obs->service_types.num)
-		return false;
-	*id = obs->service_types.array[idx].id;
-	return true;
+	bool found;
+
+	if (!idx)
+		obs_activate_deferred_modules();
+
+	pthread_mutex_lock(&obs->modules_mutex);
+	found = idx < obs->service_types.num;
+	if (found)
+		*id = obs->service_types.array[idx].id;
+	pthread_mutex_unlock(&obs->modules_mutex);
+	return found;
 }
 
 void obs_enter_graphics(void)
@@ -2891,6 +2991,28 @@ uint32_t obs_get_lagged_frames(void)
 	return obs->video.lagged_frames;
 }
 
+bool obs_get_audio_buffering_info(struct obs_audio_buffering_info *info)
+{
+	struct obs_core_audio *audio = &obs->audio;
+
+	if (!obs || !info || !audio->audio)
+		return false;
+
+	long buffering_ms = os_atomic_load_long(&audio->buffering_ms);
+	long headroom_ms = os_atomic_load_long(&audio->headroom_ms);
+
+	info->buffering_ms = (uint32_t)buffering_ms;
+	info->max_buffering_ms = (uint32_t)(
+		audio->max_buffering_ticks * AUDIO_OUTPUT_FRAMES * SEC_TO_MSEC /
+		audio_output_get_sample_rate(audio->audio));
+	info->headroom_ms = headroom_ms > 0 ? (uint32_t)headroom_ms : 0;
+	info->increases =
+		(uint32_t)os_atomic_load_long(&audio->buffering_increases);
+	info->decreases =
+		(uint32_t)os_atomic_load_long(&audio->buffering_decreases);
+	return true;
+}
+
 struct obs_core_video_mix *get_mix_for_video(video_t *v)
 {
 	struct obs_core_video_mix *result = NULL;
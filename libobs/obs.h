@@ -229,6 +229,24 @@ struct obs_audio_info2 {
 
 	uint32_t max_buffering_ms;
 	bool fixed_buffering;
+
+	/** When non-zero, buffering is lowered again one tick at a time once
+	 * all sources arrived early enough for this long.  Not used with
+	 * fixed buffering. */
+	uint32_t shrink_buffering_ms;
+};
+
+/** Audio buffering statistics */
+struct obs_audio_buffering_info {
+	uint32_t buffering_ms;
+	uint32_t max_buffering_ms;
+
+	/** Smallest amount of audio any source had queued beyond what was
+	 * needed, since buffering last changed */
+	uint32_t headroom_ms;
+
+	uint32_t increases;
+	uint32_t decreases;
 };
 
 /**
@@ -300,6 +318,7 @@ struct obs_source_frame {
 	volatile long refs;
 	bool prev_frame;
 	bool in_use;
+	uint64_t trace_ts;
 };
 
 struct obs_source_frame2 {
@@ -548,6 +567,36 @@ struct obs_module_failure_info {
 EXPORT void obs_module_failure_info_free(struct obs_module_failure_info *mfi);
 EXPORT void obs_load_all_modules2(struct obs_module_failure_info *mfi);
 
+/**
+ * Same as obs_load_all_modules2, but opens module libraries and loads their
+ * locale files on a pool of loader threads.  obs_module_load is still called
+ * on the calling thread in discovery order, so type registration order is
+ * identical to obs_load_all_modules2.  Per-module open and init times are
+ * recorded in the profiler.
+ */
+EXPORT void
+obs_load_all_modules_parallel(struct obs_module_failure_info *mfi);
+
+/**
+ * Writes an index of the currently loaded modules and the source, output,
+ * encoder and service types each of them registered.  Meant to be generated
+ * once at install time for use with obs_load_all_modules_lazy.
+ */
+EXPORT bool obs_write_module_index(const char *path);
+
+/**
+ * Same as obs_load_all_modules2, but modules listed in the given module index
+ * (see obs_write_module_index) are not opened until one of their types is
+ * first looked up, for example by obs_source_create, obs_output_create or
+ * obs_encoder_create.  Modules missing from the index, changed since it was
+ * written, or that register no types are loaded immediately.
+ *
+ * @note  Enumerating types (obs_enum_source_types and friends) activates all
+ *        deferred modules, so that the enumeration is complete.
+ */
+EXPORT void obs_load_all_modules_lazy(const char *index_path,
+				      struct obs_module_failure_info *mfi);
+
 /** Notifies modules that all modules have been loaded.  This function should
  * be called after all modules have been loaded. */
 EXPORT void obs_post_load_modules(void);
@@ -911,6 +960,9 @@ EXPORT uint64_t obs_get_frame_interval_ns(void);
 EXPORT uint32_t obs_get_total_frames(void);
 EXPORT uint32_t obs_get_lagged_frames(void);
 
+/** Gets the current audio buffering statistics */
+EXPORT bool obs_get_audio_buffering_info(struct obs_audio_buffering_info *info);
+
 EXPORT bool obs_nv12_tex_active(void);
 EXPORT bool obs_p010_tex_active(void);
 
@@ -2511,6 +2563,22 @@ EXPORT void obs_encoder_set_last_error(obs_encoder_t *encoder,
 
 EXPORT uint64_t obs_encoder_get_pause_offset(const obs_encoder_t *encoder);
 
+/** Packet delivery statistics, summed up over the outputs the encoder is
+ * currently started for */
+struct obs_encoder_dispatch_stats {
+	uint64_t packets;
+	long queue_depth;
+	long max_queue_depth;
+	uint64_t avg_latency_ns;
+	uint64_t max_latency_ns;
+};
+
+/** Returns false if the encoder delivers no packets through dispatch
+ * threads */
+EXPORT bool
+obs_encoder_get_dispatch_stats(obs_encoder_t *encoder,
+			       struct obs_encoder_dispatch_stats *stats);
+
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
 
@@ -180,6 +180,215 @@ void *bmemdup(const void *ptr, size_t size)
 	return out;
 }
 
+/* ------------------------------------------------------------------------- */
+/* pool allocator */
+
+#define BPOOL_MIN_SHIFT 6
+#define BPOOL_NUM_CLASSES 16
+#define BPOOL_MAX_CACHED_SIZE (4 * 1024 * 1024)
+#define BPOOL_NO_CLASS ((size_t)-1)
+
+/* stored right before each pool block.  the 8 bytes before a bmalloc block
+ * hold its alignment offset (at most ALIGNMENT) in the last byte, or the
+ * pointer returned by _aligned_malloc, so they never match: both of its end
+ * bytes are larger than ALIGNMENT, and it is not a canonical address. */
+#define BPOOL_MAGIC 0xB0C0B0C0B0C0B0C0ULL
+
+/* header stored before each block, padded to keep the block aligned */
+union bpool_header {
+	struct {
+		size_t size_class;
+		union bpool_header *next;
+	};
+	struct {
+		uint8_t unused[ALIGNMENT - sizeof(uint64_t)];
+		uint64_t magic;
+	};
+	uint8_t padding[ALIGNMENT];
+};
+
+struct bpool_class {
+	pthread_mutex_t mutex;
+	union bpool_header *free_list;
+	size_t num_cached;
+};
+
+static struct bpool_class pool_classes[BPOOL_NUM_CLASSES] = {
+#define BPOOL_CLASS_INIT {.mutex = PTHREAD_MUTEX_INITIALIZER}
+	BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT,
+	BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT,
+	BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT,
+	BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT, BPOOL_CLASS_INIT,
+#undef BPOOL_CLASS_INIT
+};
+
+static long pool_num_allocs = 0;
+static long pool_num_cached = 0;
+static long pool_num_reused = 0;
+
+static inline size_t bpool_class_size(size_t size_class)
+{
+	return (size_t)1 << (size_class + BPOOL_MIN_SHIFT);
+}
+
+static inline size_t bpool_size_class(size_t size)
+{
+	size_t size_class = 0;
+
+	while (bpool_class_size(size_class) < size) {
+		if (++size_class == BPOOL_NUM_CLASSES)
+			return BPOOL_NO_CLASS;
+	}
+
+	return size_class;
+}
+
+/* large blocks are cached sparingly so idle pools stay small */
+static inline size_t bpool_max_cached(size_t size_class)
+{
+	size_t max = BPOOL_MAX_CACHED_SIZE / bpool_class_size(size_class);
+	return max ? max : 1;
+}
+
+void *bpool_alloc(size_t size)
+{
+	size_t size_class = bpool_size_class(size);
+	union bpool_header *header = NULL;
+
+	if (size_class != BPOOL_NO_CLASS) {
+		struct bpool_class *pc = &pool_classes[size_class];
+
+		pthread_mutex_lock(&pc->mutex);
+		header = pc->free_list;
+		if (header) {
+			pc->free_list = header->next;
+			pc->num_cached--;
+		}
+		pthread_mutex_unlock(&pc->mutex);
+
+		if (header) {
+			os_atomic_dec_long(&pool_num_cached);
+			os_atomic_inc_long(&pool_num_reused);
+			os_atomic_inc_long(&num_allocs);
+		} else {
+			size = bpool_class_size(size_class);
+		}
+	}
+
+	if (!header) {
+		header = bmalloc(sizeof(union bpool_header) + size);
+		header->size_class = size_class;
+		header->magic = BPOOL_MAGIC;
+	}
+
+	os_atomic_inc_long(&pool_num_allocs);
+	return header + 1;
+}
+
+static inline void bpool_release(union bpool_header *header)
+{
+	header->magic = 0;
+	bfree(header);
+}
+
+void bpool_free(void *ptr)
+{
+	union bpool_header *header;
+	struct bpool_class *pc;
+	bool cached = false;
+
+	if (!ptr)
+		return;
+
+	/* not from the pool, for example a packet allocated by a plugin */
+	if (((const uint64_t *)ptr)[-1] != BPOOL_MAGIC) {
+		bfree(ptr);
+		return;
+	}
+
+	header = (union bpool_header *)ptr - 1;
+	os_atomic_dec_long(&pool_num_allocs);
+
+	if (header->size_class == BPOOL_NO_CLASS) {
+		bpool_release(header);
+		return;
+	}
+
+	pc = &pool_classes[header->size_class];
+
+	pthread_mutex_lock(&pc->mutex);
+	if (pc->num_cached < bpool_max_cached(header->size_class)) {
+		header->next = pc->free_list;
+		pc->free_list = header;
+		pc->num_cached++;
+		cached = true;
+	}
+	pthread_mutex_unlock(&pc->mutex);
+
+	if (cached) {
+		os_atomic_inc_long(&pool_num_cached);
+		os_atomic_dec_long(&num_allocs);
+	} else {
+		bpool_release(header);
+	}
+}
+
+size_t bpool_block_size(const void *ptr)
+{
+	const union bpool_header *header;
+
+	if (!ptr)
+		return 0;
+
+	if (((const uint64_t *)ptr)[-1] != BPOOL_MAGIC)
+		return 0;
+
+	header = (const union bpool_header *)ptr - 1;
+	if (header->size_class == BPOOL_NO_CLASS)
+		return 0;
+
+	return bpool_class_size(header->size_class);
+}
+
+void bpool_trim(void)
+{
+	for (size_t i = 0; i < BPOOL_NUM_CLASSES; i++) {
+		struct bpool_class *pc = &pool_classes[i];
+		union bpool_header *header;
+
+		pthread_mutex_lock(&pc->mutex);
+		header = pc->free_list;
+		pc->free_list = NULL;
+		pc->num_cached = 0;
+		pthread_mutex_unlock(&pc->mutex);
+
+		while (header) {
+			union bpool_header *next = header->next;
+
+			/* cached blocks are not counted, see bpool_free */
+			os_atomic_inc_long(&num_allocs);
+			os_atomic_dec_long(&pool_num_cached);
+			bpool_release(header);
+			header = next;
+		}
+	}
+}
+
+long bpool_num_allocs(void)
+{
+	return pool_num_allocs;
+}
+
+long bpool_num_cached(void)
+{
+	return pool_num_cached;
+}
+
+long bpool_num_reused(void)
+{
+	return pool_num_reused;
+}
+
 OBS_DEPRECATED void base_set_allocator(struct base_allocator *defs)
 {
 	UNUSED_PARAMETER(defs);
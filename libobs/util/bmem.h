@@ -44,6 +44,31 @@ EXPORT long bnum_allocs(void);
 
 EXPORT void *bmemdup(const void *ptr, size_t size);
 
+/*
+ * Size-classed memory pool for frequently allocated, short-lived buffers
+ * (encoded packets and the like).  Memory returned by bpool_alloc must be
+ * freed with bpool_free, never with bfree.  bpool_free also takes memory
+ * allocated with bmalloc and frees it with bfree, so buffers allocated either
+ * way can share a release path.  Freed blocks are kept for reuse up to a
+ * per-class limit; bpool_trim releases all of them.
+ *
+ * Blocks in use are also counted by bnum_allocs, cached blocks are not.
+ */
+EXPORT void *bpool_alloc(size_t size);
+EXPORT void bpool_free(void *ptr);
+EXPORT void bpool_trim(void);
+
+/* usable size of a block returned by bpool_alloc, at least the size that was
+ * requested.  0 for blocks too large to be pooled, or not from the pool. */
+EXPORT size_t bpool_block_size(const void *ptr);
+
+/* number of pool blocks currently in use */
+EXPORT long bpool_num_allocs(void);
+/* number of freed pool blocks currently held for reuse */
+EXPORT long bpool_num_cached(void);
+/* number of allocations served from cached blocks */
+EXPORT long bpool_num_reused(void);
+
 static inline void *bzalloc(size_t size)
 {
 	void *mem = bmalloc(size);
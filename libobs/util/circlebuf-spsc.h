@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2023 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+#include <assert.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed-capacity, lock-free circular byte buffer for exactly one producer
+ * thread and one consumer thread.
+ *
+ * The producer uses spsc_circlebuf_push_back, or spsc_circlebuf_write
+ * followed by spsc_circlebuf_commit to publish several pieces of data at
+ * once.  The consumer uses spsc_circlebuf_peek_front/pop_front.  Unlike
+ * circlebuf the buffer never grows; pushing more than the free space fails.
+ */
+
+struct spsc_circlebuf {
+	uint8_t *data;
+	size_t capacity;
+
+	/* owned by the consumer */
+	volatile long start_pos;
+
+	/* owned by the producer */
+	volatile long end_pos;
+	size_t write_pos;
+};
+
+static inline void spsc_circlebuf_init(struct spsc_circlebuf *cb,
+				       size_t capacity)
+{
+	memset(cb, 0, sizeof(struct spsc_circlebuf));
+
+	/* one byte is kept free to tell a full buffer from an empty one */
+	cb->capacity = capacity + 1;
+	cb->data = bmalloc(cb->capacity);
+}
+
+static inline void spsc_circlebuf_free(struct spsc_circlebuf *cb)
+{
+	bfree(cb->data);
+	memset(cb, 0, sizeof(struct spsc_circlebuf));
+}
+
+static inline size_t spsc_circlebuf_used(size_t capacity, size_t start,
+					 size_t end)
+{
+	return (end >= start) ? (end - start) : (capacity - start + end);
+}
+
+/** Returns the amount of data the consumer can currently read */
+static inline size_t spsc_circlebuf_size(const struct spsc_circlebuf *cb)
+{
+	size_t start = (size_t)os_atomic_load_long(&cb->start_pos);
+	size_t end = (size_t)os_atomic_load_long(&cb->end_pos);
+	return spsc_circlebuf_used(cb->capacity, start, end);
+}
+
+/** Returns the amount of data the producer can still write (producer only) */
+static inline size_t spsc_circlebuf_space(const struct spsc_circlebuf *cb)
+{
+	size_t start = (size_t)os_atomic_load_long(&cb->start_pos);
+	if (!cb->capacity)
+		return 0;
+	return cb->capacity - 1 -
+	       spsc_circlebuf_used(cb->capacity, start, cb->write_pos);
+}
+
+/**
+ * Writes data without making it visible to the consumer.  The caller must
+ * check spsc_circlebuf_space first.
+ */
+static inline void spsc_circlebuf_write(struct spsc_circlebuf *cb,
+					const void *data, size_t size)
+{
+	size_t new_write_pos = cb->write_pos + size;
+
+	assert(size <= spsc_circlebuf_space(cb));
+
+	if (new_write_pos > cb->capacity) {
+		size_t back_size = cb->capacity - cb->write_pos;
+		size_t loop_size = size - back_size;
+
+		if (back_size)
+			memcpy(cb->data + cb->write_pos, data, back_size);
+		memcpy(cb->data, (const uint8_t *)data + back_size, loop_size);
+
+		new_write_pos -= cb->capacity;
+	} else {
+		memcpy(cb->data + cb->write_pos, data, size);
+		if (new_write_pos == cb->capacity)
+			new_write_pos = 0;
+	}
+
+	cb->write_pos = new_write_pos;
+}
+
+/** Publishes everything written with spsc_circlebuf_write */
+static inline void spsc_circlebuf_commit(struct spsc_circlebuf *cb)
+{
+	os_atomic_store_long(&cb->end_pos, (long)cb->write_pos);
+}
+
+static inline bool spsc_circlebuf_push_back(struct spsc_circlebuf *cb,
+					    const void *data, size_t size)
+{
+	if (size > spsc_circlebuf_space(cb))
+		return false;
+
+	spsc_circlebuf_write(cb, data, size);
+	spsc_circlebuf_commit(cb);
+	return true;
+}
+
+static inline bool spsc_circlebuf_peek_front(struct spsc_circlebuf *cb,
+					     void *data, size_t size)
+{
+	size_t start = (size_t)os_atomic_load_long(&cb->start_pos);
+
+	if (size > spsc_circlebuf_size(cb))
+		return false;
+
+	if (data) {
+		size_t start_size = cb->capacity - start;
+
+		if (start_size < size) {
+			memcpy(data, cb->data + start, start_size);
+			memcpy((uint8_t *)data + start_size, cb->data,
+			       size - start_size);
+		} else {
+			memcpy(data, cb->data + start, size);
+		}
+	}
+
+	return true;
+}
+
+static inline bool spsc_circlebuf_pop_front(struct spsc_circlebuf *cb,
+					    void *data, size_t size)
+{
+	size_t start;
+
+	if (!spsc_circlebuf_peek_front(cb, data, size))
+		return false;
+
+	start = (size_t)os_atomic_load_long(&cb->start_pos) + size;
+	if (start >= cb->capacity)
+		start -= cb->capacity;
+
+	os_atomic_store_long(&cb->start_pos, (long)start);
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
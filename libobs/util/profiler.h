@@ -20,6 +20,10 @@ EXPORT void profile_register_root(const char *name,
 EXPORT void profile_start(const char *name);
 EXPORT void profile_end(const char *name);
 
+/* records a time span that did not start and end on the same thread */
+EXPORT void profile_record(const char *name, uint64_t start_time,
+			   uint64_t end_time);
+
 EXPORT void profile_reenable_thread(void);
 
 /* ------------------------------------------------------------------------- */
@@ -60,6 +60,9 @@ struct ffmpeg_source {
 	bool close_when_inactive;
 	bool seekable;
 	bool enable_caching;
+	int cache_max_mb;
+	bool cache_compression;
+	int preroll_frames;
 	int64_t volume;
 	
 
@@ -103,6 +106,10 @@ static bool is_local_file_modified(obs_properties_t *props,
 	obs_property_t *seekable = obs_properties_get(props, "seekable");
 	obs_property_t *speed = obs_properties_get(props, "speed_percent");
 	obs_property_t *caching = obs_properties_get(props, "caching");
+	obs_property_t *cache_max_mb =
+		obs_properties_get(props, "cache_max_mb");
+	obs_property_t *cache_compression =
+		obs_properties_get(props, "cache_compression");
 	obs_property_t *reconnect_delay_sec =
 		obs_properties_get(props, "reconnect_delay_sec");
 	obs_property_set_visible(input, !enabled);
@@ -113,6 +120,8 @@ static bool is_local_file_modified(obs_properties_t *props,
 	obs_property_set_visible(speed, enabled);
 	obs_property_set_visible(seekable, !enabled);
 	obs_property_set_visible(caching, false);
+	obs_property_set_visible(cache_max_mb, false);
+	obs_property_set_visible(cache_compression, false);
 	obs_property_set_visible(reconnect_delay_sec, !enabled);
 
 	return true;
@@ -129,6 +138,9 @@ static void ffmpeg_source_defaults(obs_data_t *settings)
 	obs_data_set_default_int(settings, "buffering_mb", 2);
 	obs_data_set_default_int(settings, "speed_percent", 100);
 	obs_data_set_default_bool(settings, "caching", false);
+	obs_data_set_default_int(settings, "cache_max_mb",
+				 MP_CACHE_DEFAULT_MAX_MB);
+	obs_data_set_default_bool(settings, "cache_compression", false);
 	obs_data_set_default_int(settings, "volume", 100);
 }
 
@@ -238,6 +250,12 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 
 	const char* text = obs_module_text("EnableCaching");
 	obs_properties_add_bool(props, "caching", obs_module_text("EnableCaching"));
+	prop = obs_properties_add_int(props, "cache_max_mb",
+				      obs_module_text("CacheMaxMB"), 16, 65536,
+				      16);
+	obs_property_int_set_suffix(prop, " MB");
+	obs_properties_add_bool(props, "cache_compression",
+				obs_module_text("CacheCompression"));
 
 	prop = obs_properties_add_text(props, "ffmpeg_options",
 						obs_module_text("FFmpegOpts"),
@@ -353,6 +371,10 @@ static void ffmpeg_source_open(struct ffmpeg_source *s)
 			.ffmpeg_options = s->ffmpeg_options,
 			.is_local_file = s->is_local_file || s->seekable,
 			.enable_caching = s->enable_caching,
+			.cache_max_bytes = (size_t)s->cache_max_mb * 1024 *
+					   1024,
+			.cache_compress = s->cache_compression,
+			.preroll_frames = s->preroll_frames,
 			.reconnecting = s->reconnecting,
 			.volume = s->volume,
 		};
@@ -458,6 +480,14 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 		s->close_when_inactive =
 			obs_data_get_bool(settings, "close_when_inactive");
 		s->enable_caching = obs_data_get_bool(settings, "caching");
+		s->cache_max_mb =
+			(int)obs_data_get_int(settings, "cache_max_mb");
+		s->cache_compression =
+			obs_data_get_bool(settings, "cache_compression");
+		/* not exposed, set by sources that own a private media source
+		 * and need it to start instantly (stinger transitions) */
+		s->preroll_frames =
+			(int)obs_data_get_int(settings, "preroll_frames");
 	} else {
 		input = obs_data_get_string(settings, "input");
 		input_format = obs_data_get_string(settings, "input_format");
@@ -473,6 +503,7 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 		s->is_looping = false;
 		s->close_when_inactive = true;
 		s->enable_caching = false;
+		s->preroll_frames = 0;
 
 		if (s->reconnect_thread_valid) {
 			s->stop_reconnect = true;
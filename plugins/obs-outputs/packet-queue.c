@@ -0,0 +1,240 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "packet-queue.h"
+
+struct packet_queue_entry {
+	struct encoder_packet packet;
+	bool dropped;
+};
+
+void packet_queue_init(struct packet_queue *pq)
+{
+	memset(pq, 0, sizeof(*pq));
+
+	/* leaves room for packets pushed to the front before the first one */
+	pq->head_seq = (uint64_t)1 << 32;
+}
+
+void packet_queue_free(struct packet_queue *pq)
+{
+	packet_queue_clear(pq);
+
+	circlebuf_free(&pq->entries);
+	for (size_t i = 0; i < PACKET_QUEUE_PRIORITIES; i++)
+		circlebuf_free(&pq->priority_index[i]);
+	circlebuf_free(&pq->video_index);
+}
+
+static inline size_t num_entries(const struct packet_queue *pq)
+{
+	return pq->entries.size / sizeof(struct packet_queue_entry);
+}
+
+static inline struct packet_queue_entry *get_entry(struct packet_queue *pq,
+						   uint64_t seq)
+{
+	size_t idx = (size_t)(seq - pq->head_seq);
+	return circlebuf_data(&pq->entries,
+			      idx * sizeof(struct packet_queue_entry));
+}
+
+static inline bool is_droppable(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO &&
+	       packet->drop_priority >= 0 &&
+	       packet->drop_priority < OBS_NAL_PRIORITY_HIGHEST;
+}
+
+static inline bool is_indexed_video(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO && !packet->keyframe;
+}
+
+/* removes index entries that refer to packets already popped */
+static void trim_index(struct packet_queue *pq, struct circlebuf *index)
+{
+	while (index->size) {
+		uint64_t seq;
+		circlebuf_peek_front(index, &seq, sizeof(seq));
+		if (seq >= pq->head_seq)
+			break;
+		circlebuf_pop_front(index, NULL, sizeof(seq));
+	}
+}
+
+static void trim_indices(struct packet_queue *pq)
+{
+	for (size_t i = 0; i < PACKET_QUEUE_PRIORITIES; i++)
+		trim_index(pq, &pq->priority_index[i]);
+	trim_index(pq, &pq->video_index);
+}
+
+/* removes dropped packets from the front of the queue */
+static void trim_dropped(struct packet_queue *pq)
+{
+	bool trimmed = false;
+
+	while (pq->entries.size) {
+		struct packet_queue_entry *entry = get_entry(pq, pq->head_seq);
+		if (!entry->dropped)
+			break;
+
+		circlebuf_pop_front(&pq->entries, NULL, sizeof(*entry));
+		pq->head_seq++;
+		trimmed = true;
+	}
+
+	if (trimmed)
+		trim_indices(pq);
+}
+
+size_t packet_queue_clear(struct packet_queue *pq)
+{
+	size_t count = pq->num_packets;
+	struct encoder_packet packet;
+
+	while (packet_queue_pop_front(pq, &packet))
+		obs_encoder_packet_release(&packet);
+
+	return count;
+}
+
+void packet_queue_push_back(struct packet_queue *pq,
+			    const struct encoder_packet *packet)
+{
+	struct packet_queue_entry entry = {.packet = *packet};
+	uint64_t seq = pq->head_seq + num_entries(pq);
+
+	circlebuf_push_back(&pq->entries, &entry, sizeof(entry));
+	pq->num_packets++;
+
+	if (is_droppable(packet))
+		circlebuf_push_back(&pq->priority_index[packet->drop_priority],
+				    &seq, sizeof(seq));
+	if (is_indexed_video(packet))
+		circlebuf_push_back(&pq->video_index, &seq, sizeof(seq));
+}
+
+void packet_queue_push_front(struct packet_queue *pq,
+			     const struct encoder_packet *packet)
+{
+	struct packet_queue_entry entry = {.packet = *packet};
+	uint64_t seq;
+
+	trim_dropped(pq);
+
+	seq = --pq->head_seq;
+	circlebuf_push_front(&pq->entries, &entry, sizeof(entry));
+	pq->num_packets++;
+
+	/* the new packet is older than any indexed packet, so pushing to the
+	 * front keeps the indices sorted */
+	if (is_droppable(packet))
+		circlebuf_push_front(&pq->priority_index[packet->drop_priority],
+				     &seq, sizeof(seq));
+	if (is_indexed_video(packet))
+		circlebuf_push_front(&pq->video_index, &seq, sizeof(seq));
+}
+
+bool packet_queue_peek_front(struct packet_queue *pq,
+			     struct encoder_packet *packet)
+{
+	trim_dropped(pq);
+
+	if (!pq->entries.size)
+		return false;
+
+	*packet = get_entry(pq, pq->head_seq)->packet;
+	return true;
+}
+
+bool packet_queue_pop_front(struct packet_queue *pq,
+			    struct encoder_packet *packet)
+{
+	struct packet_queue_entry entry;
+
+	trim_dropped(pq);
+
+	if (!pq->entries.size)
+		return false;
+
+	circlebuf_pop_front(&pq->entries, &entry, sizeof(entry));
+	pq->head_seq++;
+	pq->num_packets--;
+	trim_indices(pq);
+
+	*packet = entry.packet;
+	return true;
+}
+
+int packet_queue_drop(struct packet_queue *pq, int highest_priority)
+{
+	int num_dropped = 0;
+
+	if (highest_priority > PACKET_QUEUE_PRIORITIES)
+		highest_priority = PACKET_QUEUE_PRIORITIES;
+
+	for (int i = 0; i < highest_priority; i++) {
+		struct circlebuf *index = &pq->priority_index[i];
+
+		while (index->size) {
+			struct packet_queue_entry *entry;
+			uint64_t seq;
+
+			circlebuf_pop_front(index, &seq, sizeof(seq));
+			if (seq < pq->head_seq)
+				continue;
+
+			entry = get_entry(pq, seq);
+			if (entry->dropped)
+				continue;
+
+			obs_encoder_packet_release(&entry->packet);
+			entry->dropped = true;
+			pq->num_packets--;
+			num_dropped++;
+		}
+	}
+
+	trim_dropped(pq);
+	return num_dropped;
+}
+
+bool packet_queue_first_video(struct packet_queue *pq,
+			      struct encoder_packet *packet)
+{
+	struct circlebuf *index = &pq->video_index;
+
+	while (index->size) {
+		struct packet_queue_entry *entry;
+		uint64_t seq;
+
+		circlebuf_peek_front(index, &seq, sizeof(seq));
+		if (seq >= pq->head_seq) {
+			entry = get_entry(pq, seq);
+			if (!entry->dropped) {
+				*packet = entry->packet;
+				return true;
+			}
+		}
+
+		circlebuf_pop_front(index, NULL, sizeof(seq));
+	}
+
+	return false;
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <obs-nal.h>
+#include <util/circlebuf.h>
+
+/*
+ * FIFO of encoder packets waiting to be sent, indexed so that congestion
+ * handling is cheap:
+ *
+ * - Video packets that can be dropped are indexed by drop priority, so
+ *   dropping everything below a priority only touches the dropped packets.
+ * - Non-keyframe video packets are indexed in order, so finding the oldest
+ *   one (used to measure the buffered duration) is O(1) amortized.
+ *
+ * Dropped packets are released immediately and skipped lazily when they
+ * reach the front of the queue.  Not thread safe.
+ */
+
+#define PACKET_QUEUE_PRIORITIES (OBS_NAL_PRIORITY_HIGHEST + 1)
+
+struct packet_queue {
+	struct circlebuf entries;
+	uint64_t head_seq;
+	size_t num_packets;
+
+	struct circlebuf priority_index[PACKET_QUEUE_PRIORITIES];
+	struct circlebuf video_index;
+};
+
+extern void packet_queue_init(struct packet_queue *pq);
+extern void packet_queue_free(struct packet_queue *pq);
+
+/* releases all packets in the queue, returns how many there were */
+extern size_t packet_queue_clear(struct packet_queue *pq);
+
+extern void packet_queue_push_back(struct packet_queue *pq,
+				   const struct encoder_packet *packet);
+extern void packet_queue_push_front(struct packet_queue *pq,
+				    const struct encoder_packet *packet);
+extern bool packet_queue_pop_front(struct packet_queue *pq,
+				   struct encoder_packet *packet);
+extern bool packet_queue_peek_front(struct packet_queue *pq,
+				    struct encoder_packet *packet);
+
+/* drops all video packets with a priority lower than highest_priority,
+ * returns the number of packets dropped */
+extern int packet_queue_drop(struct packet_queue *pq, int highest_priority);
+
+/* finds the oldest non-keyframe video packet */
+extern bool packet_queue_first_video(struct packet_queue *pq,
+				     struct encoder_packet *packet);
+
+static inline size_t packet_queue_size(const struct packet_queue *pq)
+{
+	return pq->num_packets;
+}
@@ -0,0 +1,318 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include <util/bmem.h>
+#include "rtmp-congestion.h"
+
+/* ------------------------------------------------------------------------- */
+/* delay gradient controller
+ *
+ * Loosely modeled after Google Congestion Control: a trendline filter over
+ * the queuing delay (send queue duration plus TCP RTT) detects whether the
+ * link is being overused, and an AIMD rate controller reacts to it, using
+ * the measured send throughput as the basis for decreases. */
+
+#define TRENDLINE_WINDOW 20
+#define DELAY_SMOOTHING 0.9
+
+#define THRESHOLD_INIT 25.0
+#define THRESHOLD_MIN 10.0
+#define THRESHOLD_MAX 200.0
+#define THRESHOLD_K_UP 0.01
+#define THRESHOLD_K_DOWN 0.00018
+
+#define OVERUSE_TIME_MS 100
+#define MAX_QUEUE_DELAY_MS 700
+#define MIN_QUEUE_DELAY_MS 50
+
+#define DECREASE_FACTOR 0.85
+#define DECREASE_INTERVAL_MS 300
+#define HOLD_TIME_MS 1000
+#define MULTIPLICATIVE_INCREASE 0.08
+#define ADDITIVE_INCREASE_DIV 50
+#define MAX_SEND_RATE_FACTOR 1.5
+
+#define NSEC_PER_MS 1000000ULL
+
+enum usage_state { USAGE_NORMAL, USAGE_OVERUSE, USAGE_UNDERUSE };
+
+struct delay_gradient {
+	long max_kbps;
+	long min_kbps;
+	double target_kbps;
+
+	double times[TRENDLINE_WINDOW];
+	double delays[TRENDLINE_WINDOW];
+	size_t count;
+	size_t pos;
+	double smoothed_delay;
+	double threshold;
+
+	uint64_t first_ts;
+	uint64_t last_ts;
+	uint64_t overuse_start_ts;
+	uint64_t last_decrease_ts;
+	long last_decrease_kbps;
+};
+
+static void *delay_gradient_create(long max_kbps, long min_kbps)
+{
+	struct delay_gradient *dg = bzalloc(sizeof(struct delay_gradient));
+	dg->max_kbps = max_kbps;
+	dg->min_kbps = min_kbps;
+	dg->target_kbps = (double)max_kbps;
+	dg->threshold = THRESHOLD_INIT;
+	return dg;
+}
+
+static void delay_gradient_destroy(void *data)
+{
+	bfree(data);
+}
+
+/* least squares slope of delay over time, in ms of delay per second */
+static double trendline_slope(const struct delay_gradient *dg)
+{
+	double avg_t = 0.0, avg_d = 0.0;
+	double num = 0.0, den = 0.0;
+
+	for (size_t i = 0; i < dg->count; i++) {
+		avg_t += dg->times[i];
+		avg_d += dg->delays[i];
+	}
+	avg_t /= (double)dg->count;
+	avg_d /= (double)dg->count;
+
+	for (size_t i = 0; i < dg->count; i++) {
+		double dt = dg->times[i] - avg_t;
+		num += dt * (dg->delays[i] - avg_d);
+		den += dt * dt;
+	}
+
+	return den > 0.0 ? num / den * 1000.0 : 0.0;
+}
+
+static void update_threshold(struct delay_gradient *dg, double trend,
+			     double dt_ms)
+{
+	double k = fabs(trend) < dg->threshold ? THRESHOLD_K_DOWN
+					       : THRESHOLD_K_UP;
+
+	/* ignore spikes that are far outside the current threshold */
+	if (fabs(trend) > dg->threshold + 15.0 * THRESHOLD_MIN)
+		return;
+	if (dt_ms > 100.0)
+		dt_ms = 100.0;
+
+	dg->threshold += k * (fabs(trend) - dg->threshold) * dt_ms;
+	if (dg->threshold < THRESHOLD_MIN)
+		dg->threshold = THRESHOLD_MIN;
+	else if (dg->threshold > THRESHOLD_MAX)
+		dg->threshold = THRESHOLD_MAX;
+}
+
+static enum usage_state detect_usage(struct delay_gradient *dg,
+				     const struct congestion_sample *sample,
+				     double queue_delay_ms)
+{
+	double dt_ms = (double)(sample->ts - dg->last_ts) / NSEC_PER_MS;
+	double now_ms = (double)(sample->ts - dg->first_ts) / NSEC_PER_MS;
+	double trend;
+
+	dg->smoothed_delay = DELAY_SMOOTHING * dg->smoothed_delay +
+			     (1.0 - DELAY_SMOOTHING) * queue_delay_ms;
+
+	dg->times[dg->pos] = now_ms;
+	dg->delays[dg->pos] = dg->smoothed_delay;
+	dg->pos = (dg->pos + 1) % TRENDLINE_WINDOW;
+	if (dg->count < TRENDLINE_WINDOW)
+		dg->count++;
+
+	/* the send queue is too deep regardless of the trend */
+	if (sample->buffer_duration_usec / 1000 >= MAX_QUEUE_DELAY_MS)
+		return USAGE_OVERUSE;
+
+	if (dg->count < TRENDLINE_WINDOW)
+		return USAGE_NORMAL;
+
+	trend = trendline_slope(dg);
+	update_threshold(dg, trend, dt_ms);
+
+	if (trend > dg->threshold &&
+	    sample->buffer_duration_usec / 1000 >= MIN_QUEUE_DELAY_MS) {
+		if (!dg->overuse_start_ts)
+			dg->overuse_start_ts = sample->ts;
+		if (sample->ts - dg->overuse_start_ts >=
+		    OVERUSE_TIME_MS * NSEC_PER_MS)
+			return USAGE_OVERUSE;
+		return USAGE_NORMAL;
+	}
+
+	dg->overuse_start_ts = 0;
+	return trend < -dg->threshold ? USAGE_UNDERUSE : USAGE_NORMAL;
+}
+
+static long delay_gradient_update(void *data,
+				  const struct congestion_sample *sample)
+{
+	struct delay_gradient *dg = data;
+	double queue_delay_ms = (double)sample->buffer_duration_usec / 1000.0;
+	double measured = (double)sample->send_kbps;
+	enum usage_state usage;
+	double dt_sec;
+
+	if (sample->has_tcp_info)
+		queue_delay_ms += (double)sample->rtt_usec / 1000.0;
+
+	if (!dg->first_ts) {
+		dg->first_ts = sample->ts;
+		dg->last_ts = sample->ts;
+		dg->smoothed_delay = queue_delay_ms;
+	}
+
+	usage = detect_usage(dg, sample, queue_delay_ms);
+	dt_sec = (double)(sample->ts - dg->last_ts) / (NSEC_PER_MS * 1000.0);
+	dg->last_ts = sample->ts;
+
+	if (usage == USAGE_OVERUSE) {
+		if (sample->ts - dg->last_decrease_ts >=
+		    DECREASE_INTERVAL_MS * NSEC_PER_MS) {
+			double basis = measured > 0.0 &&
+						       measured < dg->target_kbps
+					       ? measured
+					       : dg->target_kbps;
+
+			dg->target_kbps = basis * DECREASE_FACTOR;
+			dg->last_decrease_ts = sample->ts;
+			dg->last_decrease_kbps = (long)dg->target_kbps;
+		}
+
+	} else if (usage == USAGE_NORMAL &&
+		   sample->ts - dg->last_decrease_ts >=
+			   HOLD_TIME_MS * NSEC_PER_MS) {
+		/* increase quickly while far from the last point of
+		 * congestion, carefully when close to it */
+		if (!dg->last_decrease_kbps ||
+		    dg->target_kbps < dg->last_decrease_kbps * 0.95 ||
+		    dg->target_kbps > dg->last_decrease_kbps * 1.5) {
+			dg->target_kbps *=
+				1.0 + MULTIPLICATIVE_INCREASE * dt_sec;
+		} else {
+			dg->target_kbps += (double)dg->max_kbps /
+					   ADDITIVE_INCREASE_DIV * dt_sec;
+		}
+
+		/* don't run away from what is actually being sent */
+		if (measured > 0.0 &&
+		    dg->target_kbps > measured * MAX_SEND_RATE_FACTOR &&
+		    measured * MAX_SEND_RATE_FACTOR < dg->max_kbps)
+			dg->target_kbps = measured * MAX_SEND_RATE_FACTOR;
+	}
+
+	if (dg->target_kbps > (double)dg->max_kbps)
+		dg->target_kbps = (double)dg->max_kbps;
+	else if (dg->target_kbps < (double)dg->min_kbps)
+		dg->target_kbps = (double)dg->min_kbps;
+
+	return (long)dg->target_kbps;
+}
+
+static const struct congestion_controller_info delay_gradient_info = {
+	.id = "delay_gradient",
+	.create = delay_gradient_create,
+	.destroy = delay_gradient_destroy,
+	.update = delay_gradient_update,
+};
+
+/* ------------------------------------------------------------------------- */
+
+static const struct congestion_controller_info *controllers[] = {
+	&delay_gradient_info,
+};
+
+#define NUM_CONTROLLERS (sizeof(controllers) / sizeof(controllers[0]))
+
+/* bitrate changes smaller than this are not worth an encoder update */
+#define MIN_INCREASE_PERCENT 5
+#define MIN_DECREASE_PERCENT 2
+
+const struct congestion_controller_info *
+congestion_controller_find(const char *id)
+{
+	if (!id)
+		return NULL;
+
+	for (size_t i = 0; i < NUM_CONTROLLERS; i++) {
+		if (strcmp(controllers[i]->id, id) == 0)
+			return controllers[i];
+	}
+
+	return NULL;
+}
+
+bool congestion_controller_init(struct congestion_controller *cc,
+				const char *id, long max_kbps, long min_kbps)
+{
+	memset(cc, 0, sizeof(*cc));
+
+	cc->info = congestion_controller_find(id);
+	if (!cc->info)
+		return false;
+
+	cc->data = cc->info->create(max_kbps, min_kbps);
+	if (!cc->data) {
+		cc->info = NULL;
+		return false;
+	}
+
+	cc->cur_kbps = max_kbps;
+	cc->max_kbps = max_kbps;
+	return true;
+}
+
+void congestion_controller_free(struct congestion_controller *cc)
+{
+	if (cc->info)
+		cc->info->destroy(cc->data);
+	memset(cc, 0, sizeof(*cc));
+}
+
+bool congestion_controller_update(struct congestion_controller *cc,
+				  const struct congestion_sample *sample)
+{
+	long new_kbps;
+	long diff;
+
+	if (!cc->info)
+		return false;
+
+	new_kbps = cc->info->update(cc->data, sample);
+	diff = new_kbps - cc->cur_kbps;
+
+	if (diff > 0 && diff * 100 < cc->cur_kbps * MIN_INCREASE_PERCENT &&
+	    new_kbps < cc->max_kbps)
+		return false;
+	if (diff < 0 && -diff * 100 < cc->cur_kbps * MIN_DECREASE_PERCENT)
+		return false;
+	if (!diff)
+		return false;
+
+	cc->cur_kbps = new_kbps;
+	return true;
+}
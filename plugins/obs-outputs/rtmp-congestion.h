@@ -0,0 +1,81 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+/*
+ * Congestion controllers for dynamic bitrate.
+ *
+ * A controller is fed one sample per video packet queued by the output and
+ * returns the video bitrate it wants the encoder to use.  The output applies
+ * changes through obs_encoder_update.  The original threshold based dynamic
+ * bitrate logic in rtmp-stream.c is used when no controller is selected.
+ */
+
+struct congestion_sample {
+	/* os_gettime_ns() when the sample was taken */
+	uint64_t ts;
+
+	/* duration of media waiting in the output's send queue */
+	int64_t buffer_duration_usec;
+
+	/* measured video throughput in kbps over the last couple of seconds,
+	 * 0 if there is not enough data yet */
+	long send_kbps;
+
+	/* TCP statistics, if available on this platform */
+	bool has_tcp_info;
+	uint32_t rtt_usec;
+	uint32_t rtt_var_usec;
+};
+
+struct congestion_controller_info {
+	const char *id;
+
+	void *(*create)(long max_kbps, long min_kbps);
+	void (*destroy)(void *data);
+
+	/* returns the desired video bitrate in kbps */
+	long (*update)(void *data, const struct congestion_sample *sample);
+};
+
+struct congestion_controller {
+	const struct congestion_controller_info *info;
+	void *data;
+	long cur_kbps;
+	long max_kbps;
+};
+
+extern const struct congestion_controller_info *
+congestion_controller_find(const char *id);
+
+extern bool congestion_controller_init(struct congestion_controller *cc,
+				       const char *id, long max_kbps,
+				       long min_kbps);
+extern void congestion_controller_free(struct congestion_controller *cc);
+
+/* returns true if the bitrate changed, new bitrate is in cc->cur_kbps */
+extern bool congestion_controller_update(struct congestion_controller *cc,
+					 const struct congestion_sample *sample);
+
+static inline bool
+congestion_controller_active(const struct congestion_controller *cc)
+{
+	return cc->info != NULL;
+}
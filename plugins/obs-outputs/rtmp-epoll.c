@@ -0,0 +1,389 @@
+#ifdef __linux__
+#include "rtmp-stream.h"
+
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static bool socket_event(struct rtmp_stream *stream, uint32_t events,
+			 bool *can_write, uint64_t last_send_time)
+{
+	if (events & EPOLLOUT)
+		*can_write = true;
+
+	if (events & EPOLLIN) {
+		char discard[16384];
+		int err_code;
+		bool fatal = false;
+
+		for (;;) {
+			ssize_t ret = recv(stream->rtmp.m_sb.sb_socket, discard,
+					   sizeof(discard), 0);
+			if (ret == -1) {
+				err_code = errno;
+				if (err_code == EAGAIN ||
+				    err_code == EWOULDBLOCK)
+					break;
+				if (err_code == EINTR)
+					continue;
+
+				fatal = true;
+			} else if (ret == 0) {
+				err_code = 0;
+				fatal = true;
+			}
+
+			if (fatal) {
+				blog(LOG_ERROR,
+				     "socket_thread_linux: "
+				     "Socket error, recv() returned "
+				     "%d, errno %d",
+				     (int)ret, err_code);
+				stream->rtmp.last_error_code = err_code;
+				fatal_sock_shutdown(stream);
+				return false;
+			}
+		}
+	}
+
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_ERROR,
+			   &err_code, &size);
+
+		if (last_send_time) {
+			uint32_t diff =
+				(os_gettime_ns() / 1000000) - last_send_time;
+
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Socket closed, "
+			     "%u ms since last send "
+			     "(buffer: %d / %d)",
+			     diff, (int)stream->write_buf_len,
+			     (int)stream->write_buf_size);
+		}
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due "
+			     "to socket close during shutdown, "
+			     "%d bytes lost, error %d",
+			     (int)stream->write_buf_len, err_code);
+		else
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due "
+			     "to socket close, error %d",
+			     err_code);
+
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	return true;
+}
+
+/* Limits the amount of data that can sit unsent in the kernel's socket
+ * buffer, so that network congestion builds up in our own write buffer
+ * (where it is visible to the congestion/bitrate logic) rather than in the
+ * kernel where it just adds latency. */
+static void set_notsent_lowat(struct rtmp_stream *stream)
+{
+	int sndbuf_size = 0;
+	socklen_t size = sizeof(sndbuf_size);
+	int lowat = (int)(stream->write_buf_size / 4);
+
+	if (lowat < 16384)
+		lowat = 16384;
+
+	if (!getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+			&sndbuf_size, &size) &&
+	    sndbuf_size > 0 && lowat > sndbuf_size)
+		lowat = sndbuf_size;
+
+	if (setsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP,
+		       TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) == 0) {
+		blog(LOG_INFO,
+		     "socket_thread_linux: Limiting unsent socket data to "
+		     "%d bytes (send buffer: %d, write buffer: %d)",
+		     lowat, sndbuf_size, (int)stream->write_buf_size);
+	} else {
+		blog(LOG_WARNING,
+		     "socket_thread_linux: Failed to set "
+		     "TCP_NOTSENT_LOWAT, errno %d",
+		     errno);
+	}
+}
+
+enum data_ret { RET_BREAK, RET_FATAL, RET_CONTINUE };
+
+static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
+				uint64_t *last_send_time,
+				size_t latency_packet_size, int delay_time)
+{
+	bool exit_loop = false;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (!stream->write_buf_len) {
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	int ret;
+	if (stream->low_latency_mode) {
+		size_t send_len =
+			latency_packet_size < stream->write_buf_len
+				? latency_packet_size
+				: stream->write_buf_len;
+
+		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
+				       (const char *)stream->write_buf,
+				       (int)send_len);
+	} else {
+		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
+				       (const char *)stream->write_buf,
+				       (int)stream->write_buf_len);
+	}
+
+	if (ret > 0) {
+		if (stream->write_buf_len - ret)
+			memmove(stream->write_buf, stream->write_buf + ret,
+				stream->write_buf_len - ret);
+		stream->write_buf_len -= ret;
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+		os_event_signal(stream->buffer_space_available_event);
+	} else {
+		int err_code = 0;
+
+		if (ret == -1) {
+			err_code = errno;
+
+			if (err_code == EAGAIN || err_code == EWOULDBLOCK) {
+				*can_write = false;
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				return RET_BREAK;
+			}
+			if (err_code == EINTR) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				return RET_CONTINUE;
+			}
+		}
+
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error. */
+		blog(LOG_ERROR,
+		     "socket_thread_linux: "
+		     "Socket error, send() returned %d, errno %d",
+		     ret, err_code);
+
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	/* finish writing for now */
+	if (stream->write_buf_len <= 1000)
+		exit_loop = true;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return exit_loop ? RET_BREAK : RET_CONTINUE;
+}
+
+static void drain_eventfd(int fd)
+{
+	uint64_t val;
+	while (read(fd, &val, sizeof(val)) > 0)
+		;
+}
+
+#define LATENCY_FACTOR 20
+
+/* how long to keep sending buffered data after the send thread exits; the
+ * socket may never become writable again if the server stops reading */
+#define EXIT_DRAIN_TIMEOUT_MS 5000
+
+static inline void socket_thread_linux_internal(struct rtmp_stream *stream,
+						int epoll_fd)
+{
+	bool can_write = false;
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+	uint64_t exit_deadline = 0;
+
+	struct epoll_event ev = {0};
+
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.fd = stream->rtmp.m_sb.sb_socket;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) {
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Failed to add socket to "
+		     "epoll, errno %d",
+		     errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->socket_wakeup_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) {
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Failed to add wakeup event to "
+		     "epoll, errno %d",
+		     errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->socket_stop_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) {
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Failed to add stop event to "
+		     "epoll, errno %d",
+		     errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size =
+			stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	if (!stream->disable_send_window_optimization) {
+		set_notsent_lowat(stream);
+	} else {
+		blog(LOG_INFO, "socket_thread_linux: Send window "
+			       "optimization disabled by user.");
+	}
+
+	for (;;) {
+		struct epoll_event events[3];
+		int timeout = -1;
+		int count;
+
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			if (stream->write_buf_len == 0) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(
+					stream->send_thread_signaled_exit);
+				break;
+			}
+
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+		}
+
+		if (exit_deadline) {
+			uint64_t now = os_gettime_ns() / 1000000;
+			if (now >= exit_deadline) {
+				pthread_mutex_lock(&stream->write_buf_mutex);
+				blog(LOG_WARNING,
+				     "socket_thread_linux: Timed out sending "
+				     "remaining data on exit, %d bytes lost",
+				     (int)stream->write_buf_len);
+				stream->write_buf_len = 0;
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(
+					stream->send_thread_signaled_exit);
+				break;
+			}
+
+			timeout = (int)(exit_deadline - now);
+		}
+
+		count = epoll_wait(epoll_fd, events, 3, timeout);
+		if (count == -1) {
+			if (errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR,
+			     "socket_thread_linux: Aborting due "
+			     "to epoll_wait failure, errno %d",
+			     errno);
+			fatal_sock_shutdown(stream);
+			return;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (events[i].data.fd == stream->socket_wakeup_fd) {
+				drain_eventfd(stream->socket_wakeup_fd);
+			} else if (events[i].data.fd == stream->socket_stop_fd) {
+				drain_eventfd(stream->socket_stop_fd);
+				if (!exit_deadline)
+					exit_deadline = os_gettime_ns() /
+								1000000 +
+							EXIT_DRAIN_TIMEOUT_MS;
+			} else if (!socket_event(stream, events[i].events,
+						 &can_write, last_send_time)) {
+				return;
+			}
+		}
+
+		if (can_write) {
+			for (;;) {
+				enum data_ret ret = write_data(
+					stream, &can_write, &last_send_time,
+					latency_packet_size, delay_time);
+
+				switch (ret) {
+				case RET_BREAK:
+					goto exit_write_loop;
+				case RET_FATAL:
+					return;
+				case RET_CONTINUE:;
+				}
+			}
+		}
+	exit_write_loop:;
+	}
+
+	blog(LOG_INFO, "socket_thread_linux: Normal exit");
+}
+
+void *socket_thread_linux(void *data)
+{
+	struct rtmp_stream *stream = data;
+	int epoll_fd;
+
+	os_set_thread_name("rtmp-stream: socket_thread");
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Failed to create epoll "
+		     "instance, errno %d",
+		     errno);
+		fatal_sock_shutdown(stream);
+		return NULL;
+	}
+
+	socket_thread_linux_internal(stream, epoll_fd);
+	close(epoll_fd);
+	return NULL;
+}
+#endif
@@ -0,0 +1,1010 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * RTMP output that sends the same encoded streams to several destinations.
+ *
+ * Every packet is muxed into an FLV tag exactly once; the tag is kept in a
+ * reference counted encoder packet and queued to each connected destination.
+ * Each destination has its own connection, send thread, packet queue and
+ * frame drop state, so a slow destination only drops its own frames and
+ * never blocks the others.  A destination that disconnects reconnects on its
+ * own with exponential backoff while the others keep streaming.
+ */
+
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "librtmp/rtmp.h"
+#include "packet-queue.h"
+#include "flv-mux.h"
+
+#define do_log(level, format, ...)                \
+	blog(level, "[rtmp multi: '%s'] " format, \
+	     obs_output_get_name(rm->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+#define OPT_DESTINATIONS "destinations"
+#define OPT_DROP_THRESHOLD "drop_threshold_ms"
+#define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
+#define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
+#define OPT_RETRY_DELAY_SEC "retry_delay_sec"
+#define OPT_MAX_RETRIES "max_retries"
+
+#define RETRY_MAX_MSEC (15 * 60 * 1000)
+#define RETRY_EXP 1.5f
+
+/* ------------------------------------------------------------------------- */
+
+/* Replaces the muxed data with a copy in a reference counted packet, so the
+ * tag can be shared by all destinations and queued in their packet queues.
+ * The other fields are taken from the source packet, if any. */
+static void create_tag(struct encoder_packet *tag,
+		       const struct encoder_packet *packet, uint8_t *data,
+		       size_t size)
+{
+	long *p_refs = bpool_alloc(sizeof(long) + size);
+
+	*p_refs = 1;
+	memcpy(p_refs + 1, data, size);
+	bfree(data);
+
+	if (packet)
+		*tag = *packet;
+	else
+		memset(tag, 0, sizeof(*tag));
+
+	tag->data = (uint8_t *)(p_refs + 1);
+	tag->size = size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct rtmp_multi;
+
+struct rtmp_destination {
+	struct rtmp_multi *rm;
+	size_t idx;
+
+	struct dstr path, key;
+	struct dstr username, password;
+
+	RTMP rtmp;
+	pthread_t send_thread;
+	bool send_thread_active;
+	os_sem_t *send_sem;
+
+	/* written by the encoder thread, read by the send thread */
+	pthread_mutex_t packets_mutex;
+	struct packet_queue packets;
+	int64_t last_dts_usec;
+	int min_priority;
+	float congestion;
+
+	volatile bool connected;
+	bool sent_headers;
+	bool got_keyframe;
+	int retries;
+
+	uint64_t total_bytes_sent;
+	volatile long dropped_frames;
+};
+
+struct rtmp_multi {
+	obs_output_t *output;
+
+	DARRAY(struct rtmp_destination *) destinations;
+	volatile long running_destinations;
+
+	/* metadata and codec headers, sent to each destination on connect */
+	pthread_mutex_t headers_mutex;
+	DARRAY(struct encoder_packet) headers;
+	bool got_first_video;
+	int32_t start_dts_offset;
+
+	volatile bool active;
+	volatile bool capturing;
+	volatile bool stopping;
+	volatile bool encode_error;
+	uint64_t stop_ts;
+	uint64_t shutdown_timeout_ts;
+
+	/* interrupts reconnect delays */
+	os_event_t *stop_event;
+
+	int64_t drop_threshold_usec;
+	int64_t pframe_drop_threshold_usec;
+	int max_shutdown_time_sec;
+	int retry_delay_msec;
+	int max_retries;
+};
+
+static inline bool stopping(struct rtmp_multi *rm)
+{
+	return os_atomic_load_bool(&rm->stopping);
+}
+
+static const char *rtmp_multi_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMultiStream");
+}
+
+/* ------------------------------------------------------------------------- */
+/* destination queues (called from the encoder thread) */
+
+static void drop_packets(struct rtmp_destination *dest, int highest_priority)
+{
+	int num_frames_dropped =
+		packet_queue_drop(&dest->packets, highest_priority);
+
+	if (dest->min_priority < highest_priority)
+		dest->min_priority = highest_priority;
+	if (num_frames_dropped)
+		os_atomic_set_long(&dest->dropped_frames,
+				   dest->dropped_frames + num_frames_dropped);
+}
+
+static void check_to_drop_frames(struct rtmp_destination *dest, bool pframes)
+{
+	struct rtmp_multi *rm = dest->rm;
+	struct encoder_packet first;
+	int64_t buffer_duration_usec;
+	int priority = pframes ? OBS_NAL_PRIORITY_HIGHEST
+			       : OBS_NAL_PRIORITY_HIGH;
+	int64_t drop_threshold = pframes ? rm->pframe_drop_threshold_usec
+					 : rm->drop_threshold_usec;
+
+	if (packet_queue_size(&dest->packets) < 5) {
+		if (!pframes)
+			dest->congestion = 0.0f;
+		return;
+	}
+
+	if (!packet_queue_first_video(&dest->packets, &first))
+		return;
+
+	buffer_duration_usec = dest->last_dts_usec - first.dts_usec;
+
+	if (!pframes)
+		dest->congestion =
+			(float)buffer_duration_usec / (float)drop_threshold;
+
+	if (buffer_duration_usec > drop_threshold)
+		drop_packets(dest, priority);
+}
+
+static bool queue_tag(struct rtmp_destination *dest,
+		      struct encoder_packet *tag)
+{
+	struct encoder_packet packet;
+	bool added = true;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+
+	if (tag->type == OBS_ENCODER_VIDEO) {
+		check_to_drop_frames(dest, false);
+		check_to_drop_frames(dest, true);
+
+		/* if currently dropping frames, drop packets until it reaches
+		 * the desired priority */
+		if (tag->drop_priority < dest->min_priority) {
+			os_atomic_inc_long(&dest->dropped_frames);
+			added = false;
+		} else {
+			dest->min_priority = 0;
+			dest->last_dts_usec = tag->dts_usec;
+		}
+	}
+
+	if (added) {
+		obs_encoder_packet_ref(&packet, tag);
+		packet_queue_push_back(&dest->packets, &packet);
+	}
+
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	if (added)
+		os_sem_post(dest->send_sem);
+	return added;
+}
+
+static bool pop_tag(struct rtmp_destination *dest, struct encoder_packet *tag)
+{
+	bool got_tag;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	got_tag = packet_queue_pop_front(&dest->packets, tag);
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	return got_tag;
+}
+
+static void free_tags(struct rtmp_destination *dest)
+{
+	pthread_mutex_lock(&dest->packets_mutex);
+	packet_queue_clear(&dest->packets);
+	dest->min_priority = 0;
+	dest->congestion = 0.0f;
+	pthread_mutex_unlock(&dest->packets_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* headers */
+
+static void add_header_tag(struct rtmp_multi *rm, uint8_t *data, size_t size)
+{
+	struct encoder_packet tag;
+
+	create_tag(&tag, NULL, data, size);
+	da_push_back(rm->headers, &tag);
+}
+
+static void add_audio_header(struct rtmp_multi *rm, size_t idx, bool *next)
+{
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(rm->output, idx);
+	struct encoder_packet packet = {.type = OBS_ENCODER_AUDIO,
+					.timebase_den = 1};
+	uint8_t *header;
+	uint8_t *data;
+	size_t size;
+
+	if (!aencoder) {
+		*next = false;
+		return;
+	}
+
+	if (!obs_encoder_get_extra_data(aencoder, &header, &packet.size))
+		return;
+
+	packet.data = header;
+	if (idx > 0)
+		flv_additional_packet_mux(&packet, 0, &data, &size, true, idx);
+	else
+		flv_packet_mux(&packet, 0, &data, &size, true);
+
+	add_header_tag(rm, data, size);
+}
+
+static void add_video_header(struct rtmp_multi *rm)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(rm->output);
+	struct encoder_packet packet = {
+		.type = OBS_ENCODER_VIDEO, .timebase_den = 1, .keyframe = true};
+	uint8_t *header;
+	uint8_t *data;
+	size_t size;
+
+	if (!obs_encoder_get_extra_data(vencoder, &header, &size))
+		return;
+
+	packet.size = obs_parse_avc_header(&packet.data, header, size);
+	flv_packet_mux(&packet, 0, &data, &size, true);
+	bfree(packet.data);
+
+	add_header_tag(rm, data, size);
+}
+
+/* called on the first packet, once all encoders have their extra data */
+static void build_headers(struct rtmp_multi *rm)
+{
+	uint8_t *data;
+	size_t size;
+	size_t i = 0;
+	bool next = true;
+
+	pthread_mutex_lock(&rm->headers_mutex);
+
+	flv_meta_data(rm->output, &data, &size, false);
+	add_header_tag(rm, data, size);
+
+	if (obs_output_get_audio_encoder(rm->output, 1)) {
+		flv_additional_meta_data(rm->output, &data, &size);
+		add_header_tag(rm, data, size);
+	}
+
+	add_audio_header(rm, i++, &next);
+	add_video_header(rm);
+	while (next)
+		add_audio_header(rm, i++, &next);
+
+	pthread_mutex_unlock(&rm->headers_mutex);
+}
+
+static void free_headers(struct rtmp_multi *rm)
+{
+	for (size_t i = 0; i < rm->headers.num; i++)
+		obs_encoder_packet_release(&rm->headers.array[i]);
+	da_free(rm->headers);
+}
+
+/* ------------------------------------------------------------------------- */
+/* destinations */
+
+static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
+{
+	bool valid = !dstr_is_empty(str);
+	val->av_val = valid ? str->array : NULL;
+	val->av_len = valid ? (int)str->len : 0;
+}
+
+/* librtmp takes everything after the host as the app, so like rtmp-stream
+ * the stream name is published separately.  a destination given as a full
+ * URL (rtmp://host/app/stream) has it split off the end of the path. */
+static bool split_stream_url(struct dstr *path, struct dstr *key)
+{
+	char *host = path->array ? strstr(path->array, "://") : NULL;
+	char *app;
+	char *stream;
+
+	if (!host)
+		return false;
+
+	app = strchr(host + 3, '/');
+	stream = strrchr(path->array, '/');
+	if (!app || stream == app || !stream[1])
+		return false;
+
+	dstr_copy(key, stream + 1);
+	dstr_resize(path, stream - path->array);
+	return true;
+}
+
+static struct rtmp_destination *destination_create(struct rtmp_multi *rm,
+						   const char *path,
+						   const char *key,
+						   const char *username,
+						   const char *password)
+{
+	struct rtmp_destination *dest;
+
+	if (!path || !*path)
+		return NULL;
+
+	dest = bzalloc(sizeof(struct rtmp_destination));
+	dest->rm = rm;
+	dest->idx = rm->destinations.num;
+	dstr_copy(&dest->path, path);
+	dstr_copy(&dest->key, key);
+	dstr_depad(&dest->path);
+	dstr_depad(&dest->key);
+
+	if (dstr_is_empty(&dest->key) &&
+	    !split_stream_url(&dest->path, &dest->key)) {
+		warn("No stream name in RTMP URL %s, destination ignored",
+		     path);
+		dstr_free(&dest->path);
+		dstr_free(&dest->key);
+		bfree(dest);
+		return NULL;
+	}
+
+	dstr_copy(&dest->username, username);
+	dstr_copy(&dest->password, password);
+	pthread_mutex_init_value(&dest->packets_mutex);
+	packet_queue_init(&dest->packets);
+
+	if (pthread_mutex_init(&dest->packets_mutex, NULL) != 0 ||
+	    os_sem_init(&dest->send_sem, 0) != 0) {
+		warn("Failed to initialize destination %s", path);
+		pthread_mutex_destroy(&dest->packets_mutex);
+		dstr_free(&dest->path);
+		dstr_free(&dest->key);
+		dstr_free(&dest->username);
+		dstr_free(&dest->password);
+		bfree(dest);
+		return NULL;
+	}
+
+	return dest;
+}
+
+static void destination_destroy(struct rtmp_destination *dest)
+{
+	if (dest->send_thread_active)
+		pthread_join(dest->send_thread, NULL);
+
+	free_tags(dest);
+	packet_queue_free(&dest->packets);
+	RTMP_TLS_Free(&dest->rtmp);
+	os_sem_destroy(dest->send_sem);
+	pthread_mutex_destroy(&dest->packets_mutex);
+	dstr_free(&dest->path);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	bfree(dest);
+}
+
+static void free_destinations(struct rtmp_multi *rm)
+{
+	for (size_t i = 0; i < rm->destinations.num; i++)
+		destination_destroy(rm->destinations.array[i]);
+	da_free(rm->destinations);
+}
+
+static bool destination_connect(struct rtmp_destination *dest)
+{
+	struct rtmp_multi *rm = dest->rm;
+	RTMP *rtmp = &dest->rtmp;
+
+	info("Connecting to RTMP URL %s...", dest->path.array);
+
+	RTMP_TLS_Free(rtmp);
+	RTMP_Init(rtmp);
+
+	if (!RTMP_SetupURL(rtmp, dest->path.array)) {
+		warn("Invalid RTMP URL %s", dest->path.array);
+		return false;
+	}
+
+	RTMP_EnableWrite(rtmp);
+
+	set_rtmp_dstr(&rtmp->Link.pubUser, &dest->username);
+	set_rtmp_dstr(&rtmp->Link.pubPasswd, &dest->password);
+	rtmp->Link.swfUrl = rtmp->Link.tcUrl;
+
+	RTMP_AddStream(rtmp, dest->key.array);
+
+	rtmp->m_outChunkSize = 4096;
+	rtmp->m_bSendChunkSizeInfo = true;
+	rtmp->m_bUseNagle = true;
+
+	if (!RTMP_Connect(rtmp, NULL) || !RTMP_ConnectStream(rtmp, 0)) {
+		warn("Connection to %s failed: %d", dest->path.array,
+		     rtmp->last_error_code);
+		return false;
+	}
+
+	info("Connection to %s successful", dest->path.array);
+	return true;
+}
+
+static bool send_tag(struct rtmp_destination *dest,
+		     const struct encoder_packet *tag)
+{
+	if (RTMP_Write(&dest->rtmp, (char *)tag->data, (int)tag->size, 0) < 0)
+		return false;
+
+	dest->total_bytes_sent += tag->size;
+	return true;
+}
+
+static bool send_headers(struct rtmp_destination *dest)
+{
+	struct rtmp_multi *rm = dest->rm;
+	bool success = true;
+
+	pthread_mutex_lock(&rm->headers_mutex);
+	for (size_t i = 0; i < rm->headers.num; i++) {
+		if (!send_tag(dest, &rm->headers.array[i])) {
+			success = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&rm->headers_mutex);
+
+	dest->sent_headers = true;
+	return success;
+}
+
+static inline bool can_shutdown(struct rtmp_multi *rm,
+				const struct encoder_packet *tag)
+{
+	if (os_gettime_ns() >= rm->shutdown_timeout_ts) {
+		info("Stream shutdown timeout reached (%d second(s))",
+		     rm->max_shutdown_time_sec);
+		return true;
+	}
+
+	return tag->sys_dts_usec >= (int64_t)rm->stop_ts;
+}
+
+static void destination_send_loop(struct rtmp_destination *dest)
+{
+	struct rtmp_multi *rm = dest->rm;
+
+	while (os_sem_wait(dest->send_sem) == 0) {
+		struct encoder_packet tag;
+
+		if (os_atomic_load_bool(&rm->encode_error))
+			break;
+		if (stopping(rm) && rm->stop_ts == 0)
+			break;
+
+		if (!pop_tag(dest, &tag))
+			continue;
+
+		if (stopping(rm) && can_shutdown(rm, &tag)) {
+			obs_encoder_packet_release(&tag);
+			break;
+		}
+
+		/* destinations that connect late start on a keyframe */
+		if (!dest->got_keyframe) {
+			if (tag.type != OBS_ENCODER_VIDEO || !tag.keyframe) {
+				obs_encoder_packet_release(&tag);
+				continue;
+			}
+			dest->got_keyframe = true;
+		}
+
+		if (!dest->sent_headers && !send_headers(dest)) {
+			obs_encoder_packet_release(&tag);
+			warn("Disconnected from %s", dest->path.array);
+			break;
+		}
+
+		if (!send_tag(dest, &tag)) {
+			obs_encoder_packet_release(&tag);
+			warn("Disconnected from %s", dest->path.array);
+			break;
+		}
+
+		obs_encoder_packet_release(&tag);
+	}
+}
+
+static inline bool should_exit(struct rtmp_multi *rm)
+{
+	return stopping(rm) || os_atomic_load_bool(&rm->encode_error);
+}
+
+/* waits before the next reconnect attempt, returns false if the destination
+ * should give up */
+static bool wait_to_reconnect(struct rtmp_destination *dest,
+			      uint32_t *retry_msec)
+{
+	struct rtmp_multi *rm = dest->rm;
+
+	if (dest->retries >= rm->max_retries) {
+		warn("Giving up on %s after %d reconnect attempt(s)",
+		     dest->path.array, dest->retries);
+		return false;
+	}
+
+	if (dest->retries++) {
+		*retry_msec = (uint32_t)((float)*retry_msec * RETRY_EXP);
+		if (*retry_msec > RETRY_MAX_MSEC)
+			*retry_msec = RETRY_MAX_MSEC;
+	}
+
+	info("Reconnecting to %s in %.02f seconds..", dest->path.array,
+	     (float)*retry_msec / 1000.0f);
+
+	return os_event_timedwait(rm->stop_event, *retry_msec) == ETIMEDOUT &&
+	       !should_exit(rm);
+}
+
+static void *destination_thread(void *data)
+{
+	struct rtmp_destination *dest = data;
+	struct rtmp_multi *rm = dest->rm;
+	uint32_t retry_msec = (uint32_t)rm->retry_delay_msec;
+	bool was_connected = false;
+
+	os_set_thread_name("rtmp-multi: send_thread");
+
+	/* like other outputs, only an established connection is retried;
+	 * failing to connect in the first place fails the destination */
+	for (;;) {
+		if (destination_connect(dest)) {
+			was_connected = true;
+			dest->retries = 0;
+			retry_msec = (uint32_t)rm->retry_delay_msec;
+			dest->sent_headers = false;
+			dest->got_keyframe = false;
+
+			free_tags(dest);
+			os_atomic_set_bool(&dest->connected, true);
+
+			if (!os_atomic_set_bool(&rm->capturing, true))
+				obs_output_begin_data_capture(rm->output, 0);
+
+			destination_send_loop(dest);
+			os_atomic_set_bool(&dest->connected, false);
+			free_tags(dest);
+		}
+
+		RTMP_Close(&dest->rtmp);
+
+		if (!was_connected || should_exit(rm) ||
+		    !wait_to_reconnect(dest, &retry_msec))
+			break;
+	}
+
+	/* the last destination to finish ends the output */
+	if (os_atomic_dec_long(&rm->running_destinations) == 0) {
+		bool capturing = os_atomic_load_bool(&rm->capturing);
+
+		os_atomic_set_bool(&rm->active, false);
+
+		if (os_atomic_load_bool(&rm->encode_error))
+			obs_output_signal_stop(rm->output,
+					       OBS_OUTPUT_ENCODE_ERROR);
+		else if (stopping(rm) && capturing)
+			obs_output_end_data_capture(rm->output);
+		else if (stopping(rm))
+			obs_output_signal_stop(rm->output, OBS_OUTPUT_SUCCESS);
+		else if (capturing)
+			obs_output_signal_stop(rm->output,
+					       OBS_OUTPUT_DISCONNECTED);
+		else
+			obs_output_signal_stop(rm->output,
+					       OBS_OUTPUT_CONNECT_FAILED);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void join_destinations(struct rtmp_multi *rm)
+{
+	for (size_t i = 0; i < rm->destinations.num; i++) {
+		struct rtmp_destination *dest = rm->destinations.array[i];
+
+		if (dest->send_thread_active) {
+			pthread_join(dest->send_thread, NULL);
+			dest->send_thread_active = false;
+		}
+	}
+}
+
+static void rtmp_multi_destroy(void *data)
+{
+	struct rtmp_multi *rm = data;
+
+	if (os_atomic_load_bool(&rm->active)) {
+		os_atomic_set_bool(&rm->stopping, true);
+		rm->stop_ts = 0;
+		os_event_signal(rm->stop_event);
+		for (size_t i = 0; i < rm->destinations.num; i++)
+			os_sem_post(rm->destinations.array[i]->send_sem);
+	}
+
+	join_destinations(rm);
+	free_destinations(rm);
+	free_headers(rm);
+	os_event_destroy(rm->stop_event);
+	pthread_mutex_destroy(&rm->headers_mutex);
+	bfree(rm);
+}
+
+static void *rtmp_multi_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct rtmp_multi *rm = bzalloc(sizeof(struct rtmp_multi));
+	rm->output = output;
+	pthread_mutex_init_value(&rm->headers_mutex);
+
+	if (pthread_mutex_init(&rm->headers_mutex, NULL) != 0) {
+		bfree(rm);
+		return NULL;
+	}
+	if (os_event_init(&rm->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		pthread_mutex_destroy(&rm->headers_mutex);
+		bfree(rm);
+		return NULL;
+	}
+
+	UNUSED_PARAMETER(settings);
+	return rm;
+}
+
+static void add_destination(struct rtmp_multi *rm, const char *path,
+			    const char *key, const char *username,
+			    const char *password)
+{
+	struct rtmp_destination *dest =
+		destination_create(rm, path, key, username, password);
+	if (dest)
+		da_push_back(rm->destinations, &dest);
+}
+
+static void load_destinations(struct rtmp_multi *rm, obs_data_t *settings)
+{
+	obs_service_t *service = obs_output_get_service(rm->output);
+	obs_data_array_t *array;
+	size_t count;
+
+	if (service)
+		add_destination(rm, obs_service_get_url(service),
+				obs_service_get_key(service),
+				obs_service_get_username(service),
+				obs_service_get_password(service));
+
+	/* each entry is either a full URL (editable list "value") or an
+	 * object with separate server/key/username/password fields */
+	array = obs_data_get_array(settings, OPT_DESTINATIONS);
+	count = obs_data_array_count(array);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+		const char *server = obs_data_get_string(item, "server");
+
+		if (!*server)
+			server = obs_data_get_string(item, "value");
+
+		add_destination(rm, server, obs_data_get_string(item, "key"),
+				obs_data_get_string(item, "username"),
+				obs_data_get_string(item, "password"));
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(array);
+}
+
+static bool start_destinations(struct rtmp_multi *rm)
+{
+	rm->got_first_video = false;
+	rm->stop_ts = 0;
+	os_event_reset(rm->stop_event);
+	os_atomic_set_bool(&rm->stopping, false);
+	os_atomic_set_bool(&rm->capturing, false);
+	os_atomic_set_bool(&rm->encode_error, false);
+	os_atomic_set_bool(&rm->active, true);
+	os_atomic_set_long(&rm->running_destinations,
+			   (long)rm->destinations.num);
+
+	info("Starting stream to %d destination(s)",
+	     (int)rm->destinations.num);
+
+	for (size_t i = 0; i < rm->destinations.num; i++) {
+		struct rtmp_destination *dest = rm->destinations.array[i];
+
+		if (pthread_create(&dest->send_thread, NULL,
+				   destination_thread, dest) == 0) {
+			dest->send_thread_active = true;
+		} else {
+			warn("Failed to create send thread for %s",
+			     dest->path.array);
+			os_atomic_dec_long(&rm->running_destinations);
+		}
+	}
+
+	if (!os_atomic_load_long(&rm->running_destinations)) {
+		os_atomic_set_bool(&rm->active, false);
+		return false;
+	}
+
+	return true;
+}
+
+static bool rtmp_multi_start(void *data)
+{
+	struct rtmp_multi *rm = data;
+	obs_data_t *settings;
+
+	if (os_atomic_load_bool(&rm->active))
+		return false;
+	if (!obs_output_can_begin_data_capture(rm->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(rm->output, 0))
+		return false;
+
+	join_destinations(rm);
+	free_destinations(rm);
+	free_headers(rm);
+
+	settings = obs_output_get_settings(rm->output);
+	rm->drop_threshold_usec =
+		1000 * obs_data_get_int(settings, OPT_DROP_THRESHOLD);
+	rm->pframe_drop_threshold_usec =
+		1000 * obs_data_get_int(settings, OPT_PFRAME_DROP_THRESHOLD);
+	rm->max_shutdown_time_sec =
+		(int)obs_data_get_int(settings, OPT_MAX_SHUTDOWN_TIME_SEC);
+	if (rm->pframe_drop_threshold_usec < rm->drop_threshold_usec + 200000)
+		rm->pframe_drop_threshold_usec =
+			rm->drop_threshold_usec + 200000;
+	rm->retry_delay_msec =
+		1000 * (int)obs_data_get_int(settings, OPT_RETRY_DELAY_SEC);
+	rm->max_retries = (int)obs_data_get_int(settings, OPT_MAX_RETRIES);
+
+	load_destinations(rm, settings);
+	obs_data_release(settings);
+
+	if (!rm->destinations.num) {
+		warn("No destinations");
+		return false;
+	}
+
+	return start_destinations(rm);
+}
+
+static void rtmp_multi_stop(void *data, uint64_t ts)
+{
+	struct rtmp_multi *rm = data;
+
+	if (stopping(rm) && ts != 0)
+		return;
+
+	rm->stop_ts = ts / 1000ULL;
+	rm->shutdown_timeout_ts =
+		ts + (uint64_t)rm->max_shutdown_time_sec * 1000000000ULL;
+	os_atomic_set_bool(&rm->stopping, true);
+	os_event_signal(rm->stop_event);
+
+	if (!os_atomic_load_bool(&rm->active)) {
+		obs_output_signal_stop(rm->output, OBS_OUTPUT_SUCCESS);
+		return;
+	}
+
+	for (size_t i = 0; i < rm->destinations.num; i++)
+		os_sem_post(rm->destinations.array[i]->send_sem);
+}
+
+static void rtmp_multi_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi *rm = data;
+	struct encoder_packet new_packet;
+	struct encoder_packet tag;
+	uint8_t *tag_data;
+	size_t tag_size;
+	int32_t offset;
+
+	if (!os_atomic_load_bool(&rm->active))
+		return;
+
+	/* encoder fail */
+	if (!packet) {
+		os_atomic_set_bool(&rm->encode_error, true);
+		os_event_signal(rm->stop_event);
+		for (size_t i = 0; i < rm->destinations.num; i++)
+			os_sem_post(rm->destinations.array[i]->send_sem);
+		return;
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (!rm->got_first_video) {
+			rm->start_dts_offset = get_ms_time(packet, packet->dts);
+			rm->got_first_video = true;
+			build_headers(rm);
+		}
+
+		obs_parse_avc_packet(&new_packet, packet);
+	} else {
+		obs_encoder_packet_ref(&new_packet, packet);
+	}
+
+	/* mux once for every destination */
+	offset = rm->start_dts_offset;
+	if (new_packet.track_idx > 0)
+		flv_additional_packet_mux(&new_packet, offset, &tag_data,
+					  &tag_size, false,
+					  new_packet.track_idx);
+	else
+		flv_packet_mux(&new_packet, offset, &tag_data, &tag_size,
+			       false);
+
+	create_tag(&tag, &new_packet, tag_data, tag_size);
+	obs_encoder_packet_release(&new_packet);
+
+	for (size_t i = 0; i < rm->destinations.num; i++) {
+		struct rtmp_destination *dest = rm->destinations.array[i];
+		if (os_atomic_load_bool(&dest->connected))
+			queue_tag(dest, &tag);
+	}
+
+	obs_encoder_packet_release(&tag);
+}
+
+static void rtmp_multi_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
+	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 900);
+	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 30);
+	obs_data_set_default_int(defaults, OPT_RETRY_DELAY_SEC, 2);
+	obs_data_set_default_int(defaults, OPT_MAX_RETRIES, 20);
+}
+
+static obs_properties_t *rtmp_multi_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p;
+
+	obs_properties_add_editable_list(
+		props, OPT_DESTINATIONS,
+		obs_module_text("RTMPMultiStream.Destinations"),
+		OBS_EDITABLE_LIST_TYPE_STRINGS, NULL, NULL);
+
+	p = obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+				   obs_module_text("RTMPStream.DropThreshold"),
+				   200, 10000, 100);
+	obs_property_int_set_suffix(p, " ms");
+
+	return props;
+}
+
+static uint64_t rtmp_multi_total_bytes_sent(void *data)
+{
+	struct rtmp_multi *rm = data;
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < rm->destinations.num; i++)
+		total += rm->destinations.array[i]->total_bytes_sent;
+	return total;
+}
+
+static int rtmp_multi_dropped_frames(void *data)
+{
+	struct rtmp_multi *rm = data;
+	long total = 0;
+
+	for (size_t i = 0; i < rm->destinations.num; i++)
+		total += os_atomic_load_long(
+			&rm->destinations.array[i]->dropped_frames);
+	return (int)total;
+}
+
+/* reports the most congested destination */
+static float rtmp_multi_congestion(void *data)
+{
+	struct rtmp_multi *rm = data;
+	float congestion = 0.0f;
+
+	for (size_t i = 0; i < rm->destinations.num; i++) {
+		struct rtmp_destination *dest = rm->destinations.array[i];
+		float val = dest->min_priority > 0 ? 1.0f : dest->congestion;
+
+		if (val > congestion)
+			congestion = val;
+	}
+
+	return congestion;
+}
+
+static int rtmp_multi_connect_time(void *data)
+{
+	struct rtmp_multi *rm = data;
+	int connect_time = 0;
+
+	for (size_t i = 0; i < rm->destinations.num; i++) {
+		int val = rm->destinations.array[i]->rtmp.connect_time_ms;
+		if (val > connect_time)
+			connect_time = val;
+	}
+
+	return connect_time;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id = "rtmp_multi_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = rtmp_multi_getname,
+	.create = rtmp_multi_create,
+	.destroy = rtmp_multi_destroy,
+	.start = rtmp_multi_start,
+	.stop = rtmp_multi_stop,
+	.encoded_packet = rtmp_multi_data,
+	.get_defaults = rtmp_multi_defaults,
+	.get_properties = rtmp_multi_properties,
+	.get_total_bytes = rtmp_multi_total_bytes_sent,
+	.get_congestion = rtmp_multi_congestion,
+	.get_connect_time_ms = rtmp_multi_connect_time,
+	.get_dropped_frames = rtmp_multi_dropped_frames,
+};
@@ -74,23 +74,16 @@ static void log_rtmp(int level, const char *format, va_list args)
 	blogva(LOG_INFO, format, args);
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream);
-
 static inline void free_packets(struct rtmp_stream *stream)
 {
 	size_t num_packets;
 
 	pthread_mutex_lock(&stream->packets_mutex);
 
-	num_packets = num_buffered_packets(stream);
+	num_packets = packet_queue_clear(&stream->packets);
 	if (num_packets)
 		info("Freeing %d remaining packets", (int)num_packets);
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-		obs_encoder_packet_release(&packet);
-	}
 	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
@@ -151,11 +144,12 @@ static void rtmp_stream_destroy(void *data)
 	os_event_destroy(stream->stop_event);
 	os_sem_destroy(stream->send_sem);
 	pthread_mutex_destroy(&stream->packets_mutex);
-	circlebuf_free(&stream->packets);
+	packet_queue_free(&stream->packets);
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
 	circlebuf_free(&stream->dbr_frames);
+	congestion_controller_free(&stream->dbr_controller);
 	pthread_mutex_destroy(&stream->dbr_mutex);
 
 	os_event_destroy(stream->buffer_space_available_event);
@@ -163,6 +157,12 @@ static void rtmp_stream_destroy(void *data)
 	os_event_destroy(stream->socket_available_event);
 	os_event_destroy(stream->send_thread_signaled_exit);
 	pthread_mutex_destroy(&stream->write_buf_mutex);
+#ifdef __linux__
+	if (stream->socket_wakeup_fd != -1)
+		close(stream->socket_wakeup_fd);
+	if (stream->socket_stop_fd != -1)
+		close(stream->socket_stop_fd);
+#endif
 
 	if (stream->write_buf)
 		bfree(stream->write_buf);
@@ -174,6 +174,11 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+	packet_queue_init(&stream->packets);
+#ifdef __linux__
+	stream->socket_wakeup_fd = -1;
+	stream->socket_stop_fd = -1;
+#endif
 
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
@@ -213,6 +218,18 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 		warn("Failed to initialize socket exit event");
 		goto fail;
 	}
+#ifdef __linux__
+	stream->socket_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stream->socket_wakeup_fd == -1) {
+		warn("Failed to initialize socket wakeup event");
+		goto fail;
+	}
+	stream->socket_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stream->socket_stop_fd == -1) {
+		warn("Failed to initialize socket stop event");
+		goto fail;
+	}
+#endif
 
 	UNUSED_PARAMETER(settings);
 	return stream;
@@ -268,11 +285,7 @@ static inline bool get_next_packet(struct rtmp_stream *stream,
 	bool new_packet = false;
 
 	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				    sizeof(struct encoder_packet));
-		new_packet = true;
-	}
+	new_packet = packet_queue_pop_front(&stream->packets, packet);
 	pthread_mutex_unlock(&stream->packets_mutex);
 
 	return new_packet;
@@ -282,8 +295,7 @@ static inline void peek_next_packet(struct rtmp_stream *stream,
 				    struct encoder_packet *packet)
 {
 	pthread_mutex_lock(&stream->packets_mutex);
-	circlebuf_peek_front(&stream->packets, packet,
-			     sizeof(struct encoder_packet));
+	packet_queue_peek_front(&stream->packets, packet);
 	pthread_mutex_unlock(&stream->packets_mutex);
 }
 
@@ -291,8 +303,7 @@ static void reinsert_packet_at_front(struct rtmp_stream *stream,
 				     struct encoder_packet *packet)
 {
 	pthread_mutex_lock(&stream->packets_mutex);
-	circlebuf_push_front(&stream->packets, packet,
-			     sizeof(struct encoder_packet));
+	packet_queue_push_front(&stream->packets, packet);
 	pthread_mutex_unlock(&stream->packets_mutex);
 	os_sem_post(stream->send_sem);
 }
@@ -432,7 +443,7 @@ retry_send:
 
 	pthread_mutex_unlock(&stream->write_buf_mutex);
 
-	os_event_signal(stream->buffer_has_data_event);
+	signal_buffer_has_data(stream);
 
 	return len;
 }
@@ -478,6 +489,10 @@ static int send_packet(struct rtmp_stream *stream,
 	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
 	bfree(data);
 
+	/* with the socket thread this is the time the data was queued for it */
+	if (!is_header && ret >= 0)
+		OBS_LATENCY_TRACE_PACKET(packet, OBS_LATENCY_SEND);
+
 	if (is_header)
 		bfree(packet->data);
 	else
@@ -606,6 +621,32 @@ static void dbr_add_frame(struct rtmp_stream *stream, struct dbr_frame *back)
 	}
 }
 
+#define TCP_INFO_INTERVAL_NS (100ULL * MSEC_TO_NSEC)
+
+/* samples TCP_INFO for the congestion controller, call with dbr_mutex */
+static void dbr_update_tcp_info(struct rtmp_stream *stream, uint64_t ts)
+{
+#ifdef __linux__
+	struct tcp_info tcp_info;
+	socklen_t size = sizeof(tcp_info);
+
+	if (ts - stream->last_tcp_info_ts < TCP_INFO_INTERVAL_NS)
+		return;
+	stream->last_tcp_info_ts = ts;
+
+	if (getsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_INFO,
+		       &tcp_info, &size) != 0)
+		return;
+
+	stream->has_tcp_info = true;
+	stream->tcp_rtt_usec = tcp_info.tcpi_rtt;
+	stream->tcp_rtt_var_usec = tcp_info.tcpi_rttvar;
+#else
+	UNUSED_PARAMETER(stream);
+	UNUSED_PARAMETER(ts);
+#endif
+}
+
 static void dbr_set_bitrate(struct rtmp_stream *stream);
 static bool rtmp_stream_start(void *data);
 
@@ -700,6 +741,10 @@ static void *send_thread(void *data)
 
 			pthread_mutex_lock(&stream->dbr_mutex);
 			dbr_add_frame(stream, &dbr_frame);
+			if (congestion_controller_active(
+				    &stream->dbr_controller))
+				dbr_update_tcp_info(stream,
+						    dbr_frame.send_end);
 			pthread_mutex_unlock(&stream->dbr_mutex);
 		}
 	}
@@ -721,8 +766,8 @@ static void *send_thread(void *data)
 #endif
 
 	if (stream->new_socket_loop) {
-		os_event_signal(stream->send_thread_signaled_exit);
-		os_event_signal(stream->buffer_has_data_event);
+		signal_socket_thread_exit(stream);
+		signal_buffer_has_data(stream);
 		pthread_join(stream->socket_thread, NULL);
 		stream->socket_thread_active = false;
 		stream->rtmp.m_bCustomSend = false;
@@ -900,7 +945,7 @@ static int init_send(struct rtmp_stream *stream)
 			return OBS_OUTPUT_ERROR;
 		}
 
-		os_event_reset(stream->send_thread_signaled_exit);
+		reset_socket_thread_exit(stream);
 
 		info("New socket loop enabled by user");
 		if (stream->low_latency_mode)
@@ -956,6 +1001,9 @@ static int init_send(struct rtmp_stream *stream)
 #ifdef _WIN32
 		ret = pthread_create(&stream->socket_thread, NULL,
 				     socket_thread_windows, stream);
+#elif defined(__linux__)
+		ret = pthread_create(&stream->socket_thread, NULL,
+				     socket_thread_linux, stream);
 #else
 		warn("New socket loop not supported on this platform");
 		return OBS_OUTPUT_ERROR;
@@ -1192,8 +1240,26 @@ static bool init_connect(struct rtmp_stream *stream)
 		stream->dbr_enabled = false;
 	}
 
+	congestion_controller_free(&stream->dbr_controller);
+	stream->has_tcp_info = false;
+	stream->last_tcp_info_ts = 0;
+
 	if (stream->dbr_enabled) {
+		const char *controller = obs_data_get_string(
+			settings, OPT_DYN_BITRATE_CONTROLLER);
+
 		info("Dynamic bitrate enabled.  Dropped frames begone!");
+
+		if (*controller && strcmp(controller, "legacy") != 0) {
+			if (congestion_controller_init(
+				    &stream->dbr_controller, controller,
+				    stream->dbr_orig_bitrate, 50))
+				info("Using '%s' congestion controller",
+				     controller);
+			else
+				warn("Unknown congestion controller '%s'",
+				     controller);
+		}
 	}
 
 	obs_data_release(vsettings);
@@ -1278,14 +1344,13 @@ static bool rtmp_stream_start(void *data)
 static inline bool add_packet(struct rtmp_stream *stream,
 			      struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			    sizeof(struct encoder_packet));
+	packet_queue_push_back(&stream->packets, packet);
 	return true;
 }
 
 static inline size_t num_buffered_packets(struct rtmp_stream *stream)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	return packet_queue_size(&stream->packets);
 }
 
 static void drop_frames(struct rtmp_stream *stream, const char *name,
@@ -1293,7 +1358,6 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 {
 	UNUSED_PARAMETER(pframes);
 
-	struct circlebuf new_buf = {0};
 	int num_frames_dropped = 0;
 
 #ifdef _DEBUG
@@ -1302,25 +1366,9 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 	UNUSED_PARAMETER(name);
 #endif
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
-
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-
-		/* do not drop audio data or video keyframes */
-		if (packet.type == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority >= highest_priority) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
-
-		} else {
-			num_frames_dropped++;
-			obs_encoder_packet_release(&packet);
-		}
-	}
-
-	circlebuf_free(&stream->packets);
-	stream->packets = new_buf;
+	/* audio data and video keyframes are never dropped */
+	num_frames_dropped =
+		packet_queue_drop(&stream->packets, highest_priority);
 
 	if (stream->min_priority < highest_priority)
 		stream->min_priority = highest_priority;
@@ -1337,18 +1385,7 @@ static void drop_frames(struct rtmp_stream *stream, const char *name,
 static bool find_first_video_packet(struct rtmp_stream *stream,
 				    struct encoder_packet *first)
 {
-	size_t count = stream->packets.size / sizeof(*first);
-
-	for (size_t i = 0; i < count; i++) {
-		struct encoder_packet *cur =
-			circlebuf_data(&stream->packets, i * sizeof(*first));
-		if (cur->type == OBS_ENCODER_VIDEO && !cur->keyframe) {
-			*first = *cur;
-			return true;
-		}
-	}
-
-	return false;
+	return packet_queue_first_video(&stream->packets, first);
 }
 
 static bool dbr_bitrate_lowered(struct rtmp_stream *stream, Severity severity)
@@ -1456,6 +1493,36 @@ static void dbr_inc_bitrate(struct rtmp_stream *stream)
 	}
 }
 
+static void dbr_controller_update(struct rtmp_stream *stream,
+				  int64_t buffer_duration_usec)
+{
+	struct congestion_sample sample = {
+		.ts = os_gettime_ns(),
+		.buffer_duration_usec = buffer_duration_usec,
+	};
+	bool bitrate_changed;
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	sample.send_kbps = stream->dbr_est_bitrate;
+	sample.has_tcp_info = stream->has_tcp_info;
+	sample.rtt_usec = stream->tcp_rtt_usec;
+	sample.rtt_var_usec = stream->tcp_rtt_var_usec;
+	bitrate_changed = congestion_controller_update(&stream->dbr_controller,
+						       &sample);
+	pthread_mutex_unlock(&stream->dbr_mutex);
+
+	if (bitrate_changed) {
+		long prev_bitrate = stream->dbr_cur_bitrate;
+
+		stream->dbr_cur_bitrate = stream->dbr_controller.cur_kbps;
+		info("bitrate %s to: %ld",
+		     stream->dbr_cur_bitrate < prev_bitrate ? "decreased"
+							     : "increased",
+		     stream->dbr_cur_bitrate);
+		dbr_set_bitrate(stream);
+	}
+}
+
 static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 {
 	struct encoder_packet first;
@@ -1467,7 +1534,8 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	int64_t drop_threshold = pframes ? stream->pframe_drop_threshold_usec
 					 : stream->drop_threshold_usec;
 
-	if (!pframes && stream->dbr_enabled) {
+	if (!pframes && stream->dbr_enabled &&
+	    !congestion_controller_active(&stream->dbr_controller)) {
 		if (stream->dbr_inc_timeout) {
 			uint64_t t = os_gettime_ns();
 
@@ -1479,6 +1547,18 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 		}
 	}
 
+	/* the congestion controller needs a sample for every video packet,
+	 * an (almost) empty queue is what lets it raise the bitrate again */
+	if (!pframes && stream->dbr_enabled &&
+	    congestion_controller_active(&stream->dbr_controller)) {
+		buffer_duration_usec = 0;
+		if (num_packets >= 5 && find_first_video_packet(stream, &first))
+			buffer_duration_usec =
+				stream->last_dts_usec - first.dts_usec;
+
+		dbr_controller_update(stream, buffer_duration_usec);
+	}
+
 	if (num_packets < 5) {
 		if (!pframes)
 			stream->congestion = 0.0f;
@@ -1501,6 +1581,10 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	 * (!pframes && stream->dbr_enabled)
 	 * but let's test without dropping frames
 	 * at all first */
+	if (stream->dbr_enabled &&
+	    congestion_controller_active(&stream->dbr_controller))
+		return;
+
 	if (stream->dbr_enabled) {
 		bool bitrate_changed = false;
 
@@ -1607,6 +1691,8 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_string(defaults, OPT_DYN_BITRATE_CONTROLLER,
+				    "legacy");
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -1641,6 +1727,18 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
 				obs_module_text("RTMPStream.LowLatencyMode"));
 
+	p = obs_properties_add_list(
+		props, OPT_DYN_BITRATE_CONTROLLER,
+		obs_module_text("RTMPStream.DynBitrateController"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(
+		p, obs_module_text("RTMPStream.DynBitrateController.Legacy"),
+		"legacy");
+	obs_property_list_add_string(
+		p,
+		obs_module_text("RTMPStream.DynBitrateController.DelayGradient"),
+		"delay_gradient");
+
 	return props;
 }
 
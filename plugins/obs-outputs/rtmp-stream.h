@@ -1,5 +1,6 @@
 #include <obs-module.h>
 #include <obs-avc.h>
+#include <obs-latency.h>
 #include <util/platform.h>
 #include <util/circlebuf.h>
 #include <util/dstr.h>
@@ -9,6 +10,8 @@
 #include "librtmp/log.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "packet-queue.h"
+#include "rtmp-congestion.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -16,6 +19,16 @@
 #include <sys/ioctl.h>
 #endif
 
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 #define do_log(level, format, ...)                 \
 	blog(level, "[rtmp stream: '%s'] " format, \
 	     obs_output_get_name(stream->output), ##__VA_ARGS__)
@@ -25,6 +38,7 @@
 #define debug(format, ...) do_log(LOG_DEBUG, format, ##__VA_ARGS__)
 
 #define OPT_DYN_BITRATE "dyn_bitrate"
+#define OPT_DYN_BITRATE_CONTROLLER "dyn_bitrate_controller"
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
 #define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
 #define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
@@ -57,7 +71,7 @@ struct rtmp_stream {
 	obs_output_t *output;
 
 	pthread_mutex_t packets_mutex;
-	struct circlebuf packets;
+	struct packet_queue packets;
 	bool sent_headers;
 
 	bool got_first_video;
@@ -117,6 +131,13 @@ struct rtmp_stream {
 	long dbr_inc_bitrate;
 	bool dbr_enabled;
 
+	/* optional replacement for the threshold based logic above */
+	struct congestion_controller dbr_controller;
+	bool has_tcp_info;
+	uint32_t tcp_rtt_usec;
+	uint32_t tcp_rtt_var_usec;
+	uint64_t last_tcp_info_ts;
+
 	RTMP rtmp;
 
 	bool new_socket_loop;
@@ -132,8 +153,52 @@ struct rtmp_stream {
 	os_event_t *buffer_has_data_event;
 	os_event_t *socket_available_event;
 	os_event_t *send_thread_signaled_exit;
+#ifdef __linux__
+	/* wakes the epoll socket loop, mirrors buffer_has_data_event */
+	int socket_wakeup_fd;
+	/* wakes the epoll socket loop, mirrors send_thread_signaled_exit */
+	int socket_stop_fd;
+#endif
 };
 
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#elif defined(__linux__)
+void *socket_thread_linux(void *data);
+#endif
+
+static inline void signal_buffer_has_data(struct rtmp_stream *stream)
+{
+	os_event_signal(stream->buffer_has_data_event);
+#ifdef __linux__
+	if (stream->socket_wakeup_fd != -1) {
+		uint64_t val = 1;
+		if (write(stream->socket_wakeup_fd, &val, sizeof(val)) < 0)
+			return;
+	}
+#endif
+}
+
+static inline void signal_socket_thread_exit(struct rtmp_stream *stream)
+{
+	os_event_signal(stream->send_thread_signaled_exit);
+#ifdef __linux__
+	if (stream->socket_stop_fd != -1) {
+		uint64_t val = 1;
+		if (write(stream->socket_stop_fd, &val, sizeof(val)) < 0)
+			return;
+	}
+#endif
+}
+
+static inline void reset_socket_thread_exit(struct rtmp_stream *stream)
+{
+	os_event_reset(stream->send_thread_signaled_exit);
+#ifdef __linux__
+	if (stream->socket_stop_fd != -1) {
+		uint64_t val;
+		while (read(stream->socket_stop_fd, &val, sizeof(val)) > 0)
+			;
+	}
 #endif
+}
@@ -70,12 +70,14 @@ static void stinger_update(void *data, obs_data_t *settings)
 	const char *path = obs_data_get_string(settings, "path");
 	bool hw_decode = obs_data_get_bool(settings, "hw_decode");
 	int64_t volume = obs_data_get_int(settings, "volume");
+	int64_t preroll_frames = obs_data_get_int(settings, "preroll_frames");
 
 	obs_data_t *media_settings = obs_data_create();
 	obs_data_set_string(media_settings, "local_file", path);
 	obs_data_set_bool(media_settings, "hw_decode", hw_decode);
 	obs_data_set_bool(media_settings, "looping", false);
 	obs_data_set_int(media_settings, "volume", volume);
+	obs_data_set_int(media_settings, "preroll_frames", preroll_frames);
 
 	obs_source_release(s->media_source);
 	struct dstr name;
@@ -123,6 +125,8 @@ static void stinger_update(void *data, obs_data_t *settings)
 		obs_data_t *tm_media_settings = obs_data_create();
 		obs_data_set_string(tm_media_settings, "local_file", tm_path);
 		obs_data_set_bool(tm_media_settings, "looping", false);
+		obs_data_set_int(tm_media_settings, "preroll_frames",
+				 preroll_frames);
 
 		s->matte_source = obs_source_create_private(
 			"ffmpeg_source", NULL, tm_media_settings);
@@ -228,6 +232,7 @@ static void stinger_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, "hw_decode", true);
 	obs_data_set_default_int(settings, "volume", 100);
+	obs_data_set_default_int(settings, "preroll_frames", 10);
 }
 
 static void stinger_matte_render(void *data, gs_texture_t *a, gs_texture_t *b,
@@ -769,6 +774,11 @@ static obs_properties_t *stinger_properties(void *data)
 			       obs_module_text("TransitionPoint"), 0, 120000,
 			       1);
 
+	p = obs_properties_add_int(ppts, "preroll_frames",
+				   obs_module_text("PrerollFrames"), 0, 120, 1);
+	obs_property_set_long_description(
+		p, obs_module_text("PrerollFrames.ToolTip"));
+
 	// track matte properties
 	{
 		obs_properties_t *track_matte_group = obs_properties_create();
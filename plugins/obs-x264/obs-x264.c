@@ -15,11 +15,20 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <util/bmem.h>
 #include <util/dstr.h>
 #include <util/darray.h>
+#include <util/circlebuf.h>
+#include <util/threading.h>
 #include <util/platform.h>
 #include <obs-module.h>
 #include <opts-parser.h>
@@ -44,8 +53,40 @@
 
 //#define ENABLE_VFR
 
+/* limits of segment encoding, see "Segment encoding" */
+#define MAX_SEGMENT_WORKERS 16
+#define MAX_SEGMENT_LATENCY_SEC 20
+#define MAX_SEGMENT_BUFFER_MB 2048
+
 /* ------------------------------------------------------------------------- */
 
+struct x264_seg_frame {
+	uint8_t *data;
+	uint32_t linesize[3];
+	int64_t pts;
+};
+
+struct x264_seg_packet {
+	DARRAY(uint8_t) data;
+	int64_t pts;
+	int64_t dts;
+	bool keyframe;
+};
+
+struct x264_segment {
+	DARRAY(struct x264_seg_frame) frames;
+	DARRAY(struct x264_seg_packet) packets;
+	size_t next_packet;
+	volatile bool encoded;
+	bool failed;
+};
+
+struct x264_worker {
+	struct obs_x264 *obsx264;
+	pthread_t thread;
+	int index;
+};
+
 struct obs_x264 {
 	obs_encoder_t *encoder;
 
@@ -61,6 +102,21 @@ struct obs_x264 {
 	size_t sei_size;
 
 	os_performance_token_t *performance_token;
+
+	/* segment encoding, only used if num_workers is non-zero */
+	int num_workers;
+	int segment_frames;
+	int cores_per_worker;
+	int num_planes;
+	uint32_t plane_heights[3];
+
+	struct x264_worker *workers;
+	pthread_mutex_t seg_mutex;
+	os_sem_t *seg_sem;
+	os_event_t *seg_done_event;
+	struct circlebuf pending_segments;
+	struct circlebuf segments;
+	struct x264_segment *cur_segment;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -72,6 +128,8 @@ static const char *obs_x264_getname(void *unused)
 }
 
 static void obs_x264_stop(void *data);
+static bool start_segment_workers(struct obs_x264 *obsx264);
+static void stop_segment_workers(struct obs_x264 *obsx264);
 
 static void clear_data(struct obs_x264 *obsx264)
 {
@@ -92,6 +150,8 @@ static void obs_x264_destroy(void *data)
 
 	if (obsx264) {
 		os_end_high_performance(obsx264->performance_token);
+		if (obsx264->workers)
+			stop_segment_workers(obsx264);
 		clear_data(obsx264);
 		da_free(obsx264->packet_data);
 		bfree(obsx264);
@@ -115,6 +175,8 @@ static void obs_x264_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, "tune", "");
 	obs_data_set_default_string(settings, "x264opts", "");
 	obs_data_set_default_bool(settings, "repeat_headers", false);
+	obs_data_set_default_int(settings, "segment_workers", 0);
+	obs_data_set_default_int(settings, "segment_sec", 2);
 }
 
 static inline void add_strings(obs_property_t *list, const char *const *strings)
@@ -137,6 +199,10 @@ static inline void add_strings(obs_property_t *list, const char *const *strings)
 #define TEXT_TUNE obs_module_text("Tune")
 #define TEXT_NONE obs_module_text("None")
 #define TEXT_X264_OPTS obs_module_text("EncoderOptions")
+#define TEXT_SEGMENT_WORKERS obs_module_text("SegmentWorkers")
+#define TEXT_SEGMENT_WORKERS_OFF obs_module_text("SegmentWorkers.Off")
+#define TEXT_SEGMENT_WORKERS_TOOLTIP obs_module_text("SegmentWorkers.ToolTip")
+#define TEXT_SEGMENT_SEC obs_module_text("SegmentLength")
 
 static bool use_bufsize_modified(obs_properties_t *ppts, obs_property_t *p,
 				 obs_data_t *settings)
@@ -170,6 +236,36 @@ static bool rate_control_modified(obs_properties_t *ppts, obs_property_t *p,
 	return true;
 }
 
+/* packets are delayed by up to the length of workers + 2 segments */
+static inline int max_segment_sec(int workers)
+{
+	return workers > 1 ? MAX_SEGMENT_LATENCY_SEC / (workers + 2)
+			   : MAX_SEGMENT_LATENCY_SEC;
+}
+
+static bool segment_modified(obs_properties_t *ppts, obs_property_t *p,
+			     obs_data_t *settings)
+{
+	int workers = (int)obs_data_get_int(settings, "segment_workers");
+	int segment_sec = (int)obs_data_get_int(settings, "segment_sec");
+	size_t count;
+
+	p = obs_properties_get(ppts, "segment_sec");
+	obs_property_int_set_limits(p, 1, max_segment_sec(workers), 1);
+	obs_property_set_enabled(p, workers > 1);
+
+	p = obs_properties_get(ppts, "segment_workers");
+	count = obs_property_list_item_count(p);
+
+	for (size_t i = 0; i < count; i++) {
+		int item = (int)obs_property_list_item_int(p, i);
+		obs_property_list_item_disable(
+			p, i, item > 1 && max_segment_sec(item) < segment_sec);
+	}
+
+	return true;
+}
+
 static obs_properties_t *obs_x264_props(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -230,6 +326,25 @@ static obs_properties_t *obs_x264_props(void *unused)
 	obs_properties_add_text(props, "x264opts", TEXT_X264_OPTS,
 				OBS_TEXT_DEFAULT);
 
+	/* a single segment encoder would only add latency */
+	list = obs_properties_add_list(props, "segment_workers",
+				       TEXT_SEGMENT_WORKERS,
+				       OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(list, TEXT_SEGMENT_WORKERS_OFF, 0);
+	for (int i = 2; i <= MAX_SEGMENT_WORKERS; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "%d", i);
+		obs_property_list_add_int(list, name, i);
+	}
+	obs_property_set_long_description(list, TEXT_SEGMENT_WORKERS_TOOLTIP);
+	obs_property_set_modified_callback(list, segment_modified);
+
+	p = obs_properties_add_int(props, "segment_sec", TEXT_SEGMENT_SEC, 1,
+				   max_segment_sec(2), 1);
+	obs_property_int_set_suffix(p, " s");
+	obs_property_set_modified_callback(p, segment_modified);
+
 	headers = obs_properties_add_bool(props, "repeat_headers",
 					  "repeat_headers");
 	obs_property_set_visible(headers, false);
@@ -388,6 +503,72 @@ enum rate_control {
 	RATE_CONTROL_CRF
 };
 
+static inline int segment_length_frames(const struct video_output_info *voi,
+					int segment_sec)
+{
+	return (int)(((int64_t)segment_sec * voi->fps_num + voi->fps_den / 2) /
+		     voi->fps_den);
+}
+
+/* the properties only offer valid combinations, but settings can come from
+ * anywhere.  returns the number of workers to use, 0 to encode normally. */
+static int limit_segment_workers(struct obs_x264 *obsx264,
+				 const struct video_output_info *voi,
+				 int workers, int segment_sec)
+{
+	uint64_t max_buffer = (uint64_t)MAX_SEGMENT_BUFFER_MB * 1024 * 1024;
+	uint64_t frame_size = (uint64_t)obsx264->params.i_width *
+			      (uint64_t)obsx264->params.i_height;
+	uint64_t segment_size;
+	int max_workers;
+
+	if (workers < 2) {
+		warn("segment encoding disabled: it needs at least 2 segment "
+		     "encoders, %d set",
+		     workers);
+		return 0;
+	}
+
+	if (workers > MAX_SEGMENT_WORKERS)
+		workers = MAX_SEGMENT_WORKERS;
+
+	/* outputs only wait so long for the last packets when they stop */
+	max_workers = MAX_SEGMENT_LATENCY_SEC / segment_sec - 2;
+	if (workers > max_workers) {
+		warn("segment encoding: %d second segments can delay packets "
+		     "by up to %d seconds with %d encoders, limited to %d "
+		     "encoders (at most %d seconds of delay)",
+		     segment_sec, segment_sec * (workers + 2), workers,
+		     max_workers, MAX_SEGMENT_LATENCY_SEC);
+		workers = max_workers;
+	}
+
+	/* the raw frames of every queued segment are kept in memory */
+	if (obsx264->params.i_csp == X264_CSP_I444)
+		frame_size *= 3;
+	else
+		frame_size = frame_size * 3 / 2;
+	segment_size = frame_size * segment_length_frames(voi, segment_sec);
+	max_workers = (int)(max_buffer / (segment_size ? segment_size : 1)) - 2;
+	if (workers > max_workers) {
+		warn("segment encoding: %d encoders would buffer up to %d MB "
+		     "of raw frames, limited to %d encoders (at most %d MB)",
+		     workers,
+		     (int)(segment_size * (workers + 2) / (1024 * 1024)),
+		     max_workers, MAX_SEGMENT_BUFFER_MB);
+		workers = max_workers;
+	}
+
+	if (workers < 2) {
+		warn("segment encoding disabled: %d second segments do not "
+		     "fit in the limits with 2 encoders, use shorter segments",
+		     segment_sec);
+		return 0;
+	}
+
+	return workers;
+}
+
 static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 			  const struct obs_options *options, bool update)
 {
@@ -411,6 +592,8 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	int width = (int)obs_encoder_get_width(obsx264->encoder);
 	int height = (int)obs_encoder_get_height(obsx264->encoder);
 	int bf = (int)obs_data_get_int(settings, "bf");
+	int segment_workers = (int)obs_data_get_int(settings, "segment_workers");
+	int segment_sec = (int)obs_data_get_int(settings, "segment_sec");
 	bool use_bufsize = obs_data_get_bool(settings, "use_bufsize");
 	bool cbr_override = obs_data_get_bool(settings, "cbr");
 	enum rate_control rc;
@@ -539,6 +722,34 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	for (size_t i = 0; i < options->count; ++i)
 		set_param(obsx264, options->options[i]);
 
+	/* segment mode can only be set up when the encoder is created */
+	if (segment_sec < 1)
+		segment_sec = 1;
+
+	if (!update && segment_workers)
+		segment_workers = limit_segment_workers(obsx264, voi,
+							segment_workers,
+							segment_sec);
+
+	if (!update && segment_workers) {
+		int cores = os_get_logical_cores();
+
+		obsx264->num_workers = segment_workers;
+		obsx264->segment_frames =
+			segment_length_frames(voi, segment_sec);
+		obsx264->cores_per_worker = cores > segment_workers
+						    ? cores / segment_workers
+						    : 1;
+	}
+
+	/* every segment is a closed GOP encoded by its own x264 instance, so
+	 * the segment length has to be the keyframe interval */
+	if (obsx264->num_workers) {
+		obsx264->params.i_keyint_max = obsx264->segment_frames;
+		obsx264->params.b_open_gop = 0;
+		obsx264->params.i_threads = obsx264->cores_per_worker;
+	}
+
 	if (!update) {
 		info("settings:\n"
 		     "\trate_control: %s\n"
@@ -554,6 +765,12 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 		     obsx264->params.rc.i_vbv_buffer_size,
 		     (int)obsx264->params.rc.f_rf_constant, voi->fps_num,
 		     voi->fps_den, width, height, obsx264->params.i_keyint_max);
+
+		if (obsx264->num_workers)
+			info("segment encoding: %d workers, %d frames per "
+			     "segment, %d threads per worker",
+			     obsx264->num_workers, obsx264->segment_frames,
+			     obsx264->cores_per_worker);
 	}
 }
 
@@ -643,9 +860,19 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings,
 static bool obs_x264_update(void *data, obs_data_t *settings)
 {
 	struct obs_x264 *obsx264 = data;
-	bool success = update_settings(obsx264, settings, true);
+	bool success;
 	int ret = 0;
 
+	/* new parameters are picked up by the next segment */
+	if (obsx264->num_workers) {
+		pthread_mutex_lock(&obsx264->seg_mutex);
+		success = update_settings(obsx264, settings, true);
+		pthread_mutex_unlock(&obsx264->seg_mutex);
+		return success;
+	}
+
+	success = update_settings(obsx264, settings, true);
+
 	if (success) {
 		if (obsx264->context) {
 			ret = x264_encoder_reconfig(obsx264->context, &obsx264->params);
@@ -732,6 +959,15 @@ static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
 		return NULL;
 	}
 
+	if (obsx264->num_workers && !start_segment_workers(obsx264)) {
+		warn("failed to start segment workers");
+		if (obsx264->workers)
+			stop_segment_workers(obsx264);
+		clear_data(obsx264);
+		bfree(obsx264);
+		return NULL;
+	}
+
 	obsx264->performance_token =
 		os_request_high_performance("x264 encoding");
 
@@ -761,19 +997,19 @@ static void parse_packet(struct obs_x264 *obsx264,
 	packet->keyframe = pic_out->b_keyframe != 0;
 }
 
-static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
+static inline void init_pic_data(int csp, x264_picture_t *pic,
 				 struct encoder_frame *frame)
 {
 	x264_picture_init(pic);
 
 	pic->i_pts = frame->pts;
-	pic->img.i_csp = obsx264->params.i_csp;
+	pic->img.i_csp = csp;
 
-	if (obsx264->params.i_csp == X264_CSP_NV12)
+	if (csp == X264_CSP_NV12)
 		pic->img.i_plane = 2;
-	else if (obsx264->params.i_csp == X264_CSP_I420)
+	else if (csp == X264_CSP_I420)
 		pic->img.i_plane = 3;
-	else if (obsx264->params.i_csp == X264_CSP_I444)
+	else if (csp == X264_CSP_I444)
 		pic->img.i_plane = 3;
 
 	for (int i = 0; i < pic->img.i_plane; i++) {
@@ -782,6 +1018,348 @@ static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* Segment encoding
+ *
+ * Splits the frame stream into closed GOP segments and encodes each segment
+ * on its own x264 instance on a pool of worker threads.  All instances use
+ * the same parameters and every segment starts with an IDR frame, so the
+ * packets of consecutive segments form one regular H.264 stream.  This
+ * trades latency (about segment length times the number of workers) for
+ * throughput with slow presets.
+ *
+ * Outputs stop at a timestamp and keep receiving packets until they get one
+ * past it, and frames keep coming in until then, so everything up to the
+ * stop point is encoded and emitted as long as the output waits long enough.
+ * The number of workers is limited so that the latency stays shorter than
+ * outputs wait (rtmp-stream gives up after 30 seconds by default), and so
+ * that the raw frames of the queued segments fit in MAX_SEGMENT_BUFFER_MB. */
+
+static void free_segment(struct x264_segment *seg)
+{
+	for (size_t i = 0; i < seg->frames.num; i++)
+		bfree(seg->frames.array[i].data);
+	for (size_t i = 0; i < seg->packets.num; i++)
+		da_free(seg->packets.array[i].data);
+
+	da_free(seg->frames);
+	da_free(seg->packets);
+	bfree(seg);
+}
+
+static void add_segment_packet(struct x264_segment *seg, x264_nal_t *nals,
+			       int nal_count, x264_picture_t *pic_out)
+{
+	struct x264_seg_packet *packet;
+
+	if (!nal_count)
+		return;
+
+	packet = da_push_back_new(seg->packets);
+	for (int i = 0; i < nal_count; i++)
+		da_push_back_array(packet->data, nals[i].p_payload,
+				   nals[i].i_payload);
+
+	packet->pts = pic_out->i_pts;
+	packet->dts = pic_out->i_dts;
+	packet->keyframe = pic_out->b_keyframe != 0;
+}
+
+static void encode_segment(struct obs_x264 *obsx264, struct x264_segment *seg)
+{
+	x264_param_t params;
+	x264_picture_t pic, pic_out;
+	x264_nal_t *nals;
+	int nal_count;
+	x264_t *context;
+
+	pthread_mutex_lock(&obsx264->seg_mutex);
+	params = obsx264->params;
+	pthread_mutex_unlock(&obsx264->seg_mutex);
+
+	context = x264_encoder_open(&params);
+	if (!context) {
+		warn("failed to open x264 instance for segment");
+		seg->failed = true;
+		return;
+	}
+
+	for (size_t i = 0; i < seg->frames.num; i++) {
+		struct x264_seg_frame *seg_frame = seg->frames.array + i;
+		struct encoder_frame frame = {.pts = seg_frame->pts};
+		uint8_t *plane = seg_frame->data;
+
+		for (int j = 0; j < obsx264->num_planes; j++) {
+			frame.data[j] = plane;
+			frame.linesize[j] = seg_frame->linesize[j];
+			plane += (size_t)seg_frame->linesize[j] *
+				 obsx264->plane_heights[j];
+		}
+
+		init_pic_data(params.i_csp, &pic, &frame);
+		if (i == 0)
+			pic.i_type = X264_TYPE_IDR;
+
+		if (x264_encoder_encode(context, &nals, &nal_count, &pic,
+					&pic_out) < 0) {
+			warn("segment encode failed");
+			seg->failed = true;
+			break;
+		}
+
+		add_segment_packet(seg, nals, nal_count, &pic_out);
+
+		bfree(seg_frame->data);
+		seg_frame->data = NULL;
+	}
+
+	while (!seg->failed && x264_encoder_delayed_frames(context)) {
+		if (x264_encoder_encode(context, &nals, &nal_count, NULL,
+					&pic_out) < 0) {
+			warn("segment flush failed");
+			seg->failed = true;
+			break;
+		}
+
+		add_segment_packet(seg, nals, nal_count, &pic_out);
+	}
+
+	x264_encoder_close(context);
+}
+
+/* pins the worker (and the threads x264 creates from it) to its own set of
+ * cores so the instances don't fight over the same caches */
+static void pin_worker_thread(struct obs_x264 *obsx264, int index)
+{
+#ifdef __linux__
+	int first = index * obsx264->cores_per_worker;
+	cpu_set_t set;
+
+	if (first + obsx264->cores_per_worker > os_get_logical_cores())
+		return;
+
+	CPU_ZERO(&set);
+	for (int i = 0; i < obsx264->cores_per_worker; i++)
+		CPU_SET(first + i, &set);
+
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		warn("failed to set affinity of segment worker %d", index);
+#else
+	UNUSED_PARAMETER(obsx264);
+	UNUSED_PARAMETER(index);
+#endif
+}
+
+static void *segment_worker_thread(void *data)
+{
+	struct x264_worker *worker = data;
+	struct obs_x264 *obsx264 = worker->obsx264;
+
+	os_set_thread_name("obs-x264: segment worker");
+	pin_worker_thread(obsx264, worker->index);
+
+	while (os_sem_wait(obsx264->seg_sem) == 0) {
+		struct x264_segment *seg = NULL;
+
+		pthread_mutex_lock(&obsx264->seg_mutex);
+		if (obsx264->pending_segments.size)
+			circlebuf_pop_front(&obsx264->pending_segments, &seg,
+					    sizeof(seg));
+		pthread_mutex_unlock(&obsx264->seg_mutex);
+
+		/* posted without a segment: shutting down */
+		if (!seg)
+			break;
+
+		encode_segment(obsx264, seg);
+		os_atomic_set_bool(&seg->encoded, true);
+		os_event_signal(obsx264->seg_done_event);
+	}
+
+	return NULL;
+}
+
+static bool start_segment_workers(struct obs_x264 *obsx264)
+{
+	uint32_t height = (uint32_t)obsx264->params.i_height;
+
+	if (obsx264->params.i_csp == X264_CSP_I444) {
+		obsx264->num_planes = 3;
+		obsx264->plane_heights[0] = height;
+		obsx264->plane_heights[1] = height;
+		obsx264->plane_heights[2] = height;
+	} else if (obsx264->params.i_csp == X264_CSP_I420) {
+		obsx264->num_planes = 3;
+		obsx264->plane_heights[0] = height;
+		obsx264->plane_heights[1] = (height + 1) / 2;
+		obsx264->plane_heights[2] = (height + 1) / 2;
+	} else {
+		obsx264->num_planes = 2;
+		obsx264->plane_heights[0] = height;
+		obsx264->plane_heights[1] = (height + 1) / 2;
+	}
+
+	if (pthread_mutex_init(&obsx264->seg_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&obsx264->seg_sem, 0) != 0)
+		return false;
+	if (os_event_init(&obsx264->seg_done_event, OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+
+	obsx264->workers =
+		bzalloc(sizeof(struct x264_worker) * obsx264->num_workers);
+
+	for (int i = 0; i < obsx264->num_workers; i++) {
+		struct x264_worker *worker = obsx264->workers + i;
+
+		worker->obsx264 = obsx264;
+		worker->index = i;
+		if (pthread_create(&worker->thread, NULL,
+				   segment_worker_thread, worker) != 0) {
+			warn("failed to create segment worker %d", i);
+			obsx264->num_workers = i;
+			return i > 0;
+		}
+	}
+
+	return true;
+}
+
+static void stop_segment_workers(struct obs_x264 *obsx264)
+{
+	struct x264_segment *seg;
+	size_t discarded = 0;
+
+	/* the encoder is only destroyed once all outputs have what they
+	 * need, what is still queued lies past their stop points (or they
+	 * were force stopped), so segments nobody started on are dropped */
+	pthread_mutex_lock(&obsx264->seg_mutex);
+	circlebuf_free(&obsx264->pending_segments);
+	pthread_mutex_unlock(&obsx264->seg_mutex);
+
+	for (int i = 0; i < obsx264->num_workers; i++)
+		os_sem_post(obsx264->seg_sem);
+	for (int i = 0; i < obsx264->num_workers; i++)
+		pthread_join(obsx264->workers[i].thread, NULL);
+
+	while (obsx264->segments.size) {
+		circlebuf_pop_front(&obsx264->segments, &seg, sizeof(seg));
+		discarded += seg->frames.num - seg->next_packet;
+		free_segment(seg);
+	}
+
+	if (discarded)
+		info("segment encoding: discarded %d frame(s) queued after "
+		     "the outputs stopped",
+		     (int)discarded);
+
+	circlebuf_free(&obsx264->segments);
+	os_event_destroy(obsx264->seg_done_event);
+	os_sem_destroy(obsx264->seg_sem);
+	pthread_mutex_destroy(&obsx264->seg_mutex);
+	bfree(obsx264->workers);
+	obsx264->workers = NULL;
+}
+
+static void queue_segment_frame(struct obs_x264 *obsx264,
+				const struct encoder_frame *frame)
+{
+	struct x264_segment *seg = obsx264->cur_segment;
+	struct x264_seg_frame *seg_frame;
+	size_t size = 0;
+	uint8_t *plane;
+
+	if (!seg) {
+		seg = bzalloc(sizeof(struct x264_segment));
+		circlebuf_push_back(&obsx264->segments, &seg, sizeof(seg));
+		obsx264->cur_segment = seg;
+	}
+
+	for (int i = 0; i < obsx264->num_planes; i++)
+		size += (size_t)frame->linesize[i] * obsx264->plane_heights[i];
+
+	seg_frame = da_push_back_new(seg->frames);
+	seg_frame->data = bmalloc(size);
+	seg_frame->pts = frame->pts;
+
+	plane = seg_frame->data;
+	for (int i = 0; i < obsx264->num_planes; i++) {
+		size_t plane_size =
+			(size_t)frame->linesize[i] * obsx264->plane_heights[i];
+
+		memcpy(plane, frame->data[i], plane_size);
+		seg_frame->linesize[i] = frame->linesize[i];
+		plane += plane_size;
+	}
+
+	if (seg->frames.num == (size_t)obsx264->segment_frames) {
+		pthread_mutex_lock(&obsx264->seg_mutex);
+		circlebuf_push_back(&obsx264->pending_segments, &seg,
+				    sizeof(seg));
+		pthread_mutex_unlock(&obsx264->seg_mutex);
+
+		os_sem_post(obsx264->seg_sem);
+		obsx264->cur_segment = NULL;
+	}
+}
+
+static inline struct x264_segment *oldest_segment(struct obs_x264 *obsx264)
+{
+	struct x264_segment *seg = NULL;
+
+	if (obsx264->segments.size)
+		circlebuf_peek_front(&obsx264->segments, &seg, sizeof(seg));
+	return seg;
+}
+
+static bool encode_segmented(struct obs_x264 *obsx264,
+			     struct encoder_frame *frame,
+			     struct encoder_packet *packet,
+			     bool *received_packet)
+{
+	size_t max_segments = (size_t)obsx264->num_workers + 2;
+	struct x264_segment *seg;
+	struct x264_seg_packet *seg_packet;
+
+	queue_segment_frame(obsx264, frame);
+
+	/* if the workers can't keep up, wait for them instead of buffering
+	 * raw frames without limit */
+	seg = oldest_segment(obsx264);
+	while (obsx264->segments.size / sizeof(seg) > max_segments &&
+	       !os_atomic_load_bool(&seg->encoded))
+		os_event_wait(obsx264->seg_done_event);
+
+	*received_packet = false;
+
+	if (!os_atomic_load_bool(&seg->encoded))
+		return true;
+	if (seg->failed || !seg->packets.num)
+		return false;
+
+	/* one packet out per frame in, the output catches up while the
+	 * following segments are being encoded */
+	seg_packet = seg->packets.array + seg->next_packet++;
+
+	da_free(obsx264->packet_data);
+	da_move(obsx264->packet_data, seg_packet->data);
+
+	packet->data = obsx264->packet_data.array;
+	packet->size = obsx264->packet_data.num;
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->pts = seg_packet->pts;
+	packet->dts = seg_packet->dts;
+	packet->keyframe = seg_packet->keyframe;
+	*received_packet = true;
+
+	if (seg->next_packet == seg->packets.num) {
+		circlebuf_pop_front(&obsx264->segments, NULL, sizeof(seg));
+		free_segment(seg);
+	}
+
+	return true;
+}
+
 static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 			    struct encoder_packet *packet,
 			    bool *received_packet)
@@ -795,8 +1373,12 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	if (!frame || !packet || !received_packet)
 		return false;
 
+	if (obsx264->num_workers)
+		return encode_segmented(obsx264, frame, packet,
+					received_packet);
+
 	if (frame)
-		init_pic_data(obsx264, &pic, frame);
+		init_pic_data(obsx264->params.i_csp, &pic, frame);
 
 	ret = x264_encoder_encode(obsx264->context, &nals, &nal_count,
 				  (frame ? &pic : NULL), &pic_out);
@@ -0,0 +1,158 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <util/platform.h>
+
+/* Runs the audio thread of libobs with a single source that stalls once,
+ * which makes libobs add audio buffering.  Once the source has caught up
+ * again and stays ahead, the buffering has to be lowered one tick at a time,
+ * and the mixed audio has to stay continuous throughout: every tick that is
+ * removed is caught up on right away, nothing is skipped or mixed twice. */
+
+#define SAMPLE_RATE 48000
+#define SHRINK_MS 200
+#define STALL_AFTER_MS 500
+#define STALL_MS 150
+#define RUN_MS 3000
+
+struct output_state {
+	uint64_t last_ts;
+	int outputs;
+	int discontinuities;
+};
+
+static void *test_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void test_source_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static const char *test_source_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Audio Buffering Test Source";
+}
+
+static struct obs_source_info test_source_info = {
+	.id = "audio_buffering_test_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name = test_source_get_name,
+	.create = test_source_create,
+	.destroy = test_source_destroy,
+};
+
+/* runs on the audio thread */
+static void output_audio(void *param, size_t mix_idx, struct audio_data *data)
+{
+	struct output_state *state = param;
+	uint64_t tick_ns = audio_frames_to_ns(SAMPLE_RATE, AUDIO_OUTPUT_FRAMES);
+
+	UNUSED_PARAMETER(mix_idx);
+
+	/* tick timestamps are rounded to the nanosecond */
+	if (state->last_ts) {
+		uint64_t diff = data->timestamp - state->last_ts;
+		if (data->timestamp <= state->last_ts || diff + 1 < tick_ns ||
+		    diff > tick_ns + 1)
+			state->discontinuities++;
+	}
+
+	state->last_ts = data->timestamp;
+	state->outputs++;
+}
+
+static void output_packets(obs_source_t *source, uint64_t start_ts)
+{
+	static float silence[AUDIO_OUTPUT_FRAMES];
+	uint64_t tick_ns = audio_frames_to_ns(SAMPLE_RATE, AUDIO_OUTPUT_FRAMES);
+	uint64_t stall_ts = start_ts + STALL_AFTER_MS * 1000000ULL;
+	uint64_t end_ts = start_ts + RUN_MS * 1000000ULL;
+	bool stalled = false;
+
+	for (uint64_t i = 0;; i++) {
+		struct obs_source_audio audio = {
+			.data = {(uint8_t *)silence, (uint8_t *)silence},
+			.frames = AUDIO_OUTPUT_FRAMES,
+			.speakers = SPEAKERS_STEREO,
+			.format = AUDIO_FORMAT_FLOAT_PLANAR,
+			.samples_per_sec = SAMPLE_RATE,
+			.timestamp = start_ts + i * tick_ns,
+		};
+
+		if (audio.timestamp >= end_ts)
+			break;
+
+		/* the device hiccups once, then delivers what it missed */
+		if (!stalled && audio.timestamp >= stall_ts) {
+			os_sleepto_ns(audio.timestamp + STALL_MS * 1000000ULL);
+			stalled = true;
+		}
+
+		os_sleepto_ns(audio.timestamp);
+		obs_source_output_audio(source, &audio);
+	}
+}
+
+static void shrink_buffering_test(void **state)
+{
+	struct obs_audio_info2 oai = {
+		.samples_per_sec = SAMPLE_RATE,
+		.speakers = SPEAKERS_STEREO,
+		.max_buffering_ms = 1000,
+		.shrink_buffering_ms = SHRINK_MS,
+	};
+	struct obs_audio_buffering_info info;
+	struct output_state output = {0};
+	obs_source_t *source;
+
+	UNUSED_PARAMETER(state);
+
+	assert_true(obs_startup("en-US", NULL, NULL));
+	assert_true(obs_reset_audio2(&oai));
+	obs_register_source(&test_source_info);
+
+	source = obs_source_create("audio_buffering_test_source", "audio", NULL,
+				   NULL);
+	assert_non_null(source);
+	obs_set_output_source(0, source);
+
+	assert_true(audio_output_connect(obs_get_audio(), 0, NULL,
+					 output_audio, &output));
+
+	output_packets(source, os_gettime_ns());
+
+	audio_output_disconnect(obs_get_audio(), 0, output_audio, &output);
+	assert_true(obs_get_audio_buffering_info(&info));
+
+	printf("%d ticks mixed, buffering %u ms, %u increase(s), "
+	       "%u decrease(s)\n",
+	       output.outputs, info.buffering_ms, info.increases,
+	       info.decreases);
+
+	assert_true(output.outputs > 0);
+	assert_int_equal(output.discontinuities, 0);
+	assert_true(info.increases > 0);
+	assert_true(info.decreases > 0);
+
+	obs_set_output_source(0, NULL);
+	obs_source_release(source);
+	obs_shutdown();
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(shrink_buffering_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,234 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <obs-audio-drift.h>
+#include <media-io/audio-resampler.h>
+
+/* Plays a device with a drifting clock for a few hours and applies its
+ * timestamps the way obs-source.c does for sources with system timestamps:
+ * each timestamp is snapped to the one predicted from the sample count of
+ * the audio before it, unless it is off by more than TS_SMOOTHING_THRESHOLD,
+ * in which case the timestamps jump.  The audio goes through a real
+ * resampler with the drift compensation applied, the way process_audio does
+ * it, so the sample counts are the ones the resampler actually produces. */
+
+#define SAMPLE_RATE 48000
+#define PACKET_FRAMES 480
+#define TS_SMOOTHING_THRESHOLD 70000000LL
+#define JITTER_NS 2000000
+#define SIM_HOURS 3
+
+struct sim_result {
+	int jumps;
+	int64_t max_diff_ns;
+	int64_t last_diff_ns;
+};
+
+static float silence[PACKET_FRAMES];
+
+static uint32_t next_random(uint32_t *seed)
+{
+	*seed = *seed * 1664525 + 1013904223;
+	return *seed >> 8;
+}
+
+static audio_resampler_t *create_resampler(void)
+{
+	struct resample_info info = {
+		.samples_per_sec = SAMPLE_RATE,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers = SPEAKERS_MONO,
+	};
+	audio_resampler_t *resampler = audio_resampler_create(&info, &info);
+
+	assert_non_null(resampler);
+	return resampler;
+}
+
+static uint32_t resample_packet(audio_resampler_t *resampler)
+{
+	const uint8_t *input[MAX_AV_PLANES] = {(const uint8_t *)silence};
+	uint8_t *output[MAX_AV_PLANES] = {0};
+	uint32_t frames = 0;
+	uint64_t offset;
+
+	assert_true(audio_resampler_resample(resampler, output, &frames,
+					     &offset, input, PACKET_FRAMES));
+	return frames;
+}
+
+static struct sim_result run_sim(double clock_ppm, bool compensate)
+{
+	struct audio_drift drift = {0};
+	struct sim_result result = {0};
+	audio_resampler_t *resampler = create_resampler();
+	int distance = SAMPLE_RATE * AUDIO_DRIFT_DISTANCE_SEC;
+	double packet_ns = (double)PACKET_FRAMES * 1000000000.0 /
+			   (double)SAMPLE_RATE / (1.0 + clock_ppm / 1000000.0);
+	int64_t packets = (int64_t)SIM_HOURS * 3600 * 1000000000LL /
+			  (int64_t)packet_ns;
+	int64_t next_ts = 0;
+	uint32_t seed = 1;
+
+	for (int64_t i = 0; i < packets; i++) {
+		int64_t jitter = (int64_t)(next_random(&seed) % (2 * JITTER_NS)) -
+				 JITTER_NS;
+		int64_t ts = (int64_t)((double)i * packet_ns) + jitter;
+		uint32_t frames;
+
+		if (drift.compensating) {
+			int delta = audio_drift_get_delta(drift.ppm, distance,
+							  &drift.remainder);
+			assert_true(audio_resampler_set_compensation(
+				resampler, delta, distance));
+		}
+
+		frames = resample_packet(resampler);
+
+		if (next_ts) {
+			int64_t diff = ts - next_ts;
+			int64_t abs_diff = diff < 0 ? -diff : diff;
+
+			if (abs_diff > result.max_diff_ns)
+				result.max_diff_ns = abs_diff;
+			result.last_diff_ns = diff;
+
+			if (abs_diff < TS_SMOOTHING_THRESHOLD) {
+				if (compensate)
+					audio_drift_update(&drift, diff, frames,
+							   SAMPLE_RATE);
+				ts = next_ts;
+			} else {
+				result.jumps++;
+			}
+		}
+
+		next_ts = ts + (int64_t)frames * 1000000000LL / SAMPLE_RATE;
+	}
+
+	audio_resampler_destroy(resampler);
+	return result;
+}
+
+static void drifting_clock_test(void **state)
+{
+	static const double clocks_ppm[] = {-500.0, -100.0, -25.0,
+					    25.0,   100.0,  500.0};
+
+	UNUSED_PARAMETER(state);
+
+	for (size_t i = 0; i < sizeof(clocks_ppm) / sizeof(clocks_ppm[0]);
+	     i++) {
+		struct sim_result uncompensated = run_sim(clocks_ppm[i], false);
+		struct sim_result compensated = run_sim(clocks_ppm[i], true);
+
+		printf("clock %+.0f ppm: %d jumps uncompensated, %d jumps "
+		       "compensated (max diff %.1f ms, final %.1f ms)\n",
+		       clocks_ppm[i], uncompensated.jumps, compensated.jumps,
+		       (double)compensated.max_diff_ns / 1000000.0,
+		       (double)compensated.last_diff_ns / 1000000.0);
+
+		assert_true(uncompensated.jumps > 0);
+		assert_int_equal(compensated.jumps, 0);
+		assert_true(compensated.last_diff_ns < JITTER_NS * 5 &&
+			    compensated.last_diff_ns > -JITTER_NS * 5);
+	}
+}
+
+static void stable_clock_test(void **state)
+{
+	struct sim_result result;
+
+	UNUSED_PARAMETER(state);
+
+	result = run_sim(0.0, true);
+	assert_int_equal(result.jumps, 0);
+	assert_true(result.max_diff_ns < JITTER_NS * 5);
+}
+
+/* the whole samples passed to the resampler have to add up to the requested
+ * correction, not one truncated to whole samples per second */
+static void fractional_delta_test(void **state)
+{
+	static const double corrections_ppm[] = {0.3, 7.3, -12.6, 20.7, 999.9};
+	int distance = SAMPLE_RATE * AUDIO_DRIFT_DISTANCE_SEC;
+
+	UNUSED_PARAMETER(state);
+
+	for (size_t i = 0;
+	     i < sizeof(corrections_ppm) / sizeof(corrections_ppm[0]); i++) {
+		double remainder = 0.0;
+		int64_t total = 0;
+		double expected;
+
+		for (int j = 0; j < 1000; j++)
+			total += audio_drift_get_delta(corrections_ppm[i],
+						       distance, &remainder);
+
+		expected = corrections_ppm[i] * distance / 1000000.0 * 1000;
+		assert_true((double)total - expected < 1.0 &&
+			    (double)total - expected > -1.0);
+	}
+}
+
+/* libswresample can only change the rate in steps of about 1000 ppm, the
+ * resampler has to produce the requested rate anyway */
+static void resampler_compensation_test(void **state)
+{
+	static const double corrections_ppm[] = {-500.0, -100.0, -7.3, 7.3,
+						 25.0,   100.0,  999.0};
+	int distance = SAMPLE_RATE * AUDIO_DRIFT_DISTANCE_SEC;
+	int warmup = 100;
+	int packets = 60 * SAMPLE_RATE / PACKET_FRAMES;
+
+	UNUSED_PARAMETER(state);
+
+	for (size_t i = 0;
+	     i < sizeof(corrections_ppm) / sizeof(corrections_ppm[0]); i++) {
+		audio_resampler_t *resampler = create_resampler();
+		double remainder = 0.0;
+		int64_t produced = 0;
+		double expected;
+
+		for (int j = 0; j < warmup + packets; j++) {
+			int delta = audio_drift_get_delta(corrections_ppm[i],
+							  distance, &remainder);
+			uint32_t frames;
+
+			assert_true(audio_resampler_set_compensation(
+				resampler, delta, distance));
+			frames = resample_packet(resampler);
+
+			/* skips the filter delay after compensation starts */
+			if (j >= warmup)
+				produced += frames;
+		}
+
+		/* the correction is relative to the output rate */
+		expected = (double)packets * PACKET_FRAMES /
+			   (1.0 - corrections_ppm[i] / 1000000.0);
+
+		printf("correction %+.1f ppm: %lld frames, expected %.1f\n",
+		       corrections_ppm[i], (long long)produced, expected);
+
+		assert_true((double)produced - expected < 2.0 &&
+			    (double)produced - expected > -2.0);
+
+		audio_resampler_destroy(resampler);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(drifting_clock_test),
+		cmocka_unit_test(stable_clock_test),
+		cmocka_unit_test(fractional_delta_test),
+		cmocka_unit_test(resampler_compensation_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
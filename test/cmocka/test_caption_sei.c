@@ -0,0 +1,209 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <obs.h>
+#include <obs-caption-sei.h>
+
+/* Appends CEA-608 caption SEIs to a minute of 60 fps video packets, once into
+ * the headroom of the packets and once with the packets shared, which forces
+ * the old copy of every packet.  Both have to give the same data, and the
+ * cost per packet of both is printed. */
+
+#define BENCH_FPS 60
+#define BENCH_PACKETS (BENCH_FPS * 60)
+#define PACKET_SIZE 12500     /* ~6 Mbps */
+#define KEYFRAME_SIZE 250000
+#define KEYFRAME_INTERVAL (BENCH_FPS * 2)
+
+static const uint8_t nal_start[4] = {0, 0, 0, 1};
+
+static void create_packet(struct encoder_packet *packet, size_t size,
+			  size_t headroom)
+{
+	long *p_refs = bpool_alloc(sizeof(long) + size + headroom);
+
+	memset(packet, 0, sizeof(*packet));
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->data = (uint8_t *)(p_refs + 1);
+	packet->size = size;
+	*p_refs = 1;
+
+	for (size_t i = 0; i < size; i++)
+		packet->data[i] = (uint8_t)(i * 7);
+}
+
+static void push_cc_data(struct circlebuf *cc_data)
+{
+	/* "HI" with odd parity on field 1 */
+	const uint8_t triplet[3] = {0xfc, 0xc8, 0x49};
+	circlebuf_push_back(cc_data, triplet, sizeof(triplet));
+}
+
+static size_t packet_size(int i)
+{
+	return (i % KEYFRAME_INTERVAL) == 0 ? KEYFRAME_SIZE : PACKET_SIZE;
+}
+
+static double bench_append(caption_sei_t *cs, bool shared,
+			   struct encoder_packet *last)
+{
+	struct circlebuf cc_data;
+	uint64_t elapsed = 0;
+
+	circlebuf_init(&cc_data);
+
+	for (int i = 0; i < BENCH_PACKETS; i++) {
+		struct encoder_packet packet;
+		struct encoder_packet ref;
+		uint64_t start;
+		bool in_place;
+
+		create_packet(&packet, packet_size(i),
+			      shared ? 0 : CAPTION_SEI_HEADROOM);
+		if (shared)
+			obs_encoder_packet_ref(&ref, &packet);
+
+		push_cc_data(&cc_data);
+
+		start = os_gettime_ns();
+		caption_sei_build_cc_data(cs, &cc_data);
+		in_place = caption_sei_append(cs, &packet);
+		elapsed += os_gettime_ns() - start;
+
+		assert_true(in_place == !shared);
+		assert_int_equal(cc_data.size, 0);
+
+		if (shared)
+			obs_encoder_packet_release(&ref);
+
+		if (i == BENCH_PACKETS - 1)
+			*last = packet;
+		else
+			obs_encoder_packet_release(&packet);
+	}
+
+	circlebuf_free(&cc_data);
+	return (double)elapsed / (double)BENCH_PACKETS;
+}
+
+static void check_packet(const struct encoder_packet *packet, size_t size)
+{
+	assert_true(packet->size > size + sizeof(nal_start) + 1);
+
+	for (size_t i = 0; i < size; i++)
+		assert_int_equal(packet->data[i], (uint8_t)(i * 7));
+
+	assert_memory_equal(packet->data + size, nal_start, sizeof(nal_start));
+	assert_int_equal(packet->data[size + sizeof(nal_start)] & 0x1f, 6);
+}
+
+static void caption_sei_append_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	caption_sei_t *cs = caption_sei_create();
+	struct encoder_packet in_place;
+	struct encoder_packet copied;
+	size_t size = packet_size(BENCH_PACKETS - 1);
+	double in_place_ns;
+	double copy_ns;
+
+	in_place_ns = bench_append(cs, false, &in_place);
+	copy_ns = bench_append(cs, true, &copied);
+
+	printf("%d fps caption SEI: in place %.0f ns/packet, "
+	       "copy %.0f ns/packet (%.2fx)\n",
+	       BENCH_FPS, in_place_ns, copy_ns, copy_ns / in_place_ns);
+
+	check_packet(&in_place, size);
+	check_packet(&copied, size);
+	assert_int_equal(in_place.size, copied.size);
+	assert_memory_equal(in_place.data, copied.data, in_place.size);
+
+	obs_encoder_packet_release(&in_place);
+	obs_encoder_packet_release(&copied);
+	caption_sei_destroy(cs);
+}
+
+static void caption_sei_text_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	caption_sei_t *cs = caption_sei_create();
+	struct encoder_packet packet;
+
+	/* text SEIs can be larger than the headroom, the packet is copied
+	 * then */
+	create_packet(&packet, PACKET_SIZE, 0);
+	assert_true(caption_sei_build_text(cs, "caption text"));
+	caption_sei_append(cs, &packet);
+	check_packet(&packet, PACKET_SIZE);
+	obs_encoder_packet_release(&packet);
+
+	caption_sei_destroy(cs);
+}
+
+/* encoders in plugins allocate their packets with bmalloc, which have to be
+ * copied for the SEI and released like pool packets */
+static void caption_sei_bmalloc_packet_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	caption_sei_t *cs = caption_sei_create();
+	struct encoder_packet packet = {0};
+	struct circlebuf cc_data;
+	long allocs = bnum_allocs();
+	long pool_allocs = bpool_num_allocs();
+	long *p_refs;
+
+	p_refs = bmalloc(sizeof(long) + PACKET_SIZE + CAPTION_SEI_HEADROOM);
+	*p_refs = 1;
+	packet.type = OBS_ENCODER_VIDEO;
+	packet.data = (uint8_t *)(p_refs + 1);
+	packet.size = PACKET_SIZE;
+	for (size_t i = 0; i < PACKET_SIZE; i++)
+		packet.data[i] = (uint8_t)(i * 7);
+
+	assert_int_equal(bpool_block_size(p_refs), 0);
+
+	circlebuf_init(&cc_data);
+	push_cc_data(&cc_data);
+	caption_sei_build_cc_data(cs, &cc_data);
+	assert_false(caption_sei_append(cs, &packet));
+	check_packet(&packet, PACKET_SIZE);
+	obs_encoder_packet_release(&packet);
+	circlebuf_free(&cc_data);
+
+	/* bmalloc packet freed by the copy, and the copy released to the
+	 * pool */
+	assert_int_equal(bpool_num_allocs(), pool_allocs);
+	assert_int_equal(bnum_allocs(), allocs);
+
+	p_refs = bmalloc(sizeof(long) + PACKET_SIZE);
+	*p_refs = 1;
+	packet.data = (uint8_t *)(p_refs + 1);
+	packet.size = PACKET_SIZE;
+	obs_encoder_packet_release(&packet);
+	assert_int_equal(bpool_num_allocs(), pool_allocs);
+	assert_int_equal(bnum_allocs(), allocs);
+
+	caption_sei_destroy(cs);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(caption_sei_append_test),
+		cmocka_unit_test(caption_sei_text_test),
+		cmocka_unit_test(caption_sei_bmalloc_packet_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,145 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/circlebuf-spsc.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define THREADED_RECORDS 200000
+#define THREADED_CAPACITY 61
+
+static void spsc_circlebuf_wrap_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct spsc_circlebuf cb;
+	uint8_t in[6] = {1, 2, 3, 4, 5, 6};
+	uint8_t out[6] = {0};
+
+	spsc_circlebuf_init(&cb, 8);
+	assert_int_equal(spsc_circlebuf_space(&cb), 8);
+
+	assert_true(spsc_circlebuf_push_back(&cb, in, 6));
+	assert_false(spsc_circlebuf_push_back(&cb, in, 6));
+	assert_true(spsc_circlebuf_pop_front(&cb, out, 6));
+	assert_memory_equal(in, out, 6);
+
+	/* wraps around the end of the buffer */
+	assert_true(spsc_circlebuf_push_back(&cb, in, 6));
+	assert_int_equal(spsc_circlebuf_size(&cb), 6);
+	assert_true(spsc_circlebuf_pop_front(&cb, out, 6));
+	assert_memory_equal(in, out, 6);
+
+	assert_int_equal(spsc_circlebuf_size(&cb), 0);
+	assert_false(spsc_circlebuf_pop_front(&cb, out, 1));
+
+	spsc_circlebuf_free(&cb);
+}
+
+static void spsc_circlebuf_commit_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct spsc_circlebuf cb;
+	uint32_t val = 0x12345678;
+
+	spsc_circlebuf_init(&cb, 16);
+
+	spsc_circlebuf_write(&cb, &val, sizeof(val));
+	assert_int_equal(spsc_circlebuf_size(&cb), 0);
+
+	spsc_circlebuf_commit(&cb);
+	assert_int_equal(spsc_circlebuf_size(&cb), sizeof(val));
+
+	val = 0;
+	assert_true(spsc_circlebuf_pop_front(&cb, &val, sizeof(val)));
+	assert_int_equal(val, 0x12345678);
+
+	spsc_circlebuf_free(&cb);
+}
+
+/* records of varying size, so that they straddle the end of the buffer at
+ * every possible offset */
+static inline uint32_t record_size(uint32_t seq)
+{
+	return 1 + seq % 13;
+}
+
+static inline uint8_t record_byte(uint32_t seq, uint32_t i)
+{
+	return (uint8_t)(seq * 31 + i);
+}
+
+static void *producer_thread(void *data)
+{
+	struct spsc_circlebuf *cb = data;
+	uint8_t payload[16];
+
+	for (uint32_t seq = 0; seq < THREADED_RECORDS; seq++) {
+		uint32_t size = record_size(seq);
+
+		for (uint32_t i = 0; i < size; i++)
+			payload[i] = record_byte(seq, i);
+
+		while (spsc_circlebuf_space(cb) < sizeof(seq) + size)
+			os_sleep_ms(0);
+
+		/* header and payload become visible together */
+		spsc_circlebuf_write(cb, &seq, sizeof(seq));
+		spsc_circlebuf_write(cb, payload, size);
+		spsc_circlebuf_commit(cb);
+	}
+
+	return NULL;
+}
+
+static void spsc_circlebuf_threaded_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct spsc_circlebuf cb;
+	pthread_t thread;
+	uint32_t expected = 0;
+
+	spsc_circlebuf_init(&cb, THREADED_CAPACITY);
+	assert_int_equal(pthread_create(&thread, NULL, producer_thread, &cb),
+			 0);
+
+	while (expected < THREADED_RECORDS) {
+		uint8_t payload[16];
+		uint32_t seq;
+		uint32_t size;
+
+		if (!spsc_circlebuf_pop_front(&cb, &seq, sizeof(seq))) {
+			os_sleep_ms(0);
+			continue;
+		}
+
+		/* a committed header is always followed by its payload */
+		assert_int_equal(seq, expected);
+		size = record_size(seq);
+		assert_true(spsc_circlebuf_pop_front(&cb, payload, size));
+
+		for (uint32_t i = 0; i < size; i++)
+			assert_int_equal(payload[i], record_byte(seq, i));
+
+		expected++;
+	}
+
+	pthread_join(thread, NULL);
+	assert_int_equal(spsc_circlebuf_size(&cb), 0);
+	spsc_circlebuf_free(&cb);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(spsc_circlebuf_wrap_test),
+		cmocka_unit_test(spsc_circlebuf_commit_test),
+		cmocka_unit_test(spsc_circlebuf_threaded_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
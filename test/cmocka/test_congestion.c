@@ -0,0 +1,265 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <cmocka.h>
+
+#include <util/circlebuf.h>
+#include "rtmp-congestion.h"
+
+/* Replays bandwidth traces over a simulated bottleneck link and compares the
+ * congestion controller against a fixed bitrate stream.  The sender mimics
+ * rtmp-stream: frames wait in a send queue, the controller gets a sample each
+ * time a frame is queued, and the queue is flushed (all frames dropped) once
+ * it holds more than 700ms of video. */
+
+#define FPS 60
+#define FRAME_NS (1000000000ULL / FPS)
+#define FRAME_USEC (1000000 / FPS)
+#define DROP_THRESHOLD_USEC 700000
+#define ESTIMATE_WINDOW_FRAMES (2 * FPS)
+#define BASE_RTT_USEC 40000
+
+struct sim_frame {
+	int64_t dts_usec;
+	size_t size;
+};
+
+struct sim_result {
+	int dropped;
+	int frames;
+	double avg_kbps;
+	long final_kbps;
+	int64_t max_buffer_usec;
+};
+
+struct sim {
+	struct congestion_controller cc;
+	struct circlebuf queue;
+	size_t head_sent;
+	int64_t last_dts_usec;
+
+	size_t sent_bytes[ESTIMATE_WINDOW_FRAMES];
+	size_t sent_total;
+	int sent_frames;
+};
+
+/* measured like rtmp-stream's check_to_drop_frames: nothing while fewer than
+ * 5 packets are queued, otherwise from the oldest queued frame to the last
+ * queued one */
+static int64_t buffer_duration(struct sim *sim)
+{
+	struct sim_frame front;
+
+	if (sim->queue.size < 5 * sizeof(struct sim_frame))
+		return 0;
+
+	circlebuf_peek_front(&sim->queue, &front, sizeof(front));
+	return sim->last_dts_usec - front.dts_usec;
+}
+
+static long send_kbps(struct sim *sim)
+{
+	int frames = sim->sent_frames < ESTIMATE_WINDOW_FRAMES
+			     ? sim->sent_frames
+			     : ESTIMATE_WINDOW_FRAMES;
+
+	if (frames < FPS / 2)
+		return 0;
+	return (long)(sim->sent_total * 8 * FPS / frames / 1000);
+}
+
+/* sends up to budget bytes from the front of the queue */
+static void send_data(struct sim *sim, size_t budget)
+{
+	size_t sent = 0;
+	size_t slot = sim->sent_frames % ESTIMATE_WINDOW_FRAMES;
+
+	while (sim->queue.size && budget) {
+		struct sim_frame front;
+		size_t left;
+
+		circlebuf_peek_front(&sim->queue, &front, sizeof(front));
+		left = front.size - sim->head_sent;
+
+		if (left > budget) {
+			sim->head_sent += budget;
+			sent += budget;
+			break;
+		}
+
+		circlebuf_pop_front(&sim->queue, NULL, sizeof(front));
+		sim->head_sent = 0;
+		sent += left;
+		budget -= left;
+	}
+
+	sim->sent_total -= sim->sent_bytes[slot];
+	sim->sent_bytes[slot] = sent;
+	sim->sent_total += sent;
+	sim->sent_frames++;
+}
+
+static int drop_frames(struct sim *sim)
+{
+	int dropped = 0;
+
+	/* the frame that is partially sent has to stay */
+	while (sim->queue.size > sizeof(struct sim_frame)) {
+		circlebuf_pop_back(&sim->queue, NULL, sizeof(struct sim_frame));
+		dropped++;
+	}
+
+	return dropped;
+}
+
+/* trace: available bandwidth in kbps for each second of the simulation */
+static void run_trace(const int *trace_kbps, size_t seconds, long max_kbps,
+		      const char *controller, struct sim_result *result)
+{
+	struct sim sim = {0};
+	long bitrate = max_kbps;
+	double total_kbps = 0.0;
+	size_t link_bytes = 0;
+
+	memset(result, 0, sizeof(*result));
+	if (controller)
+		assert_true(congestion_controller_init(&sim.cc, controller,
+						       max_kbps, 50));
+
+	for (int frame = 0; frame < (int)seconds * FPS; frame++) {
+		int64_t dts = (int64_t)frame * FRAME_USEC;
+		int64_t buffer_usec = buffer_duration(&sim);
+		int link_kbps = trace_kbps[frame / FPS];
+		struct sim_frame new_frame = {
+			.dts_usec = dts,
+			.size = (size_t)bitrate * 1000 / 8 / FPS,
+		};
+
+		if (buffer_usec > result->max_buffer_usec)
+			result->max_buffer_usec = buffer_usec;
+
+		if (congestion_controller_active(&sim.cc)) {
+			struct congestion_sample sample = {
+				.ts = (uint64_t)frame * FRAME_NS + 1,
+				.buffer_duration_usec = buffer_usec,
+				.send_kbps = send_kbps(&sim),
+				.has_tcp_info = true,
+				.rtt_usec = BASE_RTT_USEC,
+			};
+
+			if (congestion_controller_update(&sim.cc, &sample))
+				bitrate = sim.cc.cur_kbps;
+		}
+
+		if (buffer_usec > DROP_THRESHOLD_USEC)
+			result->dropped += drop_frames(&sim);
+
+		circlebuf_push_back(&sim.queue, &new_frame, sizeof(new_frame));
+		sim.last_dts_usec = dts;
+		result->frames++;
+		total_kbps += (double)bitrate;
+
+		link_bytes += (size_t)link_kbps * 1000 / 8 / FPS;
+		send_data(&sim, link_bytes);
+		link_bytes = 0;
+	}
+
+	result->avg_kbps = total_kbps / result->frames;
+	result->final_kbps = bitrate;
+
+	printf("%-16s dropped %5d/%d frames, average %5.0f kbps, "
+	       "final %5ld kbps, max buffer %4lld ms\n",
+	       controller ? controller : "fixed", result->dropped,
+	       result->frames, result->avg_kbps, result->final_kbps,
+	       (long long)(result->max_buffer_usec / 1000));
+
+	congestion_controller_free(&sim.cc);
+	circlebuf_free(&sim.queue);
+}
+
+static void congestion_steady_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int trace[] = {8000, 8000, 8000, 8000, 8000,
+				    8000, 8000, 8000, 8000, 8000};
+	struct sim_result result;
+
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), 6000,
+		  "delay_gradient", &result);
+
+	/* an uncongested link must not cost any quality */
+	assert_int_equal(result.dropped, 0);
+	assert_int_equal(result.final_kbps, 6000);
+}
+
+static void congestion_step_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int trace[] = {
+		8000, 8000, 8000, 8000, 8000, 2500, 2500, 2500, 2500, 2500,
+		2500, 2500, 2500, 2500, 2500, 2500, 2500, 2500, 2500, 2500,
+		8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000,
+		8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000,
+		8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000, 8000};
+	struct sim_result fixed;
+	struct sim_result result;
+
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), 6000, NULL, &fixed);
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), 6000,
+		  "delay_gradient", &result);
+
+	assert_true(result.dropped * 4 < fixed.dropped);
+	assert_true(result.max_buffer_usec <= DROP_THRESHOLD_USEC + FRAME_USEC);
+
+	/* recovers once the link is back */
+	assert_true(result.final_kbps >= 6000 * 9 / 10);
+	assert_true(result.avg_kbps > fixed.avg_kbps / 2);
+}
+
+static void congestion_fluctuating_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int trace[] = {6000, 5000, 3000, 4500, 2000, 2000, 3500,
+				    5000, 1500, 1500, 1200, 3000, 4000, 6000,
+				    6000, 2500, 3000, 3500, 4000, 4000, 4000,
+				    2000, 2000, 2000, 5000, 5000, 5000, 5000,
+				    5000, 5000};
+	struct sim_result fixed;
+	struct sim_result result;
+
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), 4000, NULL, &fixed);
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), 4000,
+		  "delay_gradient", &result);
+
+	assert_true(result.dropped * 2 < fixed.dropped);
+
+	/* should not give up more bitrate than needed */
+	assert_true(result.avg_kbps > 2000.0);
+}
+
+static void congestion_unknown_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct congestion_controller cc;
+
+	assert_true(!congestion_controller_init(&cc, "legacy", 6000, 50));
+	assert_true(!congestion_controller_active(&cc));
+	congestion_controller_free(&cc);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(congestion_steady_test),
+		cmocka_unit_test(congestion_step_test),
+		cmocka_unit_test(congestion_fluctuating_test),
+		cmocka_unit_test(congestion_unknown_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
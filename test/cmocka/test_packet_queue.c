@@ -0,0 +1,267 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/darray.h>
+#include "packet-queue.h"
+
+/* Simulates rtmp-stream's frame dropping with synthetic congestion traces
+ * and checks the indexed queue against a straightforward reference queue
+ * that rebuilds itself on every drop, like rtmp-stream used to. */
+
+#define FPS 60
+#define FRAME_USEC (1000000 / FPS)
+#define GOP_SIZE 120
+#define DROP_THRESHOLD_USEC 700000
+#define PFRAME_DROP_THRESHOLD_USEC 900000
+
+struct sim {
+	struct packet_queue pq;
+	DARRAY(struct encoder_packet) ref;
+
+	int64_t last_dts_usec;
+	int min_priority;
+	int dropped;
+	int ref_dropped;
+
+	size_t audio_in;
+	size_t audio_out;
+	size_t keyframes_in;
+	size_t keyframes_out;
+};
+
+static int ref_drop(struct sim *sim, int highest_priority)
+{
+	int num_dropped = 0;
+
+	for (size_t i = sim->ref.num; i > 0; i--) {
+		struct encoder_packet *packet = &sim->ref.array[i - 1];
+
+		if (packet->type == OBS_ENCODER_VIDEO &&
+		    packet->drop_priority < highest_priority) {
+			da_erase(sim->ref, i - 1);
+			num_dropped++;
+		}
+	}
+
+	return num_dropped;
+}
+
+static bool ref_first_video(struct sim *sim, struct encoder_packet *first)
+{
+	for (size_t i = 0; i < sim->ref.num; i++) {
+		struct encoder_packet *cur = &sim->ref.array[i];
+		if (cur->type == OBS_ENCODER_VIDEO && !cur->keyframe) {
+			*first = *cur;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void check_first_video(struct sim *sim)
+{
+	struct encoder_packet first = {0};
+	struct encoder_packet ref_first = {0};
+	bool found = packet_queue_first_video(&sim->pq, &first);
+	bool ref_found = ref_first_video(sim, &ref_first);
+
+	assert_int_equal(found, ref_found);
+	if (found)
+		assert_int_equal(first.dts_usec, ref_first.dts_usec);
+}
+
+static void check_to_drop_frames(struct sim *sim, bool pframes)
+{
+	struct encoder_packet first;
+	int priority = pframes ? OBS_NAL_PRIORITY_HIGHEST
+			       : OBS_NAL_PRIORITY_HIGH;
+	int64_t drop_threshold = pframes ? PFRAME_DROP_THRESHOLD_USEC
+					 : DROP_THRESHOLD_USEC;
+
+	assert_int_equal(packet_queue_size(&sim->pq), sim->ref.num);
+	check_first_video(sim);
+
+	if (packet_queue_size(&sim->pq) < 5)
+		return;
+	if (!packet_queue_first_video(&sim->pq, &first))
+		return;
+
+	if (sim->last_dts_usec - first.dts_usec > drop_threshold) {
+		sim->dropped += packet_queue_drop(&sim->pq, priority);
+		sim->ref_dropped += ref_drop(sim, priority);
+		assert_int_equal(sim->dropped, sim->ref_dropped);
+
+		if (sim->min_priority < priority)
+			sim->min_priority = priority;
+	}
+}
+
+static void add_packet(struct sim *sim, const struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		check_to_drop_frames(sim, false);
+		check_to_drop_frames(sim, true);
+
+		if (packet->drop_priority < sim->min_priority) {
+			sim->dropped++;
+			sim->ref_dropped++;
+			return;
+		}
+
+		sim->min_priority = 0;
+		sim->last_dts_usec = packet->dts_usec;
+	} else {
+		sim->audio_in++;
+	}
+
+	if (packet->keyframe)
+		sim->keyframes_in++;
+
+	packet_queue_push_back(&sim->pq, packet);
+	da_push_back(sim->ref, packet);
+}
+
+static bool send_packet(struct sim *sim, size_t *budget, bool reinsert)
+{
+	struct encoder_packet packet;
+	struct encoder_packet ref_packet;
+
+	if (!packet_queue_peek_front(&sim->pq, &packet))
+		return false;
+	if (packet.size > *budget)
+		return false;
+
+	assert_true(packet_queue_pop_front(&sim->pq, &packet));
+	ref_packet = sim->ref.array[0];
+	da_erase(sim->ref, 0);
+
+	assert_int_equal(packet.type, ref_packet.type);
+	assert_int_equal(packet.dts_usec, ref_packet.dts_usec);
+
+	/* like a silent reconnect, put the packet back and try again */
+	if (reinsert) {
+		packet_queue_push_front(&sim->pq, &packet);
+		da_insert(sim->ref, 0, &packet);
+		return true;
+	}
+
+	*budget -= packet.size;
+
+	if (packet.type == OBS_ENCODER_AUDIO)
+		sim->audio_out++;
+	if (packet.keyframe)
+		sim->keyframes_out++;
+	return true;
+}
+
+static struct encoder_packet make_video_packet(int frame)
+{
+	int gop_pos = frame % GOP_SIZE;
+	struct encoder_packet packet = {
+		.type = OBS_ENCODER_VIDEO,
+		.dts_usec = (int64_t)frame * FRAME_USEC,
+		.timebase_den = 1,
+	};
+
+	if (gop_pos == 0) {
+		packet.keyframe = true;
+		packet.drop_priority = OBS_NAL_PRIORITY_HIGHEST;
+		packet.size = 120000;
+	} else if (gop_pos % 3 == 0) {
+		packet.drop_priority = OBS_NAL_PRIORITY_HIGH;
+		packet.size = 25000;
+	} else {
+		packet.drop_priority = OBS_NAL_PRIORITY_DISPOSABLE;
+		packet.size = 8000;
+	}
+
+	return packet;
+}
+
+/* trace: available bandwidth in kbps for each second of the simulation */
+static void run_trace(const int *trace_kbps, size_t seconds, bool congested)
+{
+	struct sim sim = {0};
+	size_t budget = 0;
+	bool reinsert;
+
+	packet_queue_init(&sim.pq);
+
+	for (int frame = 0; frame < (int)seconds * FPS; frame++) {
+		struct encoder_packet video = make_video_packet(frame);
+		struct encoder_packet audio = {
+			.type = OBS_ENCODER_AUDIO,
+			.dts_usec = (int64_t)frame * FRAME_USEC,
+			.drop_priority = OBS_NAL_PRIORITY_HIGHEST,
+			.size = 400,
+		};
+
+		add_packet(&sim, &audio);
+		add_packet(&sim, &video);
+
+		budget += (size_t)trace_kbps[frame / FPS] * 1000 / 8 / FPS;
+		reinsert = frame % 97 == 0;
+		while (send_packet(&sim, &budget, reinsert))
+			reinsert = false;
+	}
+
+	assert_int_equal(sim.dropped, sim.ref_dropped);
+	if (congested)
+		assert_true(sim.dropped > 0);
+	else
+		assert_int_equal(sim.dropped, 0);
+
+	/* drain the rest: audio and keyframes are never dropped */
+	budget = (size_t)-1;
+	while (send_packet(&sim, &budget, false))
+		;
+
+	assert_int_equal(packet_queue_size(&sim.pq), 0);
+	assert_int_equal(sim.ref.num, 0);
+	assert_int_equal(sim.audio_in, sim.audio_out);
+	assert_int_equal(sim.keyframes_in, sim.keyframes_out);
+
+	packet_queue_free(&sim.pq);
+	da_free(sim.ref);
+}
+
+static void packet_queue_steady_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int trace[] = {8000, 8000, 8000, 8000, 8000,
+				    8000, 8000, 8000, 8000, 8000};
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), false);
+}
+
+static void packet_queue_congestion_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int trace[] = {8000, 6000, 2000, 1000, 500,  500,
+				    1500, 4000, 8000, 8000, 300,  300,
+				    300,  300,  2500, 2500, 9000, 9000};
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), true);
+}
+
+static void packet_queue_outage_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int trace[] = {8000, 8000, 0, 0, 0, 0, 0, 0, 12000, 12000};
+	run_trace(trace, sizeof(trace) / sizeof(trace[0]), true);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(packet_queue_steady_test),
+		cmocka_unit_test(packet_queue_congestion_test),
+		cmocka_unit_test(packet_queue_outage_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,462 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/* the output is tested through its internals, with librtmp and the FLV muxer
+ * replaced by the stubs below */
+#include "rtmp-multi.c"
+
+/* Streams to three destinations through stubbed connections that record
+ * every tag they are sent.  All destinations have to receive the same tags,
+ * and a destination whose connection breaks has to reconnect on its own and
+ * resume on a keyframe without the others missing anything. */
+
+#define NUM_DESTINATIONS 3
+#define FPS 30
+#define WAIT_TIMEOUT_MS 5000
+
+enum tag_kind {
+	TAG_META = 'M',
+	TAG_KEYFRAME = 'K',
+	TAG_PFRAME = 'P',
+	TAG_AUDIO = 'A',
+};
+
+struct tag_id {
+	char kind;
+	int64_t seq;
+};
+
+struct stub_conn {
+	DARRAY(struct tag_id) tags;
+	char url[256];
+	char stream_name[256];
+	int connects;
+	bool broken;
+};
+
+static pthread_mutex_t conns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct stub_conn conns[NUM_DESTINATIONS];
+
+static struct stub_conn *get_conn(RTMP *r)
+{
+	struct rtmp_destination *dest =
+		(struct rtmp_destination *)((uint8_t *)r -
+					    offsetof(struct rtmp_destination,
+						     rtmp));
+	return &conns[dest->idx];
+}
+
+/* normally defined by OBS_MODULE_USE_DEFAULT_LOCALE in obs-outputs.c */
+const char *obs_module_text(const char *lookup_string)
+{
+	return lookup_string;
+}
+
+/* ------------------------------------------------------------------------- */
+/* librtmp stubs */
+
+void RTMP_Init(RTMP *r)
+{
+	memset(r, 0, sizeof(*r));
+}
+
+void RTMP_TLS_Free(RTMP *r)
+{
+	UNUSED_PARAMETER(r);
+}
+
+void RTMP_EnableWrite(RTMP *r)
+{
+	UNUSED_PARAMETER(r);
+}
+
+void RTMP_Close(RTMP *r)
+{
+	UNUSED_PARAMETER(r);
+}
+
+int RTMP_SetupURL(RTMP *r, char *url)
+{
+	if (!url || !*url)
+		return false;
+
+	snprintf(get_conn(r)->url, sizeof(get_conn(r)->url), "%s", url);
+	return true;
+}
+
+int RTMP_AddStream(RTMP *r, const char *playpath)
+{
+	struct stub_conn *conn = get_conn(r);
+
+	snprintf(conn->stream_name, sizeof(conn->stream_name), "%s",
+		 playpath ? playpath : "");
+	return r->Link.nStreams++;
+}
+
+int RTMP_Connect(RTMP *r, RTMPPacket *cp)
+{
+	struct stub_conn *conn = get_conn(r);
+	bool success;
+
+	UNUSED_PARAMETER(cp);
+
+	pthread_mutex_lock(&conns_mutex);
+	success = !conn->broken;
+	if (success)
+		conn->connects++;
+	pthread_mutex_unlock(&conns_mutex);
+
+	return success;
+}
+
+int RTMP_ConnectStream(RTMP *r, int seekTime)
+{
+	UNUSED_PARAMETER(r);
+	UNUSED_PARAMETER(seekTime);
+	return true;
+}
+
+int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
+{
+	struct stub_conn *conn = get_conn(r);
+	struct tag_id id;
+	bool success;
+
+	UNUSED_PARAMETER(streamIdx);
+	if (size != sizeof(id))
+		return -1;
+	memcpy(&id, buf, sizeof(id));
+
+	pthread_mutex_lock(&conns_mutex);
+	success = !conn->broken;
+	if (success)
+		da_push_back(conn->tags, &id);
+	pthread_mutex_unlock(&conns_mutex);
+
+	return success ? size : -1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* FLV muxer stubs, every tag is just its kind and sequence number */
+
+static void mux_tag(char kind, int64_t seq, uint8_t **output, size_t *size)
+{
+	struct tag_id id = {.kind = kind, .seq = seq};
+
+	*output = bmemdup(&id, sizeof(id));
+	*size = sizeof(id);
+}
+
+void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
+		   bool write_header)
+{
+	UNUSED_PARAMETER(context);
+	UNUSED_PARAMETER(write_header);
+	mux_tag(TAG_META, 0, output, size);
+}
+
+void flv_additional_meta_data(obs_output_t *context, uint8_t **output,
+			      size_t *size)
+{
+	flv_meta_data(context, output, size, false);
+}
+
+void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
+		    uint8_t **output, size_t *size, bool is_header)
+{
+	char kind = TAG_AUDIO;
+
+	UNUSED_PARAMETER(dts_offset);
+	UNUSED_PARAMETER(is_header);
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		kind = packet->keyframe ? TAG_KEYFRAME : TAG_PFRAME;
+	mux_tag(kind, packet->pts, output, size);
+}
+
+void flv_additional_packet_mux(struct encoder_packet *packet,
+			       int32_t dts_offset, uint8_t **output,
+			       size_t *size, bool is_header, size_t index)
+{
+	UNUSED_PARAMETER(index);
+	flv_packet_mux(packet, dts_offset, output, size, is_header);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void create_packet(struct encoder_packet *packet,
+			  enum obs_encoder_type type, bool keyframe,
+			  int64_t seq)
+{
+	/* IDR or non-IDR slice NAL */
+	const uint8_t video[] = {0, 0, 0, 1, keyframe ? 0x65 : 0x41, 0x88};
+	const uint8_t audio[] = {0x21, 0x10};
+	const uint8_t *data = type == OBS_ENCODER_VIDEO ? video : audio;
+	size_t size = type == OBS_ENCODER_VIDEO ? sizeof(video) : sizeof(audio);
+	long *p_refs = bpool_alloc(sizeof(long) + size);
+
+	*p_refs = 1;
+	memcpy(p_refs + 1, data, size);
+
+	memset(packet, 0, sizeof(*packet));
+	packet->type = type;
+	packet->keyframe = keyframe;
+	packet->data = (uint8_t *)(p_refs + 1);
+	packet->size = size;
+	packet->pts = seq;
+	packet->dts = seq;
+	packet->timebase_num = 1;
+	packet->timebase_den = FPS;
+	packet->dts_usec = seq * 1000000 / FPS;
+	packet->sys_dts_usec = packet->dts_usec;
+}
+
+/* sends video and audio for frames [first, last), with a keyframe first */
+static void send_frames(struct rtmp_multi *rm, int64_t first, int64_t last)
+{
+	for (int64_t i = first; i < last; i++) {
+		struct encoder_packet packet;
+
+		create_packet(&packet, OBS_ENCODER_VIDEO, i == first, i);
+		rtmp_multi_data(rm, &packet);
+		obs_encoder_packet_release(&packet);
+
+		create_packet(&packet, OBS_ENCODER_AUDIO, false, i);
+		rtmp_multi_data(rm, &packet);
+		obs_encoder_packet_release(&packet);
+	}
+}
+
+static size_t num_tags(size_t idx)
+{
+	size_t num;
+
+	pthread_mutex_lock(&conns_mutex);
+	num = conns[idx].tags.num;
+	pthread_mutex_unlock(&conns_mutex);
+
+	return num;
+}
+
+static bool wait_for_tags(size_t idx, size_t count)
+{
+	for (int ms = 0; ms < WAIT_TIMEOUT_MS; ms++) {
+		if (num_tags(idx) >= count)
+			return true;
+		os_sleep_ms(1);
+	}
+
+	return false;
+}
+
+static bool wait_for_connected(struct rtmp_destination *dest, bool connected)
+{
+	for (int ms = 0; ms < WAIT_TIMEOUT_MS; ms++) {
+		if (os_atomic_load_bool(&dest->connected) == connected)
+			return true;
+		os_sleep_ms(1);
+	}
+
+	return false;
+}
+
+static void set_broken(size_t idx, bool broken)
+{
+	pthread_mutex_lock(&conns_mutex);
+	conns[idx].broken = broken;
+	pthread_mutex_unlock(&conns_mutex);
+}
+
+static struct rtmp_multi *create_output(void)
+{
+	struct rtmp_multi *rm = rtmp_multi_create(NULL, NULL);
+
+	assert_non_null(rm);
+
+	memset(conns, 0, sizeof(conns));
+
+	/* frames are sent much faster than real time, so only drop frames
+	 * if a destination is completely stuck */
+	rm->drop_threshold_usec = 60000000;
+	rm->pframe_drop_threshold_usec = 60200000;
+	rm->max_shutdown_time_sec = 30;
+	rm->retry_delay_msec = 10;
+	rm->max_retries = 100;
+	return rm;
+}
+
+static void connect_output(struct rtmp_multi *rm)
+{
+	assert_int_equal(rm->destinations.num, NUM_DESTINATIONS);
+	assert_true(start_destinations(rm));
+
+	for (size_t i = 0; i < NUM_DESTINATIONS; i++)
+		assert_true(
+			wait_for_connected(rm->destinations.array[i], true));
+}
+
+static struct rtmp_multi *start_output(void)
+{
+	struct rtmp_multi *rm = create_output();
+
+	for (size_t i = 0; i < NUM_DESTINATIONS; i++)
+		add_destination(rm, "rtmp://localhost/live", "key", NULL,
+				NULL);
+	connect_output(rm);
+	return rm;
+}
+
+static void stop_output(struct rtmp_multi *rm)
+{
+	rtmp_multi_stop(rm, 0);
+	join_destinations(rm);
+	assert_int_equal(os_atomic_load_long(&rm->running_destinations), 0);
+	assert_false(os_atomic_load_bool(&rm->active));
+	rtmp_multi_destroy(rm);
+
+	for (size_t i = 0; i < NUM_DESTINATIONS; i++)
+		da_free(conns[i].tags);
+}
+
+static void check_tags(size_t idx, size_t offset, int64_t first, int64_t last)
+{
+	struct tag_id *tags = conns[idx].tags.array + offset;
+
+	assert_true(conns[idx].tags.num >=
+		    offset + 1 + (size_t)(last - first) * 2);
+	assert_int_equal(tags[0].kind, TAG_META);
+
+	for (int64_t i = first; i < last; i++) {
+		struct tag_id *video = &tags[1 + (i - first) * 2];
+		struct tag_id *audio = video + 1;
+
+		assert_int_equal(video->kind,
+				 i == first ? TAG_KEYFRAME : TAG_PFRAME);
+		assert_int_equal(video->seq, i);
+		assert_int_equal(audio->kind, TAG_AUDIO);
+		assert_int_equal(audio->seq, i);
+	}
+}
+
+static void fan_out_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct rtmp_multi *rm = start_output();
+	size_t count = 1 + FPS * 2;
+
+	send_frames(rm, 0, FPS);
+
+	for (size_t i = 0; i < NUM_DESTINATIONS; i++) {
+		assert_true(wait_for_tags(i, count));
+		assert_int_equal(conns[i].tags.num, count);
+		check_tags(i, 0, 0, FPS);
+		assert_int_equal(conns[i].connects, 1);
+	}
+
+	assert_int_equal(rtmp_multi_dropped_frames(rm), 0);
+	stop_output(rm);
+}
+
+static void failing_destination_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct rtmp_multi *rm = start_output();
+	struct rtmp_destination *failing = rm->destinations.array[1];
+	size_t count = 1 + FPS * 2;
+
+	send_frames(rm, 0, FPS);
+	for (size_t i = 0; i < NUM_DESTINATIONS; i++)
+		assert_true(wait_for_tags(i, count));
+
+	/* the connection breaks and reconnecting fails for a while, the
+	 * other destinations keep receiving everything */
+	set_broken(1, true);
+	send_frames(rm, FPS, FPS * 2);
+	assert_true(wait_for_connected(failing, false));
+	send_frames(rm, FPS * 2, FPS * 3);
+
+	assert_true(wait_for_tags(0, count + FPS * 4));
+	assert_true(wait_for_tags(2, count + FPS * 4));
+	assert_int_equal(num_tags(1), count);
+	assert_true(os_atomic_load_bool(&rm->active));
+	assert_int_equal(os_atomic_load_long(&rm->running_destinations),
+			 NUM_DESTINATIONS);
+
+	/* once it reconnects, it gets the headers again and resumes on the
+	 * next keyframe */
+	set_broken(1, false);
+	assert_true(wait_for_connected(failing, true));
+	send_frames(rm, FPS * 3, FPS * 4);
+	assert_true(wait_for_tags(1, count * 2));
+
+	for (size_t i = 0; i < NUM_DESTINATIONS; i += 2) {
+		assert_true(wait_for_tags(i, count + FPS * 6));
+		assert_int_equal(conns[i].tags.num, count + FPS * 6);
+		assert_int_equal(conns[i].connects, 1);
+	}
+
+	assert_int_equal(conns[1].tags.num, count * 2);
+	check_tags(1, 0, 0, FPS);
+	check_tags(1, count, FPS * 3, FPS * 4);
+	assert_int_equal(conns[1].connects, 2);
+	assert_int_equal(failing->retries, 0);
+
+	stop_output(rm);
+}
+
+/* destinations given as full URLs have to publish the stream name at the
+ * end of the path, the way rtmp-stream publishes its key */
+static void stream_url_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const char *urls[NUM_DESTINATIONS] = {
+		"rtmp://localhost/live",
+		"rtmp://localhost/live",
+		"rtmp://localhost:1936/app/instance",
+	};
+	static const char *stream_names[NUM_DESTINATIONS] = {
+		"key",
+		"stream1",
+		"stream2?auth=1",
+	};
+	struct rtmp_multi *rm = create_output();
+
+	add_destination(rm, "rtmp://localhost/live", "key", NULL, NULL);
+	add_destination(rm, "rtmp://localhost/live/stream1", "", NULL, NULL);
+
+	/* no stream name to publish */
+	add_destination(rm, "rtmp://localhost/live", "", NULL, NULL);
+	add_destination(rm, "rtmp://localhost/live/", NULL, NULL, NULL);
+	add_destination(rm, "localhost/live/stream", NULL, NULL, NULL);
+	assert_int_equal(rm->destinations.num, 2);
+
+	add_destination(rm, "rtmp://localhost:1936/app/instance/stream2?auth=1",
+			NULL, NULL, NULL);
+	connect_output(rm);
+
+	for (size_t i = 0; i < NUM_DESTINATIONS; i++) {
+		struct rtmp_destination *dest = rm->destinations.array[i];
+
+		assert_int_equal(dest->rtmp.Link.nStreams, 1);
+		assert_string_equal(conns[i].url, urls[i]);
+		assert_string_equal(conns[i].stream_name, stream_names[i]);
+	}
+
+	stop_output(rm);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(fan_out_test),
+		cmocka_unit_test(failing_destination_test),
+		cmocka_unit_test(stream_url_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
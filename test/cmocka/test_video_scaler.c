@@ -0,0 +1,129 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <util/platform.h>
+#include <media-io/video-frame.h>
+#include <media-io/video-scaler.h>
+#include <libswscale/version.h>
+
+/* Compares the banded (multi-threaded) scaler against scaling on a single
+ * thread: the output has to be identical.  See test/scaler-bench for the
+ * throughput of both. */
+
+#define SRC_WIDTH 1920
+#define SRC_HEIGHT 1080
+#define DST_WIDTH 960
+#define DST_HEIGHT 540
+#define BANDS 4
+
+/* same check as video-scaler-ffmpeg.c */
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+#define EXPECTED_BANDS BANDS
+#else
+#define EXPECTED_BANDS 1
+#endif
+
+static void fill_pattern(struct video_frame *frame)
+{
+	for (uint32_t y = 0; y < SRC_HEIGHT; y++) {
+		uint8_t *line = frame->data[0] + y * frame->linesize[0];
+		for (uint32_t x = 0; x < SRC_WIDTH; x++)
+			line[x] = (uint8_t)((x * 7) ^ (y * 13));
+	}
+
+	for (uint32_t y = 0; y < SRC_HEIGHT / 2; y++) {
+		uint8_t *line = frame->data[1] + y * frame->linesize[1];
+		for (uint32_t x = 0; x < SRC_WIDTH; x++)
+			line[x] = (uint8_t)(x + y * 3);
+	}
+}
+
+static void scale(video_scaler_t *scaler, struct video_frame *src,
+		  struct video_frame *dst)
+{
+	assert_true(video_scaler_scale(scaler, dst->data, dst->linesize,
+				       (const uint8_t *const *)src->data,
+				       src->linesize));
+}
+
+static bool frames_equal(const struct video_frame *a,
+			 const struct video_frame *b)
+{
+	for (uint32_t y = 0; y < DST_HEIGHT; y++) {
+		if (memcmp(a->data[0] + y * a->linesize[0],
+			   b->data[0] + y * b->linesize[0], DST_WIDTH) != 0)
+			return false;
+	}
+
+	for (uint32_t y = 0; y < DST_HEIGHT / 2; y++) {
+		if (memcmp(a->data[1] + y * a->linesize[1],
+			   b->data[1] + y * b->linesize[1], DST_WIDTH) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static void video_scaler_bands_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct video_scale_info src_info = {
+		.format = VIDEO_FORMAT_NV12,
+		.width = SRC_WIDTH,
+		.height = SRC_HEIGHT,
+		.range = VIDEO_RANGE_PARTIAL,
+		.colorspace = VIDEO_CS_709,
+	};
+	struct video_scale_info dst_info = src_info;
+	struct video_frame src, single_dst, banded_dst;
+	video_scaler_t *single;
+	video_scaler_t *banded;
+
+	dst_info.width = DST_WIDTH;
+	dst_info.height = DST_HEIGHT;
+
+	video_frame_init(&src, VIDEO_FORMAT_NV12, SRC_WIDTH, SRC_HEIGHT);
+	video_frame_init(&single_dst, VIDEO_FORMAT_NV12, DST_WIDTH, DST_HEIGHT);
+	video_frame_init(&banded_dst, VIDEO_FORMAT_NV12, DST_WIDTH, DST_HEIGHT);
+	fill_pattern(&src);
+
+	assert_int_equal(video_scaler_create(&single, &dst_info, &src_info,
+					     VIDEO_SCALE_FAST_BILINEAR),
+			 VIDEO_SCALER_SUCCESS);
+	assert_int_equal(video_scaler_create(&banded, &dst_info, &src_info,
+					     VIDEO_SCALE_FAST_BILINEAR),
+			 VIDEO_SCALER_SUCCESS);
+
+	video_scaler_set_threads(single, 1);
+	video_scaler_set_threads(banded, BANDS);
+
+	assert_int_equal(video_scaler_get_threads(single), 1);
+	assert_int_equal(video_scaler_get_threads(banded), EXPECTED_BANDS);
+
+	scale(single, &src, &single_dst);
+	scale(banded, &src, &banded_dst);
+
+	/* a failing band falls back to a single thread */
+	assert_int_equal(video_scaler_get_threads(banded), EXPECTED_BANDS);
+	assert_true(frames_equal(&single_dst, &banded_dst));
+
+	video_scaler_destroy(single);
+	video_scaler_destroy(banded);
+	video_frame_free(&src);
+	video_frame_free(&single_dst);
+	video_frame_free(&banded_dst);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(video_scaler_bands_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
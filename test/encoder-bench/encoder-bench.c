@@ -0,0 +1,744 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Headless encoder benchmark.
+ *
+ * Runs any registered video encoder on synthetic or raw (.yuv) frames without
+ * a graphics context: frames are pushed into a private video_t and the
+ * packets are collected by a small output registered here.  Encode fps,
+ * per-frame latency percentiles, CPU time per thread and the output bitrate
+ * are written as JSON.
+ *
+ *   obs-encoder-bench --encoder obs_x264 --width 1920 --height 1080 \
+ *                     --fps 60 --frames 600 --preset medium
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/video-frame.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#define CHECK(condition)                                                    \
+	do {                                                                \
+		if (!(condition)) {                                         \
+			fprintf(stderr, "%s:%d: error: check failed: %s\n", \
+				__FILE__, __LINE__, #condition);            \
+			exit(1);                                            \
+		}                                                           \
+	} while (0)
+
+#define CACHE_SIZE 16
+#define DRAIN_TIMEOUT_NS 5000000000ULL
+
+struct bench_options {
+	const char *encoder_id;
+	const char *preset;
+	const char *settings_json;
+	const char *input_path;
+	const char *output_path;
+	const char *module_index_path;
+	const char *pattern;
+	enum video_format format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps;
+	int bitrate;
+	int frames;
+	bool realtime;
+};
+
+struct bench_state {
+	uint64_t *submit_ts;
+	int num_frames;
+
+	pthread_mutex_t mutex;
+	DARRAY(uint64_t) latencies;
+	uint64_t total_bytes;
+	uint64_t last_packet_ts;
+	volatile long received;
+	int keyframes;
+};
+
+static struct bench_state bench;
+
+/* ------------------------------------------------------------------------- */
+/* output collecting the packets */
+
+static const char *bench_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Encoder Benchmark";
+}
+
+static void *bench_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	UNUSED_PARAMETER(settings);
+	return output;
+}
+
+static void bench_output_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static bool bench_output_start(void *data)
+{
+	obs_output_t *output = data;
+
+	if (!obs_output_can_begin_data_capture(output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(output, 0))
+		return false;
+
+	return obs_output_begin_data_capture(output, 0);
+}
+
+static void bench_output_stop(void *data, uint64_t ts)
+{
+	UNUSED_PARAMETER(ts);
+	obs_output_end_data_capture(data);
+}
+
+static void bench_output_packet(void *data, struct encoder_packet *packet)
+{
+	uint64_t now = os_gettime_ns();
+
+	UNUSED_PARAMETER(data);
+
+	if (!packet)
+		return;
+
+	pthread_mutex_lock(&bench.mutex);
+
+	/* pts counts frames, see obs-encoder.c */
+	if (packet->pts >= 0 && packet->pts < bench.num_frames) {
+		uint64_t latency = now - bench.submit_ts[packet->pts];
+		da_push_back(bench.latencies, &latency);
+	}
+
+	bench.total_bytes += packet->size;
+	bench.last_packet_ts = now;
+	if (packet->keyframe)
+		bench.keyframes++;
+
+	pthread_mutex_unlock(&bench.mutex);
+
+	os_atomic_inc_long(&bench.received);
+}
+
+static struct obs_output_info bench_output_info = {
+	.id = "encoder_bench_output",
+	.flags = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED,
+	.get_name = bench_output_getname,
+	.create = bench_output_create,
+	.destroy = bench_output_destroy,
+	.start = bench_output_start,
+	.stop = bench_output_stop,
+	.encoded_packet = bench_output_packet,
+};
+
+/* ------------------------------------------------------------------------- */
+/* frame sources */
+
+struct frame_source {
+	FILE *file;
+	uint8_t *file_frame;
+	size_t file_frame_size;
+	uint32_t seed;
+};
+
+static inline uint32_t plane_height(enum video_format format, uint32_t height,
+				    int plane)
+{
+	return plane > 0 && (format == VIDEO_FORMAT_NV12 ||
+			     format == VIDEO_FORMAT_I420)
+		       ? (height + 1) / 2
+		       : height;
+}
+
+static inline uint32_t plane_width(enum video_format format, uint32_t width,
+				   int plane)
+{
+	return plane > 0 && format == VIDEO_FORMAT_I420 ? (width + 1) / 2
+							: width;
+}
+
+static inline int num_planes(enum video_format format)
+{
+	return format == VIDEO_FORMAT_NV12 ? 2 : 3;
+}
+
+static inline uint32_t next_random(struct frame_source *src)
+{
+	src->seed = src->seed * 1664525 + 1013904223;
+	return src->seed >> 8;
+}
+
+/* moving gradient with random noise blocks, similar to test-random, so that
+ * encoders have both motion and detail to work with */
+static void fill_synthetic(struct frame_source *src,
+			   const struct bench_options *opts,
+			   struct video_frame *frame, int index)
+{
+	bool noise = strcmp(opts->pattern, "noise") == 0;
+
+	for (int p = 0; p < num_planes(opts->format); p++) {
+		uint32_t w = plane_width(opts->format, opts->width, p);
+		uint32_t h = plane_height(opts->format, opts->height, p);
+
+		for (uint32_t y = 0; y < h; y++) {
+			uint8_t *line = frame->data[p] + y * frame->linesize[p];
+
+			for (uint32_t x = 0; x < w; x++)
+				line[x] = (uint8_t)(x + y + index * (p + 2));
+
+			if (noise && ((y / 16) + index) % 4 == 0) {
+				for (uint32_t x = 0; x < w; x++)
+					line[x] ^= (uint8_t)next_random(src);
+			}
+		}
+	}
+}
+
+/* reads raw frames in the chosen format, looping at the end of the file */
+static bool fill_from_file(struct frame_source *src,
+			   const struct bench_options *opts,
+			   struct video_frame *frame)
+{
+	const uint8_t *pos = src->file_frame;
+
+	if (fread(src->file_frame, 1, src->file_frame_size, src->file) !=
+	    src->file_frame_size) {
+		fseek(src->file, 0, SEEK_SET);
+		if (fread(src->file_frame, 1, src->file_frame_size,
+			  src->file) != src->file_frame_size)
+			return false;
+	}
+
+	for (int p = 0; p < num_planes(opts->format); p++) {
+		uint32_t w = plane_width(opts->format, opts->width, p);
+		uint32_t h = plane_height(opts->format, opts->height, p);
+
+		for (uint32_t y = 0; y < h; y++) {
+			memcpy(frame->data[p] + y * frame->linesize[p], pos,
+			       w);
+			pos += w;
+		}
+	}
+
+	return true;
+}
+
+static bool frame_source_init(struct frame_source *src,
+			      const struct bench_options *opts)
+{
+	memset(src, 0, sizeof(*src));
+	src->seed = 12345;
+
+	if (!opts->input_path)
+		return true;
+
+	for (int p = 0; p < num_planes(opts->format); p++)
+		src->file_frame_size +=
+			(size_t)plane_width(opts->format, opts->width, p) *
+			plane_height(opts->format, opts->height, p);
+
+	src->file = os_fopen(opts->input_path, "rb");
+	if (!src->file) {
+		fprintf(stderr, "Failed to open '%s'\n", opts->input_path);
+		return false;
+	}
+
+	src->file_frame = bmalloc(src->file_frame_size);
+	return true;
+}
+
+static void frame_source_free(struct frame_source *src)
+{
+	if (src->file)
+		fclose(src->file);
+	bfree(src->file_frame);
+}
+
+/* ------------------------------------------------------------------------- */
+/* per-thread CPU time */
+
+struct thread_time {
+	char name[32];
+	int tid;
+	double cpu_sec;
+};
+
+typedef DARRAY(struct thread_time) thread_times_t;
+
+#ifdef __linux__
+static bool read_thread_time(const char *tid, struct thread_time *tt)
+{
+	struct dstr path = {0};
+	char buf[1024];
+	char *pos, *end;
+	unsigned long long utime = 0, stime = 0;
+	size_t len = 0;
+	FILE *file;
+
+	dstr_printf(&path, "/proc/self/task/%s/stat", tid);
+	file = fopen(path.array, "r");
+	dstr_free(&path);
+	if (!file)
+		return false;
+
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = 0;
+
+	/* "tid (name) state ppid ...", the name can contain spaces */
+	pos = strchr(buf, '(');
+	end = strrchr(buf, ')');
+	if (!pos || !end || end < pos)
+		return false;
+
+	len = (size_t)(end - pos - 1);
+	if (len >= sizeof(tt->name))
+		len = sizeof(tt->name) - 1;
+	memcpy(tt->name, pos + 1, len);
+	tt->name[len] = 0;
+	tt->tid = atoi(tid);
+
+	/* utime and stime are the 14th and 15th fields */
+	if (sscanf(end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+		   &utime, &stime) != 2)
+		return false;
+
+	tt->cpu_sec = (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+	return true;
+}
+#endif
+
+static thread_times_t get_thread_times(void)
+{
+	thread_times_t times;
+
+	da_init(times);
+
+#ifdef __linux__
+	os_dir_t *dir = os_opendir("/proc/self/task");
+	struct os_dirent *ent;
+
+	if (!dir)
+		return times;
+
+	while ((ent = os_readdir(dir)) != NULL) {
+		struct thread_time tt;
+
+		if (ent->d_name[0] != '.' && read_thread_time(ent->d_name, &tt))
+			da_push_back(times, &tt);
+	}
+
+	os_closedir(dir);
+#endif
+	return times;
+}
+
+static double start_time_of(const thread_times_t *start, int tid)
+{
+	for (size_t i = 0; i < start->num; i++) {
+		if (start->array[i].tid == tid)
+			return start->array[i].cpu_sec;
+	}
+
+	return 0.0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t *)a;
+	uint64_t val_b = *(const uint64_t *)b;
+	return val_a < val_b ? -1 : (val_a > val_b ? 1 : 0);
+}
+
+static double percentile_ms(const uint64_t *sorted, size_t num, double pct)
+{
+	size_t idx;
+
+	if (!num)
+		return 0.0;
+
+	idx = (size_t)(pct / 100.0 * (double)(num - 1) + 0.5);
+	return (double)sorted[idx] / 1000000.0;
+}
+
+static void write_results(const struct bench_options *opts,
+			  uint64_t elapsed_ns, double cpu_usage,
+			  const thread_times_t *start_times,
+			  const thread_times_t *end_times)
+{
+	obs_data_t *results = obs_data_create();
+	obs_data_t *latency = obs_data_create();
+	obs_data_array_t *threads = obs_data_array_create();
+	uint64_t *sorted = bench.latencies.array;
+	size_t num = bench.latencies.num;
+	long received = os_atomic_load_long(&bench.received);
+	double media_sec = (double)opts->frames / (double)opts->fps;
+	const char *json;
+
+	qsort(sorted, num, sizeof(uint64_t), compare_u64);
+
+	obs_data_set_string(results, "encoder", opts->encoder_id);
+	obs_data_set_int(results, "width", opts->width);
+	obs_data_set_int(results, "height", opts->height);
+	obs_data_set_int(results, "fps", opts->fps);
+	obs_data_set_string(results, "format",
+			    get_video_format_name(opts->format));
+	obs_data_set_string(results, "preset", opts->preset ? opts->preset : "");
+	obs_data_set_string(results, "input", opts->input_path
+						      ? opts->input_path
+						      : opts->pattern);
+	obs_data_set_bool(results, "realtime", opts->realtime);
+	obs_data_set_int(results, "frames", opts->frames);
+	obs_data_set_int(results, "packets", received);
+	obs_data_set_int(results, "keyframes", bench.keyframes);
+	obs_data_set_double(results, "elapsed_sec",
+			    (double)elapsed_ns / 1000000000.0);
+	obs_data_set_double(results, "encode_fps",
+			    (double)received * 1000000000.0 /
+				    (double)elapsed_ns);
+	obs_data_set_double(results, "bitrate_kbps",
+			    (double)bench.total_bytes * 8.0 / 1000.0 /
+				    media_sec);
+	obs_data_set_double(results, "cpu_usage_percent", cpu_usage);
+
+	obs_data_set_double(latency, "p50_ms", percentile_ms(sorted, num, 50));
+	obs_data_set_double(latency, "p90_ms", percentile_ms(sorted, num, 90));
+	obs_data_set_double(latency, "p99_ms", percentile_ms(sorted, num, 99));
+	obs_data_set_double(latency, "max_ms",
+			    num ? (double)sorted[num - 1] / 1000000.0 : 0.0);
+	obs_data_set_obj(results, "latency", latency);
+
+	for (size_t i = 0; i < end_times->num; i++) {
+		const struct thread_time *tt = end_times->array + i;
+		double cpu_sec = tt->cpu_sec - start_time_of(start_times, tt->tid);
+		obs_data_t *thread;
+
+		if (cpu_sec <= 0.0)
+			continue;
+
+		thread = obs_data_create();
+		obs_data_set_string(thread, "name", tt->name);
+		obs_data_set_int(thread, "tid", tt->tid);
+		obs_data_set_double(thread, "cpu_sec", cpu_sec);
+		obs_data_array_push_back(threads, thread);
+		obs_data_release(thread);
+	}
+	obs_data_set_array(results, "threads", threads);
+
+	json = obs_data_get_json(results);
+
+	if (opts->output_path) {
+		if (!os_quick_write_utf8_file(opts->output_path, json,
+					      strlen(json), false))
+			fprintf(stderr, "Failed to write '%s'\n",
+				opts->output_path);
+	} else {
+		printf("%s\n", json);
+	}
+
+	obs_data_array_release(threads);
+	obs_data_release(latency);
+	obs_data_release(results);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --encoder <id>        encoder id (default: obs_x264)\n"
+		"  --width <px>          frame width (default: 1920)\n"
+		"  --height <px>         frame height (default: 1080)\n"
+		"  --fps <n>             frame rate (default: 60)\n"
+		"  --frames <n>          frames to encode (default: 600)\n"
+		"  --format <nv12|i420|i444>\n"
+		"  --preset <name>       encoder \"preset\" setting\n"
+		"  --bitrate <kbps>      encoder \"bitrate\" setting\n"
+		"  --settings <json>     other encoder settings\n"
+		"  --input <file>        raw frames in --format, looped\n"
+		"  --pattern <gradient|noise>  synthetic frames (default: noise)\n"
+		"  --realtime            feed frames at --fps instead of as fast\n"
+		"                        as the encoder takes them\n"
+		"  --output <file>       write JSON there instead of stdout\n"
+		"  --module-index <file> only load the modules needed, see\n"
+		"                        obs-module-index\n",
+		name);
+}
+
+static bool parse_options(int argc, char *argv[], struct bench_options *opts)
+{
+	opts->encoder_id = "obs_x264";
+	opts->pattern = "noise";
+	opts->format = VIDEO_FORMAT_NV12;
+	opts->width = 1920;
+	opts->height = 1080;
+	opts->fps = 60;
+	opts->frames = 600;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--realtime") == 0) {
+			opts->realtime = true;
+			continue;
+		}
+		if (!val)
+			return false;
+		i++;
+
+		if (strcmp(arg, "--encoder") == 0)
+			opts->encoder_id = val;
+		else if (strcmp(arg, "--width") == 0)
+			opts->width = (uint32_t)atoi(val);
+		else if (strcmp(arg, "--height") == 0)
+			opts->height = (uint32_t)atoi(val);
+		else if (strcmp(arg, "--fps") == 0)
+			opts->fps = (uint32_t)atoi(val);
+		else if (strcmp(arg, "--frames") == 0)
+			opts->frames = atoi(val);
+		else if (strcmp(arg, "--preset") == 0)
+			opts->preset = val;
+		else if (strcmp(arg, "--bitrate") == 0)
+			opts->bitrate = atoi(val);
+		else if (strcmp(arg, "--settings") == 0)
+			opts->settings_json = val;
+		else if (strcmp(arg, "--input") == 0)
+			opts->input_path = val;
+		else if (strcmp(arg, "--pattern") == 0)
+			opts->pattern = val;
+		else if (strcmp(arg, "--output") == 0)
+			opts->output_path = val;
+		else if (strcmp(arg, "--module-index") == 0)
+			opts->module_index_path = val;
+		else if (strcmp(arg, "--format") == 0) {
+			if (astrcmpi(val, "i420") == 0)
+				opts->format = VIDEO_FORMAT_I420;
+			else if (astrcmpi(val, "i444") == 0)
+				opts->format = VIDEO_FORMAT_I444;
+			else if (astrcmpi(val, "nv12") == 0)
+				opts->format = VIDEO_FORMAT_NV12;
+			else
+				return false;
+		} else {
+			return false;
+		}
+	}
+
+	return opts->width && opts->height && opts->fps && opts->frames > 0;
+}
+
+static obs_data_t *create_settings(const struct bench_options *opts)
+{
+	obs_data_t *settings = opts->settings_json
+				       ? obs_data_create_from_json(
+						 opts->settings_json)
+				       : obs_data_create();
+
+	CHECK(settings);
+
+	if (opts->preset)
+		obs_data_set_string(settings, "preset", opts->preset);
+	if (opts->bitrate)
+		obs_data_set_int(settings, "bitrate", opts->bitrate);
+	return settings;
+}
+
+/* waits until the video thread has a free frame, in throughput mode frames
+ * must not be skipped */
+static void wait_for_frame_slot(video_t *video, int submitted)
+{
+	while (submitted - (int)video_output_get_total_frames(video) >=
+	       CACHE_SIZE - 1)
+		os_sleepto_ns(os_gettime_ns() + 200000);
+}
+
+static void wait_for_packets(int frames)
+{
+	uint64_t wait_start = os_gettime_ns();
+
+	for (;;) {
+		uint64_t last;
+
+		if (os_atomic_load_long(&bench.received) >= frames)
+			return;
+
+		pthread_mutex_lock(&bench.mutex);
+		last = bench.last_packet_ts;
+		pthread_mutex_unlock(&bench.mutex);
+
+		/* encoders are never flushed, delayed frames stay inside.  also
+		 * gives up on encoders that never output anything. */
+		if (last < wait_start)
+			last = wait_start;
+		if (os_gettime_ns() - last > DRAIN_TIMEOUT_NS)
+			return;
+
+		os_sleep_ms(10);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options opts = {0};
+	struct video_output_info voi = {0};
+	struct frame_source src;
+	thread_times_t start_times, end_times;
+	os_cpu_usage_info_t *cpu_info;
+	obs_encoder_t *encoder;
+	obs_output_t *output;
+	obs_data_t *settings;
+	video_t *video;
+	uint64_t start_ts, frame_time;
+	double cpu_usage;
+	int ret = 0;
+
+	if (!parse_options(argc, argv, &opts)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	CHECK(obs_startup("en-US", NULL, NULL));
+	if (opts.module_index_path)
+		obs_load_all_modules_lazy(opts.module_index_path, NULL);
+	else
+		obs_load_all_modules();
+	obs_post_load_modules();
+	obs_register_output(&bench_output_info);
+
+	voi.name = "encoder-bench";
+	voi.format = opts.format;
+	voi.fps_num = opts.fps;
+	voi.fps_den = 1;
+	voi.width = opts.width;
+	voi.height = opts.height;
+	voi.cache_size = CACHE_SIZE;
+	voi.colorspace = VIDEO_CS_709;
+	voi.range = VIDEO_RANGE_PARTIAL;
+	CHECK(video_output_open(&video, &voi) == VIDEO_OUTPUT_SUCCESS);
+
+	settings = create_settings(&opts);
+	encoder = obs_video_encoder_create(opts.encoder_id, "bench", settings,
+					   NULL);
+	obs_data_release(settings);
+	if (!encoder) {
+		fprintf(stderr, "Failed to create encoder '%s'\n",
+			opts.encoder_id);
+		return 1;
+	}
+
+	obs_encoder_set_video(encoder, video);
+
+	output = obs_output_create("encoder_bench_output", "bench", NULL, NULL);
+	CHECK(output);
+	obs_output_set_video_encoder(output, encoder);
+
+	CHECK(frame_source_init(&src, &opts));
+	CHECK(pthread_mutex_init(&bench.mutex, NULL) == 0);
+	bench.num_frames = opts.frames;
+	bench.submit_ts = bzalloc(sizeof(uint64_t) * opts.frames);
+
+	if (!obs_output_start(output)) {
+		fprintf(stderr, "Failed to start encoder '%s': %s\n",
+			opts.encoder_id,
+			obs_encoder_get_last_error(encoder)
+				? obs_encoder_get_last_error(encoder)
+				: "unknown error");
+		return 1;
+	}
+
+	frame_time = video_output_get_frame_time(video);
+	start_times = get_thread_times();
+	cpu_info = os_cpu_usage_info_start();
+	start_ts = os_gettime_ns();
+
+	for (int i = 0; i < opts.frames; i++) {
+		struct video_frame frame;
+		uint64_t ts = start_ts + (uint64_t)i * frame_time;
+
+		if (opts.realtime)
+			os_sleepto_ns(ts);
+		else
+			wait_for_frame_slot(video, i);
+
+		bench.submit_ts[i] = os_gettime_ns();
+
+		if (!video_output_lock_frame(video, &frame, 1, ts))
+			continue;
+
+		if (opts.input_path)
+			CHECK(fill_from_file(&src, &opts, &frame));
+		else
+			fill_synthetic(&src, &opts, &frame, i);
+
+		video_output_unlock_frame(video);
+	}
+
+	wait_for_packets(opts.frames);
+
+	cpu_usage = os_cpu_usage_info_query(cpu_info);
+	end_times = get_thread_times();
+
+	pthread_mutex_lock(&bench.mutex);
+	if (os_atomic_load_long(&bench.received) > 0) {
+		write_results(&opts, bench.last_packet_ts - start_ts,
+			      cpu_usage, &start_times, &end_times);
+	} else {
+		fprintf(stderr, "Encoder '%s' did not output any packets\n",
+			opts.encoder_id);
+		ret = 1;
+	}
+	pthread_mutex_unlock(&bench.mutex);
+
+	obs_output_force_stop(output);
+	obs_output_release(output);
+	obs_encoder_release(encoder);
+	video_output_close(video);
+
+	os_cpu_usage_info_destroy(cpu_info);
+	da_free(start_times);
+	da_free(end_times);
+	da_free(bench.latencies);
+	bfree(bench.submit_ts);
+	pthread_mutex_destroy(&bench.mutex);
+	frame_source_free(&src);
+
+	obs_shutdown();
+	return ret;
+}
@@ -0,0 +1,199 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Video scaler benchmark.
+ *
+ * Scales synthetic NV12 frames on the calling thread only and with the
+ * requested number of threads (image bands), and prints the throughput of
+ * both.
+ *
+ *   obs-scaler-bench --width 3840 --height 2160 --out-width 1920 \
+ *                    --out-height 1080 --frames 60 --threads 4
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/c99defs.h>
+#include <util/platform.h>
+#include <media-io/video-frame.h>
+#include <media-io/video-scaler.h>
+
+#define CHECK(condition)                                                    \
+	do {                                                                \
+		if (!(condition)) {                                         \
+			fprintf(stderr, "%s:%d: error: check failed: %s\n", \
+				__FILE__, __LINE__, #condition);            \
+			exit(1);                                            \
+		}                                                           \
+	} while (0)
+
+struct bench_options {
+	uint32_t width;
+	uint32_t height;
+	uint32_t out_width;
+	uint32_t out_height;
+	int frames;
+	int threads;
+};
+
+static void fill_pattern(struct video_frame *frame, uint32_t width,
+			 uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *line = frame->data[0] + y * frame->linesize[0];
+		for (uint32_t x = 0; x < width; x++)
+			line[x] = (uint8_t)((x * 7) ^ (y * 13));
+	}
+
+	for (uint32_t y = 0; y < height / 2; y++) {
+		uint8_t *line = frame->data[1] + y * frame->linesize[1];
+		for (uint32_t x = 0; x < width; x++)
+			line[x] = (uint8_t)(x + y * 3);
+	}
+}
+
+static double bench_scaler(video_scaler_t *scaler, struct video_frame *src,
+			   struct video_frame *dst, int frames)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t elapsed;
+
+	for (int i = 0; i < frames; i++)
+		CHECK(video_scaler_scale(scaler, dst->data, dst->linesize,
+					 (const uint8_t *const *)src->data,
+					 src->linesize));
+
+	elapsed = os_gettime_ns() - start;
+	return (double)frames * 1000000000.0 / (double)elapsed;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  --width <px>       source width (default 3840)\n"
+		"  --height <px>      source height (default 2160)\n"
+		"  --out-width <px>   output width (default 1920)\n"
+		"  --out-height <px>  output height (default 1080)\n"
+		"  --frames <n>       frames to scale per run (default 60)\n"
+		"  --threads <n>      threads of the banded run (default 4)\n",
+		name);
+}
+
+static bool parse_options(int argc, char *argv[], struct bench_options *opts)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!val) {
+			usage(argv[0]);
+			return false;
+		}
+
+		if (strcmp(arg, "--width") == 0)
+			opts->width = (uint32_t)strtoul(val, NULL, 10);
+		else if (strcmp(arg, "--height") == 0)
+			opts->height = (uint32_t)strtoul(val, NULL, 10);
+		else if (strcmp(arg, "--out-width") == 0)
+			opts->out_width = (uint32_t)strtoul(val, NULL, 10);
+		else if (strcmp(arg, "--out-height") == 0)
+			opts->out_height = (uint32_t)strtoul(val, NULL, 10);
+		else if (strcmp(arg, "--frames") == 0)
+			opts->frames = atoi(val);
+		else if (strcmp(arg, "--threads") == 0)
+			opts->threads = atoi(val);
+		else {
+			usage(argv[0]);
+			return false;
+		}
+
+		i++;
+	}
+
+	if (!opts->width || !opts->height || !opts->out_width ||
+	    !opts->out_height || opts->frames <= 0 || opts->threads <= 0) {
+		usage(argv[0]);
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options opts = {
+		.width = 3840,
+		.height = 2160,
+		.out_width = 1920,
+		.out_height = 1080,
+		.frames = 60,
+		.threads = 4,
+	};
+	struct video_scale_info src_info = {
+		.format = VIDEO_FORMAT_NV12,
+		.range = VIDEO_RANGE_PARTIAL,
+		.colorspace = VIDEO_CS_709,
+	};
+	struct video_scale_info dst_info;
+	struct video_frame src, dst;
+	video_scaler_t *single;
+	video_scaler_t *banded;
+	double single_fps, banded_fps;
+
+	if (!parse_options(argc, argv, &opts))
+		return 1;
+
+	src_info.width = opts.width;
+	src_info.height = opts.height;
+	dst_info = src_info;
+	dst_info.width = opts.out_width;
+	dst_info.height = opts.out_height;
+
+	video_frame_init(&src, VIDEO_FORMAT_NV12, opts.width, opts.height);
+	video_frame_init(&dst, VIDEO_FORMAT_NV12, opts.out_width,
+			 opts.out_height);
+	fill_pattern(&src, opts.width, opts.height);
+
+	CHECK(video_scaler_create(&single, &dst_info, &src_info,
+				  VIDEO_SCALE_FAST_BILINEAR) ==
+	      VIDEO_SCALER_SUCCESS);
+	CHECK(video_scaler_create(&banded, &dst_info, &src_info,
+				  VIDEO_SCALE_FAST_BILINEAR) ==
+	      VIDEO_SCALER_SUCCESS);
+
+	video_scaler_set_threads(single, 1);
+	video_scaler_set_threads(banded, opts.threads);
+
+	single_fps = bench_scaler(single, &src, &dst, opts.frames);
+	banded_fps = bench_scaler(banded, &src, &dst, opts.frames);
+
+	printf("%ux%u -> %ux%u NV12: 1 thread %.1f fps, %d threads %.1f fps "
+	       "(%.2fx)\n",
+	       opts.width, opts.height, opts.out_width, opts.out_height,
+	       single_fps, video_scaler_get_threads(banded), banded_fps,
+	       banded_fps / single_fps);
+
+	video_scaler_destroy(single);
+	video_scaler_destroy(banded);
+	video_frame_free(&src);
+	video_frame_free(&dst);
+	return 0;
+}
@@ -0,0 +1,64 @@
+/******************************************************************************
+    Copyright (C) 2023 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Generates the module index used by obs_load_all_modules_lazy.
+ *
+ * Loads every module found in the default module paths (plus any given on
+ * the command line) and writes the types each of them registers.  Meant to
+ * be run once after installing, from the same installation that will later
+ * load the index: modules are matched by the path they are found at.
+ */
+
+#include <stdio.h>
+
+#include <obs.h>
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s <index file> [<module bin path> <module data path>]...\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	bool success;
+
+	if (argc < 2 || argc % 2 != 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "Failed to start libobs\n");
+		return 1;
+	}
+
+	for (int i = 2; i + 1 < argc; i += 2)
+		obs_add_module_path(argv[i], argv[i + 1]);
+
+	obs_load_all_modules();
+
+	success = obs_write_module_index(argv[1]);
+	if (!success)
+		fprintf(stderr, "Failed to write module index to '%s'\n",
+			argv[1]);
+
+	obs_shutdown();
+	return success ? 0 : 1;
+}